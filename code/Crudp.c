@@ -5,17 +5,44 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <signal.h>
-#include <sys/time.h>
 #include <errno.h>
 #include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "CrudpSocket.h"
+#include "CrudpStats.h"
+#include "CrudpImpair.h"
+#include "CrudpTimer.h"
+#include "CrudpReasm.h"
+#include "CrudpRing.h"
+#include "CrudpPool.h"
+#include "CrudpArena.h"
+#include "CrudpZerocopy.h"
+#include "CrudpXdp.h"
+#include "CrudpCookie.h"
+#include "CrudpAead.h"
+#include "CrudpManifest.h"
+#include "CrudpSim.h"
+#include "CrudpPath.h"
+#include "CrudpMux.h"
+#include "CrudpBulk.h"
+#include "CrudpMcast.h"
+#include "CrudpClock.h"
 
 #define G_MY_PORT ((uint16_t)23204) // use 'id -u'
-#define G_SIZE ((uint32_t)65495)
-#define G_ITIMER_S ((uint32_t)0)  // seconds
-#define G_ITIMER_US ((uint32_t)200000) // microseconds
-#define HEADER_SIZE ((uint32_t)12)
+#define G_RTO_INIT_US ((uint64_t)1000000) // RTO before the first RTT sample
+#define G_RTO_MIN_US ((uint64_t)200000)   // lower bound of RTO
+#define G_RTO_MAX_MS ((uint64_t)60000)   // upper bound of the backed off RTO
+#define G_CLOCK_US ((uint64_t)1000)       // timer granularity
+#define G_RTO_BACKOFF_MAX ((uint32_t)6)   // RTO doubles at most this many times
+#define G_TLP_MIN_US ((uint64_t)2000)     // lower bound of the tail loss probe timeout
+#define G_REO_WND_PERSIST ((uint32_t)16)  // losses before a grown reordering window shrinks again
+#define G_TIME_WAIT_MS ((uint64_t)1000)   // 2MSL
+#define G_REASM_BYTES ((uint32_t)1 << 20) // memory budget of the reassembly buffer
+#define G_SEND_RING ((uint32_t)64)       // segments the transmitter can keep in flight
+#define G_SAVE_FILE "../save/download.txt"
+#define G_SAVE_TREE "../save/download" // directory a tree is unpacked into
 
 #define ERROR(_s) fprintf(stderr, "%s\n", _s)
 
@@ -62,6 +89,20 @@
 #define CRUDP_SEND_DATA ((int)28)
 #define CRUDP_RECV_DATA ((int)29)
 
+#define CRUDP_ACTION_SETUP_TRANSFER ((int)30)
+#define CRUDP_ACTION_START_2MSL ((int)31)
+
+#define CRUDP_FSM_IDS ((int)32) // every id above, the columns of the transition table
+#define CRUDP_FSM_STATES (CRUDP_STATE_LAST_ACK - CRUDP_STATE_CLOSED + 1)
+
+// CRUDP_TRACE=1 prints every transition, nothing is formatted otherwise
+#define TRACE(...)               \
+    do                           \
+    {                            \
+        if (trace)               \
+            printf(__VA_ARGS__); \
+    } while (0)
+
 // This array of strings is indexed by integer values in #define
 // values above, so the order of the list is important!
 const char *CRUDP_fsm_strings_G[] = {
@@ -95,22 +136,14 @@ const char *CRUDP_fsm_strings_G[] = {
     "LAST_ACK",
     "SEND_DATA",
     "RECV_DATA",
+    "setup transfer",
+    "start 2MSL timer",
 };
 
-int w,
-    startW,
+int startW, // active or passive open, the input of CLOSED
     tcp_state,
     tcp_new_state, // after the state change
-
-    // The CRUDP FSM only ever has 2 inputs, events, or actions
-    // possible in each state, so the following is convenient.
-    inputs[3],  // possible input from CRUDP user
-    events[3],  // possible network or timer events
-    actions[3], // actions to be taken during state change
-
-    // Input for what to do next in the emulation.
-    what; // what to do next
-// Get and check input from terminal
+    trace = 0;
 
 int G_net, G_flag;
 
@@ -118,39 +151,116 @@ int established, transmitter, receiver, received, rto_incr = 0;
 
 sigset_t G_sigmask;
 
-struct sigaction G_sigio, G_sigalrm;
+struct sigaction G_sigio;
 
-struct timespec sendTime, endTime;
 double gSnedTime, gEndTime;
 
 UdpSocket_t *G_local;
 UdpSocket_t *G_remote;
+UdpSocket_t G_from; // source of the latest datagram
 
 char *filename,
     *remote,
     *fileBuffer;
 
-// For RTO
-long filelen, vn, sn, tn, rn;
-unsigned long urto, rto = 0;
-uint32_t srto = 1;
-
-// File read index
+// Ports and output file, overridden by CRUDP_PORT, CRUDP_PEER_PORT and CRUDP_OUTPUT
+uint16_t myPort = G_MY_PORT,
+         peerPort = G_MY_PORT;
+char *saveFile = G_SAVE_FILE,
+     *saveTree = G_SAVE_TREE;
+
+// Datagrams of at least this many bytes go out with MSG_ZEROCOPY, CRUDP_ZEROCOPY sets it (0 is off)
+uint32_t zerocopyMin = 0;
+
+// AF_XDP interface and queue, "ifname[:queue]"
+char *xdpSpec = NULL;
+
+// Sub-paths of the transmitter and their scheduler, CRUDP_PATHS and CRUDP_SCHEDULER
+char *pathSpec = NULL,
+     *schedulerName = NULL;
+
+// Answer SYNs with SYN cookies, CRUDP_SYN_COOKIES=1 turns it on
+int synCookies = 0;
+
+// Out of order data of the receiver, CRUDP_REASM_BYTES overrides the budget
+CrudpReasm_t G_reasm;
+uint32_t reasmBytes = G_REASM_BYTES;
+uint32_t dataSeq = 0; // sequence number of the first data byte
+
+long filelen;
+int fileMapped = 0; // fileBuffer is mapped, not allocated
+
+// A directory is sent as one stream, its manifest then every file
+CrudpManifest_t G_tree;
+
+// Several files go as independent streams, each one delivered on its own,
+// CRUDP_URGENCY gives the urgency of each one (0 first)
+CrudpMux_t G_mux;
+char **sources;
+int sourceCount = 0;
+char *urgencies = NULL;
+
+// A pipe, a FIFO or stdin ("-") is sent as it is read, its end is only known
+// when it closes, new data goes out with the latest ACK
+int streamSource = 0;
+int streamFd = -1;
+CrudpHeader_t G_lastAck;
+
+// The receiver writes to stdout with CRUDP_OUTPUT=-, its messages go to stderr
+int streamOut = -1;
+uint16_t recvWn = 1; // segment size of the latest data, asked for again in a window update
+
+// Bulk mode, CRUDP_BULK=<kbit/s> on the transmitter: a file goes at a paced rate,
+// the receiver reports what is missing every BULK_REPORT_MS and only that goes again
+CrudpBulk_t G_bulk;
+uint64_t bulkKbit = 0;
+CrudpTimer_t G_bulkTimer; // pacer of the transmitter, reports of the receiver
+
+// A multicast group as the host: one file goes to every member at once without a handshake,
+// CRUDP_MCAST_IF picks the interface and CRUDP_MCAST_TTL the hops
+int mcastMode = 0;
+CrudpMcast_t G_mcast;
+char *mcastIf = NULL;
+int mcastTtl = 1;
+CrudpTimer_t G_mcastTimer; // pacer and announces of the sender, NACKs of a member
+
+// For RTO (microseconds), RFC 6298
+long srtt, rttvar;
+int rttSampled = 0;
+uint64_t rto = G_RTO_INIT_US,
+         rtoMin = G_RTO_MIN_US;
+
+// RACK (RFC 8985) on the timestamp echo, which names the transmission that arrived:
+// send time and RTT of the latest transmission delivered on each path, a segment
+// sent before it on the same path is lost once a reordering window has passed
+uint32_t rackTs[PATH_MAX_PATHS], rackRtt[PATH_MAX_PATHS];
+uint32_t minRtt = 0;        // the reordering window is a quarter of it (microseconds)
+uint32_t reoWndMult = 1,    // times that quarter, grows with every spurious retransmission
+         reoWndPersist = 0; // losses found since the last one, back to 1 after G_REO_WND_PERSIST
+int tlpProbing = 0;         // a tail loss probe is out, the next one waits for an ACK
+
+// File read index, the next byte to send
 long currentIndex = 0;
+uint64_t ackedOffset = 0; // every byte before it was acknowledged, the 32 bit 'an' of an ACK is unwrapped from it
+int eodSent = 0; // the segment with EOD is in the send ring
+long recoverPoint = 0; // currentIndex at the last timeout
 
-struct itimerval G_timer;
+// Retransmission timer of the oldest segment in flight, reordering timer of RACK,
+// tail loss probe timer and TIME_WAIT timer of the connection
+CrudpTimer_t G_rtoTimer, G_rackTimer, G_tlpTimer, G_timeWaitTimer;
+uint32_t rtoBackoff = 0;
+
+// Segments in flight, ready to be sent again as they are
+CrudpRing_t G_sendRing;
 
-unsigned char bytes[G_SIZE];
 int r;
 
 void stateHandler(CrudpHeader_t *header);
-CrudpHeader_t *headerHandler();
-
-int checkInputsAndEvents(int tcp_state, int *inputs, int *events);
+void freeHeader(CrudpHeader_t *header);
 
 void makeSocket(char *remote);
 
-FILE *fileToSave;
+int fileToSave = -1;
 /*
   i/o functions
 */
@@ -158,65 +268,158 @@ FILE *fileToSave;
 void setupSIGIO();
 void handleSIGIO(int sig);
 void checkNetwork();
+void checkSocket(UdpSocket_t *local, int path);
+int listenCookie(CrudpHeader_t *header);
+uint32_t echoRtt(uint32_t tsecr);
 int setAsyncFd(int fd);
 
 /*
-  alarm functions
+  timer functions
 */
-void handleSIGALRM(int sig);
-void setupSIGALRM();
-void setITIMER(uint32_t sec, uint32_t usec);
+void setupTimers();
+void armRTO();
+void expireRTO(CrudpTimer_t *timer);
+void resendSegment(CrudpSegment_t *segment, int lost);
+void rackAck(const CrudpHeader_t *header);
+void rackDetect();
+void expireRACK(CrudpTimer_t *timer);
+void armTLP();
+void expireTLP(CrudpTimer_t *timer);
+void expireTimeWait(CrudpTimer_t *timer);
+void expireBulk(CrudpTimer_t *timer);
+void bulkAck(CrudpHeader_t *header);
+void bulkSend(uint64_t offset, uint32_t len);
+void mcastStart();
+void expireMcast(CrudpTimer_t *timer);
+void mcastRecv(CrudpHeader_t *header);
+void mcastEnd();
 
 void readFile();
+void releaseFile();
+void fillWindow(const CrudpHeader_t *header);
+void streamPoll();
+void readConfig();
+void makeFile();
+int recvSegment(CrudpHeader_t *header);
 
-void runActions(char *remote, CrudpHeader_t *header);
-
-void setupTransfer();
-void setRTO();
-struct timespec getTime();
-
-void green();
-void yellow();
-void reset();
-
-#define CHECK_INPUTS_AND_EVENTS \
-    what = checkInputsAndEvents(tcp_state, inputs, events);
+/*
+  FSM actions, each one takes the received header (NULL for a local input or a timer)
+  and puts it once it is done with it
+*/
+void actionOpenSocket(CrudpHeader_t *header);
+void actionSndSyn(CrudpHeader_t *header);
+void actionSndSynAck(CrudpHeader_t *header);
+void actionSndAck(CrudpHeader_t *header);
+void actionSendData(CrudpHeader_t *header);
+void actionRecvData(CrudpHeader_t *header);
+void actionSndFin(CrudpHeader_t *header);
+void actionCloseSocket(CrudpHeader_t *header);
+void actionStart2MSL(CrudpHeader_t *header);
+void traceTransition(int state, int event);
+
+void setupTransfer(CrudpHeader_t *header);
+void setRTO(uint32_t rtt);
+void releaseSegment(const CrudpSegment_t *segment);
+void checkSpurious(const CrudpHeader_t *header, uint64_t acked);
 
 int main(int argc, char *argv[])
 {
-    if (argc > 2 && argc < 5)
+    if (argc > 2)
     {
-        if ((!strcmp(argv[2], "-r") && argc != 3) || (!strcmp(argv[2], "-t") && argc != 4))
+        if ((!strcmp(argv[2], "-r") && argc != 3) || (!strcmp(argv[2], "-t") && argc < 4))
         {
-            ERROR("usage: test <hostname> -t|-r [File name \"for -t\"]");
+            ERROR("usage: test <hostname> -t|-r [File or directory name, or several files \"for -t\"]");
 
             exit(0);
         }
     }
 
-        gSnedTime = (double) clock() / CLOCKS_PER_SEC;
+    readConfig();
+
+    gSnedTime = statsNow();
 
     remote = argv[1];
-    w = startW = strcmp("-r", argv[2]) == 0 ? CRUDP_INPUT_ACTIVE_OPEN : CRUDP_INPUT_PASSIVE_OPEN;
+    startW = strcmp("-r", argv[2]) == 0 ? CRUDP_INPUT_ACTIVE_OPEN : CRUDP_INPUT_PASSIVE_OPEN;
     filename = argv[3];
+    sources = argv + 3;
+    sourceCount = argc - 3;
+    mcastMode = mcastGroup(remote);
+
+    // A directory goes with its manifest, the SYN,ACK tells the receiver,
+    // anything but a file or a directory is read as a stream,
+    // several files go as independent streams
+    if (sourceCount > 1)
+    {
+        extern int muxMode;
+
+        muxMode = 1;
+    }
+    else if (filename != NULL)
+    {
+        extern int treeMode;
+        struct stat st;
+        int found = stat(filename, &st) == 0;
+
+        treeMode = found && S_ISDIR(st.st_mode);
+        streamSource = !strcmp(filename, "-") || (found && !S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode));
+
+        // Only a file of a known length goes in bulk mode
+        if (bulkKbit > 0 && !treeMode && !streamSource && !mcastMode)
+        {
+            extern int bulkMode;
+
+            bulkMode = 1;
+        }
+    }
 
-    tcp_state = CRUDP_STATE_CLOSED;
+    // A group takes a file of a known length, nothing is negotiated
+    if (mcastMode)
+    {
+        extern int treeMode;
+
+        if (sourceCount > 1 || (filename != NULL && (treeMode || streamSource)))
+        {
+            ERROR("a multicast group takes one file");
+            exit(0);
+        }
+    }
 
-    while (!(transmitter || receiver))
+    // Active open for the receiver, passive open for the transmitter
+    receiver = startW == CRUDP_INPUT_ACTIVE_OPEN;
+    transmitter = !receiver;
+
+    // A group has no connection, the FSM stays CLOSED
+    if (mcastMode)
+    {
+        makeSocket(remote);
+    }
+    else
     {
+        tcp_state = CRUDP_STATE_CLOSED;
         stateHandler(NULL);
     }
 
     G_net = G_local->sd;
 
+    statsInit(transmitter ? "transmitter" : "receiver", remote);
+
     sigemptyset(&G_sigmask);
 
     setupSIGIO();
+    setupTimers();
+
+    if (mcastMode)
+        mcastStart();
 
     G_flag = 0;
     while (!G_flag)
     {
         checkNetwork();
+        timerAdvance(timerNow());
+        impairPoll();
+        zerocopyPoll();
+        streamPoll();
+        statsPoll();
         // (void)pause(); // wait for signal, otherwise do nothing
     }
 
@@ -227,316 +430,171 @@ int main(int argc, char *argv[])
 }
 
 /**
- * @brief Put actions based on the state
+ * @brief What an event does in a state, the actions to run in order
+ *        and the state after them
  *
- * @param header Received Header
  */
-void stateHandler(CrudpHeader_t *header)
+typedef struct CrudpTransition_s
 {
-    tcp_new_state = what = CRUDP_INVALID;
-    inputs[0] = inputs[1] = inputs[2] = CRUDP_INVALID;
-    events[0] = events[1] = events[2] = CRUDP_INVALID;
-    actions[0] = actions[1] = actions[2] = CRUDP_INVALID;
-
-    switch (tcp_state)
-    {
-        // Initial State
-    case CRUDP_STATE_CLOSED:
-        inputs[0] = CRUDP_INPUT_ACTIVE_OPEN;  // from CRUDP user
-        inputs[1] = CRUDP_INPUT_PASSIVE_OPEN; // from CRUDP user
-
-        CHECK_INPUTS_AND_EVENTS;
-
-        switch (what)
-        {
-            // Active open for receiver
-        case CRUDP_INPUT_ACTIVE_OPEN:
-            receiver = 1;
+    uint8_t next;       // CRUDP_INVALID if the state ignores the event
+    uint8_t actions[3]; // CRUDP_INVALID ends the list
+} CrudpTransition_t;
+
+#define CRUDP_ROW(_state) [(_state)-CRUDP_STATE_CLOSED]
+
+// Transitions indexed by (state, event), RFC793(S) with the data of CRUDP
+static const CrudpTransition_t G_transitions[CRUDP_FSM_STATES][CRUDP_FSM_IDS] = {
+    CRUDP_ROW(CRUDP_STATE_CLOSED) = {
+        [CRUDP_INPUT_ACTIVE_OPEN] = {CRUDP_STATE_SYN_SENT, {CRUDP_ACTION_OPEN_SOCKET, CRUDP_ACTION_SND_SYN}},
+        [CRUDP_INPUT_PASSIVE_OPEN] = {CRUDP_STATE_LISTEN, {CRUDP_ACTION_OPEN_SOCKET}},
+    },
+    CRUDP_ROW(CRUDP_STATE_LISTEN) = {
+        [CRUDP_INPUT_SEND] = {CRUDP_STATE_SYN_SENT, {CRUDP_ACTION_SND_SYN}},
+        [CRUDP_INPUT_CLOSE] = {CRUDP_STATE_CLOSED, {CRUDP_ACTION_CLOSE_SOCKET}},
+        [CRUDP_EVENT_RCV_SYN] = {CRUDP_STATE_SYN_RCVD, {CRUDP_ACTION_SND_SYN_ACK}},
+    },
+    CRUDP_ROW(CRUDP_STATE_SYN_SENT) = {
+        [CRUDP_INPUT_CLOSE] = {CRUDP_STATE_CLOSED, {CRUDP_ACTION_CLOSE_SOCKET}},
+        [CRUDP_EVENT_RCV_SYN] = {CRUDP_STATE_SYN_RCVD, {CRUDP_ACTION_SND_ACK}},
+        [CRUDP_EVENT_RCV_SYN_ACK] = {CRUDP_STATE_ESTABLISHED, {CRUDP_ACTION_SND_ACK}},
+    },
+    CRUDP_ROW(CRUDP_STATE_SYN_RCVD) = {
+        [CRUDP_INPUT_CLOSE] = {CRUDP_STATE_FINWAIT_1, {CRUDP_ACTION_SND_FIN}},
+        [CRUDP_EVENT_RCV_ACK_OF_SYN] = {CRUDP_STATE_ESTABLISHED, {CRUDP_ACTION_SETUP_TRANSFER, CRUDP_SEND_DATA}},
+    },
+    // Data loops back to ESTABLISHED, stateHandler() takes it without the table
+    CRUDP_ROW(CRUDP_STATE_ESTABLISHED) = {
+        [CRUDP_SEND_DATA] = {CRUDP_STATE_ESTABLISHED, {CRUDP_SEND_DATA}},
+        [CRUDP_RECV_DATA] = {CRUDP_STATE_ESTABLISHED, {CRUDP_RECV_DATA}},
+        [CRUDP_INPUT_CLOSE] = {CRUDP_STATE_FINWAIT_1, {CRUDP_ACTION_SND_FIN}},
+        [CRUDP_EVENT_RCV_FIN] = {CRUDP_STATE_CLOSE_WAIT, {CRUDP_ACTION_SND_ACK}},
+    },
+    CRUDP_ROW(CRUDP_STATE_FINWAIT_1) = {
+        [CRUDP_EVENT_RCV_FIN] = {CRUDP_STATE_CLOSING, {CRUDP_ACTION_SND_ACK}},
+        [CRUDP_EVENT_RCV_ACK_OF_FIN] = {CRUDP_STATE_FINWAIT_2},
+    },
+    CRUDP_ROW(CRUDP_STATE_FINWAIT_2) = {
+        [CRUDP_EVENT_RCV_FIN] = {CRUDP_STATE_TIME_WAIT, {CRUDP_ACTION_START_2MSL, CRUDP_ACTION_SND_ACK}},
+    },
+    CRUDP_ROW(CRUDP_STATE_TIME_WAIT) = {
+        [CRUDP_EVENT_CLOSE_SOCKET] = {CRUDP_STATE_CLOSED, {CRUDP_ACTION_CLOSE_SOCKET}},
+    },
+    CRUDP_ROW(CRUDP_STATE_CLOSE_WAIT) = {
+        [CRUDP_INPUT_CLOSE] = {CRUDP_STATE_LAST_ACK, {CRUDP_ACTION_SND_FIN}},
+    },
+    CRUDP_ROW(CRUDP_STATE_LAST_ACK) = {
+        [CRUDP_EVENT_RCV_ACK_OF_FIN] = {CRUDP_STATE_CLOSED, {CRUDP_ACTION_CLOSE_SOCKET}},
+    },
+};
 
-            actions[0] = CRUDP_ACTION_OPEN_SOCKET; // local CRUDP
-            actions[1] = CRUDP_ACTION_SND_SYN;     // local CRUDP
-            tcp_new_state = CRUDP_STATE_SYN_SENT;
-            break;
-            // Passive open for transmitter
-        case CRUDP_INPUT_PASSIVE_OPEN:
-            transmitter = 1;
-            actions[0] = CRUDP_ACTION_OPEN_SOCKET; // local CRUDP
-            tcp_new_state = CRUDP_STATE_LISTEN;
-            break;
-        }
-        break;
-        // LISTEN - Waiting for SYN
-    case CRUDP_STATE_LISTEN:
-        inputs[0] = CRUDP_INPUT_SEND;    // from CRUDP user
-        inputs[1] = CRUDP_INPUT_CLOSE;   // from CRUDP user
-        events[0] = CRUDP_EVENT_RCV_SYN; // from network
+// The one event each state waits for, CLOSED takes startW and ESTABLISHED looks at the header
+static const uint8_t G_stateEvents[CRUDP_FSM_STATES] = {
+    CRUDP_ROW(CRUDP_STATE_LISTEN) = CRUDP_EVENT_RCV_SYN,
+    CRUDP_ROW(CRUDP_STATE_SYN_SENT) = CRUDP_EVENT_RCV_SYN_ACK,
+    CRUDP_ROW(CRUDP_STATE_SYN_RCVD) = CRUDP_EVENT_RCV_ACK_OF_SYN,
+    CRUDP_ROW(CRUDP_STATE_FINWAIT_1) = CRUDP_EVENT_RCV_ACK_OF_FIN,
+    CRUDP_ROW(CRUDP_STATE_FINWAIT_2) = CRUDP_EVENT_RCV_FIN,
+    CRUDP_ROW(CRUDP_STATE_TIME_WAIT) = CRUDP_EVENT_CLOSE_SOCKET,
+    CRUDP_ROW(CRUDP_STATE_CLOSE_WAIT) = CRUDP_INPUT_CLOSE,
+    CRUDP_ROW(CRUDP_STATE_LAST_ACK) = CRUDP_EVENT_RCV_ACK_OF_FIN,
+};
 
-        w = CRUDP_EVENT_RCV_SYN;
+// Actions by id
+static void (*const G_actions[CRUDP_FSM_IDS])(CrudpHeader_t *header) = {
+    [CRUDP_ACTION_OPEN_SOCKET] = actionOpenSocket,
+    [CRUDP_ACTION_SND_SYN] = actionSndSyn,
+    [CRUDP_ACTION_SND_SYN_ACK] = actionSndSynAck,
+    [CRUDP_ACTION_SND_ACK] = actionSndAck,
+    [CRUDP_SEND_DATA] = actionSendData,
+    [CRUDP_RECV_DATA] = actionRecvData,
+    [CRUDP_ACTION_SND_FIN] = actionSndFin,
+    [CRUDP_ACTION_CLOSE_SOCKET] = actionCloseSocket,
+    [CRUDP_ACTION_SETUP_TRANSFER] = setupTransfer,
+    [CRUDP_ACTION_START_2MSL] = actionStart2MSL,
+};
 
-        CHECK_INPUTS_AND_EVENTS;
+/**
+ * @brief Run the transition of the event the header is in the current state
+ *        data in ESTABLISHED goes straight to its action
+ *
+ * @param header Received Header, NULL for a local input or a timer
+ */
+void stateHandler(CrudpHeader_t *header)
+{
+    const CrudpTransition_t *transition;
+    int event;
 
-        switch (what)
+    if (tcp_state == CRUDP_STATE_ESTABLISHED)
+    {
+        // Transmitter: Send data until it receives FIN flag
+        if (transmitter && !header->fin)
         {
-        case CRUDP_INPUT_SEND:
-            actions[0] = CRUDP_ACTION_SND_SYN; // local CRUDP
-            tcp_new_state = CRUDP_STATE_SYN_SENT;
-            break;
-
-        case CRUDP_INPUT_CLOSE:
-            actions[0] = CRUDP_ACTION_CLOSE_SOCKET; // local CRUDP
-            actions[1] = CRUDP_INPUT_CLOSE;         // local CRUDP
-            tcp_new_state = CRUDP_STATE_CLOSED;
-            break;
-
-        case CRUDP_EVENT_RCV_SYN:
-            actions[0] = CRUDP_ACTION_SND_SYN_ACK; // local CRUDP
-            tcp_new_state = CRUDP_STATE_SYN_RCVD;
-            setupSIGALRM();
-            break;
+            actionSendData(header);
+            return;
         }
-        break;
-
-    // SYN SENT
-    case CRUDP_STATE_SYN_SENT:
-        inputs[0] = CRUDP_INPUT_CLOSE;       // from CRUDP user
-        events[0] = CRUDP_EVENT_RCV_SYN;     // from network
-        events[1] = CRUDP_EVENT_RCV_SYN_ACK; // from network
 
-        w = CRUDP_EVENT_RCV_SYN_ACK;
-        CHECK_INPUTS_AND_EVENTS;
-
-        switch (what)
+        // Receiver: Receive data until every byte up to EOD is there
+        if (receiver && !reasmCompletes(&G_reasm, dataOffset(header, dataSeq), r - HEADER_SIZE, header->eod))
         {
-        case CRUDP_INPUT_CLOSE:
-            actions[0] = CRUDP_ACTION_CLOSE_SOCKET; // local CRUDP
-            actions[1] = CRUDP_INPUT_CLOSE;         // local CRUDP
-            tcp_new_state = CRUDP_STATE_CLOSED;
-            break;
-
-        case CRUDP_EVENT_RCV_SYN:
-            actions[0] = CRUDP_ACTION_SND_ACK; // local CRUDP
-            tcp_new_state = CRUDP_STATE_SYN_RCVD;
-            break;
-
-        case CRUDP_EVENT_RCV_SYN_ACK:
-            actions[0] = CRUDP_ACTION_SND_ACK; // local CRUDP
-            tcp_new_state = CRUDP_STATE_ESTABLISHED;
-            break;
+            actionRecvData(header);
+            return;
         }
-        break;
 
-    // SYN RCVD
-    case CRUDP_STATE_SYN_RCVD:
-    {
-        inputs[0] = CRUDP_INPUT_CLOSE;          // from CRUDP user
-        events[0] = CRUDP_EVENT_RCV_ACK_OF_SYN; // from network
-
-        w = CRUDP_EVENT_RCV_ACK_OF_SYN;
-        CHECK_INPUTS_AND_EVENTS;
-
-        switch (what)
-        {
-        case CRUDP_INPUT_CLOSE:
-            actions[0] = CRUDP_ACTION_SND_FIN; // local CRUDP
-            actions[1] = CRUDP_INPUT_CLOSE;    // local CRUDP
-            tcp_new_state = CRUDP_STATE_FINWAIT_1;
-            break;
-
-        case CRUDP_EVENT_RCV_ACK_OF_SYN:
-         gSnedTime = (double) clock() / CLOCKS_PER_SEC;
-            setupTransfer();
-            actions[0] = CRUDP_SEND_DATA;
-            tcp_new_state = CRUDP_STATE_ESTABLISHED;
-            break;
-        }
-        break;
+        event = transmitter ? CRUDP_EVENT_RCV_FIN : CRUDP_INPUT_CLOSE;
     }
-    // ESTABLISHED
-    case CRUDP_STATE_ESTABLISHED:
+    else
     {
-        inputs[0] = CRUDP_SEND_DATA;
-        inputs[1] = CRUDP_INPUT_CLOSE;
-        events[0] = CRUDP_RECV_DATA;
-        events[1] = CRUDP_EVENT_RCV_FIN;
-
-        // Transmitter: Send data until it receives FIN flag
-        w = transmitter ? (header->fin ? CRUDP_EVENT_RCV_FIN : CRUDP_SEND_DATA)
-                        // Receiver: Receive data until it receives EOD flag
-                        : (header->eod ? CRUDP_INPUT_CLOSE : CRUDP_RECV_DATA);
-        CHECK_INPUTS_AND_EVENTS;
+        event = tcp_state == CRUDP_STATE_CLOSED ? startW : G_stateEvents[tcp_state - CRUDP_STATE_CLOSED];
+    }
 
-        switch (what)
-        {
-        case CRUDP_SEND_DATA:
-            actions[0] = CRUDP_SEND_DATA;
-            tcp_new_state = CRUDP_STATE_ESTABLISHED;
-            break;
+    transition = &G_transitions[tcp_state - CRUDP_STATE_CLOSED][event];
 
-        case CRUDP_RECV_DATA:
-            actions[0] = CRUDP_RECV_DATA;
-            tcp_new_state = CRUDP_STATE_ESTABLISHED;
-            break;
-        case CRUDP_INPUT_CLOSE:
-            actions[0] = CRUDP_ACTION_SND_FIN; // local CRUDP
-            tcp_new_state = CRUDP_STATE_FINWAIT_1;
-            break;
+    if (trace)
+        traceTransition(tcp_state, event);
 
-        case CRUDP_EVENT_RCV_FIN:
-            actions[0] = CRUDP_ACTION_SND_ACK; // local CRUDP
-            tcp_new_state = CRUDP_STATE_CLOSE_WAIT;
-            break;
-        }
-    }
-    break;
-    // CLOSE WAIT
-    case CRUDP_STATE_CLOSE_WAIT:
+    // not an event of this state
+    if (transition->next == CRUDP_INVALID)
     {
-
-        inputs[0] = CRUDP_INPUT_CLOSE; // local CRUDP
-        w = CRUDP_INPUT_CLOSE;
-        CHECK_INPUTS_AND_EVENTS;
-
-        switch (what)
-        {
-        case CRUDP_INPUT_CLOSE:
-            actions[0] = CRUDP_ACTION_SND_FIN; // local CRUDP
-            tcp_new_state = CRUDP_STATE_LAST_ACK;
-            break;
-        }
+        if (header != NULL)
+            freeHeader(header);
+        return;
     }
-    break;
-    // LAST ACK
-    case CRUDP_STATE_LAST_ACK:
-        events[0] = CRUDP_EVENT_RCV_ACK_OF_FIN; // from network
-        w = CRUDP_EVENT_RCV_ACK_OF_FIN;
-
-        CHECK_INPUTS_AND_EVENTS;
-        switch (what)
-        {
-        case CRUDP_EVENT_RCV_ACK_OF_FIN:
-            actions[0] = CRUDP_ACTION_CLOSE_SOCKET;
-            tcp_new_state = CRUDP_STATE_CLOSED;
-            break;
-        }
-        break;
-        // FINWAIT 1
-    case CRUDP_STATE_FINWAIT_1:
-        events[0] = CRUDP_EVENT_RCV_FIN;        // from network
-        events[1] = CRUDP_EVENT_RCV_ACK_OF_FIN; // from network
-        w = CRUDP_EVENT_RCV_ACK_OF_FIN;
-        CHECK_INPUTS_AND_EVENTS;
-
-        switch (what)
-        {
-        case CRUDP_EVENT_RCV_FIN:
-            actions[0] = CRUDP_ACTION_SND_ACK; // local CRUDP
-            tcp_new_state = CRUDP_STATE_CLOSING;
-            break;
 
-        case CRUDP_EVENT_RCV_ACK_OF_FIN:
-            tcp_new_state = CRUDP_STATE_FINWAIT_2;
-            break;
-        }
-        break;
-        // FINWAIT 2
-    case CRUDP_STATE_FINWAIT_2:
-        events[0] = CRUDP_EVENT_RCV_FIN; // from network
-        w = CRUDP_EVENT_RCV_FIN;
-        CHECK_INPUTS_AND_EVENTS;
+    tcp_new_state = transition->next;
 
-        switch (what)
-        {
-        case CRUDP_EVENT_RCV_FIN:
-            actions[0] = CRUDP_ACTION_SND_ACK; // local CRUDP
-            tcp_new_state = CRUDP_STATE_TIME_WAIT;
-            break;
-        }
-        break;
-        // TIME WAIT
-    case CRUDP_STATE_TIME_WAIT:
-        events[0] = CRUDP_EVENT_CLOSE_SOCKET; // local timer
-        w = CRUDP_EVENT_CLOSE_SOCKET;
-        CHECK_INPUTS_AND_EVENTS;
+    if (transition->actions[0] == CRUDP_INVALID && header != NULL)
+        freeHeader(header);
 
-        switch (what)
-        {
-        case CRUDP_EVENT_CLOSE_SOCKET:
-            // CLOSE SOCKET
-            actions[0] = CRUDP_ACTION_CLOSE_SOCKET; // local CRUDP
-            tcp_new_state = CRUDP_STATE_CLOSED;
-            break;
-        }
-        break;
-    default:
-        break;
-    }
+    for (const uint8_t *ap = transition->actions; ap < transition->actions + 3 && *ap != CRUDP_INVALID; ++ap)
+        G_actions[*ap](header);
 
-    runActions(remote, header);
+    tcp_state = tcp_new_state;
 }
 
 /**
- * @brief Parse Header from byte streams
+ * @brief Print a transition, with CRUDP_TRACE=1 only
  *
- * @return CrudpHeader_t* parsed header struct
+ * @param state current state
+ * @param event event in it
  */
-CrudpHeader_t *headerHandler()
+void traceTransition(int state, int event)
 {
-    unsigned char *headerByte = (unsigned char *)calloc(1, HEADER_SIZE * sizeof(char));
-
-    for (int i = 0; i < HEADER_SIZE; i++)
-    {
-        headerByte[i] = *((char *)bytes + i);
-    }
+    const CrudpTransition_t *transition = &G_transitions[state - CRUDP_STATE_CLOSED][event];
 
-    return (CrudpHeader_t *)headerByte;
+    printf("** %s : %s -> %s\n", CRUDP_fsm_strings_G[state], CRUDP_fsm_strings_G[event],
+           CRUDP_fsm_strings_G[transition->next]);
+    for (int i = 0; i < 3 && transition->actions[i] != CRUDP_INVALID; i++)
+        printf("     %2d : %s\n", transition->actions[i], CRUDP_fsm_strings_G[transition->actions[i]]);
 }
 
 /**
- * @brief Check inputs and events and choose one of them
- *        based on 'w'
+ * @brief Return the packet of a received header to the pool
  *
- * @param tcp_state current tcp state
- * @param inputs inputs array
- * @param events events array
- * @return int selected inputs/events
+ * @param header received header, at the start of its packet
  */
-int checkInputsAndEvents(int tcp_state, int *inputs, int *events)
+void freeHeader(CrudpHeader_t *header)
 {
-    int what;
-
-    printf("\n** Current state: %s\n", CRUDP_fsm_strings_G[tcp_state]);
-
-    what = CRUDP_INVALID;
-
-    // Current possibilities for inputs or actions
-    printf("   Possible inputs and events:\n");
-    for (int *ip = inputs; *ip != CRUDP_INVALID; ++ip)
-        printf("     %2d : %s\n", *ip, CRUDP_fsm_strings_G[*ip]);
-    for (int *ep = events; *ep != CRUDP_INVALID; ++ep)
-        printf("     %2d : %s\n", *ep, CRUDP_fsm_strings_G[*ep]);
-
-    // Check validity of input
-    for (int *ip = inputs; *ip != CRUDP_INVALID; ++ip)
-        if (w == *ip)
-        {
-            what = *ip;
-            break;
-        }
-    if (what == CRUDP_INVALID)
-        for (int *ep = events; *ep != CRUDP_INVALID; ++ep)
-            if (w == *ep)
-            {
-                what = *ep;
-                break;
-            }
-    if (what == CRUDP_INVALID)
-        printf("\n** Please select a number from the list.\n");
-
-    green();
-    printf("      S : %s\n\n", CRUDP_fsm_strings_G[w]);
-    reset();
-
-    return what;
+    packetPut(packetOf(header));
 }
 
 /**
@@ -546,23 +604,44 @@ int checkInputsAndEvents(int tcp_state, int *inputs, int *events)
  */
 void makeSocket(char *remote)
 {
-    if ((G_local = setupUdpSocket_t((char *)0, G_MY_PORT)) == (UdpSocket_t *)0)
+    if ((G_local = setupUdpSocket_t((char *)0, myPort)) == (UdpSocket_t *)0)
     {
         ERROR("local problem");
         exit(0);
     }
 
-    if ((G_remote = setupUdpSocket_t(remote, G_MY_PORT)) == (UdpSocket_t *)0)
+    if ((G_remote = setupUdpSocket_t(remote, peerPort)) == (UdpSocket_t *)0)
     {
         ERROR("remote hostname/port problem");
         exit(0);
     }
 
-    if (openUdp(G_local) < 0)
+    if ((mcastMode ? mcastOpen(G_local, G_remote, mcastIf, mcastTtl) : openUdp(G_local)) < 0)
     {
         ERROR("openUdp() problem");
         exit(0);
     };
+
+    // without kernel support every send is copied as before
+    if (zerocopyMin > 0 && zerocopyInit(G_local->sd, zerocopyMin) < 0)
+        ERROR("MSG_ZEROCOPY is not supported, sends are copied");
+
+    // The transmitter spreads its segments, the receiver answers where they came from
+    if (transmitter && pathSpec != NULL && simActive())
+        ERROR("CRUDP_PATHS is ignored under CRUDP_SIM");
+    if (pathInit(transmitter && !simActive() && !mcastMode ? pathSpec : NULL, schedulerName, G_local, G_remote,
+                 G_SEND_RING) < 0)
+    {
+        ERROR("CRUDP_PATHS or CRUDP_SCHEDULER problem");
+        exit(0);
+    }
+
+    // the UDP socket stays open, it keeps the port and resolves the peer
+    if (xdpSpec != NULL && xdpInit(xdpSpec, G_local, G_remote) < 0)
+    {
+        ERROR("CRUDP_XDP problem");
+        exit(0);
+    }
 }
 
 void handleSIGIO(int sig)
@@ -602,53 +681,169 @@ void setupSIGIO()
 }
 
 /**
- * @brief Read data from current socket
+ * @brief Read data from the connection socket and the sockets of the sub-paths
  *
  */
 void checkNetwork()
 {
-    UdpSocket_t receive;
+    for (int i = 0; i < pathCount(); i++)
+        checkSocket(G_paths[i].local, i);
+}
+
+/**
+ * @brief Read data from one socket
+ *
+ * @param local socket to read
+ * @param path path of the socket, its RTT is sampled
+ */
+void checkSocket(UdpSocket_t *local, int path)
+{
     CrudpBuffer_t buffer;
+    CrudpPacket_t *packet = packetAlloc();
+
+    if (packet == NULL)
+        exit(1);
 
     /* print any network input */
-    buffer.bytes = bytes;
-    buffer.n = G_SIZE;
+    buffer.bytes = packet->bytes;
+    buffer.n = POOL_PACKET_BYTES;
+    buffer.packet = packet;
+    buffer.payload = NULL;
+    buffer.payloadLen = 0;
 
-    if ((r = recvCrudp(G_local, &receive, &buffer)) < 0)
+    if ((r = recvCrudp(local, &G_from, &buffer)) < 0)
     {
+        packetPut(packet);
         if (errno != EWOULDBLOCK)
         {
-            ERROR("checkNetwork(): recvUdp() problem");
+            ERROR("checkSocket(): recvUdp() problem");
             exit(1);
         }
     }
+    // too short for a header
+    else if (r < HEADER_SIZE)
+    {
+        packetPut(packet);
+    }
     else
     {
-        endTime = getTime();
+        extern uint32_t tsRecent;
+        CrudpHeader_t *header = (CrudpHeader_t *)packet->bytes;
+
+        packet->n = r;
 
-        // Calculate rto
-        rto = urto + srto * 1000000;
+        // The datagrams of a group go by their flags
+        if (mcastMode)
+        {
+            mcastRecv(header);
+            return;
+        }
 
-        if (tcp_state != CRUDP_STATE_LISTEN)
+        // A duplicated SYN or SYN,ACK is stale once the handshake moved on
+        if (header->syn && tcp_state != CRUDP_STATE_LISTEN && tcp_state != CRUDP_STATE_SYN_SENT)
         {
-            setRTO();
-            urto /= 1000;
+            TRACE("** Stale SYN - Abandoned due to duplication\n");
+            G_stats.duplicates++;
+            freeHeader(header);
+            return;
+        }
 
-            if (urto >= 1000000)
-            {
-                srto = urto / 1000000;
-                urto -= srto * 1000000;
-            }
+        // The keys of the sealed datagrams need the random nonce of each end
+        if (header->syn && aeadEnabled() && packetOf(header)->n < HEADER_SIZE + AEAD_NONCE_SIZE)
+        {
+            TRACE("** SYN without a nonce - Abandoned\n");
+            G_stats.aeadRejected++;
+            freeHeader(header);
+            return;
         }
 
-        // is current rto greater than previous rto
-        rto_incr = (urto + srto * 1000000) > rto;
+        // The listener keeps no state until a valid cookie comes back
+        if (synCookies && tcp_state == CRUDP_STATE_LISTEN && listenCookie(header))
+            return;
+
+        tsRecent = header->ts;
+
+        // Every echo tells which transmission is acknowledged,
+        // so every one of them is a valid RTT sample
+        if (tcp_state != CRUDP_STATE_LISTEN && header->tsecr != 0)
+        {
+            uint64_t previous = rto;
+            uint32_t rtt = echoRtt(header->tsecr);
+
+            setRTO(rtt);
+            if (pathCount() > 1)
+                pathSample(path, rtt);
+
+            // is current rto greater than previous rto
+            rto_incr = rto > previous;
+        }
 
-        CrudpHeader_t *header = headerHandler();
         stateHandler(header);
+    }
+}
+
+/**
+ * @brief Time since the transmission an echo names
+ *        a burst stamps a microsecond each, ahead of the clock for a while
+ *
+ * @param tsecr echoed timestamp
+ * @return uint32_t round trip time in microseconds, 1 at least
+ */
+uint32_t echoRtt(uint32_t tsecr)
+{
+    int32_t rtt = (int32_t)(timestampNow() - tsecr);
+
+    return rtt > 0 ? (uint32_t)rtt : 1;
+}
+
+/**
+ * @brief Stateless listener, answer a SYN with a cookie
+ *        and turn the ACK of a valid cookie into the SYN RCVD state
+ *
+ * @param header received header
+ * @return int 1 if the header was consumed, 0 to pass the ACK on to the FSM
+ */
+int listenCookie(CrudpHeader_t *header)
+{
+    if (header->syn && !header->ack)
+    {
+        synRecvCookie(G_local, &G_from, header, cookieMake(&G_from.addr, header->sn));
+        G_stats.cookiesSent++;
+    }
+    else if (header->ack && !header->syn && cookieCheck(&G_from.addr, header->sn - 1, header->an - 1))
+    {
+        extern uint32_t startSeq;
+        CrudpPacket_t *packet = packetOf(header);
+        int len = 0;
+
+        // The ACK is the first sealed datagram, the SYN it answers was never kept,
+        // the nonces of both ends come back with it
+        cookieEstablish(header);
+        aeadPeerCaps(header->gcm ? AEAD_CAP_GCM : 0);
+        if (aeadEnabled() && aeadTakeHello(packet->bytes, packet->n) == 0)
+            aeadStart(startSeq, header->sn - 1, 1);
+
+        if (!aeadEnabled() || (aeadActive() && (len = aeadOpen(packet->bytes, packet->n)) >= 0))
+        {
+            // The connection starts here, with the peer the cookie was made for
+            if (aeadEnabled())
+                packet->n = (uint32_t)len;
+            G_remote->addr = G_from.addr;
+            tcp_state = CRUDP_STATE_SYN_RCVD;
+
+            return 0;
+        }
 
-        setITIMER(srto, urto);
+        aeadStop();
+        G_stats.aeadRejected++;
+    }
+    else
+    {
+        G_stats.cookiesRejected++;
     }
+
+    freeHeader(header);
+    return 1;
 }
 
 int setAsyncFd(int fd)
@@ -670,432 +865,1392 @@ int setAsyncFd(int fd)
     return r;
 }
 
-void setITIMER(uint32_t sec, uint32_t usec)
+void setupTimers()
 {
-    G_timer.it_interval.tv_sec = sec;
-    G_timer.it_interval.tv_usec = usec;
-    G_timer.it_value.tv_sec = sec;
-    G_timer.it_value.tv_usec = usec;
-
-    if (setitimer(ITIMER_REAL, &G_timer, (struct itimerval *)0) != 0)
-    {
-        perror("setitimer");
-        ERROR("setITIMER(): setitimer() problem");
-    }
+    timerSetup(&G_rtoTimer, expireRTO, NULL);
+    timerSetup(&G_rackTimer, expireRACK, NULL);
+    timerSetup(&G_tlpTimer, expireTLP, NULL);
+    timerSetup(&G_timeWaitTimer, expireTimeWait, NULL);
+    timerSetup(&G_bulkTimer, expireBulk, NULL);
+    timerSetup(&G_mcastTimer, expireMcast, NULL);
 }
 
-void handleSIGALRM(int sig)
+/**
+ * @brief Arm the retransmission timer of the segment just sent
+ *        RTO doubles for every timeout in a row,
+ *        with sub-paths it is the one of the slowest path at least
+ */
+void armRTO()
 {
-    if (sig == SIGALRM)
-    {
-        /* protect handler actions from signals */
-        sigprocmask(SIG_BLOCK, &G_sigmask, (sigset_t *)0);
+    uint64_t timeout = (pathRTO() > rto ? pathRTO() : rto) / 1000;
 
-        // Retransmit the data
-        if (transmitter && established)
-        {
-
-            CrudpHeader_t *header = headerHandler();
-            stateHandler(header);
+    timeout <<= rtoBackoff;
+    if (timeout > G_RTO_MAX_MS)
+        timeout = G_RTO_MAX_MS;
 
-            return;
-        }
+    timerArm(&G_rtoTimer, timerNow() + timeout);
+}
 
-        // // restart connection from the bottom
-        // switch (tcp_state)
-        // {
-        // case CRUDP_STATE_ESTABLISHED:
-        //     if (actions[0] == CRUDP_ACTION_SND_ACK)
-        //     {
-        //         if (receiver)
-        //         {
-        //             srto = 2;
-        //         }
-        //         else
-        //         {
-        //             srto = 1;
-        //         }
-        //         receiver = transmitter = 0;
-        //         w = startW;
-        //         tcp_state = CRUDP_STATE_CLOSED;
-        //         closeUdp(G_local);
-        //         closeUdp(G_remote);
-        //         stateHandler(NULL);
-        //         break;
-        //     }
-        // case CRUDP_STATE_SYN_SENT:
-        // case CRUDP_STATE_LISTEN:
-        // case CRUDP_STATE_SYN_RCVD:
-        //     if (receiver)
-        //     {
-        //         srto = 2;
-        //     }
-        //     else
-        //     {
-        //         srto = 1;
-        //     }
-        //     receiver = transmitter = 0;
-        //     w = startW;
-        //     tcp_state = CRUDP_STATE_CLOSED;
-        //     closeUdp(G_local);
-        //     closeUdp(G_remote);
-        //     stateHandler(NULL);
-        //     break;
-        // default:
-        //     // Did not implement 4 way handshake
-        //     printf("ERROR\n");
-        //     exit(0);
-        //     break;
-        // }
-
-        /* protect handler actions from signals */
-        sigprocmask(SIG_UNBLOCK, &G_sigmask, (sigset_t *)0);
-    }
-    else
+/**
+ * @brief Retransmit the oldest segment in flight
+ *
+ * @param timer retransmission timer
+ */
+void expireRTO(CrudpTimer_t *timer)
+{
+    if (transmitter && established && ringCount(&G_sendRing) > 0)
     {
-        ERROR("handleSIGALRM() got a bad signal");
+        if (rtoBackoff < G_RTO_BACKOFF_MAX)
+            rtoBackoff++;
+
+        // what was sent before the timeout is likely lost as well
+        recoverPoint = currentIndex;
+
+        timerCancel(&G_tlpTimer);
+        resendSegment(ringFront(&G_sendRing), 1);
+        armRTO();
     }
 }
 
-void setupSIGALRM()
+/**
+ * @brief Resend a segment as it was built
+ *        a lost one goes on the fastest path that did not lose it,
+ *        a probe goes again on its path, nothing says it was lost
+ *
+ * @param segment segment in flight
+ * @param lost 1 for a loss, 0 for a tail loss probe
+ */
+void resendSegment(CrudpSegment_t *segment, int lost)
 {
-    sigaddset(&G_sigmask, SIGALRM);
+    int path = lost ? pathResend(segment->path) : segment->path;
 
-    G_sigalrm.sa_handler = handleSIGALRM;
-    G_sigalrm.sa_flags = 0;
+    G_stats.retransmissions++;
 
-    if (sigaction(SIGALRM, &G_sigalrm, (struct sigaction *)0) < 0)
-    {
-        perror("setupSIGALRM(): sigaction() problem");
-        exit(0);
-    }
-    else
+    if (ringUnshare(segment) < 0)
+        exit(1);
+
+    if (lost)
     {
-        setITIMER(srto, (uint32_t)urto);
+        pathLost(segment->path);
+        pathSent(path, segment->len);
     }
+    segment->path = path;
+    segment->header->mp = path != 0;
+
+    // the echo of the first ACK covering it tells whether this was needed
+    if (segment->transmissions == 1)
+        segment->firstTs = segment->header->ts;
+    segment->transmissions++;
+    resendData(G_paths[path].local, G_paths[path].remote, segment->header, segment->payload, segment->len);
+
+    TRACE("** Retransmit Data: %u\n", segment->len);
 }
 
-void readFile()
+/**
+ * @brief Find the transmission the echo of an ACK names, the latest one
+ *        delivered on its path is the reference of RACK
+ *
+ * @param header received ACK, before it releases anything
+ */
+void rackAck(const CrudpHeader_t *header)
 {
-    FILE *file;
+    if (header->tsecr == 0)
+        return;
 
-    file = fopen(filename, "rb");
-    if (!file)
+    for (uint32_t i = 0; i < ringCount(&G_sendRing); i++)
     {
-        printf("File path/name is wrong\n");
-        exit(1);
-    }
+        CrudpSegment_t *segment = ringAt(&G_sendRing, i);
+        int path = segment->path;
 
-    fseek(file, 0, SEEK_END);
-    filelen = ftell(file);
-    rewind(file);
+        if (segment->header->ts != header->tsecr)
+            continue;
 
-    fileBuffer = (char *)malloc(filelen * sizeof(char));
-    fread(fileBuffer, filelen, 1, file);
-    fclose(file);
+        segment->delivered = 1;
+        tlpProbing = 0;
+
+        if (rackTs[path] == 0 || (int32_t)(header->tsecr - rackTs[path]) > 0)
+        {
+            rackTs[path] = header->tsecr;
+            rackRtt[path] = echoRtt(header->tsecr);
+        }
+        break;
+    }
 }
 
-void makeFile()
+/**
+ * @brief Resend every segment sent before the RACK reference of its path that
+ *        should have been delivered a reordering window ago (RFC 8985)
+ *        the reordering timer wakes up for the first one still inside it
+ */
+void rackDetect()
 {
-    fileToSave = fopen("../save/download.txt", "w");
+    uint32_t now = timestampNow(),
+             reoWnd = minRtt / 4 * reoWndMult,
+             wait = 0;
 
-    if (fileToSave == NULL)
-    {
-        printf("File Generate Fail...\n");
-        exit(1);
-    }
-    else
+    // never more than an RTT, a reordering that long is not told from a loss
+    if (reoWnd > (uint32_t)srtt)
+        reoWnd = (uint32_t)srtt;
+
+    for (uint32_t i = 0; i < ringCount(&G_sendRing); i++)
     {
-        printf("File Generate Done\n");
+        CrudpSegment_t *segment = ringAt(&G_sendRing, i);
+        uint32_t sent = segment->header->ts,
+                 reference = rackTs[segment->path];
+        int32_t left;
+
+        if (segment->delivered || reference == 0 || (int32_t)(reference - sent) <= 0)
+            continue;
+
+        left = (int32_t)(sent + rackRtt[segment->path] + reoWnd - now);
+
+        if (left <= 0)
+        {
+            if (++reoWndPersist >= G_REO_WND_PERSIST)
+                reoWndMult = 1;
+            G_stats.lossesDetected++;
+            resendSegment(segment, 1);
+            TRACE("** RACK Lost: %" PRIu64 "\n", segment->offset);
+        }
+        else if (wait == 0 || (uint32_t)left < wait)
+        {
+            wait = (uint32_t)left;
+        }
     }
-}
 
-void writeFile(char *text)
-{
-    fputs(text, fileToSave);
+    if (wait > 0)
+        timerArm(&G_rackTimer, timerNow() + (wait + G_CLOCK_US - 1) / G_CLOCK_US);
 }
 
 /**
- * @brief Do action based on selected value with current state
+ * @brief The reordering window of a segment passed without its ACK
  *
- * @param remote Receiver's FQDN
- * @param header received header
+ * @param timer reordering timer
  */
-void runActions(char *remote, CrudpHeader_t *header)
+void expireRACK(CrudpTimer_t *timer)
 {
-    printf("** New state: %s\n", CRUDP_fsm_strings_G[tcp_new_state]);
-    printf("   Actions executed by CRUDP:\n");
-    for (int *ap = actions; *ap != CRUDP_INVALID; ++ap)
+    if (transmitter && established && ringCount(&G_sendRing) > 0)
+        rackDetect();
+}
+
+/**
+ * @brief Arm the tail loss probe two SRTT after the latest ACK (RFC 8985)
+ *        a lost tail leaves no later segment to tell it, the probe does
+ *        the probe is not armed when the RTO would come first
+ */
+void armTLP()
+{
+    uint64_t pto = 2 * (uint64_t)srtt,
+             timeout = (pathRTO() > rto ? pathRTO() : rto) << rtoBackoff;
+
+    if (!rttSampled || tlpProbing || ringCount(&G_sendRing) == 0 || pto >= timeout)
+    {
+        timerCancel(&G_tlpTimer);
+        return;
+    }
+
+    if (pto < G_TLP_MIN_US)
+        pto = G_TLP_MIN_US;
+
+    timerArm(&G_tlpTimer, timerNow() + (pto + G_CLOCK_US - 1) / G_CLOCK_US);
+}
+
+/**
+ * @brief Send new data if the window allows, the last segment again otherwise,
+ *        its ACK lets RACK find what was lost before it
+ *
+ * @param timer tail loss probe timer
+ */
+void expireTLP(CrudpTimer_t *timer)
+{
+    uint32_t count = ringCount(&G_sendRing);
+
+    if (!transmitter || !established || count == 0)
+        return;
+
+    G_stats.tailProbes++;
+    tlpProbing = 1;
+
+    if (G_lastAck.ack)
+        fillWindow(&G_lastAck);
+
+    if (ringCount(&G_sendRing) == count)
+    {
+        resendSegment(ringAt(&G_sendRing, count - 1), 0);
+        TRACE("** Tail Loss Probe\n");
+    }
+
+    armRTO();
+}
+
+/**
+ * @brief An ACK covers the segment, its path has room for one more
+ *
+ * @param segment released segment
+ */
+void releaseSegment(const CrudpSegment_t *segment)
+{
+    pathAcked(segment->path);
+}
+
+/**
+ * @brief 2MSL has passed, close the connection
+ *
+ * @param timer TIME_WAIT timer
+ */
+void expireTimeWait(CrudpTimer_t *timer)
+{
+    if (tcp_state == CRUDP_STATE_TIME_WAIT)
+    {
+        stateHandler(NULL);
+    }
+}
+
+/**
+ * @brief Pace the data of the transmitter every tick,
+ *        report every BULK_REPORT_MS on the receiver
+ *
+ * @param timer bulk timer
+ */
+void expireBulk(CrudpTimer_t *timer)
+{
+    if (!established)
+        return;
+
+    if (transmitter)
     {
-        printf("     %d : %s\n", *ap, CRUDP_fsm_strings_G[*ap]);
-        switch (*ap)
+        uint64_t offset;
+        uint32_t len;
+        int kind;
+
+        bulkPace(&G_bulk, clockNow());
+        while ((kind = bulkNext(&G_bulk, MAX_WINDOW_SIZE, &offset, &len, clockNow())) > 0)
         {
-        case CRUDP_ACTION_OPEN_SOCKET:
-            makeSocket(remote);
-            green();
-            printf("     O : %s Completed\n", CRUDP_fsm_strings_G[*ap]);
-            reset();
-            /* code */
-            break;
-        case CRUDP_ACTION_SND_SYN:
-            sendTime = getTime();
-            synSend(G_local, G_remote);
-            green();
-            printf("     O : %s Completed\n", CRUDP_fsm_strings_G[*ap]);
-            reset();
-
-            makeFile();
-            setupSIGALRM();
-            break;
-        case CRUDP_ACTION_SND_SYN_ACK:
+            if (kind == 2)
+                G_stats.retransmissions++;
+            bulkSend(offset, len);
+        }
+
+        timerArm(timer, timerNow() + 1);
+    }
+    else
+    {
+        extern uint32_t recvWindow;
+        CrudpHeader_t *header = headerAlloc();
+
+        // a range asked for is asked for again once its repair had time to come
+        uint64_t retry = rttSampled ? 2 * (uint64_t)srtt + BULK_REPORT_MS * 1000 : rto;
+        uint32_t n = bulkReport(&G_bulk, &G_reasm, (uint8_t *)header + HEADER_SIZE, MAX_WINDOW_SIZE, clockNow(), retry);
+
+        if (n == 0)
+            exit(1);
+
+        // past the reassembly window the data goes to its place in the file
+        sendReport(G_local, G_remote, header, n, G_reasm.seekable ? UINT32_MAX : recvWindow);
+
+        timerArm(timer, timerNow() + BULK_REPORT_MS);
+    }
+}
+
+/**
+ * @brief Start pacing on the ACK of the SYN,ACK, take the reports after it
+ *
+ * @param header received ACK
+ */
+void bulkAck(CrudpHeader_t *header)
+{
+    extern uint32_t startSeq;
+
+    uint64_t acked = seqUnwrap(ackedOffset, header->an - (startSeq + 1));
+
+    if (acked > ackedOffset)
+        ackedOffset = acked;
+
+    G_lastAck = *header;
+    G_stats.payloadDelivered = acked;
+    G_stats.rwnd = header->rwnd;
+
+    if (header->bulk)
+    {
+        G_stats.nackRanges += bulkTake(&G_bulk, (uint8_t *)header + HEADER_SIZE, r - HEADER_SIZE, acked,
+                                       header->rwnd, clockNow(), (uint64_t)srtt);
+    }
+    else if (G_bulk.ranges == NULL)
+    {
+        if (bulkStart(&G_bulk, (uint64_t)filelen, bulkKbit, clockNow()) < 0)
+            exit(1);
+        expireBulk(&G_bulkTimer);
+    }
+
+    G_stats.paceRate = G_bulk.rate;
+
+    freeHeader(header);
+}
+
+/**
+ * @brief Send a segment of the file in bulk mode, right from the mapping
+ *
+ * @param offset stream offset
+ * @param len payload bytes
+ */
+void bulkSend(uint64_t offset, uint32_t len)
+{
+    extern uint32_t seqNumber;
+    CrudpHeader_t *header = headerAlloc();
+
+    setDataOffset(header, offset);
+    header->an = G_lastAck.sn;
+    header->wn = MAX_WINDOW_SIZE;
+    header->ack = 1;
+    header->eod = offset + len >= (uint64_t)filelen;
+
+    if (seqAfter(header->sn + len, seqNumber))
+        seqNumber = header->sn + len;
+
+    resendData(G_local, G_remote, header, (uint8_t *)fileBuffer + offset, len);
+    freeHeader(header);
+
+    TRACE("** Send Data: %u\n", len);
+}
+
+/**
+ * @brief Start a multicast session, the sender announces the file and paces it,
+ *        a member takes whatever comes from the first datagram on
+ *
+ */
+void mcastStart()
+{
+    extern uint32_t startSeq;
+
+    G_stats.start = gSnedTime = statsNow();
+    G_mcast.grtt = MCAST_GRTT_INIT_US;
+    srand(time(NULL) ^ getpid());
+
+    if (transmitter)
+    {
+        // the data of a group starts at sequence number 0, a member may join at any offset
+        G_mcast.session = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+        G_lastAck.sn = G_mcast.session;
+        startSeq = UINT32_MAX;
+
+        readFile();
+        if (bulkStart(&G_bulk, (uint64_t)filelen, bulkKbit ? bulkKbit : MCAST_KBIT_DEFAULT, clockNow()) < 0)
+            exit(1);
+        G_stats.paceRate = G_bulk.rate;
+    }
+    else
+    {
+        makeFile();
+    }
+
+    established = 1;
+    timerArm(&G_mcastTimer, timerNow() + 1);
+}
+
+/**
+ * @brief Sender: pace the data and the repairs, announce, end once nobody asks
+ *        Member: NACK after a random backoff what nobody else asked for
+ *
+ * @param timer G_mcastTimer
+ */
+void expireMcast(CrudpTimer_t *timer)
+{
+    uint64_t now = clockNow();
+
+    if (transmitter)
+    {
+        CrudpMcastAnnounce_t announce;
+        uint64_t offset, quiet;
+        uint32_t len;
+        int kind;
+
+        bulkPace(&G_bulk, now);
+        while ((kind = bulkNext(&G_bulk, MAX_WINDOW_SIZE, &offset, &len, now)) > 0)
         {
-            sendTime = getTime();
-            synRecv(G_local, G_remote, header);
-            green();
-            printf("     O : %s Completed\n", CRUDP_fsm_strings_G[*ap]);
-            reset();
+            if (kind == 2)
+                G_stats.retransmissions++;
+            bulkSend(offset, len);
+        }
 
-            free(header);
+        // the members learn the length, and where the data is once the tail went
+        if (now - G_mcast.announcedAt >= MCAST_ANNOUNCE_MS * 1000 || G_bulk.tailAt > G_mcast.announcedAt)
+        {
+            announce = (CrudpMcastAnnounce_t){(uint64_t)filelen, G_bulk.next, (uint32_t)G_mcast.grtt, 0};
+            sendAnnounce(G_local, G_remote, G_mcast.session, &announce, sizeof(announce));
+            G_mcast.announcedAt = now;
         }
-        break;
-        case CRUDP_ACTION_SND_ACK:
+
+        quiet = G_mcast.nackAt > G_bulk.tailAt ? G_mcast.nackAt : G_bulk.tailAt;
+        if (G_bulk.tailAt != 0 && G_bulk.count == 0 && now - quiet > MCAST_LINGER_MS * 1000)
+        {
+            mcastEnd();
+            return;
+        }
+    }
+    else
+    {
+        uint64_t retry = 2 * G_mcast.grtt + BULK_REPORT_MS * 1000;
+        uint32_t due = G_reasm.delivered < G_bulk.highest ? bulkMissing(&G_bulk, &G_reasm, now, retry) : 0;
+
+        // a repair or the NACK of another member came first
+        if (due == 0)
+        {
+            if (G_mcast.nackDue != 0)
+                G_stats.nacksSuppressed++;
+            G_mcast.nackDue = 0;
+        }
+        else if (G_mcast.nackDue == 0)
+        {
+            G_mcast.nackDue = now + mcastBackoff(G_mcast.grtt);
+        }
+        else if (now >= G_mcast.nackDue)
         {
-            sendTime = getTime();
-            estWait(G_local, G_remote, header);
-            green();
-            printf("     O : %s Completed\n", CRUDP_fsm_strings_G[*ap]);
-            reset();
+            CrudpHeader_t *header = headerAlloc();
+            uint32_t n = bulkReport(&G_bulk, &G_reasm, (uint8_t *)header + HEADER_SIZE, MAX_WINDOW_SIZE, now, retry);
+
+            if (n == 0)
+                exit(1);
+
+            // the echo is the latest announce, held this long, the sender measures the group RTT with it
+            sendReport(G_local, G_remote, header, n, (uint32_t)(now - G_mcast.announceAt));
+            G_mcast.nackDue = 0;
+        }
+    }
+
+    timerArm(timer, timerNow() + 1);
+}
+
+/**
+ * @brief Take a datagram of the group
+ *        the sender takes the NACKs of its session, its own datagrams come back with the loop,
+ *        a member takes the data, the announces and the NACKs of the others
+ *
+ * @param header received header
+ */
+void mcastRecv(CrudpHeader_t *header)
+{
+    extern uint32_t tsRecent, seqNumber;
+    uint8_t *payload = (uint8_t *)header + HEADER_SIZE;
+    uint32_t len = r - HEADER_SIZE;
+    uint64_t now = clockNow();
 
-            established = header->fin ? 0 : 1;
+    if (transmitter)
+    {
+        if (header->bulk && header->sn == G_mcast.session)
+        {
+            int idle = G_bulk.count == 0;
 
-            if (header->fin)
+            // the worst member sets the group RTT, it comes down slowly
+            if (header->tsecr != 0 && echoRtt(header->tsecr) > header->rwnd)
             {
-                tcp_state = tcp_new_state;
-                stateHandler(header);
+                uint64_t rtt = echoRtt(header->tsecr) - header->rwnd;
 
-                return;
+                G_mcast.grtt = rtt > G_mcast.grtt ? rtt : (7 * G_mcast.grtt + rtt) / 8;
+                G_stats.srtt = G_mcast.grtt * 1000;
             }
-            free(header);
+
+            G_stats.nackRanges += bulkTake(&G_bulk, payload, len, 0, UINT64_MAX, now, G_mcast.grtt);
+
+            // the NACKs of the members that did not hear this one go with the same repair
+            if (idle && G_bulk.count > 0)
+                G_bulk.repairAt = now + G_mcast.grtt;
+
+            G_mcast.nackAt = now;
+            G_stats.paceRate = G_bulk.rate;
         }
-        break;
-        case CRUDP_SEND_DATA:
-        {
 
-            extern uint32_t startSeq;
+        freeHeader(header);
+        return;
+    }
+
+    if (header->bulk)
+    {
+        bulkHeard(&G_bulk, payload, len, now);
+        freeHeader(header);
+        return;
+    }
+
+    // the first datagram of a sender names the session, the NACKs carry it
+    if (!G_mcast.joined)
+    {
+        G_mcast.session = seqNumber = header->an;
+        G_mcast.joined = 1;
+    }
 
-            currentIndex = (header->an % (startSeq + 1));
+    if (header->an != G_mcast.session)
+    {
+        freeHeader(header);
+        return;
+    }
 
-            int windowSize = header->wn;
-            windowSize ? windowSize : windowSize++;
+    if (header->fin)
+    {
+        ERROR("the sender ended the session before the file was complete");
+        exit(1);
+    }
 
-            unsigned char *dataToSend = (unsigned char *)calloc(1, windowSize);
+    if (header->syn)
+    {
+        if (len >= sizeof(CrudpMcastAnnounce_t))
+        {
+            const CrudpMcastAnnounce_t *announce = (const CrudpMcastAnnounce_t *)payload;
 
-            /* Send the file */
+            tsRecent = header->ts;
+            G_mcast.announceAt = now;
+            G_mcast.grtt = announce->grtt;
 
-            for (unsigned int i = 0; (currentIndex < filelen && i < windowSize); i++, currentIndex++)
+            // the end is known, a lost tail is a hole like any other
+            bulkReceived(&G_bulk, announce->sent, 0);
+            if (reasmInsert(&G_reasm, announce->size, packetOf(header), payload, 0, 1) < 0)
             {
-                dataToSend[i] = *((char *)fileBuffer + currentIndex);
+                ERROR("mcastRecv(): reasmInsert() problem");
+                exit(1);
             }
+        }
+    }
+    else
+    {
+        bulkReceived(&G_bulk, dataOffset(header, dataSeq), len);
+        recvSegment(header);
+    }
 
-            sendTime = getTime();
-            int r = sendData(G_local, G_remote, header, dataToSend, currentIndex >= filelen);
+    freeHeader(header);
+
+    if (G_reasm.end != REASM_END_UNKNOWN && G_reasm.delivered >= G_reasm.end)
+        mcastEnd();
+}
 
-            green();
-            printf("     O : %s Completed\n", CRUDP_fsm_strings_G[*ap]);
-            printf("** Send Total: %d bytes\n   Send Data: %d\n   Data: %s\n", r, r - HEADER_SIZE, dataToSend);
-            reset();
+/**
+ * @brief End the session, the sender with its FINs, a member once the file is complete
+ *
+ */
+void mcastEnd()
+{
+    timerCancel(&G_mcastTimer);
 
-            free(header);
+    if (transmitter)
+    {
+        for (int i = 0; i < MCAST_FINS; i++)
+            sendGroupFin(G_local, G_remote, G_mcast.session);
+    }
+    else
+    {
+        if (reasmDrain(&G_reasm) < 0)
+        {
+            ERROR("reasmDrain() problem");
+            exit(1);
         }
-        break;
-        case CRUDP_RECV_DATA:
+
+        reasmFree(&G_reasm);
+        close(fileToSave);
+    }
+
+    bulkFree(&G_bulk);
+    actionCloseSocket(NULL);
+}
+
+/**
+ * @brief Send while the receiver has room, with nothing in flight one segment
+ *        always goes, it probes a closed window
+ *        a stream is read straight into the packets of the send ring,
+ *        until its source has nothing more for now
+ *        every segment goes on the path the scheduler picks, while one has room
+ *
+ * @param header latest ACK
+ */
+void fillWindow(const CrudpHeader_t *header)
+{
+    extern int treeMode, muxMode;
+    CrudpSegment_t *segment;
+    int path;
+
+    uint32_t window = header->rwnd;
+
+    int windowSize = header->wn;
+    windowSize ? windowSize : windowSize++;
+    if (windowSize > MAX_WINDOW_SIZE)
+        windowSize = MAX_WINDOW_SIZE;
+
+    while (!eodSent && (path = pathSchedule()) >= 0 && (segment = ringPush(&G_sendRing)) != NULL)
+    {
+        segment->offset = currentIndex;
+        segment->len = muxMode ? (windowSize < MUX_ROOM_MIN ? MUX_ROOM_MIN : windowSize)
+                     : streamSource ? windowSize
+                     : currentIndex < filelen ? (filelen - currentIndex < windowSize ? filelen - currentIndex : windowSize) : 0;
+
+        if (ringCount(&G_sendRing) > 1 && currentIndex + segment->len - ackedOffset > window)
         {
-            extern uint32_t ackNumber;
+            ringUnpush(&G_sendRing);
+            break;
+        }
 
-            unsigned int dataSize = r - HEADER_SIZE;
-            unsigned char *recvedData = (unsigned char *)calloc(1, dataSize + 1); // this code is for testing
-            /* Receive the file */
+        // the source closing is the end of the stream, an empty EOD segment tells it
+        if (streamSource)
+        {
+            ssize_t n = read(streamFd, segment->packet->bytes + HEADER_SIZE, segment->len);
 
-            for (unsigned int i = HEADER_SIZE, j = 0; i < r; i++, j++)
+            if (n < 0)
             {
-                recvedData[j] = *((char *)bytes + i);
+                ringUnpush(&G_sendRing);
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                    break;
+                perror("fillWindow(): read()");
+                exit(1);
             }
 
-            recvedData[dataSize] = '\0';
+            segment->len = (uint32_t)n;
+            segment->payload = segment->packet->bytes + HEADER_SIZE;
+            filelen += n;
+            eodSent = n == 0;
+        }
+        // every stream finished, an empty EOD segment ends the connection stream
+        else if (muxMode)
+        {
+            segment->len = muxFill(&G_mux, segment->packet->bytes + HEADER_SIZE, segment->len);
+            segment->payload = segment->packet->bytes + HEADER_SIZE;
+            filelen += segment->len;
+            eodSent = segment->len == 0;
+        }
+        else
+        {
+            segment->payload = treeMode ? manifestData(&G_tree, currentIndex, segment->len, segment->packet->bytes + HEADER_SIZE)
+                                        : (uint8_t *)fileBuffer + currentIndex;
+            eodSent = currentIndex + segment->len >= filelen;
+        }
 
-            if (header->sn == ackNumber)
-            {
-                green();
-                printf("** Recv Total: %d bytes\n   Recv Data: %d bytes\n   Data: %s\n", r, dataSize, recvedData);
-                writeFile((char *)recvedData);
+        /* Send the file */
+        segment->transmissions = 1;
+        segment->path = path;
+        segment->header->mp = path != 0;
+        currentIndex += segment->len;
+        pathSent(path, segment->len);
 
-                printf("     O : %s Completed\n", CRUDP_fsm_strings_G[*ap]);
-                reset();
-            }
-            else
-            {
-                yellow();
-                printf("** Recv Total: %d bytes\n   Recv Data: %d bytes\n   Data: %s - Abandoned due to duplication\n", r, dataSize, recvedData);
-                reset();
-            }
+        sendData(G_paths[path].local, G_paths[path].remote, header, segment->header, segment->offset, segment->payload,
+                 segment->len, eodSent);
+
+        TRACE("** Send Data: %u\n", segment->len);
+    }
+}
 
-            free(recvedData);
+/**
+ * @brief Keep a stream moving between ACKs
+ *        the transmitter sends what its source produced since,
+ *        the receiver writes what its output could not take and
+ *        advertises the window that opens
+ */
+void streamPoll()
+{
+    if (!established)
+        return;
 
-            sendTime = getTime();
-            recvData(G_local, G_remote, header, rto_incr);
+    if (transmitter && streamSource && !eodSent && G_lastAck.ack)
+    {
+        int idle = ringCount(&G_sendRing) == 0;
 
-            free(header);
+        fillWindow(&G_lastAck);
+        if (idle && ringCount(&G_sendRing) > 0)
+        {
+            armRTO();
+            armTLP();
         }
-        break;
-        case CRUDP_ACTION_SND_FIN:
-        { // Read last data
-            extern uint32_t ackNumber;
-            unsigned int dataSize = r - HEADER_SIZE;
-            unsigned char *recvedData = (unsigned char *)calloc(1, dataSize + 1); // this code is for testing
-            /* Receive the file */
-
-            for (unsigned int i = HEADER_SIZE, j = 0; i < r; i++, j++)
-            {
-                recvedData[j] = *((char *)bytes + i);
-            }
+    }
 
-            recvedData[dataSize] = '\0';
+    if (receiver && G_reasm.blocked)
+    {
+        extern uint32_t ackNumber, recvWindow;
+        int moved = reasmFlush(&G_reasm);
 
-            if (receiver)
-            {
-                if (header->sn == ackNumber)
-                {
-                    green();
-                    printf("** Recv Total: %d bytes\n   Recv Data: %d bytes\n   Data: %s\n", r, dataSize, recvedData);
-                    writeFile((char *)recvedData);
-
-                    printf("     O : %s Completed\n", CRUDP_fsm_strings_G[*ap]);
-                    reset();
-                }
-                else
-                {
-                    yellow();
-                    printf("** Recv Total: %d bytes\n   Recv Data: %d bytes\n   Data: %s - Abandoned due to duplication\n", r, dataSize, recvedData);
-                    reset();
-                }
-            }
+        if (moved < 0)
+        {
+            ERROR("streamPoll(): reasmFlush() problem");
+            exit(1);
+        }
+
+        if (moved)
+        {
+            G_stats.payloadDelivered = G_reasm.delivered;
+            ackNumber = dataSeq + (uint32_t)G_reasm.delivered;
+            recvWindow = reasmWindow(&G_reasm, recvWn);
+            G_stats.rwnd = recvWindow;
+            sendWindow(G_local, G_remote, recvWn);
+        }
+    }
+}
+
+/**
+ * @brief Map the file to send, segments point into the mapping
+ *        so the payload is never copied in user space
+ */
+void readFile()
+{
+    extern int treeMode, muxMode;
+    struct stat st;
+    int fd;
+
+    // the frames are built as the segments go, the length is known at the end
+    if (muxMode)
+    {
+        if (muxBuild(&G_mux, sources, sourceCount, urgencies) < 0)
+        {
+            printf("File path/name is wrong\n");
+            exit(1);
+        }
+
+        filelen = 0;
+        return;
+    }
+
+    if (treeMode)
+    {
+        if (manifestBuild(&G_tree, filename, MAX_WINDOW_SIZE) < 0)
+        {
+            printf("Directory could not be read\n");
+            exit(1);
+        }
+
+        filelen = G_tree.length;
+        return;
+    }
+
+    // read as the segments go, a FIFO is opened once it has a writer
+    if (streamSource)
+    {
+        int flags;
+
+        streamFd = strcmp(filename, "-") ? open(filename, O_RDONLY) : STDIN_FILENO;
+        if (streamFd < 0 || (flags = fcntl(streamFd, F_GETFL)) < 0 ||
+            fcntl(streamFd, F_SETFL, flags | O_NONBLOCK) < 0)
+        {
+            perror("readFile(): stream");
+            exit(1);
+        }
+
+        filelen = 0;
+        return;
+    }
+
+    fd = open(filename, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        printf("File path/name is wrong\n");
+        exit(1);
+    }
 
-            if (transmitter)
+    filelen = st.st_size;
+
+    // the page cache has no huge pages to give, a pre-fault maps the whole file at once
+    if (filelen > 0 && (fileBuffer = mmap(NULL, filelen, PROT_READ, MAP_PRIVATE | (arenaPrefaulted() ? MAP_POPULATE : 0),
+                                          fd, 0)) != MAP_FAILED)
+    {
+        fileMapped = 1;
+        madvise(fileBuffer, filelen, MADV_SEQUENTIAL);
+    }
+    else
+    {
+        // not mappable, read it instead
+        if ((fileBuffer = (char *)arenaAlloc(filelen)) == NULL)
+            exit(1);
+        for (long n = 0, r; n < filelen; n += r)
+        {
+            if ((r = read(fd, fileBuffer + n, filelen - n)) <= 0)
             {
-                green();
-                printf("     O : %s Completed\n", CRUDP_fsm_strings_G[*ap]);
-                reset();
-                free(recvedData);
-                free(fileBuffer);
+                perror("readFile(): read()");
+                exit(1);
             }
+        }
+    }
+
+    close(fd);
+}
+
+/**
+ * @brief Release the file sent, once no delayed packet points into it
+ *
+ */
+void releaseFile()
+{
+    extern int treeMode, muxMode;
 
-            // send fin
-            sendTime = getTime();
-            sendFin(G_local, G_remote, header);
+    if (treeMode)
+        manifestFree(&G_tree);
+    if (muxMode)
+        muxFree(&G_mux);
+
+    if (streamFd >= 0)
+    {
+        close(streamFd);
+        streamFd = -1;
+    }
 
-            if (receiver)
-                fclose(fileToSave);
+    if (fileBuffer == NULL)
+        return;
 
-            established = 0;
-            free(header);
-        }
-        break;
-        case CRUDP_ACTION_CLOSE_SOCKET:
-            gEndTime = (double) clock()  / CLOCKS_PER_SEC;
-            closeUdp(G_local);
-            closeUdp(G_remote);
-            green();
-            printf("     O : %s Completed\n", CRUDP_fsm_strings_G[*ap]);
-            reset();
-            
-            printf("\n\n%lf\n\n", gEndTime -gSnedTime);
+    if (fileMapped)
+        munmap(fileBuffer, filelen);
+    else
+        arenaFree(fileBuffer, filelen);
+
+    fileBuffer = NULL;
+}
+
+/**
+ * @brief Read ports, output file and minimum RTO (ms) from the environment
+ *        so that both ends can run on one host
+ */
+void readConfig()
+{
+    char *value;
+    int hugePages = ARENA_PAGES, prefault = 0;
+
+    if ((value = getenv("CRUDP_PORT")) != NULL)
+        myPort = (uint16_t)atoi(value);
+
+    peerPort = myPort;
+    if ((value = getenv("CRUDP_PEER_PORT")) != NULL)
+        peerPort = (uint16_t)atoi(value);
+
+    if ((value = getenv("CRUDP_OUTPUT")) != NULL)
+        saveFile = saveTree = value;
+
+    // The data takes stdout over, the messages move to stderr before the first one
+    if (!strcmp(saveFile, "-"))
+    {
+        if ((streamOut = dup(STDOUT_FILENO)) < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0)
+        {
+            perror("readConfig(): dup()");
             exit(0);
-        default:
-            printf("Did not set the state!\n");
-            break;
         }
     }
-    printf("\n");
 
-    tcp_state = tcp_new_state;
+    if ((value = getenv("CRUDP_TRACE")) != NULL)
+        trace = atoi(value);
+
+    if ((value = getenv("CRUDP_RTO_MIN")) != NULL)
+        rtoMin = (uint64_t)atol(value) * 1000;
+
+    if ((value = getenv("CRUDP_REASM_BYTES")) != NULL)
+        reasmBytes = (uint32_t)atol(value);
+
+    if ((value = getenv("CRUDP_ZEROCOPY")) != NULL)
+        zerocopyMin = (uint32_t)atol(value);
+
+    if ((value = getenv("CRUDP_BULK")) != NULL)
+        bulkKbit = (uint64_t)atoll(value);
+
+    // Buffers on 2 MB pages, 1 advised to THP, 2 from hugetlbfs, and all of them faulted in at start
+    if ((value = getenv("CRUDP_HUGEPAGES")) != NULL)
+        hugePages = atoi(value);
+    if ((value = getenv("CRUDP_PREFAULT")) != NULL)
+        prefault = atoi(value);
+    arenaSetup(hugePages, prefault);
+
+    mcastIf = getenv("CRUDP_MCAST_IF");
+    if ((value = getenv("CRUDP_MCAST_TTL")) != NULL)
+        mcastTtl = atoi(value);
+
+    xdpSpec = getenv("CRUDP_XDP");
+
+    urgencies = getenv("CRUDP_URGENCY");
+
+    pathSpec = getenv("CRUDP_PATHS");
+    schedulerName = getenv("CRUDP_SCHEDULER");
+
+    // Run in lock step with CrudpSimulator, on its clock and its packets
+    if ((value = getenv("CRUDP_SIM")) != NULL && simInit(value) < 0)
+    {
+        ERROR("CRUDP_SIM problem");
+        exit(0);
+    }
+
+    if ((value = getenv("CRUDP_SYN_COOKIES")) != NULL && atoi(value) && cookieInit() == 0)
+        synCookies = 1;
+
+    // Seal every datagram after the SYNs, CRUDP_AEAD=chacha20-poly1305 rules out AES-256-GCM
+    if ((value = getenv("CRUDP_PSK")) != NULL && aeadInit(value, getenv("CRUDP_AEAD")) < 0)
+    {
+        ERROR("CRUDP_PSK or CRUDP_AEAD problem");
+        exit(0);
+    }
+
+    // Both ends impair their own packets, the port keeps their streams apart
+    if (impairInit(getenv("CRUDP_IMPAIR"), myPort) < 0)
+    {
+        ERROR("CRUDP_IMPAIR problem");
+        exit(0);
+    }
+}
+
+void makeFile()
+{
+    extern uint32_t recvWindow, windowSize;
+    extern int treeMode, muxMode;
+
+    // Every stream is written as its segments come, the connection stream only acknowledges them
+    if (muxMode)
+    {
+        if (muxOpen(&G_mux, saveTree, reasmBytes) < 0 || reasmInit(&G_reasm, -1, reasmBytes) < 0)
+        {
+            printf("File Generate Fail...\n");
+            exit(1);
+        }
+
+        G_reasm.sink = muxSink;
+        G_reasm.sinkContext = &G_mux;
+    }
+    // A tree is unpacked by the manifest, the reassembly buffer writes through it
+    else if (treeMode)
+    {
+        if (manifestOpen(&G_tree, saveTree) < 0 || reasmInit(&G_reasm, -1, reasmBytes) < 0)
+        {
+            printf("File Generate Fail...\n");
+            exit(1);
+        }
+
+        G_reasm.sink = manifestWrite;
+        G_reasm.sinkContext = &G_tree;
+    }
+    // A full pipe keeps the bytes in the reassembly buffer, its window closes
+    else if (streamOut >= 0)
+    {
+        int flags = fcntl(streamOut, F_GETFL);
+
+        fileToSave = streamOut;
+        if (flags < 0 || fcntl(fileToSave, F_SETFL, flags | O_NONBLOCK) < 0 ||
+            reasmInit(&G_reasm, fileToSave, reasmBytes) < 0)
+        {
+            printf("File Generate Fail...\n");
+            exit(1);
+        }
+    }
+    else if ((fileToSave = open(saveFile, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0 ||
+             reasmInit(&G_reasm, fileToSave, reasmBytes) < 0)
+    {
+        printf("File Generate Fail...\n");
+        exit(1);
+    }
+    else
+    {
+        TRACE("File Generate Done\n");
+    }
+
+    // every packet out of order data may hold, faulted in before the first one comes
+    if (arenaPrefaulted() && poolReserve(G_reasm.maxHelds) < 0)
+        exit(1);
+
+    // advertised with the ACK of the SYN,ACK
+    recvWindow = reasmWindow(&G_reasm, windowSize);
 }
 
 /**
- * @brief Read file and set established flag
+ * @brief Put the received segment in the reassembly buffer
+ *        and acknowledge every byte written in order
  *
+ * @param header received header
+ * @return int 1 if it brought new bytes, 0 for a duplicate
  */
-void setupTransfer()
+int recvSegment(CrudpHeader_t *header)
 {
-    printf("** New state: %s\n", CRUDP_fsm_strings_G[tcp_new_state]);
-    printf("   Actions executed by CRUDP:\n");
-    printf("     R : Read file - %s\n", filename);
-    if (transmitter)
-        readFile();
-    green();
-    printf("     O : Read file Completed - %s | %ld bytes \n\n", filename, filelen);
-    reset();
-    established = 1;
-    tcp_state = tcp_new_state;
+    extern uint32_t ackNumber, recvWindow;
+    extern int treeMode, muxMode;
+
+    unsigned int dataSize = r - HEADER_SIZE;
+    uint8_t *data = (uint8_t *)header + HEADER_SIZE;
+    int fresh;
+
+    // file data can only be put in place once the manifest is known
+    if (treeMode)
+        G_reasm.seekable = G_tree.ready;
+
+    fresh = reasmInsert(&G_reasm, dataOffset(header, dataSeq), packetOf(header), data, dataSize, header->eod);
+
+    // a stream does not wait for the holes of the others
+    if (fresh > 0 && muxMode && dataSize > 0 && muxReceive(&G_mux, packetOf(header), data, dataSize) < 0)
+        fresh = -1;
+
+    if (fresh < 0)
+    {
+        ERROR("recvSegment(): reasmInsert() problem");
+        exit(1);
+    }
+
+    if (fresh)
+    {
+        TRACE("** Recv Data: %u\n", dataSize);
+    }
+    else
+    {
+        TRACE("** Recv Data: %u - Abandoned due to duplication\n", dataSize);
+        G_stats.duplicates++;
+    }
+
+    G_stats.payloadDelivered = G_reasm.delivered;
+    ackNumber = dataSeq + (uint32_t)G_reasm.delivered;
+    recvWindow = reasmWindow(&G_reasm, header->wn);
+    recvWn = header->wn;
+
+    return fresh;
+}
+
+/**
+ * @brief Open socket for the FQDN given on the command line
+ *
+ * @param header NULL, a local input
+ */
+void actionOpenSocket(CrudpHeader_t *header)
+{
+    makeSocket(remote);
 }
 
 /**
- * @brief Get the Time object
+ * @brief Send SYN
  *
- * @return struct timespec
+ * @param header NULL, a local input
  */
-struct timespec getTime()
+void actionSndSyn(CrudpHeader_t *header)
 {
-    struct timespec t;
+    synSend(G_local, G_remote);
+}
+
+/**
+ * @brief Answer a SYN, the SYN,ACK is the last datagram in the clear
+ *
+ * @param header received SYN
+ */
+void actionSndSynAck(CrudpHeader_t *header)
+{
+    extern uint32_t startSeq;
+
+    synRecv(G_local, G_remote, header);
+
+    aeadPeerCaps(header->wn);
+    aeadPeerHello((const uint8_t *)header + HEADER_SIZE);
+    aeadStart(startSeq, header->sn, 1);
+
+    freeHeader(header);
+}
+
+/**
+ * @brief Acknowledge a SYN,ACK or a FIN
+ *        a FIN goes on to the state it leads to
+ *
+ * @param header received header
+ */
+void actionSndAck(CrudpHeader_t *header)
+{
+    extern uint32_t ackNumber, startSeq;
+    extern int treeMode, muxMode, bulkMode;
 
-    if (clock_gettime(CLOCK_REALTIME, &t) == 0)
+    // The receiver seals from the ACK of the SYN,ACK on,
+    // and the SYN,ACK tells whether a file, a tree or several streams come
+    // and whether to report losses instead of acknowledging
+    if (header->syn && header->ack)
     {
-        return t;
+        aeadPeerCaps(header->wn);
+        aeadPeerHello((const uint8_t *)header + HEADER_SIZE);
+        aeadStart(header->sn, startSeq, 0);
+
+        treeMode = header->tree;
+        muxMode = header->mux;
+        bulkMode = header->bulk;
+        makeFile();
+
+        if (bulkMode)
+            timerArm(&G_bulkTimer, timerNow() + BULK_REPORT_MS);
     }
 
-    printf("clock_gettime error");
+    estWait(G_local, G_remote, header);
+
+    established = header->fin ? 0 : 1;
+
+    // The data of the transmitter starts right after its SYN
+    if (receiver && tcp_new_state == CRUDP_STATE_ESTABLISHED)
+        dataSeq = ackNumber;
 
-    return t;
+    if (header->fin)
+    {
+        tcp_state = tcp_new_state;
+        stateHandler(header);
+
+        return;
+    }
+    freeHeader(header);
 }
 
 /**
- * @brief set RTO
+ * @brief Release what the ACK covers and send what the window allows
  *
+ * @param header received ACK
  */
-void setRTO()
+void actionSendData(CrudpHeader_t *header)
 {
-    if (!vn)
+    extern uint32_t startSeq;
+    extern int bulkMode;
+
+    if (bulkMode)
     {
-        vn = labs(endTime.tv_sec - sendTime.tv_sec) * 1000000000;
-        vn += labs(endTime.tv_nsec - sendTime.tv_nsec) / 2;
-        rn = vn * 2;
-        sn = vn;
-        tn = sn + 4 * vn;
+        bulkAck(header);
+        return;
     }
 
-    else
+    // The data starts right after the SYN,ACK, past 4 GiB the ACK is told by the one before
+    uint64_t acked = seqUnwrap(ackedOffset, header->an - (startSeq + 1));
+    uint32_t released;
+    uint32_t window = header->rwnd;
+    int idle = ringCount(&G_sendRing) == 0;
+
+    if (acked > ackedOffset)
+        ackedOffset = acked;
+
+    rackAck(header);
+    checkSpurious(header, acked);
+    released = ringRelease(&G_sendRing, acked);
+
+    G_stats.payloadDelivered = acked;
+    G_stats.rwnd = window;
+
+    int windowSize = header->wn;
+    windowSize ? windowSize : windowSize++;
+    if (windowSize > MAX_WINDOW_SIZE)
+        windowSize = MAX_WINDOW_SIZE;
+    G_stats.cwnd = window < G_SEND_RING * (uint32_t)windowSize ? window : G_SEND_RING * (uint32_t)windowSize;
+
+    fillWindow(header);
+    G_lastAck = *header;
+
+    // A partial ACK after a timeout points at the next hole, fill it right away
+    if (released > 0 && acked < recoverPoint && ringCount(&G_sendRing) > 0)
+        resendSegment(ringFront(&G_sendRing), 1);
+
+    // A later segment arrived, what was sent a reordering window before it is lost
+    rackDetect();
+
+    // A new acknowledgement ends the backoff, the timer follows the oldest segment
+    if (released > 0)
+        rtoBackoff = 0;
+    if ((released > 0 || idle) && ringCount(&G_sendRing) > 0)
+        armRTO();
+    armTLP();
+
+    freeHeader(header);
+}
+
+/**
+ * @brief Take a data segment and acknowledge it
+ *
+ * @param header received segment
+ */
+void actionRecvData(CrudpHeader_t *header)
+{
+    extern uint32_t recvWindow;
+    extern int bulkMode;
+
+    recvSegment(header);
+
+    G_stats.cwnd = header->wn;
+    G_stats.rwnd = recvWindow;
+
+    // the reports acknowledge in bulk mode
+    if (bulkMode)
+    {
+        bulkReceived(&G_bulk, dataOffset(header, dataSeq), r - HEADER_SIZE);
+        freeHeader(header);
+        return;
+    }
+
+    // the ACK of a sub-path goes back on it, its RTT is measured that way
+    recvData(G_local, header->mp ? &G_from : G_remote, header, rto_incr);
+
+    freeHeader(header);
+}
+
+/**
+ * @brief Send FIN, the receiver takes the last data first
+ *
+ * @param header received header
+ */
+void actionSndFin(CrudpHeader_t *header)
+{
+    if (receiver)
+    {
+        recvSegment(header);
+
+        // the FIN goes once the output took everything
+        if (reasmDrain(&G_reasm) < 0)
+        {
+            ERROR("reasmDrain() problem");
+            exit(1);
+        }
+
+        // and acknowledges the whole stream
+        extern uint32_t ackNumber;
+        ackNumber = dataSeq + (uint32_t)G_reasm.delivered;
+    }
+
+    if (transmitter)
+        ringFree(&G_sendRing);
+    timerCancel(&G_bulkTimer);
+    bulkFree(&G_bulk);
+
+    // send fin
+    sendFin(G_local, G_remote, header);
+
+    if (receiver)
     {
-        long newRtt = labs(endTime.tv_sec - sendTime.tv_sec) * 1000000000;
-        newRtt += labs(endTime.tv_nsec - sendTime.tv_nsec);
+        extern int treeMode, muxMode;
 
-        vn = 0.75f * vn + 0.25f * labs(sn - newRtt);
-        sn = 0.875f * sn + 0.125f * newRtt;
-        tn = sn + 4 * vn;
+        reasmFree(&G_reasm);
+        if (treeMode)
+        {
+            manifestFree(&G_tree);
+        }
+        else if (muxMode)
+        {
+            // when every stream was complete, from the start of the transfer
+            for (uint32_t i = 0; i < G_mux.count; i++)
+            {
+                if (G_mux.streams[i].done)
+                    printf("stream %u: %s %" PRIu64 " bytes %lf\n", i, G_mux.streams[i].name,
+                           G_mux.streams[i].size, G_mux.streams[i].doneAt / 1e6 - G_stats.start);
+            }
+            muxFree(&G_mux);
+        }
+        else
+        {
+            close(fileToSave);
+        }
     }
 
-    urto = tn;
+    established = 0;
+    freeHeader(header);
+}
+
+/**
+ * @brief Close the connection and exit
+ *
+ * @param header last header, if any
+ */
+void actionCloseSocket(CrudpHeader_t *header)
+{
+    gEndTime = statsNow();
+    impairFlush();
+    zerocopyDrain();
+    releaseFile();
+    xdpClose();
+    pathClose();
+    closeUdp(G_local);
+    closeUdp(G_remote);
+
+    printf("\n\n%lf\n\n", gEndTime - gSnedTime);
+
+    for (int i = 0; pathCount() > 1 && i < pathCount(); i++)
+        printf("path %d: %" PRIu64 " segments %" PRIu64 " bytes %" PRIu64 " lost srtt %.3f ms\n", i,
+               G_paths[i].segments, G_paths[i].bytes, G_paths[i].lost, G_paths[i].srtt / 1000.0);
+
+    statsClose();
+    exit(0);
+}
+
+/**
+ * @brief Wait 2MSL in TIME_WAIT before closing
+ *
+ * @param header received FIN
+ */
+void actionStart2MSL(CrudpHeader_t *header)
+{
+    timerArm(&G_timeWaitTimer, timerNow() + G_TIME_WAIT_MS);
 }
 
-void green()
+/**
+ * @brief Read file and set established flag, the transfer starts here
+ *
+ * @param header ACK of the SYN,ACK, left to the next action
+ */
+void setupTransfer(CrudpHeader_t *header)
 {
-    printf("\033[0;32m");
+    G_stats.start = gSnedTime = statsNow();
+
+    if (transmitter)
+    {
+        readFile();
+        if (ringInit(&G_sendRing, G_SEND_RING * pathCount()) < 0 ||
+            (arenaPrefaulted() && poolReserve(G_sendRing.size) < 0))
+            exit(1);
+        G_sendRing.release = releaseSegment;
+    }
+    TRACE("   Read file - %s | %ld bytes\n", filename, filelen);
+    established = 1;
 }
 
-void yellow()
+/**
+ * @brief Update SRTT, RTTVAR and RTO with a new sample (RFC 6298)
+ *
+ * @param rtt round trip time in microseconds
+ */
+void setRTO(uint32_t rtt)
 {
-    printf("\033[0;33m");
+    if (!rttSampled)
+    {
+        srtt = rtt;
+        rttvar = rtt / 2;
+        rttSampled = 1;
+    }
+    else
+    {
+        rttvar = (3 * rttvar + labs(srtt - (long)rtt)) / 4;
+        srtt = (7 * srtt + (long)rtt) / 8;
+    }
+
+    if (minRtt == 0 || rtt < minRtt)
+        minRtt = rtt;
+
+    rto = srtt + (4 * rttvar > G_CLOCK_US ? 4 * rttvar : G_CLOCK_US);
+
+    if (rto < rtoMin)
+        rto = rtoMin;
+    if (rto > G_RTO_MAX_MS * 1000)
+        rto = G_RTO_MAX_MS * 1000;
+
+    G_stats.srtt = srtt * 1000;
+    G_stats.rttvar = rttvar * 1000;
+    G_stats.rto = rto * 1000;
 }
 
-void reset()
+/**
+ * @brief Tell whether retransmissions were needed (RFC 3522)
+ *        on the first ACK covering a segment sent again, before it is released:
+ *        the original transmission arrived if the echo is not after its timestamp
+ *
+ * @param header received ACK
+ * @param acked stream offset the ACK acknowledges
+ */
+void checkSpurious(const CrudpHeader_t *header, uint64_t acked)
 {
-    printf("\033[0m");
+    int spurious = 0;
+
+    if (header->tsecr == 0)
+        return;
+
+    for (uint32_t i = 0; i < ringCount(&G_sendRing); i++)
+    {
+        CrudpSegment_t *segment = ringAt(&G_sendRing, i);
+
+        if (segment->len == 0 || segment->offset + segment->len > acked)
+            break;
+
+        if (segment->transmissions > 1 && !seqAfter(header->tsecr, segment->firstTs))
+        {
+            G_stats.spurious++;
+            spurious = 1;
+        }
+    }
+
+    // The RTO was not too short for the path, undo the backoff,
+    // the segment was reordered, not lost, widen the reordering window
+    if (spurious)
+    {
+        rtoBackoff = 0;
+        reoWndMult++;
+        reoWndPersist = 0;
+    }
 }
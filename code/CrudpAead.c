@@ -0,0 +1,1658 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+
+#include <errno.h>
+void perror(const char *s);
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "CrudpAead.h"
+
+// Words are stored as they are in memory, hosts are little-endian
+#define ROTL32(_v, _n) (((_v) << (_n)) | ((_v) >> (32 - (_n))))
+
+#define CHACHA_BLOCK ((uint32_t)64)
+#define CHACHA_WIDE ((uint32_t)8)    // blocks per vector kernel call
+#define CHACHA_WIDE512 ((uint32_t)16) // with 512 bit vectors
+
+#define POLY_MASK44 ((uint64_t)0xfffffffffff)
+#define POLY_MASK42 ((uint64_t)0x3ffffffffff)
+
+#define AEAD_CHACHA_AVX2 ((int)1)
+#define AEAD_CHACHA_AVX512 ((int)2)
+
+int aeadOn = 0;
+int aeadStarted = 0;
+int aeadGcm = 0;     // this CPU does AES-256-GCM
+int aeadPeerGcm = 0; // and the peer said it does too
+int aeadChacha = 0;  // AEAD_CHACHA_* vector kernel
+int aeadDetected = 0;
+
+uint8_t aeadPsk[AEAD_KEY_SIZE];
+CrudpAeadKey_t aeadSendKey, aeadRecvKey;
+uint64_t aeadSendCounter = 0;
+uint8_t aeadHelloNonce[AEAD_NONCE_SIZE], aeadPeerHelloNonce[AEAD_NONCE_SIZE]; // of this end and of the peer
+
+/*
+  ChaCha20 (RFC 8439)
+*/
+
+#define CHACHA_QR(_a, _b, _c, _d) \
+    _a += _b;                     \
+    _d = ROTL32(_d ^ _a, 16);     \
+    _c += _d;                     \
+    _b = ROTL32(_b ^ _c, 12);     \
+    _a += _b;                     \
+    _d = ROTL32(_d ^ _a, 8);      \
+    _c += _d;                     \
+    _b = ROTL32(_b ^ _c, 7);
+
+void chachaSetup(uint32_t state[16], const uint32_t key[8], uint32_t counter, const uint32_t nonce[3])
+{
+    state[0] = 0x61707865;
+    state[1] = 0x3320646e;
+    state[2] = 0x79622d32;
+    state[3] = 0x6b206574;
+    memcpy(state + 4, key, 32);
+    state[12] = counter;
+    memcpy(state + 13, nonce, 12);
+}
+
+/**
+ * @brief One block of key stream
+ *
+ */
+void chachaBlock(const uint32_t state[16], uint8_t out[64])
+{
+    uint32_t x[16];
+
+    memcpy(x, state, sizeof(x));
+
+    for (int i = 0; i < 10; i++)
+    {
+        CHACHA_QR(x[0], x[4], x[8], x[12])
+        CHACHA_QR(x[1], x[5], x[9], x[13])
+        CHACHA_QR(x[2], x[6], x[10], x[14])
+        CHACHA_QR(x[3], x[7], x[11], x[15])
+        CHACHA_QR(x[0], x[5], x[10], x[15])
+        CHACHA_QR(x[1], x[6], x[11], x[12])
+        CHACHA_QR(x[2], x[7], x[8], x[13])
+        CHACHA_QR(x[3], x[4], x[9], x[14])
+    }
+
+    for (int i = 0; i < 16; i++)
+        x[i] += state[i];
+
+    memcpy(out, x, sizeof(x));
+}
+
+#if defined(__x86_64__)
+
+/*
+  8 or 16 blocks at once, vector i holds word i of every block
+*/
+
+#define CHACHA_ROTL_AVX2(_x, _n)                                                                                   \
+    ((_n) == 16  ? _mm256_shuffle_epi8((_x), _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,  \
+                                                             13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2)) \
+     : (_n) == 8 ? _mm256_shuffle_epi8((_x), _mm256_set_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3,  \
+                                                             14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3)) \
+                 : _mm256_or_si256(_mm256_slli_epi32((_x), (_n)), _mm256_srli_epi32((_x), 32 - (_n))))
+
+// AVX-512 rotates in one instruction
+#define CHACHA_ROTL_AVX512(_x, _n) _mm256_rol_epi32((_x), (_n))
+#define CHACHA_ROTL_ZMM(_x, _n) _mm512_rol_epi32((_x), (_n))
+
+// _w is the vector width in bits, 256 or 512
+#define CHACHA_VEC_QR(_w, _rotl, _a, _b, _c, _d)            \
+    _a = _mm##_w##_add_epi32(_a, _b);                       \
+    _d = _rotl(_mm##_w##_xor_si##_w(_d, _a), 16);           \
+    _c = _mm##_w##_add_epi32(_c, _d);                       \
+    _b = _rotl(_mm##_w##_xor_si##_w(_b, _c), 12);           \
+    _a = _mm##_w##_add_epi32(_a, _b);                       \
+    _d = _rotl(_mm##_w##_xor_si##_w(_d, _a), 8);            \
+    _c = _mm##_w##_add_epi32(_c, _d);                       \
+    _b = _rotl(_mm##_w##_xor_si##_w(_b, _c), 7);
+
+#define CHACHA_VEC_ROUNDS(_w, _rotl, _v)                           \
+    for (int i = 0; i < 10; i++)                                   \
+    {                                                              \
+        CHACHA_VEC_QR(_w, _rotl, _v[0], _v[4], _v[8], _v[12])      \
+        CHACHA_VEC_QR(_w, _rotl, _v[1], _v[5], _v[9], _v[13])      \
+        CHACHA_VEC_QR(_w, _rotl, _v[2], _v[6], _v[10], _v[14])     \
+        CHACHA_VEC_QR(_w, _rotl, _v[3], _v[7], _v[11], _v[15])     \
+        CHACHA_VEC_QR(_w, _rotl, _v[0], _v[5], _v[10], _v[15])     \
+        CHACHA_VEC_QR(_w, _rotl, _v[1], _v[6], _v[11], _v[12])     \
+        CHACHA_VEC_QR(_w, _rotl, _v[2], _v[7], _v[8], _v[13])      \
+        CHACHA_VEC_QR(_w, _rotl, _v[3], _v[4], _v[9], _v[14])      \
+    }
+
+static inline __attribute__((always_inline, target("avx2"))) void chacha8Load(__m256i v[16], const uint32_t state[16])
+{
+    for (int i = 0; i < 16; i++)
+        v[i] = _mm256_set1_epi32((int)state[i]);
+
+    v[12] = _mm256_add_epi32(v[12], _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+}
+
+/**
+ * @brief Transpose 8 vectors of 8 words, vector j of the result is 32 bytes of block j
+ *
+ */
+static inline __attribute__((always_inline, target("avx2"))) void chacha8Transpose(__m256i a[8])
+{
+    __m256i t[8], u[8];
+
+    for (int i = 0; i < 8; i += 2)
+    {
+        t[i] = _mm256_unpacklo_epi32(a[i], a[i + 1]);
+        t[i + 1] = _mm256_unpackhi_epi32(a[i], a[i + 1]);
+    }
+
+    for (int i = 0; i < 8; i += 4)
+    {
+        u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+        u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+        u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+        u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        a[i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+        a[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+    }
+}
+
+/**
+ * @brief Add the input words, then xor the key stream of 8 blocks into at most 512 bytes
+ *
+ */
+static inline __attribute__((always_inline, target("avx2"))) void chacha8Store(__m256i v[16], const uint32_t state[16],
+                                                                                const uint8_t *in, uint8_t *out, uint32_t len)
+{
+    __m256i x[16];
+    uint8_t stream[CHACHA_WIDE * CHACHA_BLOCK];
+
+    chacha8Load(x, state);
+    for (int i = 0; i < 16; i++)
+        v[i] = _mm256_add_epi32(v[i], x[i]);
+
+    chacha8Transpose(v);
+    chacha8Transpose(v + 8);
+
+    if (len == CHACHA_WIDE * CHACHA_BLOCK)
+    {
+        for (int j = 0; j < 8; j++)
+        {
+            const __m256i *src = (const __m256i *)(in + j * CHACHA_BLOCK);
+            __m256i *dst = (__m256i *)(out + j * CHACHA_BLOCK);
+
+            _mm256_storeu_si256(dst, _mm256_xor_si256(_mm256_loadu_si256(src), v[j]));
+            _mm256_storeu_si256(dst + 1, _mm256_xor_si256(_mm256_loadu_si256(src + 1), v[j + 8]));
+        }
+        return;
+    }
+
+    for (int j = 0; j < 8; j++)
+    {
+        _mm256_storeu_si256((__m256i *)(stream + j * CHACHA_BLOCK), v[j]);
+        _mm256_storeu_si256((__m256i *)(stream + j * CHACHA_BLOCK + 32), v[j + 8]);
+    }
+
+    for (uint32_t i = 0; i < len; i++)
+        out[i] = in[i] ^ stream[i];
+}
+
+__attribute__((target("avx2"))) void chacha8Avx2(const uint32_t state[16], const uint8_t *in, uint8_t *out, uint32_t len)
+{
+    __m256i v[16];
+
+    chacha8Load(v, state);
+    CHACHA_VEC_ROUNDS(256, CHACHA_ROTL_AVX2, v)
+    chacha8Store(v, state, in, out, len);
+}
+
+__attribute__((target("avx2,avx512f,avx512vl"))) void chacha8Avx512(const uint32_t state[16], const uint8_t *in, uint8_t *out, uint32_t len)
+{
+    __m256i v[16];
+
+    chacha8Load(v, state);
+    CHACHA_VEC_ROUNDS(256, CHACHA_ROTL_AVX512, v)
+    chacha8Store(v, state, in, out, len);
+}
+
+static inline __attribute__((always_inline, target("avx512f"))) void chacha16Load(__m512i v[16], const uint32_t state[16])
+{
+    for (int i = 0; i < 16; i++)
+        v[i] = _mm512_set1_epi32((int)state[i]);
+
+    v[12] = _mm512_add_epi32(v[12], _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+}
+
+/**
+ * @brief Add the input words, then xor the key stream of 16 blocks into at most 1024 bytes
+ *        the words are transposed 4 by 4 within the 128 bit lanes, then the lanes across 4 vectors
+ *
+ */
+static inline __attribute__((always_inline, target("avx512f"))) void chacha16Store(__m512i v[16], const uint32_t state[16],
+                                                                                    const uint8_t *in, uint8_t *out, uint32_t len)
+{
+    __m512i x[16], t[16], q[4][4];
+    uint8_t stream[CHACHA_WIDE512 * CHACHA_BLOCK];
+
+    chacha16Load(x, state);
+    for (int i = 0; i < 16; i++)
+        v[i] = _mm512_add_epi32(v[i], x[i]);
+
+    for (int i = 0; i < 16; i += 2)
+    {
+        t[i] = _mm512_unpacklo_epi32(v[i], v[i + 1]);
+        t[i + 1] = _mm512_unpackhi_epi32(v[i], v[i + 1]);
+    }
+
+    // q[k][o], lane l: words 4k .. 4k + 3 of block 4l + o
+    for (int k = 0; k < 4; k++)
+    {
+        q[k][0] = _mm512_unpacklo_epi64(t[4 * k], t[4 * k + 2]);
+        q[k][1] = _mm512_unpackhi_epi64(t[4 * k], t[4 * k + 2]);
+        q[k][2] = _mm512_unpacklo_epi64(t[4 * k + 1], t[4 * k + 3]);
+        q[k][3] = _mm512_unpackhi_epi64(t[4 * k + 1], t[4 * k + 3]);
+    }
+
+    // v[j] becomes block j
+    for (int o = 0; o < 4; o++)
+    {
+        __m512i a = _mm512_shuffle_i32x4(q[0][o], q[1][o], 0x44), b = _mm512_shuffle_i32x4(q[2][o], q[3][o], 0x44);
+        __m512i c = _mm512_shuffle_i32x4(q[0][o], q[1][o], 0xee), d = _mm512_shuffle_i32x4(q[2][o], q[3][o], 0xee);
+
+        v[o] = _mm512_shuffle_i32x4(a, b, 0x88);
+        v[o + 4] = _mm512_shuffle_i32x4(a, b, 0xdd);
+        v[o + 8] = _mm512_shuffle_i32x4(c, d, 0x88);
+        v[o + 12] = _mm512_shuffle_i32x4(c, d, 0xdd);
+    }
+
+    if (len == CHACHA_WIDE512 * CHACHA_BLOCK)
+    {
+        for (int j = 0; j < 16; j++)
+            _mm512_storeu_si512((void *)(out + j * CHACHA_BLOCK),
+                                _mm512_xor_si512(_mm512_loadu_si512((const void *)(in + j * CHACHA_BLOCK)), v[j]));
+        return;
+    }
+
+    for (int j = 0; j < 16; j++)
+        _mm512_storeu_si512((void *)(stream + j * CHACHA_BLOCK), v[j]);
+
+    for (uint32_t i = 0; i < len; i++)
+        out[i] = in[i] ^ stream[i];
+}
+
+__attribute__((target("avx512f"))) void chacha16Avx512(const uint32_t state[16], const uint8_t *in, uint8_t *out, uint32_t len)
+{
+    __m512i v[16];
+
+    chacha16Load(v, state);
+    CHACHA_VEC_ROUNDS(512, CHACHA_ROTL_ZMM, v)
+    chacha16Store(v, state, in, out, len);
+}
+
+#endif
+
+/**
+ * @brief Xor the key stream from block 'counter' on
+ *
+ */
+void chachaXor(const uint32_t key[8], uint32_t counter, const uint32_t nonce[3], const uint8_t *in, uint8_t *out, uint32_t len)
+{
+    uint32_t state[16];
+    uint8_t stream[CHACHA_BLOCK];
+
+    chachaSetup(state, key, counter, nonce);
+
+#if defined(__x86_64__)
+    // more than 8 blocks take the 512 bit kernel
+    while (aeadChacha == AEAD_CHACHA_AVX512 && len > CHACHA_WIDE * CHACHA_BLOCK)
+    {
+        uint32_t n = len < CHACHA_WIDE512 * CHACHA_BLOCK ? len : CHACHA_WIDE512 * CHACHA_BLOCK;
+
+        chacha16Avx512(state, in, out, n);
+
+        state[12] += CHACHA_WIDE512;
+        in += n;
+        out += n;
+        len -= n;
+    }
+
+    // the tail goes through the vector kernel too, a segment is only ~22 blocks
+    while (aeadChacha && len > CHACHA_BLOCK)
+    {
+        uint32_t n = len < CHACHA_WIDE * CHACHA_BLOCK ? len : CHACHA_WIDE * CHACHA_BLOCK;
+
+        if (aeadChacha == AEAD_CHACHA_AVX512)
+            chacha8Avx512(state, in, out, n);
+        else
+            chacha8Avx2(state, in, out, n);
+
+        state[12] += CHACHA_WIDE;
+        in += n;
+        out += n;
+        len -= n;
+    }
+#endif
+
+    while (len > 0)
+    {
+        uint32_t n = len < CHACHA_BLOCK ? len : CHACHA_BLOCK;
+
+        chachaBlock(state, stream);
+        for (uint32_t i = 0; i < n; i++)
+            out[i] = in[i] ^ stream[i];
+
+        state[12]++;
+        in += n;
+        out += n;
+        len -= n;
+    }
+}
+
+/*
+  Poly1305, 44+44+42 bit limbs
+*/
+
+typedef struct PolyState_s
+{
+    uint64_t r[3], s[2], h[3];
+} PolyState_t;
+
+void polyInit(PolyState_t *st, const uint8_t key[32])
+{
+    uint64_t t0, t1;
+
+    memcpy(&t0, key, 8);
+    memcpy(&t1, key + 8, 8);
+
+    st->r[0] = t0 & 0xffc0fffffff;
+    st->r[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffff;
+    st->r[2] = (t1 >> 24) & 0x00ffffffc0f;
+
+    memcpy(&st->s[0], key + 16, 8);
+    memcpy(&st->s[1], key + 24, 8);
+
+    st->h[0] = st->h[1] = st->h[2] = 0;
+}
+
+/**
+ * @brief Absorb whole 16 byte blocks
+ *
+ */
+void polyBlocks(PolyState_t *st, const uint8_t *m, uint32_t len)
+{
+    typedef unsigned __int128 u128;
+
+    uint64_t r0 = st->r[0], r1 = st->r[1], r2 = st->r[2];
+    uint64_t s1 = r1 * (5 << 2), s2 = r2 * (5 << 2);
+    uint64_t h0 = st->h[0], h1 = st->h[1], h2 = st->h[2];
+
+    for (; len >= 16; m += 16, len -= 16)
+    {
+        uint64_t t0, t1, c;
+        u128 d0, d1, d2;
+
+        memcpy(&t0, m, 8);
+        memcpy(&t1, m + 8, 8);
+
+        h0 += t0 & POLY_MASK44;
+        h1 += ((t0 >> 44) | (t1 << 20)) & POLY_MASK44;
+        h2 += ((t1 >> 24) & POLY_MASK42) | ((uint64_t)1 << 40);
+
+        d0 = (u128)h0 * r0 + (u128)h1 * s2 + (u128)h2 * s1;
+        d1 = (u128)h0 * r1 + (u128)h1 * r0 + (u128)h2 * s2;
+        d2 = (u128)h0 * r2 + (u128)h1 * r1 + (u128)h2 * r0;
+
+        c = (uint64_t)(d0 >> 44);
+        h0 = (uint64_t)d0 & POLY_MASK44;
+        d1 += c;
+        c = (uint64_t)(d1 >> 44);
+        h1 = (uint64_t)d1 & POLY_MASK44;
+        d2 += c;
+        c = (uint64_t)(d2 >> 42);
+        h2 = (uint64_t)d2 & POLY_MASK42;
+        h0 += c * 5;
+        c = h0 >> 44;
+        h0 &= POLY_MASK44;
+        h1 += c;
+    }
+
+    st->h[0] = h0;
+    st->h[1] = h1;
+    st->h[2] = h2;
+}
+
+/*
+  Poly1305 over 4 (AVX2) or 8 (AVX-512) blocks at once, 26 bit limbs in 64 bit lanes
+  lane j takes the blocks j, j + width, ..., every step multiplies the lanes by r^width,
+  the last one lane j by r^(width - j), then the lanes are added up
+*/
+
+#define POLY_MASK26 ((uint64_t)0x3ffffff)
+#define POLY_WIDE_MIN ((uint32_t)256) // bytes, below that the powers of r cost more than they save
+
+/**
+ * @brief h = h * r modulo 2^130 - 5, the step of polyBlocks()
+ *
+ */
+void polyMul(uint64_t h[3], const uint64_t r[3])
+{
+    typedef unsigned __int128 u128;
+
+    uint64_t s1 = r[1] * (5 << 2), s2 = r[2] * (5 << 2), c;
+    u128 d0, d1, d2;
+
+    d0 = (u128)h[0] * r[0] + (u128)h[1] * s2 + (u128)h[2] * s1;
+    d1 = (u128)h[0] * r[1] + (u128)h[1] * r[0] + (u128)h[2] * s2;
+    d2 = (u128)h[0] * r[2] + (u128)h[1] * r[1] + (u128)h[2] * r[0];
+
+    c = (uint64_t)(d0 >> 44);
+    h[0] = (uint64_t)d0 & POLY_MASK44;
+    d1 += c;
+    c = (uint64_t)(d1 >> 44);
+    h[1] = (uint64_t)d1 & POLY_MASK44;
+    d2 += c;
+    c = (uint64_t)(d2 >> 42);
+    h[2] = (uint64_t)d2 & POLY_MASK42;
+    h[0] += c * 5;
+    c = h[0] >> 44;
+    h[0] &= POLY_MASK44;
+    h[1] += c;
+}
+
+/**
+ * @brief 44+44+42 bit limbs to 5 of 26 bits
+ *
+ */
+void polyTo26(const uint64_t h[3], uint64_t l[5])
+{
+    uint64_t h0 = h[0], h1 = h[1], h2 = h[2], c;
+
+    c = h0 >> 44;
+    h0 &= POLY_MASK44;
+    h1 += c;
+    c = h1 >> 44;
+    h1 &= POLY_MASK44;
+    h2 += c;
+
+    l[0] = h0 & POLY_MASK26;
+    l[1] = ((h0 >> 26) | (h1 << 18)) & POLY_MASK26;
+    l[2] = (h1 >> 8) & POLY_MASK26;
+    l[3] = ((h1 >> 34) | (h2 << 10)) & POLY_MASK26;
+    l[4] = h2 >> 16;
+}
+
+/**
+ * @brief 5 limbs of up to 62 bits, the sum of the lanes, back to 44+44+42 bits
+ *
+ */
+void polyFrom26(uint64_t l[5], uint64_t h[3])
+{
+    uint64_t c;
+
+    for (int i = 0; i < 4; i++)
+    {
+        c = l[i] >> 26;
+        l[i] &= POLY_MASK26;
+        l[i + 1] += c;
+    }
+    c = l[4] >> 26;
+    l[4] &= POLY_MASK26;
+    l[0] += c * 5;
+    c = l[0] >> 26;
+    l[0] &= POLY_MASK26;
+    l[1] += c;
+
+    h[0] = l[0] + (l[1] << 26);
+    c = h[0] >> 44;
+    h[0] &= POLY_MASK44;
+    h[1] = c + (l[2] << 8) + (l[3] << 34);
+    c = h[1] >> 44;
+    h[1] &= POLY_MASK44;
+    h[2] = c + (l[4] << 16);
+}
+
+#if defined(__x86_64__)
+
+// _w is the vector width in bits, 256 or 512
+#define POLY_MUL(_w, _a, _b) _mm##_w##_mul_epu32((_a), (_b))
+#define POLY_ADD(_w, _a, _b) _mm##_w##_add_epi64((_a), (_b))
+
+/**
+ * @brief d = h * r of every lane, s = 5 * r
+ *
+ */
+#define POLY_VEC_MUL(_w, _d, _h, _r, _s)                                                                              \
+    _d[0] = POLY_ADD(_w, POLY_ADD(_w, POLY_ADD(_w, POLY_ADD(_w, POLY_MUL(_w, _h[0], _r[0]), POLY_MUL(_w, _h[1], _s[4])), \
+                                               POLY_MUL(_w, _h[2], _s[3])),                                          \
+                                  POLY_MUL(_w, _h[3], _s[2])),                                                       \
+                     POLY_MUL(_w, _h[4], _s[1]));                                                                    \
+    _d[1] = POLY_ADD(_w, POLY_ADD(_w, POLY_ADD(_w, POLY_ADD(_w, POLY_MUL(_w, _h[0], _r[1]), POLY_MUL(_w, _h[1], _r[0])), \
+                                               POLY_MUL(_w, _h[2], _s[4])),                                          \
+                                  POLY_MUL(_w, _h[3], _s[3])),                                                       \
+                     POLY_MUL(_w, _h[4], _s[2]));                                                                    \
+    _d[2] = POLY_ADD(_w, POLY_ADD(_w, POLY_ADD(_w, POLY_ADD(_w, POLY_MUL(_w, _h[0], _r[2]), POLY_MUL(_w, _h[1], _r[1])), \
+                                               POLY_MUL(_w, _h[2], _r[0])),                                          \
+                                  POLY_MUL(_w, _h[3], _s[4])),                                                       \
+                     POLY_MUL(_w, _h[4], _s[3]));                                                                    \
+    _d[3] = POLY_ADD(_w, POLY_ADD(_w, POLY_ADD(_w, POLY_ADD(_w, POLY_MUL(_w, _h[0], _r[3]), POLY_MUL(_w, _h[1], _r[2])), \
+                                               POLY_MUL(_w, _h[2], _r[1])),                                          \
+                                  POLY_MUL(_w, _h[3], _r[0])),                                                       \
+                     POLY_MUL(_w, _h[4], _s[4]));                                                                    \
+    _d[4] = POLY_ADD(_w, POLY_ADD(_w, POLY_ADD(_w, POLY_ADD(_w, POLY_MUL(_w, _h[0], _r[4]), POLY_MUL(_w, _h[1], _r[3])), \
+                                               POLY_MUL(_w, _h[2], _r[2])),                                          \
+                                  POLY_MUL(_w, _h[3], _r[1])),                                                       \
+                     POLY_MUL(_w, _h[4], _r[0]));
+
+/**
+ * @brief Carry the lanes back under 27 bits a limb, the top carry comes round times 5
+ *
+ */
+#define POLY_VEC_CARRY(_w, _d, _mask)                                             \
+    for (int i = 0; i < 4; i++)                                                   \
+    {                                                                             \
+        _d[i + 1] = POLY_ADD(_w, _d[i + 1], _mm##_w##_srli_epi64(_d[i], 26));     \
+        _d[i] = _mm##_w##_and_si##_w(_d[i], _mask);                               \
+    }                                                                             \
+    {                                                                             \
+        __m##_w##i c = _mm##_w##_srli_epi64(_d[4], 26);                           \
+        _d[4] = _mm##_w##_and_si##_w(_d[4], _mask);                               \
+        _d[0] = POLY_ADD(_w, _d[0], POLY_ADD(_w, c, _mm##_w##_slli_epi64(c, 2))); \
+        _d[1] = POLY_ADD(_w, _d[1], _mm##_w##_srli_epi64(_d[0], 26));             \
+        _d[0] = _mm##_w##_and_si##_w(_d[0], _mask);                               \
+    }
+
+/**
+ * @brief Split the low and high 64 bits of a block in every lane into limbs, with the 2^128 bit
+ *
+ */
+#define POLY_VEC_LIMBS(_w, _m, _lo, _hi, _mask, _top)                                                                  \
+    _m[0] = _mm##_w##_and_si##_w(_lo, _mask);                                                                    \
+    _m[1] = _mm##_w##_and_si##_w(_mm##_w##_srli_epi64(_lo, 26), _mask);                                          \
+    _m[2] = _mm##_w##_and_si##_w(_mm##_w##_or_si##_w(_mm##_w##_srli_epi64(_lo, 52), _mm##_w##_slli_epi64(_hi, 12)), \
+                                 _mask);                                                                         \
+    _m[3] = _mm##_w##_and_si##_w(_mm##_w##_srli_epi64(_hi, 14), _mask);                                          \
+    _m[4] = _mm##_w##_or_si##_w(_mm##_w##_srli_epi64(_hi, 40), _top);
+
+static inline __attribute__((always_inline, target("avx2"))) void poly4Load(__m256i m[5], const uint8_t *p)
+{
+    __m256i a = _mm256_loadu_si256((const __m256i *)p);
+    __m256i b = _mm256_loadu_si256((const __m256i *)(p + 32));
+    __m256i lo = _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(a, b), 0xd8);
+    __m256i hi = _mm256_permute4x64_epi64(_mm256_unpackhi_epi64(a, b), 0xd8);
+    __m256i mask = _mm256_set1_epi64x(POLY_MASK26), top = _mm256_set1_epi64x((int64_t)1 << 24);
+
+    POLY_VEC_LIMBS(256, m, lo, hi, mask, top)
+}
+
+/**
+ * @brief Absorb 'len' bytes, a multiple of 64, into the 26 bit limbs h
+ *
+ * @param r r^1 .. r^4 in 26 bit limbs
+ */
+__attribute__((target("avx2"))) void poly4Avx2(uint64_t h[5], const uint64_t r[][5], const uint8_t *m, uint32_t len)
+{
+    __m256i mask = _mm256_set1_epi64x(POLY_MASK26);
+    __m256i r4[5], s4[5], rl[5], sl[5], v[5], d[5], x[5];
+    uint64_t lanes[4];
+
+    for (int k = 0; k < 5; k++)
+    {
+        r4[k] = _mm256_set1_epi64x((int64_t)r[3][k]);
+        s4[k] = _mm256_add_epi64(r4[k], _mm256_slli_epi64(r4[k], 2));
+        rl[k] = _mm256_set_epi64x((int64_t)r[0][k], (int64_t)r[1][k], (int64_t)r[2][k], (int64_t)r[3][k]);
+        sl[k] = _mm256_add_epi64(rl[k], _mm256_slli_epi64(rl[k], 2));
+    }
+
+    poly4Load(v, m);
+    for (int k = 0; k < 5; k++)
+        v[k] = _mm256_add_epi64(v[k], _mm256_set_epi64x(0, 0, 0, (int64_t)h[k]));
+
+    for (m += 64, len -= 64; len > 0; m += 64, len -= 64)
+    {
+        POLY_VEC_MUL(256, d, v, r4, s4)
+        POLY_VEC_CARRY(256, d, mask)
+        poly4Load(x, m);
+        for (int k = 0; k < 5; k++)
+            v[k] = _mm256_add_epi64(d[k], x[k]);
+    }
+
+    POLY_VEC_MUL(256, d, v, rl, sl)
+
+    for (int k = 0; k < 5; k++)
+    {
+        _mm256_storeu_si256((__m256i *)lanes, d[k]);
+        h[k] = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+}
+
+static inline __attribute__((always_inline, target("avx512f"))) void poly8Load(__m512i m[5], const uint8_t *p)
+{
+    __m512i a = _mm512_loadu_si512((const void *)p);
+    __m512i b = _mm512_loadu_si512((const void *)(p + 64));
+    __m512i lo = _mm512_permutex2var_epi64(a, _mm512_set_epi64(14, 12, 10, 8, 6, 4, 2, 0), b);
+    __m512i hi = _mm512_permutex2var_epi64(a, _mm512_set_epi64(15, 13, 11, 9, 7, 5, 3, 1), b);
+    __m512i mask = _mm512_set1_epi64(POLY_MASK26), top = _mm512_set1_epi64((int64_t)1 << 24);
+
+    POLY_VEC_LIMBS(512, m, lo, hi, mask, top)
+}
+
+/**
+ * @brief Absorb 'len' bytes, a multiple of 128, into the 26 bit limbs h
+ *
+ * @param r r^1 .. r^8 in 26 bit limbs
+ */
+__attribute__((target("avx512f"))) void poly8Avx512(uint64_t h[5], const uint64_t r[][5], const uint8_t *m, uint32_t len)
+{
+    __m512i mask = _mm512_set1_epi64(POLY_MASK26);
+    __m512i r8[5], s8[5], rl[5], sl[5], v[5], d[5], x[5];
+
+    for (int k = 0; k < 5; k++)
+    {
+        r8[k] = _mm512_set1_epi64((int64_t)r[7][k]);
+        s8[k] = _mm512_add_epi64(r8[k], _mm512_slli_epi64(r8[k], 2));
+        rl[k] = _mm512_set_epi64((int64_t)r[0][k], (int64_t)r[1][k], (int64_t)r[2][k], (int64_t)r[3][k],
+                                 (int64_t)r[4][k], (int64_t)r[5][k], (int64_t)r[6][k], (int64_t)r[7][k]);
+        sl[k] = _mm512_add_epi64(rl[k], _mm512_slli_epi64(rl[k], 2));
+    }
+
+    poly8Load(v, m);
+    for (int k = 0; k < 5; k++)
+        v[k] = _mm512_add_epi64(v[k], _mm512_set_epi64(0, 0, 0, 0, 0, 0, 0, (int64_t)h[k]));
+
+    for (m += 128, len -= 128; len > 0; m += 128, len -= 128)
+    {
+        POLY_VEC_MUL(512, d, v, r8, s8)
+        POLY_VEC_CARRY(512, d, mask)
+        poly8Load(x, m);
+        for (int k = 0; k < 5; k++)
+            v[k] = _mm512_add_epi64(d[k], x[k]);
+    }
+
+    POLY_VEC_MUL(512, d, v, rl, sl)
+
+    for (int k = 0; k < 5; k++)
+        h[k] = (uint64_t)_mm512_reduce_add_epi64(d[k]);
+}
+
+#endif
+
+/**
+ * @brief Absorb whole 16 byte blocks, with the vector kernel of the CPU when there are enough of them
+ *
+ */
+void polyWide(PolyState_t *st, const uint8_t *m, uint32_t len)
+{
+#if defined(__x86_64__)
+    uint32_t width = aeadChacha == AEAD_CHACHA_AVX512 ? 8 : 4, n;
+    uint64_t power[8][3], r[8][5], h[5];
+
+    if (aeadChacha && len >= POLY_WIDE_MIN)
+    {
+        // r^(i + 1) from two powers of about half of it, three products deep rather than seven
+        memcpy(power[0], st->r, sizeof(power[0]));
+        for (uint32_t i = 1; i < width; i++)
+        {
+            memcpy(power[i], power[i / 2], sizeof(power[i]));
+            polyMul(power[i], power[(i - 1) / 2]);
+        }
+        for (uint32_t i = 0; i < width; i++)
+            polyTo26(power[i], r[i]);
+
+        // 8 blocks at a time, then 4 with the same powers of r
+        for (; width >= 4; width /= 2)
+        {
+            if (len < 16 * width)
+                continue;
+
+            n = len / (16 * width) * (16 * width);
+            polyTo26(st->h, h);
+            if (width == 8)
+                poly8Avx512(h, (const uint64_t(*)[5])r, m, n);
+            else
+                poly4Avx2(h, (const uint64_t(*)[5])r, m, n);
+            polyFrom26(h, st->h);
+
+            m += n;
+            len -= n;
+        }
+    }
+#endif
+
+    polyBlocks(st, m, len);
+}
+
+/**
+ * @brief Absorb data zero padded to 16 bytes, as the AEAD construction does
+ *
+ */
+void polyPadded(PolyState_t *st, const uint8_t *m, uint32_t len)
+{
+    uint8_t last[16] = {0};
+
+    polyWide(st, m, len & ~15u);
+
+    if (len & 15)
+    {
+        memcpy(last, m + (len & ~15u), len & 15);
+        polyBlocks(st, last, 16);
+    }
+}
+
+void polyFinish(PolyState_t *st, uint8_t tag[16])
+{
+    uint64_t h0 = st->h[0], h1 = st->h[1], h2 = st->h[2];
+    uint64_t g0, g1, g2, c, mask, t0 = st->s[0], t1 = st->s[1];
+
+    c = h1 >> 44;
+    h1 &= POLY_MASK44;
+    h2 += c;
+    c = h2 >> 42;
+    h2 &= POLY_MASK42;
+    h0 += c * 5;
+    c = h0 >> 44;
+    h0 &= POLY_MASK44;
+    h1 += c;
+    c = h1 >> 44;
+    h1 &= POLY_MASK44;
+    h2 += c;
+    c = h2 >> 42;
+    h2 &= POLY_MASK42;
+    h0 += c * 5;
+    c = h0 >> 44;
+    h0 &= POLY_MASK44;
+    h1 += c;
+
+    // h - p, kept if it does not borrow
+    g0 = h0 + 5;
+    c = g0 >> 44;
+    g0 &= POLY_MASK44;
+    g1 = h1 + c;
+    c = g1 >> 44;
+    g1 &= POLY_MASK44;
+    g2 = h2 + c - ((uint64_t)1 << 42);
+
+    mask = (g2 >> 63) - 1;
+    g0 &= mask;
+    g1 &= mask;
+    g2 &= mask;
+    mask = ~mask;
+    h0 = (h0 & mask) | g0;
+    h1 = (h1 & mask) | g1;
+    h2 = (h2 & mask) | g2;
+
+    // + s
+    h0 += t0 & POLY_MASK44;
+    c = h0 >> 44;
+    h0 &= POLY_MASK44;
+    h1 += (((t0 >> 44) | (t1 << 20)) & POLY_MASK44) + c;
+    c = h1 >> 44;
+    h1 &= POLY_MASK44;
+    h2 += ((t1 >> 24) & POLY_MASK42) + c;
+    h2 &= POLY_MASK42;
+
+    h0 = h0 | (h1 << 44);
+    h1 = (h1 >> 20) | (h2 << 24);
+
+    memcpy(tag, &h0, 8);
+    memcpy(tag + 8, &h1, 8);
+}
+
+/**
+ * @brief Key stream of the first 8 blocks, in one pass of the vector kernel:
+ *        block 0 is the one time Poly1305 key, the data starts at block 1
+ *
+ * @param len bytes of data, no more blocks than it needs are made without a vector kernel
+ */
+void chachaHead(const uint32_t key[8], const uint32_t nonce[3], uint32_t len, uint8_t stream[CHACHA_WIDE * CHACHA_BLOCK])
+{
+    static const uint8_t zeros[CHACHA_WIDE * CHACHA_BLOCK];
+    uint32_t state[16], blocks = 1 + (len + CHACHA_BLOCK - 1) / CHACHA_BLOCK;
+
+    chachaSetup(state, key, 0, nonce);
+    if (blocks > CHACHA_WIDE)
+        blocks = CHACHA_WIDE;
+
+#if defined(__x86_64__)
+    if (aeadChacha == AEAD_CHACHA_AVX512)
+    {
+        chacha8Avx512(state, zeros, stream, blocks * CHACHA_BLOCK);
+        return;
+    }
+    if (aeadChacha == AEAD_CHACHA_AVX2)
+    {
+        chacha8Avx2(state, zeros, stream, blocks * CHACHA_BLOCK);
+        return;
+    }
+#endif
+
+    for (uint32_t i = 0; i < blocks; i++, state[12]++)
+        chachaBlock(state, stream + i * CHACHA_BLOCK);
+}
+
+/**
+ * @brief Xor the key stream into the data, the head from chachaHead() first
+ *
+ */
+void chachaCrypt(const uint32_t key[8], const uint32_t nonce[3], const uint8_t *head, const uint8_t *in, uint8_t *out, uint32_t len)
+{
+    uint32_t n = len < (CHACHA_WIDE - 1) * CHACHA_BLOCK ? len : (CHACHA_WIDE - 1) * CHACHA_BLOCK;
+
+    for (uint32_t i = 0; i < n; i++)
+        out[i] = in[i] ^ head[CHACHA_BLOCK + i];
+
+    chachaXor(key, CHACHA_WIDE, nonce, in + n, out + n, len - n);
+}
+
+/**
+ * @brief Poly1305 tag of the AEAD construction over ad and ciphertext
+ *
+ * @param polyKey block 0 of the key stream
+ */
+void chachaPolyTag(const uint8_t polyKey[32], const uint8_t *ad, uint32_t adLen, const uint8_t *ct, uint32_t len, uint8_t tag[16])
+{
+    uint64_t lengths[2] = {adLen, len};
+    PolyState_t st;
+
+    polyInit(&st, polyKey);
+
+    polyPadded(&st, ad, adLen);
+    polyPadded(&st, ct, len);
+    polyBlocks(&st, (const uint8_t *)lengths, 16);
+    polyFinish(&st, tag);
+}
+
+/*
+  AES-256-GCM with AES-NI and PCLMULQDQ
+  GHASH works on byte reversed blocks, the products are reduced once per 8 blocks
+*/
+
+#if defined(__x86_64__)
+
+#define GCM_BSWAP _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15)
+
+static inline __attribute__((always_inline, target("aes,sse2"))) __m128i aesAssist1(__m128i t1, __m128i t2)
+{
+    __m128i t4;
+
+    t2 = _mm_shuffle_epi32(t2, 0xff);
+    t4 = _mm_slli_si128(t1, 4);
+    t1 = _mm_xor_si128(t1, t4);
+    t4 = _mm_slli_si128(t4, 4);
+    t1 = _mm_xor_si128(t1, t4);
+    t4 = _mm_slli_si128(t4, 4);
+    t1 = _mm_xor_si128(t1, t4);
+
+    return _mm_xor_si128(t1, t2);
+}
+
+static inline __attribute__((always_inline, target("aes,sse2"))) __m128i aesAssist2(__m128i t1, __m128i t3)
+{
+    __m128i t2, t4;
+
+    t4 = _mm_aeskeygenassist_si128(t1, 0x0);
+    t2 = _mm_shuffle_epi32(t4, 0xaa);
+    t4 = _mm_slli_si128(t3, 4);
+    t3 = _mm_xor_si128(t3, t4);
+    t4 = _mm_slli_si128(t4, 4);
+    t3 = _mm_xor_si128(t3, t4);
+    t4 = _mm_slli_si128(t4, 4);
+    t3 = _mm_xor_si128(t3, t4);
+
+    return _mm_xor_si128(t3, t2);
+}
+
+#define AES_EXPAND(_i, _rcon)                                          \
+    t1 = aesAssist1(t1, _mm_aeskeygenassist_si128(t3, _rcon));         \
+    rk[_i] = t1;                                                       \
+    if (_i + 1 < 15)                                                   \
+    {                                                                  \
+        t3 = aesAssist2(t1, t3);                                       \
+        rk[_i + 1] = t3;                                               \
+    }
+
+static inline __attribute__((always_inline, target("aes,sse2"))) __m128i aesEncrypt(const __m128i *rk, __m128i x)
+{
+    x = _mm_xor_si128(x, rk[0]);
+    for (int r = 1; r < 14; r++)
+        x = _mm_aesenc_si128(x, rk[r]);
+
+    return _mm_aesenclast_si128(x, rk[14]);
+}
+
+/**
+ * @brief Carry-less product of a and b, added to the low, middle and high terms in acc
+ *
+ */
+static inline __attribute__((always_inline, target("pclmul,sse2"))) void gcmMulAdd(__m128i a, __m128i b, __m128i acc[3])
+{
+    acc[0] = _mm_xor_si128(acc[0], _mm_clmulepi64_si128(a, b, 0x00));
+    acc[1] = _mm_xor_si128(acc[1], _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10), _mm_clmulepi64_si128(a, b, 0x01)));
+    acc[2] = _mm_xor_si128(acc[2], _mm_clmulepi64_si128(a, b, 0x11));
+}
+
+/**
+ * @brief Fold the middle term in, shift the 256 bit product left by one
+ *        and reduce it modulo the GCM polynomial
+ *
+ */
+static inline __attribute__((always_inline, target("sse2"))) __m128i gcmReduce(const __m128i acc[3])
+{
+    __m128i lo = _mm_xor_si128(acc[0], _mm_slli_si128(acc[1], 8));
+    __m128i hi = _mm_xor_si128(acc[2], _mm_srli_si128(acc[1], 8));
+    __m128i t2, t4, t5, t7, t8, t9;
+
+    t7 = _mm_srli_epi32(lo, 31);
+    t8 = _mm_srli_epi32(hi, 31);
+    lo = _mm_slli_epi32(lo, 1);
+    hi = _mm_slli_epi32(hi, 1);
+    t9 = _mm_srli_si128(t7, 12);
+    t8 = _mm_slli_si128(t8, 4);
+    t7 = _mm_slli_si128(t7, 4);
+    lo = _mm_or_si128(lo, t7);
+    hi = _mm_or_si128(hi, t8);
+    hi = _mm_or_si128(hi, t9);
+
+    t7 = _mm_slli_epi32(lo, 31);
+    t8 = _mm_slli_epi32(lo, 30);
+    t9 = _mm_slli_epi32(lo, 25);
+    t7 = _mm_xor_si128(t7, t8);
+    t7 = _mm_xor_si128(t7, t9);
+    t8 = _mm_srli_si128(t7, 4);
+    t7 = _mm_slli_si128(t7, 12);
+    lo = _mm_xor_si128(lo, t7);
+
+    t2 = _mm_srli_epi32(lo, 1);
+    t4 = _mm_srli_epi32(lo, 2);
+    t5 = _mm_srli_epi32(lo, 7);
+    t2 = _mm_xor_si128(t2, t4);
+    t2 = _mm_xor_si128(t2, t5);
+    t2 = _mm_xor_si128(t2, t8);
+    lo = _mm_xor_si128(lo, t2);
+
+    return _mm_xor_si128(hi, lo);
+}
+
+static inline __attribute__((always_inline, target("pclmul,sse2"))) __m128i gcmMul(__m128i a, __m128i b)
+{
+    __m128i acc[3] = {_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128()};
+
+    gcmMulAdd(a, b, acc);
+
+    return gcmReduce(acc);
+}
+
+/**
+ * @brief GHASH of 8 byte reversed blocks, one reduction for all of them
+ *
+ */
+static inline __attribute__((always_inline, target("pclmul,sse2"))) __m128i gcmHash8(const __m128i *hp, __m128i y, const __m128i c[8])
+{
+    __m128i acc[3] = {_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128()};
+
+    gcmMulAdd(_mm_xor_si128(c[0], y), hp[7], acc);
+    for (int i = 1; i < 8; i++)
+        gcmMulAdd(c[i], hp[7 - i], acc);
+
+    return gcmReduce(acc);
+}
+
+/**
+ * @brief GHASH of data zero padded to 16 bytes, up to 8 blocks per reduction
+ *
+ */
+static inline __attribute__((always_inline, target("pclmul,ssse3"))) __m128i gcmHash(const __m128i *hp, __m128i y, const uint8_t *m, uint32_t len)
+{
+    while (len > 0)
+    {
+        __m128i acc[3] = {_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128()};
+        uint32_t n = len >= 8 * 16 ? 8 : (len + 15) / 16;
+
+        for (uint32_t i = 0; i < n; i++, m += 16)
+        {
+            uint8_t last[16] = {0};
+            __m128i b;
+
+            if (len < 16)
+            {
+                memcpy(last, m, len);
+                b = _mm_loadu_si128((const __m128i *)last);
+                len = 0;
+            }
+            else
+            {
+                b = _mm_loadu_si128((const __m128i *)m);
+                len -= 16;
+            }
+
+            b = _mm_shuffle_epi8(b, GCM_BSWAP);
+            gcmMulAdd(i == 0 ? _mm_xor_si128(b, y) : b, hp[n - 1 - i], acc);
+        }
+
+        y = gcmReduce(acc);
+    }
+
+    return y;
+}
+
+/**
+ * @brief Encrypt 8 counter blocks, the GHASH of the 8 blocks before runs between their AES rounds
+ *
+ * @param c byte reversed ciphertext of the 8 blocks before, replaced by the one of these
+ * @param hash is there anything in 'c' yet?
+ */
+static inline __attribute__((always_inline, target("aes,pclmul,ssse3"))) void gcmCtr8(const __m128i *rk, const __m128i *hp, __m128i *counter,
+                                                                                    __m128i c[8], __m128i *y, const uint8_t *in, uint8_t *out,
+                                                                                    int encrypt, int hash)
+{
+    __m128i b[8], acc[3] = {_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128()};
+
+    for (int i = 0; i < 8; i++)
+    {
+        *counter = _mm_add_epi32(*counter, _mm_set_epi32(0, 0, 0, 1));
+        b[i] = _mm_xor_si128(_mm_shuffle_epi8(*counter, GCM_BSWAP), rk[0]);
+    }
+
+    if (hash)
+        c[0] = _mm_xor_si128(c[0], *y);
+
+    // with H^8 for the first block down to H for the last
+    for (int r = 1; r < 14; r++)
+    {
+        for (int i = 0; i < 8; i++)
+            b[i] = _mm_aesenc_si128(b[i], rk[r]);
+        if (hash && r <= 8)
+            gcmMulAdd(c[r - 1], hp[8 - r], acc);
+    }
+
+    if (hash)
+        *y = gcmReduce(acc);
+
+    for (int i = 0; i < 8; i++)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(in + 16 * i));
+
+        b[i] = _mm_xor_si128(_mm_aesenclast_si128(b[i], rk[14]), x);
+        _mm_storeu_si128((__m128i *)(out + 16 * i), b[i]);
+        c[i] = _mm_shuffle_epi8(encrypt ? b[i] : x, GCM_BSWAP);
+    }
+}
+
+__attribute__((target("aes,pclmul,ssse3"))) void gcmSetKey(CrudpAeadKey_t *key, const uint8_t *raw)
+{
+    __m128i *rk = (__m128i *)key->aesRounds;
+    __m128i *hp = (__m128i *)key->ghashPowers;
+    __m128i t1 = _mm_loadu_si128((const __m128i *)raw);
+    __m128i t3 = _mm_loadu_si128((const __m128i *)(raw + 16));
+
+    rk[0] = t1;
+    rk[1] = t3;
+    AES_EXPAND(2, 0x01)
+    AES_EXPAND(4, 0x02)
+    AES_EXPAND(6, 0x04)
+    AES_EXPAND(8, 0x08)
+    AES_EXPAND(10, 0x10)
+    AES_EXPAND(12, 0x20)
+    AES_EXPAND(14, 0x40)
+
+    hp[0] = _mm_shuffle_epi8(aesEncrypt(rk, _mm_setzero_si128()), GCM_BSWAP);
+    for (int i = 1; i < 8; i++)
+        hp[i] = gcmMul(hp[i - 1], hp[0]);
+}
+
+/**
+ * @brief Encrypt or decrypt with AES-256-GCM, 8 blocks per round trip of the pipeline
+ *        the GHASH of a round trip is done during the AES of the next
+ *
+ */
+__attribute__((target("aes,pclmul,ssse3,sse4.1"))) void gcmCrypt(const CrudpAeadKey_t *key, const uint8_t nonce[12], const uint8_t *ad, uint32_t adLen,
+                                                                  const uint8_t *in, uint8_t *out, uint32_t len, int encrypt, uint8_t tag[16])
+{
+    const __m128i *rk = (const __m128i *)key->aesRounds;
+    const __m128i *hp = (const __m128i *)key->ghashPowers;
+    uint8_t j0Bytes[16], lengths[16];
+    __m128i j0, counter, y = _mm_setzero_si128();
+    uint64_t bits, total = len;
+
+    memcpy(j0Bytes, nonce, 12);
+    j0Bytes[12] = j0Bytes[13] = j0Bytes[14] = 0;
+    j0Bytes[15] = 1;
+    j0 = _mm_loadu_si128((const __m128i *)j0Bytes);
+
+    // the 32 bit big endian counter becomes word 0 once the block is reversed
+    counter = _mm_shuffle_epi8(j0, GCM_BSWAP);
+
+    y = gcmHash(hp, y, ad, adLen);
+
+    if (len >= 128)
+    {
+        __m128i c[8];
+
+        gcmCtr8(rk, hp, &counter, c, &y, in, out, encrypt, 0);
+        for (in += 128, out += 128, len -= 128; len >= 128; in += 128, out += 128, len -= 128)
+            gcmCtr8(rk, hp, &counter, c, &y, in, out, encrypt, 1);
+        y = gcmHash8(hp, y, c);
+    }
+
+    // the tail, up to 7 blocks and a part of one, in a single pass too
+    if (len > 0)
+    {
+        uint8_t stream[128];
+        __m128i b[8];
+        uint32_t n = (len + 15) / 16;
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            counter = _mm_add_epi32(counter, _mm_set_epi32(0, 0, 0, 1));
+            b[i] = _mm_xor_si128(_mm_shuffle_epi8(counter, GCM_BSWAP), rk[0]);
+        }
+        for (int r = 1; r < 14; r++)
+            for (uint32_t i = 0; i < n; i++)
+                b[i] = _mm_aesenc_si128(b[i], rk[r]);
+        for (uint32_t i = 0; i < n; i++)
+            _mm_storeu_si128((__m128i *)(stream + 16 * i), _mm_aesenclast_si128(b[i], rk[14]));
+
+        // in place, the ciphertext to hash is the input when decrypting
+        if (!encrypt)
+            y = gcmHash(hp, y, in, len);
+        for (uint32_t i = 0; i < len; i++)
+            out[i] = in[i] ^ stream[i];
+        if (encrypt)
+            y = gcmHash(hp, y, out, len);
+    }
+
+    // lengths in bits, big endian
+    bits = __builtin_bswap64((uint64_t)adLen * 8);
+    memcpy(lengths, &bits, 8);
+    bits = __builtin_bswap64((uint64_t)total * 8);
+    memcpy(lengths + 8, &bits, 8);
+    y = gcmHash(hp, y, lengths, 16);
+
+    _mm_storeu_si128((__m128i *)tag, _mm_xor_si128(_mm_shuffle_epi8(y, GCM_BSWAP), aesEncrypt(rk, j0)));
+}
+
+#endif
+
+/**
+ * @brief Nonce of a datagram, the counter then zeros
+ *
+ */
+void aeadNonce(uint64_t counter, uint8_t nonce[12])
+{
+    memcpy(nonce, &counter, 8);
+    memset(nonce + 8, 0, 4);
+}
+
+void aeadSetKey(CrudpAeadKey_t *key, const uint8_t *raw)
+{
+    memcpy(key->chacha, raw, AEAD_KEY_SIZE);
+
+#if defined(__x86_64__)
+    if (aeadHasGcm())
+        gcmSetKey(key, raw);
+#endif
+}
+
+int aeadHasGcm()
+{
+#if defined(__x86_64__)
+    return __builtin_cpu_supports("aes") && __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+#else
+    return 0;
+#endif
+}
+
+const char *aeadKernel(int gcm)
+{
+    if (gcm)
+        return aeadHasGcm() ? "aesni-pclmul" : "none";
+
+    return aeadChacha == AEAD_CHACHA_AVX512 ? "avx512" : aeadChacha == AEAD_CHACHA_AVX2 ? "avx2" : "portable";
+}
+
+/**
+ * @brief Pick the vector kernels this CPU runs
+ *
+ */
+void aeadDetect()
+{
+    aeadDetected = 1;
+
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512f"))
+        aeadChacha = AEAD_CHACHA_AVX512;
+    else if (__builtin_cpu_supports("avx2"))
+        aeadChacha = AEAD_CHACHA_AVX2;
+#endif
+}
+
+/**
+ * @brief aeadEncrypt() with a nonce of any 12 bytes
+ *
+ */
+void aeadEncryptNonce(const CrudpAeadKey_t *key, int gcm, const uint32_t nonce[3], const uint8_t *ad, uint32_t adLen,
+                      const uint8_t *in, uint8_t *out, uint32_t len, uint8_t *tag)
+{
+    uint8_t head[CHACHA_WIDE * CHACHA_BLOCK];
+
+#if defined(__x86_64__)
+    if (gcm)
+    {
+        gcmCrypt(key, (const uint8_t *)nonce, ad, adLen, in, out, len, 1, tag);
+        return;
+    }
+#endif
+
+    chachaHead(key->chacha, nonce, len, head);
+    chachaCrypt(key->chacha, nonce, head, in, out, len);
+    chachaPolyTag(head, ad, adLen, out, len, tag);
+}
+
+/**
+ * @brief aeadDecrypt() with a nonce of any 12 bytes
+ *
+ */
+int aeadDecryptNonce(const CrudpAeadKey_t *key, int gcm, const uint32_t nonce[3], const uint8_t *ad, uint32_t adLen,
+                     const uint8_t *in, uint8_t *out, uint32_t len, const uint8_t *tag)
+{
+    uint8_t head[CHACHA_WIDE * CHACHA_BLOCK], expected[AEAD_TAG_SIZE], diff = 0;
+
+#if defined(__x86_64__)
+    if (gcm)
+    {
+        // decrypts while hashing, the plaintext is dropped if the tag is wrong
+        gcmCrypt(key, (const uint8_t *)nonce, ad, adLen, in, out, len, 0, expected);
+    }
+    else
+#endif
+    {
+        if (gcm)
+            return -1;
+
+        chachaHead(key->chacha, nonce, len, head);
+        chachaPolyTag(head, ad, adLen, in, len, expected);
+    }
+
+    // in constant time
+    for (uint32_t i = 0; i < AEAD_TAG_SIZE; i++)
+        diff |= expected[i] ^ tag[i];
+
+    if (diff)
+        return -1;
+
+    if (!gcm)
+        chachaCrypt(key->chacha, nonce, head, in, out, len);
+
+    return 0;
+}
+
+void aeadEncrypt(const CrudpAeadKey_t *key, int gcm, uint64_t counter, const uint8_t *ad, uint32_t adLen,
+                 const uint8_t *in, uint8_t *out, uint32_t len, uint8_t *tag)
+{
+    uint32_t nonce[3];
+
+    if (!aeadDetected)
+        aeadDetect();
+
+    aeadNonce(counter, (uint8_t *)nonce);
+    aeadEncryptNonce(key, gcm, nonce, ad, adLen, in, out, len, tag);
+}
+
+int aeadDecrypt(const CrudpAeadKey_t *key, int gcm, uint64_t counter, const uint8_t *ad, uint32_t adLen,
+                const uint8_t *in, uint8_t *out, uint32_t len, const uint8_t *tag)
+{
+    uint32_t nonce[3];
+
+    if (!aeadDetected)
+        aeadDetect();
+
+    aeadNonce(counter, (uint8_t *)nonce);
+
+    return aeadDecryptNonce(key, gcm, nonce, ad, adLen, in, out, len, tag);
+}
+
+/*
+  Known answers: RFC 8439 2.8.2 and test case 16 of the GCM specification (AES-256),
+  then a whole segment through the 8 and 16 block paths, tags from OpenSSL 3.0
+*/
+
+#define AEAD_KAT_SIZE ((uint32_t)1388)
+#define AEAD_KAT_COUNTER ((uint64_t)0x0706050403020100)
+
+typedef struct AeadVector_s
+{
+    int gcm;
+    const char *key, *nonce, *ad, *plain, *cipher, *tag;
+} AeadVector_t;
+
+static const AeadVector_t aeadVectors[] = {
+    {0, "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f", "070000004041424344454647",
+     "50515253c0c1c2c3c4c5c6c7",
+     "4c616469657320616e642047656e746c656d656e206f662074686520636c617373206f66202739393a204966204920636f756c64206f6666"
+     "657220796f75206f6e6c79206f6e652074697020666f7220746865206675747572652c2073756e73637265656e20776f756c642062652069742e",
+     "d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d63dbea45e8ca9671282fafb69da92728b1a71de0a9e060b29"
+     "05d6a5b67ecd3b3692ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc3ff4def08e4b7a9de576d26586cec64b6116",
+     "1ae10b594f09e26a7e902ecbd0600691"},
+    {1, "feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888",
+     "feedfacedeadbeeffeedfacedeadbeefabaddad2",
+     "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a721c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39",
+     "522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa8cb08e48590dbb3da7b08b1056828838c5f61e6393ba7a0abcc9f662",
+     "76fc6ece0f4e1768cddf8853bb2d551b"},
+};
+
+// of the segment: key 0 .. 31, associated data a0 .. b7, plaintext i * 7 + 3
+static const char *aeadKatTags[2] = {"636bd77678c877c3e7e44549bedd5b40", "8b5ec95e92df84cbf5427f132f3fc39a"};
+
+/**
+ * @brief Hex to bytes
+ *
+ * @return uint32_t number of bytes
+ */
+uint32_t aeadUnhex(const char *hex, uint8_t *out)
+{
+    uint32_t n = 0;
+
+    for (; hex[0] != '\0' && hex[1] != '\0'; hex += 2)
+    {
+        unsigned int byte;
+
+        if (sscanf(hex, "%2x", &byte) != 1)
+            break;
+        out[n++] = (uint8_t)byte;
+    }
+
+    return n;
+}
+
+/**
+ * @brief Check one cipher with the kernels in use against the known answers
+ *
+ * @return int number of answers that did not match
+ */
+int aeadCheck(int gcm)
+{
+    static uint8_t plain[AEAD_KAT_SIZE], cipher[AEAD_KAT_SIZE], out[AEAD_KAT_SIZE];
+    CrudpAeadKey_t key;
+    uint8_t raw[AEAD_KEY_SIZE], ad[24], tag[AEAD_TAG_SIZE], expected[AEAD_TAG_SIZE];
+    uint32_t nonce[3];
+    int failures = 0;
+
+    for (uint32_t v = 0; v < sizeof(aeadVectors) / sizeof(aeadVectors[0]); v++)
+    {
+        const AeadVector_t *vector = &aeadVectors[v];
+        uint32_t adLen, len;
+
+        if (vector->gcm != gcm)
+            continue;
+
+        aeadUnhex(vector->key, raw);
+        aeadUnhex(vector->nonce, (uint8_t *)nonce);
+        adLen = aeadUnhex(vector->ad, ad);
+        len = aeadUnhex(vector->plain, plain);
+        aeadUnhex(vector->cipher, cipher);
+        aeadUnhex(vector->tag, expected);
+        aeadSetKey(&key, raw);
+
+        aeadEncryptNonce(&key, gcm, nonce, ad, adLen, plain, out, len, tag);
+        failures += memcmp(out, cipher, len) != 0 || memcmp(tag, expected, AEAD_TAG_SIZE) != 0;
+        failures += aeadDecryptNonce(&key, gcm, nonce, ad, adLen, cipher, out, len, expected) < 0 || memcmp(out, plain, len) != 0;
+    }
+
+    for (uint32_t i = 0; i < AEAD_KEY_SIZE; i++)
+        raw[i] = (uint8_t)i;
+    for (uint32_t i = 0; i < sizeof(ad); i++)
+        ad[i] = (uint8_t)(0xa0 + i);
+    for (uint32_t i = 0; i < AEAD_KAT_SIZE; i++)
+        plain[i] = (uint8_t)(i * 7 + 3);
+    aeadUnhex(aeadKatTags[gcm], expected);
+    aeadSetKey(&key, raw);
+
+    // in place, as a segment is sealed; a tag one bit off must not open
+    memcpy(cipher, plain, AEAD_KAT_SIZE);
+    aeadEncrypt(&key, gcm, AEAD_KAT_COUNTER, ad, sizeof(ad), cipher, cipher, AEAD_KAT_SIZE, tag);
+    failures += memcmp(tag, expected, AEAD_TAG_SIZE) != 0;
+    memcpy(out, cipher, AEAD_KAT_SIZE);
+    failures += aeadDecrypt(&key, gcm, AEAD_KAT_COUNTER, ad, sizeof(ad), out, out, AEAD_KAT_SIZE, expected) < 0 ||
+                memcmp(out, plain, AEAD_KAT_SIZE) != 0;
+    expected[AEAD_TAG_SIZE - 1] ^= 1;
+    failures += aeadDecrypt(&key, gcm, AEAD_KAT_COUNTER, ad, sizeof(ad), cipher, out, AEAD_KAT_SIZE, expected) == 0;
+
+    return failures;
+}
+
+int aeadSelfTest()
+{
+    int best, failures = 0;
+
+    if (!aeadDetected)
+        aeadDetect();
+
+    // every ChaCha20-Poly1305 kernel of this CPU, down to the portable one
+    best = aeadChacha;
+    for (aeadChacha = best; aeadChacha >= 0; aeadChacha--)
+        failures += aeadCheck(0);
+    aeadChacha = best;
+
+    if (aeadHasGcm())
+        failures += aeadCheck(1);
+
+    return failures ? -1 : 0;
+}
+
+int aeadInit(const char *psk, const char *cipher)
+{
+    if (strlen(psk) != 2 * AEAD_KEY_SIZE)
+        return -1;
+
+    for (uint32_t i = 0; i < AEAD_KEY_SIZE; i++)
+    {
+        unsigned int byte;
+
+        if (sscanf(psk + 2 * i, "%2x", &byte) != 1)
+            return -1;
+        aeadPsk[i] = (uint8_t)byte;
+    }
+
+    if (cipher != NULL && strcmp(cipher, "chacha20-poly1305") && strcmp(cipher, "aes-256-gcm"))
+        return -1;
+
+    aeadDetect();
+    aeadGcm = aeadHasGcm() && (cipher == NULL || strcmp(cipher, "chacha20-poly1305"));
+    aeadOn = 1;
+
+    return 0;
+}
+
+int aeadEnabled()
+{
+    return aeadOn;
+}
+
+uint16_t aeadCaps()
+{
+    return aeadGcm ? AEAD_CAP_GCM : 0;
+}
+
+void aeadPeerCaps(uint16_t caps)
+{
+    aeadPeerGcm = (caps & AEAD_CAP_GCM) != 0;
+}
+
+int aeadHello(uint8_t *nonce)
+{
+    if (getrandom(aeadHelloNonce, AEAD_NONCE_SIZE, 0) != AEAD_NONCE_SIZE)
+    {
+        perror("aeadHello(): getrandom()");
+        return -1;
+    }
+
+    memcpy(nonce, aeadHelloNonce, AEAD_NONCE_SIZE);
+
+    return 0;
+}
+
+void aeadPeerHello(const uint8_t *nonce)
+{
+    memcpy(aeadPeerHelloNonce, nonce, AEAD_NONCE_SIZE);
+}
+
+int aeadTakeHello(const uint8_t *bytes, uint32_t n)
+{
+    if (!((const CrudpHeader_t *)bytes)->hello || n < HEADER_SIZE + AEAD_OVERHEAD + AEAD_HELLO_SIZE)
+        return -1;
+
+    // the sender of the hello put its own nonce first
+    memcpy(aeadPeerHelloNonce, bytes + n - AEAD_HELLO_SIZE, AEAD_NONCE_SIZE);
+    memcpy(aeadHelloNonce, bytes + n - AEAD_NONCE_SIZE, AEAD_NONCE_SIZE);
+
+    return 0;
+}
+
+/**
+ * @brief HChaCha20 (XChaCha20 draft), a key from a key and a 16 byte nonce
+ *
+ */
+void hchacha(const uint32_t key[8], const uint8_t nonce[AEAD_NONCE_SIZE], uint32_t out[8])
+{
+    uint32_t x[16], words[4];
+
+    memcpy(words, nonce, sizeof(words));
+    chachaSetup(x, key, words[0], words + 1);
+
+    for (int i = 0; i < 10; i++)
+    {
+        CHACHA_QR(x[0], x[4], x[8], x[12])
+        CHACHA_QR(x[1], x[5], x[9], x[13])
+        CHACHA_QR(x[2], x[6], x[10], x[14])
+        CHACHA_QR(x[3], x[7], x[11], x[15])
+        CHACHA_QR(x[0], x[5], x[10], x[15])
+        CHACHA_QR(x[1], x[6], x[11], x[12])
+        CHACHA_QR(x[2], x[7], x[8], x[13])
+        CHACHA_QR(x[3], x[4], x[9], x[14])
+    }
+
+    memcpy(out, x, 16);
+    memcpy(out + 4, x + 12, 16);
+    memset(x, 0, sizeof(x));
+}
+
+/**
+ * @brief Key of one direction: the pre-shared key goes through HChaCha20 with
+ *        the nonce of each end, the first 32 bytes of the ChaCha20 block keyed
+ *        by the result are the key, its nonce holds the direction and both ISNs.
+ *        A fresh random nonce from either end is enough for a key never used before.
+ *
+ */
+void aeadDerive(CrudpAeadKey_t *key, uint32_t direction, uint32_t txIsn, uint32_t rxIsn,
+                const uint8_t *txNonce, const uint8_t *rxNonce)
+{
+    uint32_t state[16], nonce[3] = {direction, txIsn, rxIsn}, mixed[8];
+    uint8_t block[CHACHA_BLOCK];
+
+    hchacha((const uint32_t *)aeadPsk, txNonce, mixed);
+    hchacha(mixed, rxNonce, mixed);
+
+    chachaSetup(state, mixed, 0, nonce);
+    chachaBlock(state, block);
+    aeadSetKey(key, block);
+
+    memset(block, 0, sizeof(block));
+    memset(state, 0, sizeof(state));
+    memset(mixed, 0, sizeof(mixed));
+}
+
+void aeadStart(uint32_t txIsn, uint32_t rxIsn, int transmitter)
+{
+    const uint8_t *txNonce = transmitter ? aeadHelloNonce : aeadPeerHelloNonce,
+                  *rxNonce = transmitter ? aeadPeerHelloNonce : aeadHelloNonce;
+
+    if (!aeadOn)
+        return;
+
+    // direction 0 carries the file, direction 1 the acknowledgements
+    aeadDerive(&aeadSendKey, transmitter ? 0 : 1, txIsn, rxIsn, txNonce, rxNonce);
+    aeadDerive(&aeadRecvKey, transmitter ? 1 : 0, txIsn, rxIsn, txNonce, rxNonce);
+    aeadSendCounter = 0;
+    aeadStarted = 1;
+}
+
+void aeadStop()
+{
+    aeadStarted = 0;
+}
+
+int aeadActive()
+{
+    return aeadStarted;
+}
+
+int aeadSeal(const CrudpBuffer_t *buffer, CrudpPacket_t *out)
+{
+    uint32_t len = buffer->n - HEADER_SIZE + buffer->payloadLen;
+    uint8_t *text = out->bytes + HEADER_SIZE;
+    CrudpHeader_t *header = (CrudpHeader_t *)out->bytes;
+    int gcm = aeadGcm && aeadPeerGcm;
+
+    memcpy(out->bytes, buffer->bytes, buffer->n);
+    memcpy(out->bytes + buffer->n, buffer->payload, buffer->payloadLen);
+    header->gcm = gcm;
+
+    aeadEncrypt(&aeadSendKey, gcm, aeadSendCounter, out->bytes, HEADER_SIZE, text, text, len, text + len + AEAD_COUNTER_SIZE);
+    memcpy(text + len, &aeadSendCounter, AEAD_COUNTER_SIZE);
+    aeadSendCounter++;
+
+    out->n = HEADER_SIZE + len + AEAD_OVERHEAD;
+
+    // a listener with SYN cookies learns the nonces here, its own one first for the peer
+    if (header->hello)
+    {
+        memcpy(out->bytes + out->n, aeadHelloNonce, AEAD_NONCE_SIZE);
+        memcpy(out->bytes + out->n + AEAD_NONCE_SIZE, aeadPeerHelloNonce, AEAD_NONCE_SIZE);
+        out->n += AEAD_HELLO_SIZE;
+    }
+
+    return (int)out->n;
+}
+
+int aeadOpen(uint8_t *bytes, uint32_t n)
+{
+    const CrudpHeader_t *header = (const CrudpHeader_t *)bytes;
+    uint8_t *text = bytes + HEADER_SIZE;
+    uint32_t len;
+    uint64_t counter;
+
+    // the nonces of a hello are not sealed, the keys made from them check them
+    if (header->hello)
+    {
+        if (n < HEADER_SIZE + AEAD_OVERHEAD + AEAD_HELLO_SIZE)
+            return -1;
+        n -= AEAD_HELLO_SIZE;
+    }
+
+    if (n < HEADER_SIZE + AEAD_OVERHEAD)
+        return -1;
+
+    len = n - HEADER_SIZE - AEAD_OVERHEAD;
+    memcpy(&counter, text + len, AEAD_COUNTER_SIZE);
+
+    // AES-256-GCM is only sent once both ends advertised it
+    if (header->gcm && !aeadGcm)
+        return -1;
+
+    if (aeadDecrypt(&aeadRecvKey, header->gcm, counter, bytes, HEADER_SIZE, text, text, len, text + len + AEAD_COUNTER_SIZE))
+        return -1;
+
+    return (int)(HEADER_SIZE + len);
+}
@@ -0,0 +1,185 @@
+#ifndef __CrudpAead_h__
+#define __CrudpAead_h__
+
+#include <inttypes.h>
+
+#include "CrudpSocket.h"
+
+#define AEAD_KEY_SIZE ((uint32_t)32)
+#define AEAD_TAG_SIZE ((uint32_t)16)
+#define AEAD_COUNTER_SIZE ((uint32_t)8)                       // nonce counter, sent in the clear
+#define AEAD_OVERHEAD (AEAD_COUNTER_SIZE + AEAD_TAG_SIZE)     // trailer after the ciphertext
+
+#define AEAD_NONCE_SIZE ((uint32_t)16)                        // random bytes of one end, payload of its SYN or SYN,ACK
+#define AEAD_HELLO_SIZE (2 * AEAD_NONCE_SIZE)                 // both of them, after a sealed hello ACK
+
+#define AEAD_CAP_GCM ((uint16_t)0x1) // wn bit of a SYN or SYN,ACK: AES-256-GCM is supported
+
+/**
+ * @brief Expanded key of one direction
+ *        the AES round keys and the GHASH powers are only set up with AES-NI
+ */
+typedef struct CrudpAeadKey_s
+{
+    uint32_t chacha[8];
+    _Alignas(16) uint8_t aesRounds[15][16];
+    _Alignas(16) uint8_t ghashPowers[8][16]; // H^1 .. H^8
+} CrudpAeadKey_t;
+
+/**
+ * @brief Enable the AEAD mode with a pre-shared key
+ *        ChaCha20-Poly1305 by default, AES-256-GCM when both ends have AES-NI
+ *        and PCLMULQDQ, unless 'cipher' is "chacha20-poly1305"
+ *
+ * @param psk 64 hex digits
+ * @param cipher NULL or "chacha20-poly1305" to never use AES-256-GCM
+ * @return int 0 on success, -1 if the key is malformed
+ */
+int aeadInit(const char *psk, const char *cipher);
+
+/**
+ * @brief Is the AEAD mode configured?
+ *
+ * @return int 1 if it is
+ */
+int aeadEnabled();
+
+/**
+ * @brief Capabilities to advertise in the wn field of a SYN or SYN,ACK
+ *
+ * @return uint16_t AEAD_CAP_* bits
+ */
+uint16_t aeadCaps();
+
+/**
+ * @brief Remember what the peer advertised in its SYN or SYN,ACK
+ *
+ * @param caps AEAD_CAP_* bits
+ */
+void aeadPeerCaps(uint16_t caps);
+
+/**
+ * @brief Draw the random nonce of this end, a new one for every SYN or SYN,ACK
+ *
+ * @param nonce AEAD_NONCE_SIZE bytes to fill, the payload of the SYN
+ * @return int 0 on success, -1 if no random bytes are available
+ */
+int aeadHello(uint8_t *nonce);
+
+/**
+ * @brief Remember the nonce the peer sent in its SYN or SYN,ACK
+ *
+ * @param nonce AEAD_NONCE_SIZE bytes
+ */
+void aeadPeerHello(const uint8_t *nonce);
+
+/**
+ * @brief Take both nonces back from a sealed hello ACK,
+ *        a stateless listener kept neither of them
+ *
+ * @param bytes datagram, header first
+ * @param n size of the datagram
+ * @return int 0 on success, -1 if it is no hello
+ */
+int aeadTakeHello(const uint8_t *bytes, uint32_t n);
+
+/**
+ * @brief Derive the keys of the connection from the pre-shared key,
+ *        the nonces of both ends and both initial sequence numbers,
+ *        each direction has its own key
+ *
+ * @param txIsn initial sequence number of the transmitter
+ * @param rxIsn initial sequence number of the receiver
+ * @param transmitter 1 on the transmitter
+ */
+void aeadStart(uint32_t txIsn, uint32_t rxIsn, int transmitter);
+
+/**
+ * @brief Back to datagrams in the clear, e.g. when the first sealed one is forged
+ *
+ */
+void aeadStop();
+
+/**
+ * @brief Are datagrams sealed?
+ *        from aeadStart() on, SYNs stay in the clear
+ *
+ * @return int 1 if they are
+ */
+int aeadActive();
+
+/**
+ * @brief Seal a datagram into a packet: header in the clear as associated data,
+ *        ciphertext, nonce counter and tag, then both nonces for a hello
+ *
+ * @param buffer datagram to seal, header first
+ * @param out packet to fill
+ * @return int size of the sealed datagram
+ */
+int aeadSeal(const CrudpBuffer_t *buffer, CrudpPacket_t *out);
+
+/**
+ * @brief Check and decrypt a sealed datagram in place, the nonces of a hello are skipped
+ *
+ * @param bytes datagram, header first
+ * @param n size of the datagram
+ * @return int size of the datagram without the trailer, -1 if it is forged or corrupted
+ */
+int aeadOpen(uint8_t *bytes, uint32_t n);
+
+/**
+ * @brief Expand a key for both ciphers
+ *
+ * @param key expanded key
+ * @param raw 32 bytes
+ */
+void aeadSetKey(CrudpAeadKey_t *key, const uint8_t *raw);
+
+/**
+ * @brief Encrypt and authenticate, in and out may be the same
+ *
+ * @param key expanded key
+ * @param gcm 1 for AES-256-GCM, 0 for ChaCha20-Poly1305
+ * @param counter nonce, never used twice with the same key
+ * @param ad associated data
+ * @param adLen its length
+ * @param in plaintext
+ * @param out ciphertext
+ * @param len length of both
+ * @param tag AEAD_TAG_SIZE bytes
+ */
+void aeadEncrypt(const CrudpAeadKey_t *key, int gcm, uint64_t counter, const uint8_t *ad, uint32_t adLen,
+                 const uint8_t *in, uint8_t *out, uint32_t len, uint8_t *tag);
+
+/**
+ * @brief Check and decrypt, in and out may be the same
+ *
+ * @return int 0 if the tag matches, -1 otherwise
+ */
+int aeadDecrypt(const CrudpAeadKey_t *key, int gcm, uint64_t counter, const uint8_t *ad, uint32_t adLen,
+                const uint8_t *in, uint8_t *out, uint32_t len, const uint8_t *tag);
+
+/**
+ * @brief Check the ciphers against known answers, RFC 8439 and the GCM specification,
+ *        with every ChaCha20 kernel this CPU runs
+ *
+ * @return int 0 if all of them match, -1 otherwise
+ */
+int aeadSelfTest();
+
+/**
+ * @brief Name of the vector kernels in use
+ *
+ * @param gcm 1 for AES-256-GCM
+ * @return const char* e.g. "avx512"
+ */
+const char *aeadKernel(int gcm);
+
+/**
+ * @brief Can AES-256-GCM be used on this CPU?
+ *
+ * @return int 1 with AES-NI and PCLMULQDQ
+ */
+int aeadHasGcm();
+
+#endif
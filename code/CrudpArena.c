@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <errno.h>
+void perror(const char *s);
+
+#include "CrudpArena.h"
+
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0x40000
+#endif
+
+int arenaBacking = ARENA_PAGES;
+int arenaPrefault = 0;
+uint64_t arenaHuge = 0;
+
+void arenaSetup(int backing, int prefault)
+{
+    arenaBacking = backing;
+    arenaPrefault = prefault;
+}
+
+int arenaPrefaulted()
+{
+    return arenaPrefault;
+}
+
+size_t arenaSlab(size_t size)
+{
+    return arenaBacking != ARENA_PAGES && size < ARENA_HUGE_SIZE ? ARENA_HUGE_SIZE : size;
+}
+
+/**
+ * @brief Is the buffer mapped on its own rather than taken from the heap?
+ *
+ * @param size bytes asked for
+ * @return int 1 if so
+ */
+int arenaMapped(size_t size)
+{
+    return arenaBacking != ARENA_PAGES && size >= ARENA_HUGE_SIZE;
+}
+
+/**
+ * @brief Map huge page aligned memory and advise it to khugepaged
+ *        the mapping is trimmed to the alignment, every huge page is whole
+ *
+ * @param len bytes, a multiple of ARENA_HUGE_SIZE
+ * @return void* buffer, NULL if out of memory
+ */
+void *arenaAdvised(size_t len)
+{
+    uint8_t *raw = mmap(NULL, len + ARENA_HUGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    uint8_t *base;
+    size_t head;
+
+    if (raw == MAP_FAILED)
+    {
+        perror("arenaAlloc(): mmap()");
+        return NULL;
+    }
+
+    head = (ARENA_HUGE_SIZE - (uintptr_t)raw % ARENA_HUGE_SIZE) % ARENA_HUGE_SIZE;
+    base = raw + head;
+    if (head > 0)
+        munmap(raw, head);
+    munmap(base + len, ARENA_HUGE_SIZE - head);
+
+    // a kernel without THP keeps small pages, that is the fallback
+    if (madvise(base, len, MADV_HUGEPAGE) == 0)
+        arenaHuge += len;
+
+    return base;
+}
+
+void *arenaAlloc(size_t size)
+{
+    size_t len = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+    uint8_t *base = NULL;
+
+    if (len == 0)
+        len = ARENA_ALIGN;
+
+    if (!arenaMapped(size))
+    {
+        if ((base = aligned_alloc(ARENA_ALIGN, len)) == NULL)
+        {
+            perror("arenaAlloc(): aligned_alloc()");
+            return NULL;
+        }
+        memset(base, 0, len);
+        return base;
+    }
+
+    len = (size + ARENA_HUGE_SIZE - 1) / ARENA_HUGE_SIZE * ARENA_HUGE_SIZE;
+
+    // the reserved pool may be empty or absent, nothing to report then
+    if (arenaBacking == ARENA_HUGETLB)
+    {
+        base = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (arenaPrefault ? MAP_POPULATE : 0), -1, 0);
+        if (base != MAP_FAILED)
+        {
+            arenaHuge += len;
+            return base;
+        }
+    }
+
+    if ((base = arenaAdvised(len)) != NULL && arenaPrefault)
+        for (size_t i = 0; i < len; i += ARENA_PAGE_SIZE)
+            ((volatile uint8_t *)base)[i] = 0;
+
+    return base;
+}
+
+void arenaFree(void *base, size_t size)
+{
+    if (base == NULL)
+        return;
+
+    if (arenaMapped(size))
+        munmap(base, (size + ARENA_HUGE_SIZE - 1) / ARENA_HUGE_SIZE * ARENA_HUGE_SIZE);
+    else
+        free(base);
+}
+
+uint64_t arenaHugeBytes()
+{
+    return arenaHuge;
+}
@@ -0,0 +1,65 @@
+#ifndef __CrudpArena_h__
+#define __CrudpArena_h__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#define ARENA_ALIGN ((size_t)64)                  // cache line, what the packet pool needs
+#define ARENA_PAGE_SIZE ((size_t)4096)            // stride of the pre-fault
+#define ARENA_HUGE_SIZE ((size_t)2 * 1024 * 1024) // huge page, smaller arenas stay on the heap
+
+// What backs the arenas, CRUDP_HUGEPAGES picks one
+#define ARENA_PAGES 0   // heap, the default
+#define ARENA_THP 1     // transparent huge pages, madvise(MADV_HUGEPAGE)
+#define ARENA_HUGETLB 2 // MAP_HUGETLB from the reserved pool, else as ARENA_THP
+
+/**
+ * @brief Choose how the arenas are backed, before the first arenaAlloc()
+ *
+ * @param backing ARENA_PAGES, ARENA_THP or ARENA_HUGETLB
+ * @param prefault touch every page once allocated, no fault on the data path
+ */
+void arenaSetup(int backing, int prefault);
+
+/**
+ * @brief Does arenaSetup() ask for pre-faulted memory?
+ *
+ * @return int 1 if so
+ */
+int arenaPrefaulted();
+
+/**
+ * @brief Size a buffer that grows in slabs should take at once
+ *        a whole huge page when the arenas are made of them
+ *
+ * @param size bytes the caller would take
+ * @return size_t bytes to allocate, at least 'size'
+ */
+size_t arenaSlab(size_t size);
+
+/**
+ * @brief Allocate a zeroed, cache aligned buffer
+ *        from ARENA_HUGE_SIZE on it is made of huge pages when asked for
+ *        and of small pages where the system has none
+ *
+ * @param size bytes
+ * @return void* buffer, NULL if out of memory
+ */
+void *arenaAlloc(size_t size);
+
+/**
+ * @brief Release a buffer of arenaAlloc()
+ *
+ * @param base buffer, NULL is ignored
+ * @param size the size it was allocated with
+ */
+void arenaFree(void *base, size_t size);
+
+/**
+ * @brief Bytes allocated on huge pages so far, hugetlbfs or advised
+ *
+ * @return uint64_t bytes
+ */
+uint64_t arenaHugeBytes();
+
+#endif
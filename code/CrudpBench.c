@@ -0,0 +1,950 @@
+/*
+  Loopback benchmark for CRUDP.
+
+  Runs a transmitter and a receiver on this host for every file size
+  and every delay/loss/rate setting, then the same transfer over kernel
+  TCP as a baseline. Results are written as JSON.
+
+  CRUDP is impaired by its own emulator (CRUDP_IMPAIR), seeded so that
+  every run is repeatable. TCP is impaired with netem when available.
+
+  usage: CrudpBench [-o out.json] [-f files dir] [-g generated sizes]
+                    [-d delays ms] [-l losses %] [-r rates kbit]
+                    [-p base port] [-t timeout s] [-c Crudp binary]
+                    [-s seed]
+         CrudpBench -T timers [-o out.json]
+         CrudpBench -A segments [-o out.json]
+         CrudpBench -M megabytes [-o out.json]
+  -T only runs the timer wheel micro benchmark with that many timers armed
+  -A only seals and opens that many full segments with each AEAD cipher
+  -M only fills and drains a packet arena that large on each page size
+  lists are comma separated, e.g. -d 0,10 -l 0,1 -r 0,10000
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include <errno.h>
+void perror(const char *s);
+
+#include "CrudpTimer.h"
+#include "CrudpAead.h"
+#include "CrudpArena.h"
+
+#define ERROR(_s) fprintf(stderr, "%s\n", _s)
+
+#define BENCH_MAX_FILES ((int)32)
+#define BENCH_MAX_GRID ((int)16)
+#define BENCH_PATH ((int)1024)
+#define BENCH_TCP_CHUNK ((int)65536)
+#define BENCH_TIMER_SPAN ((uint64_t)10000) // ms
+#define BENCH_ARENA_PACKET ((size_t)2048)   // a pooled packet
+#define BENCH_ARENA_ROUNDS ((long)4)        // every packet is filled this often on average
+#define BENCH_ARENA_RUNS ((int)3)
+
+typedef struct BenchFile_s
+{
+    char path[BENCH_PATH];
+    char name[256];
+    long size;
+} BenchFile_t;
+
+typedef struct BenchPoint_s
+{
+    double delay; // ms
+    double loss;  // percent
+    long rate;    // kbit/s, 0 is unlimited
+} BenchPoint_t;
+
+typedef struct BenchResult_s
+{
+    const char *status;
+    double wall;  // seconds
+    double cpuTx; // seconds of user + system time
+    double cpuRx;
+    long retransmissions;
+    long segmentsSent;
+} BenchResult_t;
+
+// Command line settings
+char *outName = "bench.json",
+     *filesDir = "../files",
+     *crudpPath = "./Crudp";
+int basePort = 47000;
+int timeout = 60;
+int seed = 1;
+long timers = 0;
+long aeadSegments = 0;
+long arenaMegabytes = 0;
+
+double delays[BENCH_MAX_GRID] = {0},
+       losses[BENCH_MAX_GRID] = {0};
+long rates[BENCH_MAX_GRID] = {0};
+int nDelays = 1, nLosses = 1, nRates = 1;
+
+long generated[BENCH_MAX_GRID] = {2097152, 8388608};
+int nGenerated = 2;
+
+BenchFile_t files[BENCH_MAX_FILES];
+int nFiles = 0;
+
+char workDir[64];
+
+int parseList(char *list, double *values);
+void findFiles();
+void generateFiles();
+int applyNetem(const BenchPoint_t *point);
+void clearNetem();
+void runCrudp(const BenchFile_t *file, const BenchPoint_t *point, BenchResult_t *result);
+void runTcp(const BenchFile_t *file, BenchResult_t *result);
+void writeResult(FILE *out, const char *impl, const BenchFile_t *file,
+                 const BenchPoint_t *point, const BenchResult_t *result, int first);
+double now();
+void benchTimers(FILE *out);
+void benchAead(FILE *out);
+void benchArena(FILE *out);
+
+int main(int argc, char *argv[])
+{
+    double values[BENCH_MAX_GRID];
+    int c, first = 1;
+    FILE *out;
+
+    while ((c = getopt(argc, argv, "o:f:g:d:l:r:p:t:c:s:T:A:M:")) != -1)
+    {
+        switch (c)
+        {
+        case 'o':
+            outName = optarg;
+            break;
+        case 'f':
+            filesDir = optarg;
+            break;
+        case 'c':
+            crudpPath = optarg;
+            break;
+        case 'g':
+            nGenerated = parseList(optarg, values);
+            for (int i = 0; i < nGenerated; i++)
+                generated[i] = (long)values[i];
+            break;
+        case 'd':
+            nDelays = parseList(optarg, delays);
+            break;
+        case 'l':
+            nLosses = parseList(optarg, losses);
+            break;
+        case 'r':
+            nRates = parseList(optarg, values);
+            for (int i = 0; i < nRates; i++)
+                rates[i] = (long)values[i];
+            break;
+        case 'p':
+            basePort = atoi(optarg);
+            break;
+        case 't':
+            timeout = atoi(optarg);
+            break;
+        case 's':
+            seed = atoi(optarg);
+            break;
+        case 'T':
+            timers = atol(optarg);
+            break;
+        case 'A':
+            aeadSegments = atol(optarg);
+            break;
+        case 'M':
+            arenaMegabytes = atol(optarg);
+            break;
+        default:
+            ERROR("usage: CrudpBench [-o out.json] [-f files dir] [-g sizes] [-d delays] [-l losses] [-r rates] [-p port] [-t timeout] [-c Crudp] [-s seed] [-T timers] [-A segments] [-M megabytes]");
+            exit(1);
+        }
+    }
+
+    if (timers > 0 || aeadSegments > 0 || arenaMegabytes > 0)
+    {
+        if ((out = fopen(outName, "w")) == NULL)
+        {
+            perror("fopen()");
+            exit(1);
+        }
+        if (timers > 0)
+            benchTimers(out);
+        else if (aeadSegments > 0)
+            benchAead(out);
+        else
+            benchArena(out);
+        fclose(out);
+        return 0;
+    }
+
+    strcpy(workDir, "/tmp/crudp-bench-XXXXXX");
+    if (mkdtemp(workDir) == NULL)
+    {
+        perror("mkdtemp()");
+        exit(1);
+    }
+
+    findFiles();
+    generateFiles();
+
+    if ((out = fopen(outName, "w")) == NULL)
+    {
+        perror("fopen()");
+        exit(1);
+    }
+
+    fprintf(out, "{\n  \"timestamp\": %ld,\n  \"timeout_s\": %d,\n  \"seed\": %d,\n  \"runs\": [", (long)time(NULL), timeout, seed);
+
+    for (int d = 0; d < nDelays; d++)
+        for (int l = 0; l < nLosses; l++)
+            for (int r = 0; r < nRates; r++)
+            {
+                BenchPoint_t point = {delays[d], losses[l], rates[r]};
+
+                for (int f = 0; f < nFiles; f++)
+                {
+                    BenchResult_t crudp, tcp;
+                    int impaired;
+
+                    // CRUDP impairs itself, netem on lo is for TCP alone
+                    runCrudp(&files[f], &point, &crudp);
+                    impaired = applyNetem(&point);
+
+                    if (impaired < 0)
+                    {
+                        memset(&tcp, 0, sizeof(tcp));
+                        tcp.status = "skipped";
+                    }
+                    else
+                    {
+                        runTcp(&files[f], &tcp);
+                    }
+
+                    if (impaired > 0)
+                        clearNetem();
+
+                    fprintf(stderr, "%-12s %8.1fms %5.1f%% %7ldkbit  crudp %-8s %9.4fs  tcp %-8s %9.4fs\n",
+                            files[f].name, point.delay, point.loss, point.rate,
+                            crudp.status, crudp.wall, tcp.status, tcp.wall);
+
+                    writeResult(out, "crudp", &files[f], &point, &crudp, first);
+                    writeResult(out, "tcp", &files[f], &point, &tcp, 0);
+                    first = 0;
+                }
+            }
+
+    fprintf(out, "\n  ]\n}\n");
+    fclose(out);
+
+    for (int f = 0; f < nFiles; f++)
+        if (strncmp(files[f].path, workDir, strlen(workDir)) == 0)
+            unlink(files[f].path);
+    rmdir(workDir);
+
+    return 0;
+}
+
+/**
+ * @brief Parse a comma separated list
+ *
+ * @param list text to parse
+ * @param values parsed values
+ * @return int number of values
+ */
+int parseList(char *list, double *values)
+{
+    int n = 0;
+
+    for (char *token = strtok(list, ","); token != NULL && n < BENCH_MAX_GRID; token = strtok(NULL, ","))
+    {
+        values[n++] = atof(token);
+    }
+
+    return n;
+}
+
+int compareFiles(const void *a, const void *b)
+{
+    long d = ((const BenchFile_t *)a)->size - ((const BenchFile_t *)b)->size;
+
+    return d < 0 ? -1 : d > 0;
+}
+
+/**
+ * @brief Collect the sample files, smallest first
+ *
+ */
+void findFiles()
+{
+    DIR *dir;
+    struct dirent *entry;
+    struct stat st;
+
+    if ((dir = opendir(filesDir)) == NULL)
+    {
+        perror("findFiles(): opendir()");
+        return;
+    }
+
+    while ((entry = readdir(dir)) != NULL && nFiles < BENCH_MAX_FILES)
+    {
+        BenchFile_t *file = &files[nFiles];
+
+        snprintf(file->path, sizeof(file->path), "%s/%s", filesDir, entry->d_name);
+        if (stat(file->path, &st) < 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        snprintf(file->name, sizeof(file->name), "%s", entry->d_name);
+        file->size = st.st_size;
+        nFiles++;
+    }
+    closedir(dir);
+
+    qsort(files, nFiles, sizeof(BenchFile_t), compareFiles);
+}
+
+/**
+ * @brief Generate text files larger than the samples
+ *        The receiver writes text, so the content stays printable
+ */
+void generateFiles()
+{
+    for (int g = 0; g < nGenerated && nFiles < BENCH_MAX_FILES; g++)
+    {
+        BenchFile_t *file = &files[nFiles];
+        FILE *out;
+
+        snprintf(file->name, sizeof(file->name), "%ld.txt", generated[g]);
+        snprintf(file->path, sizeof(file->path), "%s/%ld.txt", workDir, generated[g]);
+        file->size = generated[g];
+
+        if ((out = fopen(file->path, "w")) == NULL)
+        {
+            perror("generateFiles(): fopen()");
+            continue;
+        }
+
+        for (long i = 0; i < generated[g]; i++)
+        {
+            fputc(i % 64 == 63 ? '\n' : 'a' + (i * 7 + i / 64) % 26, out);
+        }
+        fclose(out);
+        nFiles++;
+    }
+}
+
+/**
+ * @brief Apply the grid point on the loopback device with netem
+ *        for the TCP baseline
+ *
+ * @param point delay/loss/rate to apply
+ * @return int 0 if nothing to apply, 1 if applied, -1 if netem is unavailable
+ */
+int applyNetem(const BenchPoint_t *point)
+{
+    char command[256];
+    int n;
+
+    if (point->delay == 0 && point->loss == 0 && point->rate == 0)
+        return 0;
+
+    n = snprintf(command, sizeof(command), "tc qdisc replace dev lo root netem");
+    if (point->delay > 0)
+        n += snprintf(command + n, sizeof(command) - n, " delay %.3fms", point->delay);
+    if (point->loss > 0)
+        n += snprintf(command + n, sizeof(command) - n, " loss %.3f%%", point->loss);
+    if (point->rate > 0)
+        n += snprintf(command + n, sizeof(command) - n, " rate %ldkbit", point->rate);
+    snprintf(command + n, sizeof(command) - n, " 2>/dev/null");
+
+    if (system(command) != 0)
+    {
+        ERROR("applyNetem(): netem is unavailable, skipping the TCP baseline");
+        return -1;
+    }
+
+    return 1;
+}
+
+void clearNetem()
+{
+    if (system("tc qdisc del dev lo root 2>/dev/null") != 0)
+    {
+        ERROR("clearNetem(): tc qdisc del problem");
+    }
+}
+
+double now()
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (double)t.tv_sec + (double)t.tv_nsec / 1000000000;
+}
+
+double cpuSeconds(const struct rusage *usage)
+{
+    return usage->ru_utime.tv_sec + usage->ru_utime.tv_usec / 1e6 +
+           usage->ru_stime.tv_sec + usage->ru_stime.tv_usec / 1e6;
+}
+
+/**
+ * @brief Wait for both children, killing them after the timeout
+ *
+ * @param pids transmitter and receiver
+ * @param usage rusage of each child
+ * @param status exit status of each child
+ * @return int 0 if both exited, -1 on timeout
+ */
+int waitBoth(pid_t *pids, struct rusage *usage, int *status)
+{
+    double deadline = now() + timeout;
+    int left = 2, timedOut = 0;
+
+    while (left > 0)
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            if (pids[i] > 0 && wait4(pids[i], &status[i], WNOHANG, &usage[i]) == pids[i])
+            {
+                pids[i] = 0;
+                left--;
+            }
+        }
+
+        if (left > 0 && !timedOut && now() > deadline)
+        {
+            timedOut = 1;
+            for (int i = 0; i < 2; i++)
+                if (pids[i] > 0)
+                    kill(pids[i], SIGKILL);
+        }
+
+        if (left > 0)
+            usleep(1000);
+    }
+
+    return timedOut ? -1 : 0;
+}
+
+/**
+ * @brief Compare the received file with the source file
+ *
+ * @return int 1 if both are the same
+ */
+int sameFile(const char *a, const char *b)
+{
+    FILE *fa = fopen(a, "rb"), *fb = fopen(b, "rb");
+    int same = fa != NULL && fb != NULL;
+
+    while (same)
+    {
+        int ca = fgetc(fa), cb = fgetc(fb);
+
+        if (ca != cb)
+            same = 0;
+        if (ca == EOF || cb == EOF)
+            break;
+    }
+
+    if (fa)
+        fclose(fa);
+    if (fb)
+        fclose(fb);
+
+    return same;
+}
+
+/**
+ * @brief Read one counter from a stats file
+ *
+ * @return long value or -1 if missing
+ */
+long readMetric(const char *path, const char *name)
+{
+    char line[512];
+    long value = -1;
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL)
+        return -1;
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        if (strncmp(line, name, strlen(name)) == 0 && line[strlen(name)] == '{')
+        {
+            char *space = strrchr(line, ' ');
+            value = space ? atol(space + 1) : -1;
+            break;
+        }
+    }
+    fclose(file);
+
+    return value;
+}
+
+/**
+ * @brief Fork a CRUDP end point with its ports and output redirected
+ *
+ */
+pid_t spawnCrudp(const char *role, const char *file, int port, int peerPort,
+                 const char *stats, const char *output, const char *impair)
+{
+    pid_t pid = fork();
+
+    if (pid == 0)
+    {
+        char value[32];
+        int null = open("/dev/null", O_WRONLY);
+
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+
+        snprintf(value, sizeof(value), "%d", port);
+        setenv("CRUDP_PORT", value, 1);
+        snprintf(value, sizeof(value), "%d", peerPort);
+        setenv("CRUDP_PEER_PORT", value, 1);
+        setenv("CRUDP_STATS_FILE", stats, 1);
+        setenv("CRUDP_OUTPUT", output, 1);
+        setenv("CRUDP_IMPAIR", impair, 1);
+
+        execl(crudpPath, crudpPath, "127.0.0.1", role, file, (char *)0);
+        _exit(127);
+    }
+
+    return pid;
+}
+
+void runCrudp(const BenchFile_t *file, const BenchPoint_t *point, BenchResult_t *result)
+{
+    char output[BENCH_PATH], txStats[BENCH_PATH], rxStats[BENCH_PATH], impair[256];
+    struct rusage usage[2];
+    int status[2];
+    pid_t pids[2];
+    double start;
+
+    memset(result, 0, sizeof(*result));
+    memset(usage, 0, sizeof(usage));
+    snprintf(output, sizeof(output), "%s/crudp.out", workDir);
+    snprintf(txStats, sizeof(txStats), "%s/tx.prom", workDir);
+    snprintf(rxStats, sizeof(rxStats), "%s/rx.prom", workDir);
+    unlink(output);
+    unlink(txStats);
+
+    snprintf(impair, sizeof(impair), "seed=%d,delay=%g,loss=%g,rate=%ld",
+             seed, point->delay, point->loss, point->rate);
+
+    // The transmitter listens, so it has to be up before the receiver sends SYN
+    start = now();
+    pids[0] = spawnCrudp("-t", file->path, basePort, basePort + 1, txStats, output, impair);
+    usleep(50000);
+    pids[1] = spawnCrudp("-r", NULL, basePort + 1, basePort, rxStats, output, impair);
+
+    if (waitBoth(pids, usage, status) < 0)
+        result->status = "timeout";
+    else if (!sameFile(file->path, output))
+        result->status = "corrupt";
+    else
+        result->status = "ok";
+
+    // the transmitter was started 50 ms ahead of the receiver
+    result->wall = now() - start - 0.05;
+    result->cpuTx = cpuSeconds(&usage[0]);
+    result->cpuRx = cpuSeconds(&usage[1]);
+    result->retransmissions = readMetric(txStats, "crudp_retransmissions_total");
+    result->segmentsSent = readMetric(txStats, "crudp_segments_sent_total");
+
+    unlink(output);
+    unlink(txStats);
+    unlink(rxStats);
+}
+
+/**
+ * @brief Kernel TCP sender, reads the whole file first like CRUDP does
+ *
+ */
+void tcpSend(const char *path, int port)
+{
+    struct sockaddr_in addr;
+    char *buffer;
+    long size;
+    FILE *file = fopen(path, "rb");
+    int sd = socket(PF_INET, SOCK_STREAM, 0);
+
+    if (file == NULL || sd < 0)
+        _exit(1);
+
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    rewind(file);
+    buffer = (char *)malloc(size + 1);
+    if (fread(buffer, 1, size, file) != (size_t)size)
+        _exit(1);
+    fclose(file);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    for (int tries = 0; connect(sd, (struct sockaddr *)&addr, sizeof(addr)) < 0; tries++)
+    {
+        if (tries > 1000)
+            _exit(1);
+        usleep(1000);
+    }
+
+    for (long sent = 0; sent < size;)
+    {
+        ssize_t r = write(sd, buffer + sent, size - sent);
+        if (r < 0)
+            _exit(1);
+        sent += r;
+    }
+
+    close(sd);
+    _exit(0);
+}
+
+/**
+ * @brief Kernel TCP receiver, writes everything to the output file
+ *
+ */
+void tcpRecv(int listenSd, const char *path)
+{
+    char buffer[BENCH_TCP_CHUNK];
+    FILE *file = fopen(path, "wb");
+    int sd = accept(listenSd, NULL, NULL);
+    ssize_t r;
+
+    if (file == NULL || sd < 0)
+        _exit(1);
+
+    while ((r = read(sd, buffer, sizeof(buffer))) > 0)
+    {
+        fwrite(buffer, 1, r, file);
+    }
+
+    fclose(file);
+    close(sd);
+    _exit(r < 0);
+}
+
+void runTcp(const BenchFile_t *file, BenchResult_t *result)
+{
+    char output[BENCH_PATH];
+    struct sockaddr_in addr;
+    struct rusage usage[2];
+    int status[2], one = 1;
+    pid_t pids[2];
+    double start;
+    int port = basePort + 2;
+    int sd = socket(PF_INET, SOCK_STREAM, 0);
+
+    memset(result, 0, sizeof(*result));
+    memset(usage, 0, sizeof(usage));
+    result->retransmissions = result->segmentsSent = -1;
+    snprintf(output, sizeof(output), "%s/tcp.out", workDir);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (sd < 0 || bind(sd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sd, 1) < 0)
+    {
+        perror("runTcp(): socket()/bind()/listen()");
+        result->status = "error";
+        if (sd >= 0)
+            close(sd);
+        return;
+    }
+
+    start = now();
+    if ((pids[1] = fork()) == 0)
+        tcpRecv(sd, output);
+    if ((pids[0] = fork()) == 0)
+        tcpSend(file->path, port);
+    close(sd);
+
+    if (waitBoth(pids, usage, status) < 0)
+        result->status = "timeout";
+    else if (!sameFile(file->path, output))
+        result->status = "corrupt";
+    else
+        result->status = "ok";
+
+    result->wall = now() - start;
+    result->cpuTx = cpuSeconds(&usage[0]);
+    result->cpuRx = cpuSeconds(&usage[1]);
+
+    unlink(output);
+}
+
+void writeResult(FILE *out, const char *impl, const BenchFile_t *file,
+                 const BenchPoint_t *point, const BenchResult_t *result, int first)
+{
+    int ok = strcmp(result->status, "ok") == 0;
+
+    fprintf(out, "%s\n    {\"impl\": \"%s\", \"file\": \"%s\", \"bytes\": %ld, "
+                 "\"delay_ms\": %g, \"loss_pct\": %g, \"rate_kbit\": %ld, "
+                 "\"status\": \"%s\", \"wall_s\": %.6f, \"goodput_Bps\": %.1f, "
+                 "\"retransmissions\": %ld, \"segments_sent\": %ld, "
+                 "\"cpu_tx_s\": %.6f, \"cpu_rx_s\": %.6f}",
+            first ? "" : ",", impl, file->name, file->size,
+            point->delay, point->loss, point->rate,
+            result->status, result->wall,
+            ok && result->wall > 0 ? file->size / result->wall : 0,
+            result->retransmissions, result->segmentsSent,
+            result->cpuTx, result->cpuRx);
+}
+
+long timersExpired = 0;
+
+void expireBenchTimer(CrudpTimer_t *timer)
+{
+    timersExpired++;
+}
+
+/**
+ * @brief Timer wheel micro benchmark
+ *        arms the timers up to 10 s ahead, cancels every other one,
+ *        then runs the wheel in 1 ms steps until all of them expired
+ */
+void benchTimers(FILE *out)
+{
+    CrudpTimer_t *wheelTimers = (CrudpTimer_t *)calloc(timers, sizeof(CrudpTimer_t));
+    uint64_t base = timerNow();
+    uint32_t armed;
+    double start, arm, cancel, advance;
+
+    srand(seed);
+    for (long i = 0; i < timers; i++)
+        timerSetup(&wheelTimers[i], expireBenchTimer, NULL);
+
+    start = now();
+    for (long i = 0; i < timers; i++)
+        timerArm(&wheelTimers[i], base + 1 + rand() % BENCH_TIMER_SPAN);
+    arm = now() - start;
+    armed = timerCount();
+
+    start = now();
+    for (long i = 0; i < timers; i += 2)
+        timerCancel(&wheelTimers[i]);
+    cancel = now() - start;
+
+    start = now();
+    for (uint64_t t = 1; t <= BENCH_TIMER_SPAN; t++)
+        timerAdvance(base + t);
+    advance = now() - start;
+
+    fprintf(stderr, "%ld timers: arm %.1f ns, cancel %.1f ns, %.1f ns per tick, %ld expired\n",
+            timers, arm * 1e9 / timers, cancel * 1e9 / ((timers + 1) / 2),
+            advance * 1e9 / BENCH_TIMER_SPAN, timersExpired);
+
+    fprintf(out, "{\n  \"timers\": %ld,\n  \"armed\": %" PRIu32 ",\n  \"arm_ns\": %.1f,\n"
+                 "  \"cancel_ns\": %.1f,\n  \"tick_ns\": %.1f,\n  \"expired\": %ld\n}\n",
+            timers, armed, arm * 1e9 / timers, cancel * 1e9 / ((timers + 1) / 2),
+            advance * 1e9 / BENCH_TIMER_SPAN, timersExpired);
+
+    free(wheelTimers);
+}
+
+/**
+ * @brief Time stamp counter, 0 where there is none
+ *
+ */
+uint64_t cycles()
+{
+#if defined(__x86_64__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Seal then open full segments with a 24 byte header as associated data,
+ *        the way every data segment goes out in the AEAD mode, once the known answers match
+ *
+ * @param out JSON file
+ */
+void benchAead(FILE *out)
+{
+    static uint8_t segment[MAX_WINDOW_SIZE], plain[MAX_WINDOW_SIZE], header[HEADER_SIZE], tag[AEAD_TAG_SIZE];
+    static CrudpAeadKey_t key;
+    uint8_t raw[AEAD_KEY_SIZE];
+    int ciphers = aeadHasGcm() ? 2 : 1;
+
+    // a fast kernel is no use if it is wrong, the known answers come before any timing
+    if (aeadSelfTest() < 0)
+    {
+        ERROR("benchAead(): a cipher does not match its known answers");
+        exit(1);
+    }
+    fprintf(stderr, "known answers ok: RFC 8439, GCM test case 16, a whole segment, every kernel\n");
+
+    srand(seed);
+    for (uint32_t i = 0; i < AEAD_KEY_SIZE; i++)
+        raw[i] = (uint8_t)rand();
+    for (uint32_t i = 0; i < MAX_WINDOW_SIZE; i++)
+        segment[i] = (uint8_t)rand();
+    aeadSetKey(&key, raw);
+
+    fprintf(out, "{\n  \"segments\": %ld,\n  \"segment_bytes\": %" PRIu32 ",\n  \"known_answers\": \"ok\",\n  \"ciphers\": [",
+            aeadSegments, MAX_WINDOW_SIZE);
+
+    for (int gcm = 0; gcm < ciphers; gcm++)
+    {
+        const char *name = gcm ? "aes-256-gcm" : "chacha20-poly1305";
+        double bytes = (double)aeadSegments * MAX_WINDOW_SIZE, start, seal, open;
+        uint64_t c0, sealCycles, openCycles;
+        long rejected = 0;
+
+        start = now();
+        c0 = cycles();
+        for (long i = 0; i < aeadSegments; i++)
+            aeadEncrypt(&key, gcm, (uint64_t)i, header, HEADER_SIZE, segment, segment, MAX_WINDOW_SIZE, tag);
+        sealCycles = cycles() - c0;
+        seal = now() - start;
+
+        // the last seal is opened over and over, as fast as a valid segment gets
+        start = now();
+        c0 = cycles();
+        for (long i = 0; i < aeadSegments; i++)
+            rejected += aeadDecrypt(&key, gcm, (uint64_t)aeadSegments - 1, header, HEADER_SIZE, segment, plain, MAX_WINDOW_SIZE, tag) < 0;
+        openCycles = cycles() - c0;
+        open = now() - start;
+
+        fprintf(stderr, "%-18s %-13s seal %.2f cycles/byte %.2f GB/s, open %.2f cycles/byte %.2f GB/s%s\n",
+                name, aeadKernel(gcm), sealCycles / bytes, bytes / seal / 1e9, openCycles / bytes, bytes / open / 1e9,
+                rejected ? ", TAGS DID NOT MATCH" : "");
+
+        fprintf(out, "%s\n    {\"cipher\": \"%s\", \"kernel\": \"%s\", \"seal_cycles_per_byte\": %.3f, "
+                     "\"seal_gbps\": %.3f, \"open_cycles_per_byte\": %.3f, \"open_gbps\": %.3f, \"rejected\": %ld}",
+                gcm ? "," : "", name, aeadKernel(gcm), sealCycles / bytes, bytes / seal / 1e9, openCycles / bytes, bytes / open / 1e9, rejected);
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+}
+
+/**
+ * @brief Fill the packets of an arena in random order, the way out of order
+ *        segments land in pooled packets, then copy them out in stream order,
+ *        which is just as random in the pool once it has churned.
+ *        The arena is pre-faulted, only the page size differs between runs,
+ *        the best of BENCH_ARENA_RUNS is kept.
+ *
+ * @param out JSON file
+ */
+void benchArena(FILE *out)
+{
+    static const char *names[] = {"pages", "thp", "hugetlb"};
+    static uint8_t payload[MAX_WINDOW_SIZE], drained[MAX_WINDOW_SIZE];
+    size_t size = (size_t)arenaMegabytes << 20;
+    long packets = (long)(size / BENCH_ARENA_PACKET), segments = packets * BENCH_ARENA_ROUNDS;
+    uint32_t *order = (uint32_t *)malloc(segments * sizeof(uint32_t));
+    double bytes = 2.0 * segments * MAX_WINDOW_SIZE;
+    uint64_t sum = 0;
+    FILE *reserve;
+    long reserved = 0;
+
+    if (order == NULL)
+    {
+        perror("benchArena(): malloc()");
+        exit(1);
+    }
+
+    // without a hugetlbfs reserve the hugetlb run would only repeat the THP one
+    if ((reserve = fopen("/proc/sys/vm/nr_hugepages", "r")) != NULL)
+    {
+        if (fscanf(reserve, "%ld", &reserved) != 1)
+            reserved = 0;
+        fclose(reserve);
+    }
+
+    srand(seed);
+    for (uint32_t i = 0; i < MAX_WINDOW_SIZE; i++)
+        payload[i] = (uint8_t)rand();
+    for (long i = 0; i < segments; i++)
+        order[i] = (uint32_t)(((uint64_t)rand() * ((uint64_t)RAND_MAX + 1) + rand()) % packets);
+
+    fprintf(out, "{\n  \"arena_bytes\": %zu,\n  \"segments\": %ld,\n  \"backings\": [", size, segments);
+
+    for (int backing = ARENA_PAGES; backing <= (reserved > 0 ? ARENA_HUGETLB : ARENA_THP); backing++)
+    {
+        double best = 0, elapsed;
+        uint64_t huge = arenaHugeBytes(), c0, used, bestCycles = 0;
+        uint8_t *arena;
+
+        arenaSetup(backing, 1);
+        if ((arena = (uint8_t *)arenaAlloc(size)) == NULL)
+            exit(1);
+        huge = arenaHugeBytes() - huge;
+
+        for (int run = 0; run < BENCH_ARENA_RUNS; run++)
+        {
+            elapsed = now();
+            c0 = cycles();
+            for (long i = 0; i < segments; i++)
+            {
+                uint8_t *packet = arena + order[i] * BENCH_ARENA_PACKET;
+
+                memcpy(packet + ARENA_ALIGN, payload, MAX_WINDOW_SIZE);
+                packet[0]++;
+            }
+            for (long i = segments; i-- > 0;)
+            {
+                uint8_t *packet = arena + order[i] * BENCH_ARENA_PACKET;
+
+                memcpy(drained, packet + ARENA_ALIGN, MAX_WINDOW_SIZE);
+                sum += drained[i % MAX_WINDOW_SIZE] + packet[0];
+            }
+            used = cycles() - c0;
+            elapsed = now() - elapsed;
+
+            if (run == 0 || elapsed < best)
+            {
+                best = elapsed;
+                bestCycles = used;
+            }
+        }
+
+        fprintf(stderr, "%-8s %4ld MB, %3.0f%% huge: %.3f ns/byte %.3f cycles/byte\n",
+                names[backing], arenaMegabytes, 100.0 * huge / size, best * 1e9 / bytes, bestCycles / bytes);
+
+        fprintf(out, "%s\n    {\"backing\": \"%s\", \"huge_bytes\": %" PRIu64 ", \"ns_per_byte\": %.4f, "
+                     "\"cycles_per_byte\": %.4f}",
+                backing ? "," : "", names[backing], huge, best * 1e9 / bytes, bestCycles / bytes);
+
+        arenaFree(arena, size);
+    }
+
+    fprintf(out, "\n  ],\n  \"checksum\": %" PRIu64 "\n}\n", sum);
+
+    arenaSetup(ARENA_PAGES, 0);
+    free(order);
+}
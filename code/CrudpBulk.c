@@ -0,0 +1,376 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+void perror(const char *s);
+
+#include "CrudpBulk.h"
+
+_Static_assert(sizeof(CrudpBulkReport_t) == 32, "CrudpBulkReport_t is not packed");
+
+/**
+ * @brief Allocate the ranges the first time
+ *
+ * @return int 0 on success, -1 if out of memory
+ */
+int bulkRanges(CrudpBulk_t *bulk)
+{
+    if (bulk->ranges == NULL &&
+        (bulk->ranges = (CrudpBulkRange_t *)malloc(BULK_LOSSES_MAX * sizeof(CrudpBulkRange_t))) == NULL)
+    {
+        perror("bulkRanges(): malloc()");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Add a range to send again, merged with the ones it overlaps or touches
+ *        a full list drops it, the receiver asks for it again
+ *
+ */
+void bulkAdd(CrudpBulk_t *bulk, uint64_t start, uint64_t end)
+{
+    uint32_t i = 0, j;
+
+    while (i < bulk->count && bulk->ranges[i].end < start)
+        i++;
+
+    for (j = i; j < bulk->count && bulk->ranges[j].start <= end; j++)
+    {
+        if (bulk->ranges[j].start < start)
+            start = bulk->ranges[j].start;
+        if (bulk->ranges[j].end > end)
+            end = bulk->ranges[j].end;
+    }
+
+    if (i == j)
+    {
+        if (bulk->count == BULK_LOSSES_MAX)
+            return;
+
+        memmove(bulk->ranges + i + 1, bulk->ranges + i, (bulk->count - i) * sizeof(*bulk->ranges));
+        bulk->count++;
+    }
+    else
+    {
+        memmove(bulk->ranges + i + 1, bulk->ranges + j, (bulk->count - j) * sizeof(*bulk->ranges));
+        bulk->count -= j - i - 1;
+    }
+
+    bulk->ranges[i].start = start;
+    bulk->ranges[i].end = end;
+    bulk->ranges[i].asked = 0;
+}
+
+/**
+ * @brief Drop the ranges, or their front, before an offset
+ *
+ */
+void bulkTrim(CrudpBulk_t *bulk, uint64_t offset)
+{
+    uint32_t i = 0;
+
+    while (i < bulk->count && bulk->ranges[i].end <= offset)
+        i++;
+
+    memmove(bulk->ranges, bulk->ranges + i, (bulk->count - i) * sizeof(*bulk->ranges));
+    bulk->count -= i;
+
+    if (bulk->count > 0 && bulk->ranges[0].start < offset)
+        bulk->ranges[0].start = offset;
+}
+
+int bulkStart(CrudpBulk_t *bulk, uint64_t size, uint64_t kbit, uint64_t now)
+{
+    memset(bulk, 0, sizeof(*bulk));
+
+    if (bulkRanges(bulk) < 0)
+        return -1;
+
+    bulk->target = kbit * 1000 / 8 > BULK_RATE_MIN ? kbit * 1000 / 8 : BULK_RATE_MIN;
+    bulk->rate = bulk->target;
+    bulk->paced = now;
+    bulk->size = size;
+    bulk->window = UINT64_MAX;
+
+    return 0;
+}
+
+void bulkPace(CrudpBulk_t *bulk, uint64_t now)
+{
+    uint64_t burst = bulk->rate * BULK_BURST_US / 1000000;
+
+    bulk->credit += bulk->rate * (now - bulk->paced) / 1000000;
+    bulk->paced = now;
+
+    // an idle pacer does not save up for a burst
+    if (burst < UINT16_MAX)
+        burst = UINT16_MAX;
+    if (bulk->credit > burst)
+        bulk->credit = burst;
+}
+
+int bulkNext(CrudpBulk_t *bulk, uint32_t segmentSize, uint64_t *offset, uint32_t *len, uint64_t now)
+{
+    if (bulk->credit == 0)
+        return 0;
+
+    if (bulk->count > 0 && now >= bulk->repairAt)
+    {
+        CrudpBulkRange_t *range = &bulk->ranges[0];
+
+        *offset = range->start;
+        *len = range->end - range->start < segmentSize ? (uint32_t)(range->end - range->start) : segmentSize;
+
+        range->start += *len;
+        if (range->start >= range->end)
+            bulkTrim(bulk, range->end);
+
+        bulk->credit -= *len < bulk->credit ? *len : bulk->credit;
+        return 2;
+    }
+
+    // every byte went once, the receiver asks for the rest
+    if (bulk->tailAt != 0 || bulk->next - bulk->acked >= bulk->window)
+        return 0;
+
+    *offset = bulk->next;
+    *len = bulk->size - bulk->next < segmentSize ? (uint32_t)(bulk->size - bulk->next) : segmentSize;
+
+    bulk->next += *len;
+    if (bulk->next >= bulk->size)
+        bulk->tailAt = now;
+
+    bulk->credit -= *len < bulk->credit ? *len : bulk->credit;
+    return 1;
+}
+
+uint32_t bulkTake(CrudpBulk_t *bulk, const uint8_t *payload, uint32_t len, uint64_t acked, uint64_t window,
+                  uint64_t now, uint64_t srtt)
+{
+    const CrudpBulkReport_t *report = (const CrudpBulkReport_t *)payload;
+    const uint64_t(*ranges)[2] = (const uint64_t(*)[2])(payload + sizeof(*report));
+    uint64_t total;
+
+    if (len < sizeof(*report) || report->ranges > (len - sizeof(*report)) / sizeof(*ranges))
+        return 0;
+
+    if (acked > bulk->acked)
+        bulk->acked = acked;
+    bulk->window = window;
+    bulkTrim(bulk, bulk->acked);
+
+    for (uint32_t i = 0; i < report->ranges; i++)
+    {
+        uint64_t start = ranges[i][0] > bulk->acked ? ranges[i][0] : bulk->acked;
+        uint64_t end = ranges[i][1] < bulk->next ? ranges[i][1] : bulk->next;
+
+        if (start < end)
+            bulkAdd(bulk, start, end);
+    }
+
+    // nothing came after the tail, so nothing can tell it is lost
+    if (bulk->tailAt != 0 && report->highest < bulk->size &&
+        now - bulk->tailAt > srtt + 2 * BULK_REPORT_MS * 1000)
+    {
+        bulkAdd(bulk, report->highest > bulk->acked ? report->highest : bulk->acked, bulk->size);
+        bulk->tailAt = now;
+    }
+
+    // a loss above the threshold is congestion, cut at most once an RTT,
+    // never below what the receiver got, and come back to the target without
+    total = report->received + report->lost;
+    if (total > 0 && report->lost * 1000 > total * BULK_LOSS_PERMIL)
+    {
+        if (now - bulk->cut > srtt)
+        {
+            uint64_t received = report->interval ? report->received * 1000000 / report->interval : 0;
+
+            bulk->rate = bulk->rate * 7 / 8 > received ? bulk->rate * 7 / 8 : received;
+            if (bulk->rate > bulk->target)
+                bulk->rate = bulk->target;
+            if (bulk->rate < BULK_RATE_MIN)
+                bulk->rate = BULK_RATE_MIN;
+            bulk->cut = now;
+        }
+    }
+    else if (bulk->rate < bulk->target)
+    {
+        uint64_t step = (bulk->target - bulk->rate) / 8 > bulk->target / 64 ? (bulk->target - bulk->rate) / 8 : bulk->target / 64;
+
+        bulk->rate = bulk->target - bulk->rate > step ? bulk->rate + step : bulk->target;
+    }
+
+    return report->ranges;
+}
+
+void bulkReceived(CrudpBulk_t *bulk, uint64_t offset, uint32_t len)
+{
+    if (offset + len > bulk->highest)
+        bulk->highest = offset + len;
+    bulk->received += len;
+}
+
+uint32_t bulkMissing(CrudpBulk_t *bulk, const CrudpReasm_t *reasm, uint64_t now, uint64_t retry)
+{
+    uint64_t holes[BULK_LOSSES_MAX][2];
+    CrudpBulkRange_t merged[BULK_LOSSES_MAX];
+    uint32_t n, count = 0, k = 0, due = 0;
+
+    if (bulkRanges(bulk) < 0)
+        return 0;
+
+    n = reasmHoles(reasm, bulk->highest, holes, BULK_LOSSES_MAX);
+
+    // a hole keeps the time it was asked for, the bytes of a new one are a new loss
+    for (uint32_t i = 0; i < n && count < BULK_LOSSES_MAX; i++)
+    {
+        uint64_t at = holes[i][0];
+
+        while (k < bulk->count && bulk->ranges[k].end <= at)
+            k++;
+
+        for (uint32_t j = k; at < holes[i][1] && count < BULK_LOSSES_MAX; j++)
+        {
+            const CrudpBulkRange_t *known = j < bulk->count ? &bulk->ranges[j] : NULL;
+            uint64_t end = holes[i][1];
+
+            if (known == NULL || known->start >= end)
+            {
+                merged[count++] = (CrudpBulkRange_t){at, end, 0};
+                bulk->lost += end - at;
+                at = end;
+            }
+            else if (known->start > at)
+            {
+                merged[count++] = (CrudpBulkRange_t){at, known->start, 0};
+                bulk->lost += known->start - at;
+                at = known->start;
+                j--;
+            }
+            else
+            {
+                end = known->end < end ? known->end : end;
+                merged[count++] = (CrudpBulkRange_t){at, end, known->asked};
+                at = end;
+            }
+        }
+    }
+
+    memcpy(bulk->ranges, merged, count * sizeof(*merged));
+    bulk->count = count;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (merged[i].asked == 0 || now - merged[i].asked >= retry)
+            due++;
+    }
+
+    return due;
+}
+
+uint32_t bulkReport(CrudpBulk_t *bulk, const CrudpReasm_t *reasm, uint8_t *payload, uint32_t room, uint64_t now,
+                    uint64_t retry)
+{
+    CrudpBulkReport_t *report = (CrudpBulkReport_t *)payload;
+    uint64_t(*ranges)[2] = (uint64_t(*)[2])(payload + sizeof(*report));
+    uint32_t max = (room - sizeof(*report)) / sizeof(*ranges);
+
+    if (bulkRanges(bulk) < 0)
+        return 0;
+
+    memset(report, 0, sizeof(*report));
+    bulkMissing(bulk, reasm, now, retry);
+
+    // new holes go at once, the others once a repair had time to come
+    for (uint32_t i = 0; i < bulk->count; i++)
+    {
+        CrudpBulkRange_t *range = &bulk->ranges[i];
+
+        if (range->asked != 0 && now - range->asked < retry)
+            continue;
+
+        if (report->ranges > 0 && ranges[report->ranges - 1][1] == range->start)
+        {
+            ranges[report->ranges - 1][1] = range->end;
+        }
+        else if (report->ranges < max && report->ranges < BULK_RANGES_MAX)
+        {
+            ranges[report->ranges][0] = range->start;
+            ranges[report->ranges][1] = range->end;
+            report->ranges++;
+        }
+        else
+        {
+            continue;
+        }
+
+        range->asked = now;
+    }
+
+    report->highest = bulk->highest;
+    report->lost = bulk->lost;
+    report->received = bulk->received;
+    report->interval = bulk->reportedAt ? (uint32_t)(now - bulk->reportedAt) : 0;
+    bulk->lost = 0;
+    bulk->received = 0;
+    bulk->reportedAt = now;
+
+    return sizeof(*report) + report->ranges * sizeof(*ranges);
+}
+
+void bulkHeard(CrudpBulk_t *bulk, const uint8_t *payload, uint32_t len, uint64_t now)
+{
+    const CrudpBulkReport_t *report = (const CrudpBulkReport_t *)payload;
+    const uint64_t(*ranges)[2] = (const uint64_t(*)[2])(payload + sizeof(*report));
+    CrudpBulkRange_t split[BULK_LOSSES_MAX];
+
+    if (bulk->ranges == NULL || len < sizeof(*report) ||
+        report->ranges > (len - sizeof(*report)) / sizeof(*ranges))
+        return;
+
+    // the part of a hole another receiver asked for waits as if this one had asked
+    for (uint32_t f = 0; f < report->ranges; f++)
+    {
+        uint64_t start = ranges[f][0], end = ranges[f][1];
+        uint32_t n = 0;
+
+        for (uint32_t i = 0; i < bulk->count; i++)
+        {
+            CrudpBulkRange_t range = bulk->ranges[i];
+
+            if (range.end <= start || range.start >= end)
+            {
+                split[n++] = range;
+            }
+            // no room to cut it, the whole hole waits
+            else if (n + 3 > BULK_LOSSES_MAX - (bulk->count - i - 1))
+            {
+                range.asked = now;
+                split[n++] = range;
+            }
+            else
+            {
+                if (range.start < start)
+                    split[n++] = (CrudpBulkRange_t){range.start, start, range.asked};
+                split[n++] = (CrudpBulkRange_t){range.start > start ? range.start : start,
+                                                range.end < end ? range.end : end, now};
+                if (range.end > end)
+                    split[n++] = (CrudpBulkRange_t){end, range.end, range.asked};
+            }
+        }
+
+        memcpy(bulk->ranges, split, n * sizeof(*split));
+        bulk->count = n;
+    }
+}
+
+void bulkFree(CrudpBulk_t *bulk)
+{
+    free(bulk->ranges);
+    bulk->ranges = NULL;
+    bulk->count = 0;
+}
@@ -0,0 +1,170 @@
+#ifndef __CrudpBulk_h__
+#define __CrudpBulk_h__
+
+#include <inttypes.h>
+
+#include "CrudpReasm.h"
+
+#define BULK_REPORT_MS ((uint64_t)10)       // the receiver reports every 10 ms
+#define BULK_RANGES_MAX ((uint32_t)80)      // missing ranges of one report, it fits a segment
+#define BULK_LOSSES_MAX ((uint32_t)1024)    // missing ranges the receiver keeps track of
+#define BULK_LOSS_PERMIL ((uint64_t)10)     // more loss than this in a report cuts the rate
+#define BULK_RATE_MIN ((uint64_t)64 * 1024) // bytes per second
+#define BULK_BURST_US ((uint64_t)2000)      // the pacer sends at most 2 ms of the rate at once
+
+/**
+ * @brief Report of the receiver, the payload of an ACK with the bulk flag
+ *        followed by 'ranges' missing [start, end) stream offset pairs
+ */
+typedef struct CrudpBulkReport_s
+{
+    uint64_t highest;  // stream offset past the last byte received
+    uint64_t lost;     // bytes first found missing since the previous report
+    uint64_t received; // payload bytes received since the previous report
+    uint32_t interval; // microseconds since the previous report
+    uint32_t ranges;
+} CrudpBulkReport_t;
+
+/**
+ * @brief Range of the stream, to send again or found missing
+ *
+ */
+typedef struct CrudpBulkRange_s
+{
+    uint64_t start, end;
+    uint64_t asked; // clockNow() of the last report asking for it, 0 never
+} CrudpBulkRange_t;
+
+/**
+ * @brief Receiver driven bulk transfer
+ *        The transmitter sends at a paced rate without waiting for ACKs,
+ *        the receiver reports what is missing and how fast data comes
+ *        every BULK_REPORT_MS, the transmitter sends again only that.
+ */
+typedef struct CrudpBulk_s
+{
+    // ranges to send again (transmitter) or missing (receiver), sorted
+    CrudpBulkRange_t *ranges;
+    uint32_t count;
+
+    // transmitter, rates in bytes per second
+    uint64_t target;     // rate asked for, it is never passed
+    uint64_t rate;       // rate of now, cut on loss, back to the target without
+    uint64_t credit;     // bytes the pacer may send
+    uint64_t paced;      // clockNow() the credit was last given
+    uint64_t cut;        // clockNow() of the last cut
+    uint64_t next;       // next new byte
+    uint64_t size;       // stream length
+    uint64_t acked;      // every byte before it was delivered
+    uint64_t window;     // bytes the receiver takes past 'acked'
+    uint64_t tailAt;     // clockNow() the last new byte (or the tail again) was sent
+    uint64_t repairAt;   // clockNow() the ranges may go again, the requests merge until then
+
+    // receiver
+    uint64_t highest;    // stream offset past the last byte received
+    uint64_t received;   // payload bytes since the last report
+    uint64_t lost;       // bytes first found missing since the last report
+    uint64_t reportedAt; // clockNow() of the last report
+} CrudpBulk_t;
+
+/**
+ * @brief Start sending a stream
+ *
+ * @param bulk state to setup
+ * @param size stream length
+ * @param kbit rate to send at, kbit/s
+ * @param now clockNow()
+ * @return int 0 on success, -1 if out of memory
+ */
+int bulkStart(CrudpBulk_t *bulk, uint64_t size, uint64_t kbit, uint64_t now);
+
+/**
+ * @brief Give the pacer the credit of the time since the last call
+ *
+ * @param bulk transmitter state
+ * @param now clockNow()
+ */
+void bulkPace(CrudpBulk_t *bulk, uint64_t now);
+
+/**
+ * @brief Next segment the credit allows, the ranges to send again first
+ *
+ * @param bulk transmitter state
+ * @param segmentSize payload bytes of a segment
+ * @param offset stream offset of the segment
+ * @param len payload length, 0 for the EOD of an empty stream
+ * @param now clockNow()
+ * @return int 1 for a new segment, 2 for one sent again, 0 if nothing is due
+ */
+int bulkNext(CrudpBulk_t *bulk, uint32_t segmentSize, uint64_t *offset, uint32_t *len, uint64_t now);
+
+/**
+ * @brief Take a report, its ranges are sent again and its loss sets the rate
+ *        a tail lost with nothing sent after it is sent again once
+ *        a report should have told it
+ *
+ * @param bulk transmitter state
+ * @param payload report
+ * @param len payload length
+ * @param acked stream offset the report acknowledges
+ * @param window bytes the receiver takes past it
+ * @param now clockNow()
+ * @param srtt smoothed RTT (microseconds)
+ * @return uint32_t ranges asked for, 0 for a bad report too
+ */
+uint32_t bulkTake(CrudpBulk_t *bulk, const uint8_t *payload, uint32_t len, uint64_t acked, uint64_t window,
+                  uint64_t now, uint64_t srtt);
+
+/**
+ * @brief Account data received
+ *
+ * @param bulk receiver state
+ * @param offset stream offset of the payload
+ * @param len payload length
+ */
+void bulkReceived(CrudpBulk_t *bulk, uint64_t offset, uint32_t len);
+
+/**
+ * @brief Bring the missing ranges up to date with the reassembly buffer
+ *
+ * @param bulk receiver state
+ * @param reasm reassembly buffer of the stream
+ * @param now clockNow()
+ * @param retry microseconds before a range is asked for again
+ * @return uint32_t ranges a report would ask for now
+ */
+uint32_t bulkMissing(CrudpBulk_t *bulk, const CrudpReasm_t *reasm, uint64_t now, uint64_t retry);
+
+/**
+ * @brief Build a report, a range is asked for again only after 'retry'
+ *
+ * @param bulk receiver state
+ * @param reasm reassembly buffer of the stream
+ * @param payload report to fill
+ * @param room bytes the payload may take
+ * @param now clockNow()
+ * @param retry microseconds before a range is asked for again
+ * @return uint32_t payload bytes, 0 if out of memory
+ */
+uint32_t bulkReport(CrudpBulk_t *bulk, const CrudpReasm_t *reasm, uint8_t *payload, uint32_t room, uint64_t now,
+                    uint64_t retry);
+
+/**
+ * @brief Take the report of another receiver of a group,
+ *        what it asks for is not asked for again before 'retry'
+ *
+ * @param bulk receiver state
+ * @param payload report
+ * @param len payload length
+ * @param now clockNow()
+ */
+void bulkHeard(CrudpBulk_t *bulk, const uint8_t *payload, uint32_t len, uint64_t now);
+
+/**
+ * @brief Release the ranges
+ *
+ * @param bulk state of either end
+ */
+void bulkFree(CrudpBulk_t *bulk);
+
+#endif
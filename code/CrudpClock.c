@@ -0,0 +1,37 @@
+#include <stdio.h>
+#include <time.h>
+
+#include <errno.h>
+void perror(const char *s);
+
+#include "CrudpClock.h"
+
+uint64_t clockVirtualNow = 0;
+int clockIsVirtual = 0;
+
+uint64_t clockNow()
+{
+    struct timespec t;
+
+    if (clockIsVirtual)
+        return clockVirtualNow;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &t) != 0)
+    {
+        perror("clockNow(): clock_gettime()");
+        return 0;
+    }
+
+    return (uint64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+void clockSet(uint64_t now)
+{
+    clockVirtualNow = now;
+    clockIsVirtual = 1;
+}
+
+int clockVirtual()
+{
+    return clockIsVirtual;
+}
@@ -0,0 +1,28 @@
+#ifndef __CrudpClock_h__
+#define __CrudpClock_h__
+
+#include <inttypes.h>
+
+/**
+ * @brief Get monotonic time, or the virtual time of a simulation once it was set
+ *        every clock of CRUDP (timers, timestamps, statistics) reads this one
+ *
+ * @return uint64_t microseconds
+ */
+uint64_t clockNow();
+
+/**
+ * @brief Stop reading the system clock, time is what the caller says from now on
+ *
+ * @param now virtual time in microseconds
+ */
+void clockSet(uint64_t now);
+
+/**
+ * @brief Is the time virtual?
+ *
+ * @return int 1 once clockSet() was called
+ */
+int clockVirtual();
+
+#endif
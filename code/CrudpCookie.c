@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/random.h>
+
+#include <errno.h>
+void perror(const char *s);
+
+#include "CrudpCookie.h"
+#include "CrudpClock.h"
+
+#define COOKIE_MAC_BITS (32 - COOKIE_SLOT_BITS)
+#define COOKIE_MAC_MASK (((uint32_t)1 << COOKIE_MAC_BITS) - 1)
+#define COOKIE_SLOT_MASK (((uint32_t)1 << COOKIE_SLOT_BITS) - 1)
+
+#define ROTL64(_x, _b) (((_x) << (_b)) | ((_x) >> (64 - (_b))))
+
+uint64_t cookieKey[2];
+
+int cookieInit()
+{
+    if (getrandom(cookieKey, sizeof(cookieKey), 0) != sizeof(cookieKey))
+    {
+        perror("cookieInit(): getrandom()");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief One SipHash round
+ *
+ */
+void cookieRound(uint64_t v[4])
+{
+    v[0] += v[1];
+    v[1] = ROTL64(v[1], 13);
+    v[1] ^= v[0];
+    v[0] = ROTL64(v[0], 32);
+    v[2] += v[3];
+    v[3] = ROTL64(v[3], 16);
+    v[3] ^= v[2];
+    v[0] += v[3];
+    v[3] = ROTL64(v[3], 21);
+    v[3] ^= v[0];
+    v[2] += v[1];
+    v[1] = ROTL64(v[1], 17);
+    v[1] ^= v[2];
+    v[2] = ROTL64(v[2], 32);
+}
+
+/**
+ * @brief SipHash-2-4 of a 16 byte message
+ *
+ */
+uint64_t cookieSipHash(uint64_t m0, uint64_t m1)
+{
+    uint64_t v[4] = {cookieKey[0] ^ 0x736f6d6570736575ULL, cookieKey[1] ^ 0x646f72616e646f6dULL,
+                     cookieKey[0] ^ 0x6c7967656e657261ULL, cookieKey[1] ^ 0x7465646279746573ULL};
+    uint64_t m[3] = {m0, m1, (uint64_t)16 << 56};
+
+    for (int i = 0; i < 3; i++)
+    {
+        v[3] ^= m[i];
+        cookieRound(v);
+        cookieRound(v);
+        v[0] ^= m[i];
+    }
+
+    v[2] ^= 0xff;
+    for (int i = 0; i < 4; i++)
+        cookieRound(v);
+
+    return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
+
+/**
+ * @brief Current time slot
+ *
+ */
+uint32_t cookieSlot()
+{
+    return (uint32_t)(clockNow() / 1000000 / COOKIE_SLOT_SECONDS);
+}
+
+/**
+ * @brief MAC bits of a cookie
+ *
+ */
+uint32_t cookieMac(const struct sockaddr_in *peer, uint32_t peerSeq, uint32_t slot)
+{
+    uint64_t m0 = (uint64_t)peer->sin_addr.s_addr << 32 | peer->sin_port;
+    uint64_t m1 = (uint64_t)peerSeq << 32 | slot;
+
+    return (uint32_t)cookieSipHash(m0, m1) & COOKIE_MAC_MASK;
+}
+
+uint32_t cookieMake(const struct sockaddr_in *peer, uint32_t peerSeq)
+{
+    uint32_t slot = cookieSlot() & COOKIE_SLOT_MASK;
+
+    return slot << COOKIE_MAC_BITS | cookieMac(peer, peerSeq, slot);
+}
+
+int cookieCheck(const struct sockaddr_in *peer, uint32_t peerSeq, uint32_t cookie)
+{
+    uint32_t now = cookieSlot();
+    uint32_t slot = cookie >> COOKIE_MAC_BITS;
+
+    // the slot in the cookie is the current one or the one before
+    for (uint32_t age = 0; age < 2; age++)
+    {
+        if (((now - age) & COOKIE_SLOT_MASK) == slot &&
+            cookieMac(peer, peerSeq, slot) == (cookie & COOKIE_MAC_MASK))
+            return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,38 @@
+#ifndef __CrudpCookie_h__
+#define __CrudpCookie_h__
+
+#include <inttypes.h>
+#include <netinet/in.h>
+
+#define COOKIE_SLOT_SECONDS ((uint32_t)64) // a cookie is accepted for 64 to 128 s
+#define COOKIE_SLOT_BITS ((uint32_t)5)
+
+/**
+ * @brief Pick a new random key for the SYN cookies
+ *
+ * @return int 0 on success, -1 if no random bytes are available
+ */
+int cookieInit();
+
+/**
+ * @brief Initial sequence number of a stateless SYN,ACK
+ *        The top bits hold a time slot, the rest a SipHash MAC of the peer
+ *        address, the sequence number of its SYN and the slot.
+ *
+ * @param peer address the SYN came from
+ * @param peerSeq sequence number of the SYN
+ * @return uint32_t initial sequence number to send
+ */
+uint32_t cookieMake(const struct sockaddr_in *peer, uint32_t peerSeq);
+
+/**
+ * @brief Was the cookie made for this peer and SYN in one of the last two slots?
+ *
+ * @param peer address the ACK came from
+ * @param peerSeq sequence number of the SYN, one less than the ACK's
+ * @param cookie initial sequence number, one less than the acknowledgement number
+ * @return int 1 if valid
+ */
+int cookieCheck(const struct sockaddr_in *peer, uint32_t peerSeq, uint32_t cookie);
+
+#endif
@@ -0,0 +1,404 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "CrudpImpair.h"
+#include "CrudpStats.h"
+
+#define IMPAIR_LIMIT ((int)1000)
+#define IMPAIR_BUCKET ((double)3000)
+#define IMPAIR_GAP ((double)5)
+#define IMPAIR_LINKS ((int)8) // sockets with a token bucket of their own
+
+/**
+ * @brief Packet held back by the emulator, by reference
+ *
+ */
+typedef struct ImpairPacket_s
+{
+    double release; // when to send (seconds)
+    uint64_t order; // keeps packets with the same release time in order
+    UdpSocket_t local;
+    UdpSocket_t remote;
+    uint32_t n;
+    uint8_t *bytes;
+    CrudpPacket_t *packet;
+    const uint8_t *payload; // outlives the packet, e.g. the mapped file
+    uint32_t payloadLen;
+} ImpairPacket_t;
+
+CrudpImpair_t G_impair;
+
+int impairEnabled = 0;
+
+// random number generator state (xorshift64*)
+uint64_t impairState = 1;
+
+// Gilbert-Elliott state, 1 when bad
+int geBadState = 0;
+
+// loss trace
+char *traceBits = NULL;
+long traceLength = 0, traceIndex = 0;
+
+// token bucket of every local socket, each one is an uplink of its own
+typedef struct ImpairBucket_s
+{
+    int sd;
+    double tokens;
+    double time;
+} ImpairBucket_t;
+
+ImpairBucket_t buckets[IMPAIR_LINKS];
+int bucketCount = 0;
+
+// delay queue, a binary heap ordered by release time
+ImpairPacket_t *queue = NULL;
+int queueLength = 0;
+uint64_t queueOrder = 0;
+
+/**
+ * @brief Uniform random number
+ *
+ * @return double in [0, 1)
+ */
+double impairRandom()
+{
+    impairState ^= impairState >> 12;
+    impairState ^= impairState << 25;
+    impairState ^= impairState >> 27;
+
+    return (double)((impairState * 0x2545F4914F6CDD1DULL) >> 11) / (double)(1ULL << 53);
+}
+
+int impairChance(double percent)
+{
+    return percent > 0 && impairRandom() * 100 < percent;
+}
+
+/**
+ * @brief Read a loss trace, every '1' drops a packet and every '0' keeps one
+ *
+ * @return int 0 if read, -1 if not
+ */
+int impairReadTrace(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    long size = 0;
+    int c;
+
+    if (file == NULL)
+    {
+        perror("impairReadTrace(): fopen()");
+        return -1;
+    }
+
+    while ((c = fgetc(file)) != EOF)
+    {
+        if (c != '0' && c != '1')
+            continue;
+
+        if (traceLength == size)
+        {
+            size = size ? size * 2 : 1024;
+            traceBits = (char *)realloc(traceBits, size);
+        }
+        traceBits[traceLength++] = c == '1';
+    }
+    fclose(file);
+
+    if (traceLength == 0)
+    {
+        fprintf(stderr, "impairReadTrace(): empty trace %s\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+int impairInit(const char *spec, uint64_t stream)
+{
+    char *copy, *item, *save;
+
+    memset(&G_impair, 0, sizeof(G_impair));
+    G_impair.seed = 1;
+    G_impair.geBad = 100;
+    G_impair.gap = IMPAIR_GAP;
+    G_impair.bucket = IMPAIR_BUCKET;
+    G_impair.limit = IMPAIR_LIMIT;
+
+    if (spec == NULL || *spec == '\0')
+        return 0;
+
+    copy = strdup(spec);
+    for (item = strtok_r(copy, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save))
+    {
+        char *value = strchr(item, '=');
+
+        if (value == NULL)
+        {
+            fprintf(stderr, "impairInit(): missing value for %s\n", item);
+            free(copy);
+            return -1;
+        }
+        *value++ = '\0';
+
+        if (!strcmp(item, "seed"))
+            G_impair.seed = strtoull(value, NULL, 0);
+        else if (!strcmp(item, "loss"))
+            G_impair.loss = atof(value);
+        else if (!strcmp(item, "gep"))
+            G_impair.geP = atof(value);
+        else if (!strcmp(item, "ger"))
+            G_impair.geR = atof(value);
+        else if (!strcmp(item, "gegood"))
+            G_impair.geGood = atof(value);
+        else if (!strcmp(item, "gebad"))
+            G_impair.geBad = atof(value);
+        else if (!strcmp(item, "delay"))
+            G_impair.delay = atof(value);
+        else if (!strcmp(item, "jitter"))
+            G_impair.jitter = atof(value);
+        else if (!strcmp(item, "reorder"))
+            G_impair.reorder = atof(value);
+        else if (!strcmp(item, "gap"))
+            G_impair.gap = atof(value);
+        else if (!strcmp(item, "dup"))
+            G_impair.dup = atof(value);
+        else if (!strcmp(item, "rate"))
+            G_impair.rate = atof(value);
+        else if (!strcmp(item, "bucket"))
+            G_impair.bucket = atof(value);
+        else if (!strcmp(item, "limit"))
+            G_impair.limit = atoi(value);
+        else if (!strcmp(item, "trace"))
+            G_impair.trace = strdup(value);
+        else
+        {
+            fprintf(stderr, "impairInit(): unknown setting %s\n", item);
+            free(copy);
+            return -1;
+        }
+    }
+    free(copy);
+
+    if (G_impair.trace != NULL && impairReadTrace(G_impair.trace) < 0)
+        return -1;
+
+    impairState = G_impair.seed ^ (stream * 0x9E3779B97F4A7C15ULL);
+    if (impairState == 0)
+        impairState = 1;
+
+    bucketCount = 0;
+    queue = (ImpairPacket_t *)calloc(G_impair.limit + 1, sizeof(ImpairPacket_t));
+
+    impairEnabled = 1;
+
+    return 0;
+}
+
+int impairActive()
+{
+    return impairEnabled;
+}
+
+/**
+ * @brief Decide whether the next packet is lost
+ *
+ * @return int 1 if lost
+ */
+int impairLose()
+{
+    if (traceLength > 0)
+        return traceBits[traceIndex++ % traceLength];
+
+    if (G_impair.geP > 0 || G_impair.geR > 0)
+    {
+        geBadState = geBadState ? !impairChance(G_impair.geR) : impairChance(G_impair.geP);
+
+        if (impairChance(geBadState ? G_impair.geBad : G_impair.geGood))
+            return 1;
+    }
+
+    return impairChance(G_impair.loss);
+}
+
+/**
+ * @brief Departure time allowed by the token bucket of a socket
+ *        a bucket starts full, sockets beyond IMPAIR_LINKS share the last one
+ *
+ * @param sd local socket
+ * @param now current time
+ * @param n packet size
+ * @return double departure time
+ */
+double impairShape(int sd, double now, uint32_t n)
+{
+    double bytesPerSecond = G_impair.rate * 1000 / 8;
+    ImpairBucket_t *bucket = &buckets[0];
+    double t;
+
+    if (G_impair.rate <= 0)
+        return now;
+
+    while (bucket < buckets + bucketCount && bucket->sd != sd && bucket < buckets + IMPAIR_LINKS - 1)
+        bucket++;
+    if (bucket == buckets + bucketCount)
+    {
+        bucket->sd = sd;
+        bucket->tokens = G_impair.bucket;
+        bucket->time = now;
+        bucketCount++;
+    }
+
+    t = now > bucket->time ? now : bucket->time;
+
+    bucket->tokens += (t - bucket->time) * bytesPerSecond;
+    if (bucket->tokens > G_impair.bucket)
+        bucket->tokens = G_impair.bucket;
+    bucket->time = t;
+
+    if (bucket->tokens >= n)
+    {
+        bucket->tokens -= n;
+        return t;
+    }
+
+    bucket->time = t + (n - bucket->tokens) / bytesPerSecond;
+    bucket->tokens = 0;
+
+    return bucket->time;
+}
+
+int impairEarlier(const ImpairPacket_t *a, const ImpairPacket_t *b)
+{
+    return a->release < b->release || (a->release == b->release && a->order < b->order);
+}
+
+void impairPush(const ImpairPacket_t *packet)
+{
+    int i = queueLength++;
+
+    while (i > 0 && impairEarlier(packet, &queue[(i - 1) / 2]))
+    {
+        queue[i] = queue[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    queue[i] = *packet;
+}
+
+ImpairPacket_t impairPop()
+{
+    ImpairPacket_t top = queue[0];
+    ImpairPacket_t last = queue[--queueLength];
+    int i = 0;
+
+    while (2 * i + 1 < queueLength)
+    {
+        int child = 2 * i + 1;
+
+        if (child + 1 < queueLength && impairEarlier(&queue[child + 1], &queue[child]))
+            child++;
+        if (!impairEarlier(&queue[child], &last))
+            break;
+
+        queue[i] = queue[child];
+        i = child;
+    }
+    queue[i] = last;
+
+    return top;
+}
+
+int impairSend(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpBuffer_t *buffer)
+{
+    double now = statsNow();
+    int copies;
+
+    copies = impairLose() ? 0 : 1 + impairChance(G_impair.dup);
+
+    for (int i = 0; i < copies; i++)
+    {
+        double release = impairShape(local->sd, now, buffer->n + buffer->payloadLen) + G_impair.delay / 1000;
+
+        if (G_impair.jitter > 0)
+            release += (2 * impairRandom() - 1) * G_impair.jitter / 1000;
+        if (impairChance(G_impair.reorder))
+            release += G_impair.gap / 1000;
+
+        if (release <= now && queueLength == 0)
+        {
+            sendRawCrudp(local, remote, buffer);
+            continue;
+        }
+
+        // tail drop
+        if (queueLength >= G_impair.limit)
+            break;
+
+        ImpairPacket_t packet;
+        packet.release = release;
+        packet.order = queueOrder++;
+        packet.local = *local;
+        packet.remote = *remote;
+        packet.n = buffer->n;
+        packet.payload = buffer->payload;
+        packet.payloadLen = buffer->payloadLen;
+
+        // share the packet, a copy is needed only for bytes out of the pool
+        if (buffer->packet != NULL)
+        {
+            packet.packet = packetRef(buffer->packet);
+            packet.bytes = buffer->bytes;
+        }
+        else
+        {
+            if ((packet.packet = packetAlloc()) == NULL)
+                break;
+            packet.bytes = packet.packet->bytes;
+            memcpy(packet.bytes, buffer->bytes, buffer->n);
+        }
+
+        impairPush(&packet);
+    }
+
+    return buffer->n + buffer->payloadLen;
+}
+
+void impairPoll()
+{
+    double now;
+
+    if (!impairEnabled || queueLength == 0)
+        return;
+
+    now = statsNow();
+    while (queueLength > 0 && queue[0].release <= now)
+    {
+        ImpairPacket_t packet = impairPop();
+        CrudpBuffer_t buffer;
+
+        buffer.n = packet.n;
+        buffer.bytes = packet.bytes;
+        buffer.packet = packet.packet;
+        buffer.payload = packet.payload;
+        buffer.payloadLen = packet.payloadLen;
+        sendRawCrudp(&packet.local, &packet.remote, &buffer);
+
+        packetPut(packet.packet);
+    }
+}
+
+void impairFlush()
+{
+    while (impairEnabled && queueLength > 0)
+    {
+        double wait = queue[0].release - statsNow();
+
+        if (wait > 0)
+            usleep((useconds_t)(wait * 1000000));
+
+        impairPoll();
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef __CrudpImpair_h__
+#define __CrudpImpair_h__
+
+#include <inttypes.h>
+
+#include "CrudpSocket.h"
+
+/**
+ * @brief Network impairment settings
+ *        All probabilities are in percent, times in milliseconds.
+ */
+typedef struct CrudpImpair_s
+{
+    uint64_t seed; // seed of the random number generator
+
+    double loss; // random loss
+
+    // Gilbert-Elliott burst loss
+    double geP;    // good -> bad transition
+    double geR;    // bad -> good transition
+    double geGood; // loss in good state
+    double geBad;  // loss in bad state
+
+    double delay;   // fixed delay
+    double jitter;  // uniform jitter, +/- jitter
+    double reorder; // packets held back for 'gap' ms
+    double gap;
+    double dup; // duplicated packets
+
+    double rate;   // token bucket rate of every local socket in kbit/s, 0 is unlimited
+    double bucket; // token bucket depth in bytes
+    int limit;     // queued packets, more are tail dropped
+
+    char *trace; // loss trace file, '1' drops and '0' keeps a packet
+} CrudpImpair_t;
+
+/**
+ * @brief Parse the impairment spec and enable the emulator
+ *        e.g. "seed=7,loss=1,delay=10,jitter=2,rate=10000,trace=loss.txt"
+ *
+ * @param spec comma separated key=value list, NULL disables the emulator
+ * @param stream distinguishes both ends of a transfer with one seed
+ * @return int 0 if parsed, -1 on a bad spec
+ */
+int impairInit(const char *spec, uint64_t stream);
+
+/**
+ * @brief Is the emulator enabled?
+ *
+ * @return int 1 if enabled
+ */
+int impairActive();
+
+/**
+ * @brief Send a packet through the emulator
+ *
+ * @param local Transmitter socket
+ * @param remote Receiver socket
+ * @param buffer to send, its payload has to stay valid until impairFlush()
+ * @return int size of the packet, as if it was sent
+ */
+int impairSend(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpBuffer_t *buffer);
+
+/**
+ * @brief Send the delayed packets that are due
+ *        call it from the main loop
+ */
+void impairPoll();
+
+/**
+ * @brief Wait for every delayed packet and send it
+ *        packets on the wire outlive the socket owner
+ */
+void impairFlush();
+
+#endif
@@ -0,0 +1,665 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <errno.h>
+void perror(const char *s);
+
+#include "CrudpManifest.h"
+
+#define MANIFEST_ENTRIES ((uint32_t)64)
+#define MANIFEST_RAW_MAX ((uint64_t)1 << 30) // larger manifests are refused
+
+/**
+ * @brief Append an entry
+ *
+ * @return int 0 on success, -1 if out of memory
+ */
+int manifestAdd(CrudpManifest_t *manifest, const char *name, uint64_t size, uint32_t mode)
+{
+    CrudpManifestEntry_t *entry;
+
+    if (manifest->count == manifest->maxCount)
+    {
+        uint32_t max = manifest->maxCount ? manifest->maxCount * 2 : MANIFEST_ENTRIES;
+        CrudpManifestEntry_t *entries = realloc(manifest->entries, max * sizeof(*entries));
+
+        if (entries == NULL)
+        {
+            perror("manifestAdd(): realloc()");
+            return -1;
+        }
+
+        manifest->entries = entries;
+        manifest->maxCount = max;
+    }
+
+    entry = &manifest->entries[manifest->count];
+    memset(entry, 0, sizeof(*entry));
+
+    if ((entry->name = strdup(name)) == NULL)
+    {
+        perror("manifestAdd(): strdup()");
+        return -1;
+    }
+
+    entry->size = size;
+    entry->mode = mode;
+    manifest->count++;
+
+    return 0;
+}
+
+/**
+ * @brief Add a directory, then what it holds in name order
+ *
+ * @param root directory sent
+ * @param rel path below the root, "" for the root itself
+ * @return int 0 on success, -1 on error
+ */
+int manifestWalk(CrudpManifest_t *manifest, const char *root, const char *rel)
+{
+    char path[PATH_MAX], name[PATH_MAX];
+    struct dirent **list;
+    int n, r = 0;
+
+    snprintf(path, sizeof(path), "%s%s%s", root, *rel ? "/" : "", rel);
+
+    if ((n = scandir(path, &list, NULL, alphasort)) < 0)
+    {
+        perror("manifestWalk(): scandir()");
+        return -1;
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        struct stat st;
+
+        if (r == 0 && strcmp(list[i]->d_name, ".") && strcmp(list[i]->d_name, ".."))
+        {
+            int nameLen = snprintf(name, sizeof(name), "%s%s%s", rel, *rel ? "/" : "", list[i]->d_name);
+
+            if (nameLen >= (int)MANIFEST_NAME_MAX || snprintf(path, sizeof(path), "%s/%s", root, name) >= (int)sizeof(path))
+            {
+                printf("Name too long, not sent: %s/%s\n", rel, list[i]->d_name);
+            }
+            else if (lstat(path, &st) < 0)
+            {
+                perror("manifestWalk(): lstat()");
+                r = -1;
+            }
+            else if (S_ISDIR(st.st_mode))
+            {
+                r = manifestAdd(manifest, name, 0, st.st_mode);
+                if (r == 0)
+                    r = manifestWalk(manifest, root, name);
+            }
+            else if (S_ISREG(st.st_mode))
+            {
+                r = manifestAdd(manifest, name, st.st_size, st.st_mode);
+            }
+            else
+            {
+                // links, devices, sockets and fifos have no bytes to send
+                printf("Not a file or directory, not sent: %s\n", name);
+            }
+        }
+
+        free(list[i]);
+    }
+
+    free(list);
+
+    return r;
+}
+
+/**
+ * @brief Encode the manifest and give every file its stream offset
+ *
+ * @return int 0 on success, -1 if out of memory
+ */
+int manifestEncode(CrudpManifest_t *manifest)
+{
+    uint64_t length = MANIFEST_HEADER_SIZE;
+    uint8_t *p;
+
+    for (uint32_t i = 0; i < manifest->count; i++)
+        length += MANIFEST_ENTRY_SIZE + strlen(manifest->entries[i].name);
+
+    if ((manifest->raw = (uint8_t *)malloc(length)) == NULL)
+    {
+        perror("manifestEncode(): malloc()");
+        return -1;
+    }
+
+    manifest->rawLen = length;
+
+    p = manifest->raw;
+    memcpy(p, MANIFEST_MAGIC, 8);
+    memcpy(p + 8, &manifest->rawLen, 8);
+    memcpy(p + 16, &manifest->count, 4);
+    p += MANIFEST_HEADER_SIZE;
+
+    for (uint32_t i = 0; i < manifest->count; i++)
+    {
+        CrudpManifestEntry_t *entry = &manifest->entries[i];
+        uint16_t nameLen = (uint16_t)strlen(entry->name);
+
+        memcpy(p, &entry->size, 8);
+        memcpy(p + 8, &entry->mode, 4);
+        memcpy(p + 12, &nameLen, 2);
+        memcpy(p + MANIFEST_ENTRY_SIZE, entry->name, nameLen);
+        p += MANIFEST_ENTRY_SIZE + nameLen;
+
+        // the files follow the manifest in the same order
+        entry->start = length;
+        length += entry->size;
+    }
+
+    manifest->length = length;
+
+    return 0;
+}
+
+/**
+ * @brief Read a whole file
+ *
+ * @return int 0 on success, -1 on error or if it shrank
+ */
+int manifestRead(const char *path, uint8_t *buffer, uint64_t size)
+{
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+    {
+        perror("manifestRead(): open()");
+        return -1;
+    }
+
+    for (uint64_t n = 0; n < size;)
+    {
+        ssize_t r = read(fd, buffer + n, size - n);
+
+        if (r <= 0)
+        {
+            if (r < 0 && errno == EINTR)
+                continue;
+            printf("File changed while read: %s\n", path);
+            close(fd);
+            return -1;
+        }
+
+        n += r;
+    }
+
+    close(fd);
+
+    return 0;
+}
+
+/**
+ * @brief Map a large file
+ *
+ * @return const uint8_t* the mapping, NULL on error
+ */
+const uint8_t *manifestMap(const char *path, uint64_t size)
+{
+    int fd = open(path, O_RDONLY);
+    void *base;
+
+    if (fd < 0)
+    {
+        perror("manifestMap(): open()");
+        return NULL;
+    }
+
+    base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (base == MAP_FAILED)
+    {
+        perror("manifestMap(): mmap()");
+        return NULL;
+    }
+
+    madvise(base, size, MADV_SEQUENTIAL);
+
+    return (const uint8_t *)base;
+}
+
+int manifestBuild(CrudpManifest_t *manifest, const char *root, uint32_t packBelow)
+{
+    char path[PATH_MAX];
+    uint64_t arenaLen = 0, arenaUsed = 0;
+
+    memset(manifest, 0, sizeof(*manifest));
+    manifest->fd = -1;
+    manifest->packBelow = packBelow;
+
+    if (manifestWalk(manifest, root, "") < 0 || manifestEncode(manifest) < 0)
+        return -1;
+
+    for (uint32_t i = 0; i < manifest->count; i++)
+    {
+        if (S_ISREG(manifest->entries[i].mode) && manifest->entries[i].size < packBelow)
+            arenaLen += manifest->entries[i].size;
+    }
+
+    manifest->extents = (CrudpManifestExtent_t *)calloc(manifest->count + 1, sizeof(CrudpManifestExtent_t));
+    manifest->arena = (uint8_t *)malloc(arenaLen ? arenaLen : 1);
+
+    if (manifest->extents == NULL || manifest->arena == NULL)
+    {
+        perror("manifestBuild(): malloc()");
+        return -1;
+    }
+
+    manifest->extents[0].start = 0;
+    manifest->extents[0].len = manifest->rawLen;
+    manifest->extents[0].base = manifest->raw;
+    manifest->extentCount = 1;
+
+    for (uint32_t i = 0; i < manifest->count; i++)
+    {
+        CrudpManifestEntry_t *entry = &manifest->entries[i];
+        CrudpManifestExtent_t *last = &manifest->extents[manifest->extentCount - 1];
+
+        if (!S_ISREG(entry->mode) || entry->size == 0)
+            continue;
+
+        snprintf(path, sizeof(path), "%s/%s", root, entry->name);
+
+        if (entry->size < packBelow)
+        {
+            if (manifestRead(path, manifest->arena + arenaUsed, entry->size) < 0)
+                return -1;
+
+            // small files next to each other in the stream are next to each other in the arena
+            if (!last->mapped && last->base == manifest->arena + arenaUsed - last->len)
+            {
+                last->len += entry->size;
+                arenaUsed += entry->size;
+                continue;
+            }
+
+            last[1].base = manifest->arena + arenaUsed;
+            arenaUsed += entry->size;
+        }
+        else if ((last[1].base = manifestMap(path, entry->size)) == NULL)
+        {
+            return -1;
+        }
+        else
+        {
+            last[1].mapped = 1;
+        }
+
+        last[1].start = entry->start;
+        last[1].len = entry->size;
+        manifest->extentCount++;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Extent holding a stream offset
+ *
+ */
+uint32_t manifestExtent(CrudpManifest_t *manifest, uint64_t offset)
+{
+    uint32_t low = 0, high = manifest->extentCount;
+    const CrudpManifestExtent_t *cursor = &manifest->extents[manifest->cursor];
+
+    if (offset >= cursor->start && offset < cursor->start + cursor->len)
+        return manifest->cursor;
+
+    // last extent starting at or before the offset
+    while (high - low > 1)
+    {
+        uint32_t middle = (low + high) / 2;
+
+        if (manifest->extents[middle].start <= offset)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    return manifest->cursor = low;
+}
+
+const uint8_t *manifestData(CrudpManifest_t *manifest, uint64_t offset, uint32_t len, uint8_t *scratch)
+{
+    uint32_t i = manifestExtent(manifest, offset);
+    const CrudpManifestExtent_t *extent = &manifest->extents[i];
+    uint32_t n = 0;
+
+    if (offset + len <= extent->start + extent->len)
+        return extent->base + (offset - extent->start);
+
+    // the segment crosses files, e.g. several small ones
+    while (n < len && i < manifest->extentCount)
+    {
+        uint64_t from = offset + n - extent->start;
+        uint64_t k = extent->len - from < len - n ? extent->len - from : len - n;
+
+        memcpy(scratch + n, extent->base + from, k);
+        n += k;
+        extent = &manifest->extents[++i];
+    }
+
+    manifest->cursor = i - 1;
+
+    return scratch;
+}
+
+int manifestOpen(CrudpManifest_t *manifest, const char *root)
+{
+    memset(manifest, 0, sizeof(*manifest));
+    manifest->fd = -1;
+    manifest->root = root;
+
+    if (mkdir(root, 0755) < 0 && errno != EEXIST)
+    {
+        perror("manifestOpen(): mkdir()");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief A name stays below the root: relative, no empty, "." or ".." part
+ *
+ */
+int manifestSafe(const char *name)
+{
+    const char *part = name;
+
+    if (*name == '\0' || *name == '/')
+        return 0;
+
+    while (part != NULL)
+    {
+        const char *slash = strchr(part, '/');
+        size_t n = slash ? (size_t)(slash - part) : strlen(part);
+
+        if (n == 0 || (n == 1 && part[0] == '.') || (n == 2 && part[0] == '.' && part[1] == '.'))
+            return 0;
+
+        part = slash ? slash + 1 : NULL;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Decode the manifest received, create the directories and the empty files
+ *
+ * @return int 0 on success, -1 if it is malformed
+ */
+int manifestParse(CrudpManifest_t *manifest)
+{
+    const uint8_t *p = manifest->raw + MANIFEST_HEADER_SIZE;
+    const uint8_t *end = manifest->raw + manifest->rawLen;
+    uint64_t length = manifest->rawLen;
+    uint32_t count;
+    char path[PATH_MAX];
+
+    memcpy(&count, manifest->raw + 16, 4);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint64_t size;
+        uint32_t mode;
+        uint16_t nameLen;
+        char name[MANIFEST_NAME_MAX];
+
+        if (end - p < MANIFEST_ENTRY_SIZE)
+            return -1;
+
+        memcpy(&size, p, 8);
+        memcpy(&mode, p + 8, 4);
+        memcpy(&nameLen, p + 12, 2);
+        p += MANIFEST_ENTRY_SIZE;
+
+        if (end - p < nameLen || nameLen >= MANIFEST_NAME_MAX)
+            return -1;
+
+        memcpy(name, p, nameLen);
+        name[nameLen] = '\0';
+        p += nameLen;
+
+        if (strlen(name) != nameLen || !manifestSafe(name) || (!S_ISREG(mode) && !S_ISDIR(mode)) ||
+            (S_ISDIR(mode) && size != 0) || size > UINT64_MAX - length)
+        {
+            printf("Bad manifest entry: %s\n", name);
+            return -1;
+        }
+
+        if (manifestAdd(manifest, name, size, mode) < 0)
+            return -1;
+
+        manifest->entries[i].start = length;
+        length += size;
+
+        if (snprintf(path, sizeof(path), "%s/%s", manifest->root, name) >= (int)sizeof(path))
+        {
+            printf("Name too long: %s\n", name);
+            return -1;
+        }
+
+        // the owner keeps the right to write until the end
+        if (S_ISDIR(mode) && mkdir(path, (mode & 07777) | S_IRWXU) < 0 && errno != EEXIST)
+        {
+            perror("manifestParse(): mkdir()");
+            return -1;
+        }
+
+        if (S_ISREG(mode) && size == 0)
+        {
+            int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+            if (fd < 0)
+            {
+                perror("manifestParse(): open()");
+                return -1;
+            }
+
+            close(fd);
+            manifest->entries[i].created = 1;
+        }
+    }
+
+    manifest->length = length;
+    manifest->ready = 1;
+
+    return 0;
+}
+
+/**
+ * @brief Regular file holding a stream offset
+ *
+ * @return int index of the entry, -1 past the end
+ */
+int manifestEntryAt(const CrudpManifest_t *manifest, uint64_t offset)
+{
+    uint32_t low = 0, high = manifest->count;
+    const CrudpManifestEntry_t *entry;
+
+    if (manifest->count == 0)
+        return -1;
+
+    // last entry starting at or before the offset, empty ones start where the next file does
+    while (high - low > 1)
+    {
+        uint32_t middle = (low + high) / 2;
+
+        if (manifest->entries[middle].start <= offset)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    entry = &manifest->entries[low];
+
+    return offset >= entry->start && offset < entry->start + entry->size ? (int)low : -1;
+}
+
+/**
+ * @brief Descriptor of a file, the last one is kept open
+ *        a file is truncated when it is opened the first time only
+ *
+ */
+int manifestFile(CrudpManifest_t *manifest, uint32_t i)
+{
+    CrudpManifestEntry_t *entry = &manifest->entries[i];
+    char path[PATH_MAX];
+
+    if (manifest->fd >= 0 && manifest->current == i)
+        return manifest->fd;
+
+    if (manifest->fd >= 0)
+        close(manifest->fd);
+
+    snprintf(path, sizeof(path), "%s/%s", manifest->root, entry->name);
+
+    manifest->fd = open(path, O_WRONLY | (entry->created ? 0 : O_CREAT | O_TRUNC), 0600);
+    manifest->current = i;
+    entry->created = 1;
+
+    if (manifest->fd < 0)
+        perror("manifestFile(): open()");
+
+    return manifest->fd;
+}
+
+int manifestWrite(void *context, const uint8_t *data, uint32_t n, uint64_t offset)
+{
+    CrudpManifest_t *manifest = (CrudpManifest_t *)context;
+
+    // the manifest comes first and in order, nothing is written before it is known
+    while (!manifest->ready && n > 0)
+    {
+        uint64_t need = manifest->rawLen ? manifest->rawLen : MANIFEST_HEADER_SIZE;
+        uint32_t k = need - manifest->received < n ? (uint32_t)(need - manifest->received) : n;
+
+        if (offset != manifest->received)
+            return -1;
+
+        if (manifest->received == 0 && (manifest->raw = (uint8_t *)malloc(MANIFEST_HEADER_SIZE)) == NULL)
+        {
+            perror("manifestWrite(): malloc()");
+            return -1;
+        }
+
+        memcpy(manifest->raw + manifest->received, data, k);
+        manifest->received += k;
+        data += k;
+        offset += k;
+        n -= k;
+
+        if (manifest->rawLen == 0 && manifest->received == MANIFEST_HEADER_SIZE)
+        {
+            uint64_t rawLen;
+            uint8_t *raw;
+
+            memcpy(&rawLen, manifest->raw + 8, 8);
+
+            if (memcmp(manifest->raw, MANIFEST_MAGIC, 8) || rawLen < MANIFEST_HEADER_SIZE || rawLen > MANIFEST_RAW_MAX)
+            {
+                printf("Bad manifest\n");
+                return -1;
+            }
+
+            if ((raw = (uint8_t *)realloc(manifest->raw, rawLen)) == NULL)
+            {
+                perror("manifestWrite(): realloc()");
+                return -1;
+            }
+
+            manifest->raw = raw;
+            manifest->rawLen = rawLen;
+        }
+
+        if (manifest->rawLen && manifest->received == manifest->rawLen && manifestParse(manifest) < 0)
+        {
+            printf("Bad manifest\n");
+            return -1;
+        }
+    }
+
+    while (n > 0)
+    {
+        int i = manifestEntryAt(manifest, offset);
+        const CrudpManifestEntry_t *entry;
+        uint32_t k;
+        int fd;
+
+        if (i < 0 || (fd = manifestFile(manifest, (uint32_t)i)) < 0)
+            return -1;
+
+        entry = &manifest->entries[i];
+        k = entry->start + entry->size - offset < n ? (uint32_t)(entry->start + entry->size - offset) : n;
+
+        for (uint32_t done = 0; done < k;)
+        {
+            ssize_t w = pwrite(fd, data + done, k - done, (off_t)(offset - entry->start + done));
+
+            if (w < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                perror("manifestWrite(): pwrite()");
+                return -1;
+            }
+
+            done += w;
+        }
+
+        data += k;
+        offset += k;
+        n -= k;
+    }
+
+    return 0;
+}
+
+void manifestFree(CrudpManifest_t *manifest)
+{
+    char path[PATH_MAX];
+
+    if (manifest->fd >= 0)
+        close(manifest->fd);
+    manifest->fd = -1;
+
+    for (uint32_t i = 0; i < manifest->extentCount; i++)
+    {
+        if (manifest->extents[i].mapped)
+            munmap((void *)manifest->extents[i].base, manifest->extents[i].len);
+    }
+
+    // the modes sent, now that nothing is written any more, what a directory holds first
+    for (uint32_t i = manifest->count; i > 0 && manifest->root != NULL; i--)
+    {
+        snprintf(path, sizeof(path), "%s/%s", manifest->root, manifest->entries[i - 1].name);
+        chmod(path, manifest->entries[i - 1].mode & 07777);
+    }
+
+    for (uint32_t i = 0; i < manifest->count; i++)
+        free(manifest->entries[i].name);
+
+    free(manifest->entries);
+    free(manifest->extents);
+    free(manifest->arena);
+    free(manifest->raw);
+
+    memset(manifest, 0, sizeof(*manifest));
+    manifest->fd = -1;
+}
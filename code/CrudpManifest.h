@@ -0,0 +1,119 @@
+#ifndef __CrudpManifest_h__
+#define __CrudpManifest_h__
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+#define MANIFEST_MAGIC "CRUDPTR1"
+#define MANIFEST_HEADER_SIZE ((uint32_t)20) // magic, manifest length, entry count
+#define MANIFEST_ENTRY_SIZE ((uint32_t)14)  // size, mode, name length, then the name
+#define MANIFEST_NAME_MAX ((uint32_t)4096)
+
+/**
+ * @brief File or directory of the tree, 'start' is its stream offset
+ *
+ */
+typedef struct CrudpManifestEntry_s
+{
+    char *name; // relative to the root, '/' separated
+    uint64_t size;
+    uint32_t mode;
+    uint64_t start;
+    int created; // receiver: opened with O_TRUNC once
+} CrudpManifestEntry_t;
+
+/**
+ * @brief Bytes of the stream kept in memory, the manifest, a run of small
+ *        files read into the arena or a large file mapped as it is
+ *
+ */
+typedef struct CrudpManifestExtent_s
+{
+    uint64_t start;
+    uint64_t len;
+    const uint8_t *base;
+    int mapped; // base is a mapping of 'len' bytes
+} CrudpManifestExtent_t;
+
+/**
+ * @brief Directory tree sent as one stream: the manifest, then every file
+ *        back to back, so that small files share segments
+ */
+typedef struct CrudpManifest_s
+{
+    CrudpManifestEntry_t *entries;
+    uint32_t count;
+    uint32_t maxCount;
+
+    uint8_t *raw;     // encoded manifest
+    uint64_t rawLen;  // manifest length, header included
+    uint64_t length;  // stream length, manifest included
+
+    // transmitter
+    CrudpManifestExtent_t *extents;
+    uint32_t extentCount;
+    uint32_t cursor; // extent of the last lookup, reads are mostly sequential
+    uint8_t *arena;  // files smaller than 'packBelow'
+    uint32_t packBelow;
+
+    // receiver
+    const char *root;
+    uint64_t received; // manifest bytes received so far
+    int ready;         // manifest parsed, files can be written anywhere
+    int fd;            // file of 'current'
+    uint32_t current;
+} CrudpManifest_t;
+
+/**
+ * @brief Walk a directory and lay out the stream
+ *        files smaller than 'packBelow' bytes are read into one arena,
+ *        the others are mapped
+ *
+ * @param manifest manifest to fill
+ * @param root directory to send
+ * @param packBelow payload bytes of a segment
+ * @return int 0 on success, -1 on error
+ */
+int manifestBuild(CrudpManifest_t *manifest, const char *root, uint32_t packBelow);
+
+/**
+ * @brief Bytes of the stream, gathered into 'scratch' when they cross an extent
+ *
+ * @param manifest manifest built by manifestBuild()
+ * @param offset stream offset
+ * @param len at most the size of 'scratch'
+ * @param scratch room for 'len' bytes
+ * @return const uint8_t* the bytes, in memory of the manifest or in 'scratch'
+ */
+const uint8_t *manifestData(CrudpManifest_t *manifest, uint64_t offset, uint32_t len, uint8_t *scratch);
+
+/**
+ * @brief Prepare to unpack a tree
+ *
+ * @param manifest manifest to fill as the stream arrives
+ * @param root directory to unpack into, created if missing
+ * @return int 0 on success, -1 on error
+ */
+int manifestOpen(CrudpManifest_t *manifest, const char *root);
+
+/**
+ * @brief Write stream bytes, the manifest has to arrive in order,
+ *        file data may arrive anywhere once it is parsed
+ *        the signature of a reassembly buffer sink
+ *
+ * @param context the manifest
+ * @param data bytes
+ * @param n how many
+ * @param offset stream offset
+ * @return int 0 on success, -1 on error
+ */
+int manifestWrite(void *context, const uint8_t *data, uint32_t n, uint64_t offset);
+
+/**
+ * @brief Close the file open and release everything
+ *
+ * @param manifest manifest of either end
+ */
+void manifestFree(CrudpManifest_t *manifest);
+
+#endif
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include <errno.h>
+void perror(const char *s);
+
+#include "CrudpMcast.h"
+
+_Static_assert(sizeof(CrudpMcastAnnounce_t) == 24, "CrudpMcastAnnounce_t is not packed");
+
+int mcastGroup(const char *host)
+{
+    struct in_addr addr;
+
+    return host != NULL && inet_aton(host, &addr) != 0 && IN_MULTICAST(ntohl(addr.s_addr));
+}
+
+int mcastOpen(UdpSocket_t *local, const UdpSocket_t *group, const char *ifaddr, int ttl)
+{
+    struct ip_mreq mreq;
+    struct in_addr interface;
+    int on = 1;
+    unsigned char hops = (unsigned char)ttl;
+
+    interface.s_addr = htonl(INADDR_ANY);
+    if (ifaddr != NULL && inet_aton(ifaddr, &interface) == 0)
+    {
+        fprintf(stderr, "mcastOpen(): bad interface address %s\n", ifaddr);
+        return -1;
+    }
+
+    if ((local->sd = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0)
+    {
+        perror("mcastOpen(): socket()");
+        return -1;
+    }
+
+    // several receivers on one host share the port
+    if (setsockopt(local->sd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0)
+    {
+        perror("mcastOpen(): setsockopt(SO_REUSEADDR)");
+        return -1;
+    }
+
+    local->addr.sin_family = AF_INET;
+    local->addr.sin_port = group->addr.sin_port;
+    if (bind(local->sd, (struct sockaddr *)&local->addr, sizeof(local->addr)) < 0)
+    {
+        perror("mcastOpen(): bind()");
+        return -1;
+    }
+
+    mreq.imr_multiaddr = group->addr.sin_addr;
+    mreq.imr_interface = interface;
+    if (setsockopt(local->sd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+    {
+        perror("mcastOpen(): setsockopt(IP_ADD_MEMBERSHIP)");
+        return -1;
+    }
+
+    // members on the host of the sender get the datagrams too
+    if (setsockopt(local->sd, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface)) < 0 ||
+        setsockopt(local->sd, IPPROTO_IP, IP_MULTICAST_LOOP, &on, sizeof(on)) < 0 ||
+        setsockopt(local->sd, IPPROTO_IP, IP_MULTICAST_TTL, &hops, sizeof(hops)) < 0)
+    {
+        perror("mcastOpen(): setsockopt(IP_MULTICAST_*)");
+        return -1;
+    }
+
+    return 0;
+}
+
+uint64_t mcastBackoff(uint64_t grtt)
+{
+    double window = (double)(MCAST_BACKOFF_GRTT * grtt > MCAST_BACKOFF_MIN_US ? MCAST_BACKOFF_GRTT * grtt
+                                                                               : MCAST_BACKOFF_MIN_US);
+    double lambda = log(MCAST_GROUP_SIZE) + 1;
+    double x = (double)rand() / ((double)RAND_MAX + 1);
+
+    return (uint64_t)(window / lambda * log(x * (exp(lambda) - 1) + 1));
+}
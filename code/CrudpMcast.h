@@ -0,0 +1,82 @@
+#ifndef __CrudpMcast_h__
+#define __CrudpMcast_h__
+
+#include <inttypes.h>
+
+#include "CrudpSocket.h"
+
+#define MCAST_ANNOUNCE_MS ((uint64_t)100)     // the sender announces the file this often
+#define MCAST_LINGER_MS ((uint64_t)1000)      // the sender ends once no NACK came for this long after the last byte
+#define MCAST_FINS ((int)3)                   // FINs the sender ends with, nothing acknowledges them
+#define MCAST_KBIT_DEFAULT ((uint64_t)100000) // rate without CRUDP_BULK, kbit/s
+#define MCAST_GRTT_INIT_US ((uint64_t)10000)  // group RTT before the first sample
+#define MCAST_BACKOFF_GRTT ((uint64_t)4)      // a NACK waits up to this many group RTTs (RFC 5740)
+#define MCAST_BACKOFF_MIN_US ((uint64_t)5000) // and up to this long at least
+#define MCAST_GROUP_SIZE ((double)1000)       // receivers the backoff is made for
+
+/**
+ * @brief Payload of an announce, a SYN of the sender to the group
+ *
+ */
+typedef struct CrudpMcastAnnounce_s
+{
+    uint64_t size; // file length
+    uint64_t sent; // stream offset past the last byte sent so far
+    uint32_t grtt; // group RTT measured by the sender (microseconds)
+    uint32_t reserved;
+} CrudpMcastAnnounce_t;
+
+/**
+ * @brief One to many transfer to a multicast group
+ *        The sender paces the file to the group and announces its length,
+ *        a receiver that misses data waits a random backoff before its NACK
+ *        and keeps quiet about what another receiver asked for first,
+ *        the sender merges the NACKs and repairs to the whole group.
+ *        Every datagram of the sender carries the session in 'an',
+ *        every NACK in 'sn'.
+ */
+typedef struct CrudpMcast_s
+{
+    uint32_t session; // random id of the transfer, made by the sender
+    int joined;       // receiver: the session is known
+    uint64_t grtt;    // group RTT (microseconds)
+
+    // transmitter
+    uint64_t announcedAt; // clockNow() of the last announce
+    uint64_t nackAt;      // clockNow() of the last NACK
+
+    // receiver
+    uint64_t announceAt; // clockNow() the latest announce arrived, the NACKs echo it and tell how long it was held
+    uint64_t nackDue;    // clockNow() the pending NACK goes, 0 if none
+} CrudpMcast_t;
+
+/**
+ * @brief Is the host an IPv4 multicast group?
+ *
+ * @param host dot notation address
+ * @return int 1 for a group, 0 otherwise
+ */
+int mcastGroup(const char *host);
+
+/**
+ * @brief Open a socket on the port of the group and join it,
+ *        every member shares the port, the sender too for the NACKs
+ *
+ * @param local socket to open, its port is the one of the group
+ * @param group group address and port
+ * @param ifaddr address of the interface to use, NULL for the one of the route
+ * @param ttl hops the datagrams go
+ * @return int 0 on success, -1 on error
+ */
+int mcastOpen(UdpSocket_t *local, const UdpSocket_t *group, const char *ifaddr, int ttl);
+
+/**
+ * @brief Random wait before a NACK, exponential over the backoff
+ *        so that few receivers of a large group go first (RFC 5401)
+ *
+ * @param grtt group RTT (microseconds)
+ * @return uint64_t microseconds to wait
+ */
+uint64_t mcastBackoff(uint64_t grtt);
+
+#endif
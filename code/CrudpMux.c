@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <errno.h>
+void perror(const char *s);
+
+#include "CrudpMux.h"
+#include "CrudpArena.h"
+#include "CrudpClock.h"
+
+_Static_assert(sizeof(CrudpMuxFrame_t) == MUX_FRAME_SIZE, "CrudpMuxFrame_t does not match MUX_FRAME_SIZE");
+
+/**
+ * @brief Map a file to send, read it if it cannot be mapped
+ *
+ * @return int 0 on success, -1 on error
+ */
+int muxMap(CrudpMuxStream_t *stream, const char *path)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    void *base;
+
+    if (fd < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        fprintf(stderr, "muxMap(): %s is not a file\n", path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    stream->size = (uint64_t)st.st_size;
+
+    if (stream->size > 0 && (base = mmap(NULL, stream->size, PROT_READ, MAP_PRIVATE | (arenaPrefaulted() ? MAP_POPULATE : 0),
+                                         fd, 0)) != MAP_FAILED)
+    {
+        madvise(base, stream->size, MADV_SEQUENTIAL);
+        stream->data = (const uint8_t *)base;
+        stream->mapped = 1;
+    }
+    else
+    {
+        uint8_t *buffer = (uint8_t *)arenaAlloc(stream->size);
+
+        for (uint64_t n = 0; buffer != NULL && n < stream->size;)
+        {
+            ssize_t r = read(fd, buffer + n, stream->size - n);
+
+            if (r <= 0)
+            {
+                perror("muxMap(): read()");
+                arenaFree(buffer, stream->size);
+                buffer = NULL;
+            }
+            else
+                n += r;
+        }
+
+        if ((stream->data = buffer) == NULL)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+
+    close(fd);
+
+    return 0;
+}
+
+int muxBuild(CrudpMux_t *mux, char **paths, int count, const char *urgencies)
+{
+    const char *urgency = urgencies;
+
+    memset(mux, 0, sizeof(*mux));
+
+    if (count < 1 || (uint32_t)count > MUX_STREAMS_MAX)
+    {
+        fprintf(stderr, "muxBuild(): 1 to %u files\n", MUX_STREAMS_MAX);
+        return -1;
+    }
+
+    if ((mux->streams = (CrudpMuxStream_t *)calloc(count, sizeof(CrudpMuxStream_t))) == NULL)
+    {
+        perror("muxBuild(): calloc()");
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        CrudpMuxStream_t *stream = &mux->streams[mux->count];
+        const char *slash = strrchr(paths[i], '/');
+
+        // the receiver knows a file by its last name only
+        stream->name = strdup(slash ? slash + 1 : paths[i]);
+        stream->urgency = MUX_URGENCY_DEFAULT;
+
+        if (urgency != NULL && *urgency != '\0')
+        {
+            stream->urgency = (uint8_t)atoi(urgency);
+            urgency = strchr(urgency, ',') ? strchr(urgency, ',') + 1 : NULL;
+        }
+
+        if (stream->name == NULL || *stream->name == '\0' || strlen(stream->name) > MUX_NAME_MAX ||
+            stream->urgency > MUX_URGENCY_MAX || muxMap(stream, paths[i]) < 0)
+        {
+            fprintf(stderr, "muxBuild(): bad file %s\n", paths[i]);
+            free(stream->name);
+            muxFree(mux);
+            return -1;
+        }
+
+        mux->count++;
+    }
+
+    return 0;
+}
+
+uint32_t muxFill(CrudpMux_t *mux, uint8_t *payload, uint32_t room)
+{
+    CrudpMuxFrame_t *frame = (CrudpMuxFrame_t *)payload;
+    CrudpMuxStream_t *stream = NULL;
+    uint32_t at = MUX_FRAME_SIZE, n;
+
+    // the most urgent stream, the one after the last turn among equals
+    for (uint32_t k = 1; k <= mux->count; k++)
+    {
+        CrudpMuxStream_t *candidate = &mux->streams[(mux->turn + k) % mux->count];
+
+        if (!candidate->finished && (stream == NULL || candidate->urgency < stream->urgency))
+            stream = candidate;
+    }
+
+    if (stream == NULL)
+        return 0;
+
+    mux->turn = (uint32_t)(stream - mux->streams);
+
+    memset(frame, 0, MUX_FRAME_SIZE);
+    frame->stream = mux->turn;
+    frame->offset = stream->sent;
+    frame->urgency = stream->urgency;
+
+    if (stream->sent == 0)
+    {
+        frame->flags |= MUX_NAME;
+        frame->nameLen = (uint16_t)strlen(stream->name);
+        memcpy(payload + at, stream->name, frame->nameLen);
+        at += frame->nameLen;
+    }
+
+    n = stream->size - stream->sent < room - at ? (uint32_t)(stream->size - stream->sent) : room - at;
+    memcpy(payload + at, stream->data + stream->sent, n);
+    stream->sent += n;
+
+    if (stream->sent == stream->size)
+    {
+        frame->flags |= MUX_FIN;
+        stream->finished = 1;
+    }
+
+    return at + n;
+}
+
+int muxOpen(CrudpMux_t *mux, const char *root, uint32_t reasmBytes)
+{
+    memset(mux, 0, sizeof(*mux));
+    mux->root = root;
+    mux->reasmBytes = reasmBytes;
+
+    if ((mux->streams = (CrudpMuxStream_t *)calloc(MUX_STREAMS_MAX, sizeof(CrudpMuxStream_t))) == NULL)
+    {
+        perror("muxOpen(): calloc()");
+        return -1;
+    }
+    mux->count = MUX_STREAMS_MAX;
+
+    if (mkdir(root, 0755) < 0 && errno != EEXIST)
+    {
+        perror("muxOpen(): mkdir()");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Create the file of a stream once its name is known
+ *        a name is one part, no "." or ".."
+ *
+ * @return int 0 on success, -1 on error
+ */
+int muxName(CrudpMux_t *mux, CrudpMuxStream_t *stream, const uint8_t *name, uint16_t len)
+{
+    char path[4096];
+    int fd;
+
+    if (len == 0 || len > MUX_NAME_MAX || memchr(name, '/', len) != NULL || memchr(name, '\0', len) != NULL ||
+        (len == 1 && name[0] == '.') || (len == 2 && name[0] == '.' && name[1] == '.'))
+    {
+        fprintf(stderr, "muxName(): bad stream name\n");
+        return -1;
+    }
+
+    if ((stream->name = strndup((const char *)name, len)) == NULL)
+        return -1;
+
+    snprintf(path, sizeof(path), "%s/%s", mux->root, stream->name);
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+    {
+        perror("muxName(): open()");
+        return -1;
+    }
+
+    // bytes past a hole can go to their place from now on
+    stream->reasm.fd = fd;
+    stream->reasm.seekable = 1;
+
+    return 0;
+}
+
+int muxReceive(CrudpMux_t *mux, CrudpPacket_t *packet, const uint8_t *payload, uint32_t len)
+{
+    const CrudpMuxFrame_t *frame = (const CrudpMuxFrame_t *)payload;
+    CrudpMuxStream_t *stream;
+    uint32_t at = MUX_FRAME_SIZE;
+    int fresh;
+
+    if (len < MUX_FRAME_SIZE || frame->stream >= MUX_STREAMS_MAX ||
+        ((frame->flags & MUX_NAME) && (frame->offset != 0 || len - at < frame->nameLen)))
+    {
+        fprintf(stderr, "muxReceive(): bad frame\n");
+        return -1;
+    }
+
+    stream = &mux->streams[frame->stream];
+
+    // every byte of it was written, its buffer is gone
+    if (stream->done)
+        return 0;
+
+    // nothing is written before the name, the first bytes come with it
+    if (!stream->open)
+    {
+        if (reasmInit(&stream->reasm, -1, mux->reasmBytes) < 0)
+            return -1;
+        stream->reasm.seekable = 0;
+        stream->urgency = frame->urgency;
+        stream->open = 1;
+    }
+
+    if (frame->flags & MUX_NAME)
+    {
+        if (stream->name == NULL && muxName(mux, stream, payload + at, frame->nameLen) < 0)
+            return -1;
+        at += frame->nameLen;
+    }
+
+    fresh = reasmInsert(&stream->reasm, frame->offset, packet, payload + at, len - at, frame->flags & MUX_FIN);
+
+    if (fresh < 0)
+        return -1;
+
+    if (!stream->done && stream->reasm.end != REASM_END_UNKNOWN && stream->reasm.delivered >= stream->reasm.end)
+    {
+        stream->done = 1;
+        stream->doneAt = clockNow();
+        stream->size = stream->reasm.end;
+        mux->done++;
+
+        reasmFree(&stream->reasm);
+        close(stream->reasm.fd);
+        stream->reasm.fd = -1;
+    }
+
+    return fresh;
+}
+
+int muxSink(void *context, const uint8_t *data, uint32_t n, uint64_t offset)
+{
+    return 0;
+}
+
+void muxFree(CrudpMux_t *mux)
+{
+    for (uint32_t i = 0; mux->streams != NULL && i < mux->count; i++)
+    {
+        CrudpMuxStream_t *stream = &mux->streams[i];
+
+        if (stream->mapped)
+            munmap((void *)stream->data, stream->size);
+        else
+            arenaFree((void *)stream->data, stream->size);
+
+        if (stream->open && !stream->done)
+        {
+            reasmFree(&stream->reasm);
+            if (stream->reasm.fd >= 0)
+                close(stream->reasm.fd);
+        }
+
+        free(stream->name);
+    }
+
+    free(mux->streams);
+    mux->streams = NULL;
+    mux->count = 0;
+}
@@ -0,0 +1,131 @@
+#ifndef __CrudpMux_h__
+#define __CrudpMux_h__
+
+#include <inttypes.h>
+
+#include "CrudpPool.h"
+#include "CrudpReasm.h"
+
+#define MUX_FRAME_SIZE ((uint32_t)16)
+#define MUX_STREAMS_MAX ((uint32_t)64)
+#define MUX_NAME_MAX ((uint32_t)255)
+#define MUX_ROOM_MIN (MUX_FRAME_SIZE + MUX_NAME_MAX + 64) // a segment always has room for the name and some data
+#define MUX_URGENCY_DEFAULT ((uint8_t)3)                  // 0 goes first, 7 last (RFC 9218)
+#define MUX_URGENCY_MAX ((uint8_t)7)
+
+#define MUX_NAME ((uint8_t)1) // the name of the stream is in front of the data, first frame only
+#define MUX_FIN ((uint8_t)2)  // the data ends the stream
+
+/**
+ * @brief In front of the data of every segment of a multiplexed connection
+ *
+ */
+typedef struct CrudpMuxFrame_s
+{
+    uint64_t offset; // stream offset of the data
+    uint32_t stream; // stream id
+    uint8_t flags;
+    uint8_t urgency;
+    uint16_t nameLen; // name bytes before the data, with MUX_NAME
+} CrudpMuxFrame_t;
+
+/**
+ * @brief One object of the connection, with its own offsets and its own delivery
+ *
+ */
+typedef struct CrudpMuxStream_s
+{
+    char *name;
+    uint8_t urgency;
+    uint64_t size;
+
+    // transmitter
+    const uint8_t *data;
+    int mapped; // data is a mapping of 'size' bytes
+    uint64_t sent;
+    int finished; // the frame with MUX_FIN was built
+
+    // receiver
+    CrudpReasm_t reasm;
+    int open;        // reasm was setup
+    int done;        // every byte up to MUX_FIN was written
+    uint64_t doneAt; // clockNow() when it was done
+} CrudpMuxStream_t;
+
+/**
+ * @brief Independent streams multiplexed into the one stream of a connection
+ *        Segments are acknowledged and retransmitted by the connection, every
+ *        stream is reassembled on its own, so a loss delays only its stream.
+ */
+typedef struct CrudpMux_s
+{
+    CrudpMuxStream_t *streams;
+    uint32_t count;
+    uint32_t turn; // round robin among the streams of the same urgency
+
+    // receiver
+    const char *root;
+    uint32_t reasmBytes;
+    uint32_t done;
+} CrudpMux_t;
+
+/**
+ * @brief Map the files to send, one stream each
+ *
+ * @param mux mux to fill
+ * @param paths files to send
+ * @param count number of files
+ * @param urgencies comma separated urgency of each file, NULL for MUX_URGENCY_DEFAULT
+ * @return int 0 on success, -1 on error
+ */
+int muxBuild(CrudpMux_t *mux, char **paths, int count, const char *urgencies);
+
+/**
+ * @brief Build the next frame of the most urgent stream not finished,
+ *        streams of the same urgency take turns segment by segment
+ *
+ * @param mux mux built by muxBuild()
+ * @param payload payload of the segment
+ * @param room bytes the payload may take, at least MUX_ROOM_MIN
+ * @return uint32_t payload bytes, 0 once every stream is finished
+ */
+uint32_t muxFill(CrudpMux_t *mux, uint8_t *payload, uint32_t room);
+
+/**
+ * @brief Prepare to receive streams into a directory
+ *
+ * @param mux mux to fill as the segments arrive
+ * @param root directory of the files, created if missing
+ * @param reasmBytes reassembly budget of every stream
+ * @return int 0 on success, -1 on error
+ */
+int muxOpen(CrudpMux_t *mux, const char *root, uint32_t reasmBytes);
+
+/**
+ * @brief Put the data of a segment in its stream, written as soon as
+ *        the stream has every byte before it
+ *
+ * @param mux mux opened by muxOpen()
+ * @param packet packet holding the payload
+ * @param payload payload of the segment, a frame and its data
+ * @param len payload length
+ * @return int 1 if it brought new bytes, 0 for a duplicate, -1 on error
+ */
+int muxReceive(CrudpMux_t *mux, CrudpPacket_t *packet, const uint8_t *payload, uint32_t len);
+
+/**
+ * @brief Reassembly buffer sink of the connection stream, whose bytes
+ *        went to their streams already as the segments came
+ *
+ * @return int 0
+ */
+int muxSink(void *context, const uint8_t *data, uint32_t n, uint64_t offset);
+
+/**
+ * @brief Close every file and release everything
+ *
+ * @param mux mux of either end
+ */
+void muxFree(CrudpMux_t *mux);
+
+#endif
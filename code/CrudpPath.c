@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+
+#include <errno.h>
+void perror(const char *s);
+
+#include "CrudpPath.h"
+#include "CrudpClock.h"
+
+CrudpPath_t G_paths[PATH_MAX_PATHS];
+
+int paths = 1;
+int pathScheduler = PATH_SCHED_MINRTT;
+int pathTurn = 0; // path of the current round robin turn
+uint32_t pathWindow = 1;
+
+/**
+ * @brief Reset the measurements and the window of a path
+ *
+ */
+void pathSetup(CrudpPath_t *path, UdpSocket_t *local, UdpSocket_t *remote, uint32_t weight)
+{
+    memset(path, 0, sizeof(*path));
+    path->local = local;
+    path->remote = remote;
+    path->weight = path->credit = weight;
+    path->cwnd = PATH_CWND_INIT < pathWindow ? PATH_CWND_INIT : pathWindow;
+    path->ssthresh = pathWindow;
+}
+
+/**
+ * @brief Open the socket of a sub-path, "local[:port][/peer][*weight]"
+ *
+ * @return int 0 on success, -1 on error
+ */
+int pathAdd(char *item, uint16_t port, uint16_t peerPort)
+{
+    char *peer = NULL, *colon, *star;
+    UdpSocket_t *local, *remote;
+    uint32_t weight = 1;
+    int flags;
+
+    if ((star = strchr(item, '*')) != NULL)
+    {
+        *star++ = '\0';
+        weight = (uint32_t)atoi(star);
+    }
+    if ((peer = strchr(item, '/')) != NULL)
+        *peer++ = '\0';
+    if ((colon = strchr(item, ':')) != NULL)
+    {
+        *colon++ = '\0';
+        port = (uint16_t)atoi(colon);
+    }
+
+    if (weight == 0 || *item == '\0')
+    {
+        fprintf(stderr, "pathAdd(): bad sub-path %s\n", item);
+        return -1;
+    }
+
+    // bound to its own address, the route out of it picks the uplink
+    if ((local = setupUdpSocket_t(item, port)) == NULL ||
+        (remote = peer ? setupUdpSocket_t(peer, peerPort) : (UdpSocket_t *)malloc(sizeof(UdpSocket_t))) == NULL)
+    {
+        fprintf(stderr, "pathAdd(): bad address %s\n", item);
+        return -1;
+    }
+    if (peer == NULL)
+        *remote = *G_paths[0].remote;
+
+    if (openUdp(local) < 0 ||
+        (flags = fcntl(local->sd, F_GETFL)) < 0 || fcntl(local->sd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        perror("pathAdd()");
+        return -1;
+    }
+
+    pathSetup(&G_paths[paths++], local, remote, weight);
+
+    return 0;
+}
+
+int pathInit(const char *spec, const char *scheduler, UdpSocket_t *local, UdpSocket_t *remote, uint32_t window)
+{
+    uint16_t port = ntohs(local->addr.sin_port),
+             peerPort = ntohs(remote->addr.sin_port);
+    char *copy, *item, *save;
+
+    pathWindow = window;
+    paths = 1;
+    pathSetup(&G_paths[0], local, remote, 1);
+
+    if (scheduler != NULL && !strcmp(scheduler, "wrr"))
+        pathScheduler = PATH_SCHED_WRR;
+    else if (scheduler != NULL && strcmp(scheduler, "minrtt"))
+    {
+        fprintf(stderr, "pathInit(): unknown scheduler %s\n", scheduler);
+        return -1;
+    }
+
+    if (spec == NULL || *spec == '\0')
+        return 0;
+
+    copy = strdup(spec);
+    for (item = strtok_r(copy, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save))
+    {
+        if (paths == PATH_MAX_PATHS)
+        {
+            fprintf(stderr, "pathInit(): at most %d paths\n", PATH_MAX_PATHS);
+            free(copy);
+            return -1;
+        }
+
+        if (pathAdd(item, port + paths, peerPort) < 0)
+        {
+            free(copy);
+            return -1;
+        }
+    }
+    free(copy);
+
+    // together the paths start out with the window of one, each one grows past its share slowly
+    for (int i = 0; i < paths; i++)
+        G_paths[i].ssthresh = pathWindow / paths > G_paths[i].cwnd ? pathWindow / paths : G_paths[i].cwnd;
+
+    return 0;
+}
+
+int pathCount()
+{
+    return paths;
+}
+
+int pathSchedule()
+{
+    int best = -1;
+
+    if (paths == 1)
+        return 0;
+
+    if (pathScheduler == PATH_SCHED_WRR)
+    {
+        // a path with a full window passes its turn on
+        for (int tried = 0; tried < paths; tried++)
+        {
+            CrudpPath_t *path = &G_paths[pathTurn];
+
+            if (path->credit == 0)
+                path->credit = path->weight;
+
+            if (path->inflight < path->cwnd)
+            {
+                if (--path->credit == 0)
+                    pathTurn = (pathTurn + 1) % paths;
+                return (int)(path - G_paths);
+            }
+
+            path->credit = 0;
+            pathTurn = (pathTurn + 1) % paths;
+        }
+
+        return -1;
+    }
+
+    // a path without a sample yet is tried first, it is measured that way
+    for (int i = 0; i < paths; i++)
+    {
+        CrudpPath_t *path = &G_paths[i];
+
+        if (path->inflight >= path->cwnd)
+            continue;
+
+        if (best < 0 || path->srtt < G_paths[best].srtt ||
+            (path->srtt == G_paths[best].srtt && path->inflight < G_paths[best].inflight))
+            best = i;
+    }
+
+    return best;
+}
+
+int pathResend(int lostOn)
+{
+    int best = lostOn;
+
+    for (int i = 0; i < paths; i++)
+    {
+        if (i == lostOn)
+            continue;
+
+        if (best == lostOn || G_paths[i].srtt < G_paths[best].srtt)
+            best = i;
+    }
+
+    return best;
+}
+
+void pathSent(int path, uint32_t len)
+{
+    G_paths[path].inflight++;
+    G_paths[path].segments++;
+    G_paths[path].bytes += len;
+}
+
+void pathAcked(int path)
+{
+    CrudpPath_t *p = &G_paths[path];
+
+    if (p->inflight > 0)
+        p->inflight--;
+
+    // slow start below ssthresh, one segment per window above
+    if (p->cwnd < p->ssthresh)
+    {
+        p->cwnd++;
+    }
+    else if (++p->grown >= p->cwnd)
+    {
+        p->grown = 0;
+        p->cwnd++;
+    }
+
+    if (p->cwnd > pathWindow)
+        p->cwnd = pathWindow;
+}
+
+void pathLost(int path)
+{
+    CrudpPath_t *p = &G_paths[path];
+    uint64_t now = clockNow();
+
+    if (p->inflight > 0)
+        p->inflight--;
+    p->lost++;
+
+    // the losses of one window are one congestion event
+    if (now - p->cut > (uint64_t)p->srtt)
+    {
+        p->cut = now;
+        p->ssthresh = p->cwnd / 2 > 1 ? p->cwnd / 2 : 1;
+        p->cwnd = p->ssthresh;
+        p->grown = 0;
+    }
+}
+
+void pathSample(int path, uint32_t rtt)
+{
+    CrudpPath_t *p = &G_paths[path];
+
+    if (!p->sampled)
+    {
+        p->srtt = rtt;
+        p->rttvar = rtt / 2;
+        p->sampled = 1;
+    }
+    else
+    {
+        p->rttvar = (3 * p->rttvar + labs(p->srtt - (long)rtt)) / 4;
+        p->srtt = (7 * p->srtt + (long)rtt) / 8;
+    }
+}
+
+uint64_t pathRTO()
+{
+    uint64_t slowest = 0;
+
+    for (int i = 0; i < paths; i++)
+    {
+        uint64_t rto = (uint64_t)(G_paths[i].srtt + 4 * G_paths[i].rttvar);
+
+        if (G_paths[i].sampled && rto > slowest)
+            slowest = rto;
+    }
+
+    return slowest;
+}
+
+void pathClose()
+{
+    // path 0 is the connection socket, its owner closes it
+    for (int i = 1; i < paths; i++)
+        closeUdp(G_paths[i].local);
+}
@@ -0,0 +1,126 @@
+#ifndef __CrudpPath_h__
+#define __CrudpPath_h__
+
+#include <inttypes.h>
+
+#include "CrudpSocket.h"
+
+#define PATH_MAX_PATHS ((int)8)
+#define PATH_CWND_INIT ((uint32_t)10) // segments a new sub-path may have in flight
+
+#define PATH_SCHED_MINRTT ((int)0) // lowest smoothed RTT with room first
+#define PATH_SCHED_WRR ((int)1)    // weighted round robin over the paths with room
+
+/**
+ * @brief Sub-path of a multipath connection, a local socket and the peer it sends to
+ *        Every path measures its own RTT and loss and keeps its own window,
+ *        the sequence space is the one of the connection.
+ */
+typedef struct CrudpPath_s
+{
+    UdpSocket_t *local;
+    UdpSocket_t *remote;
+
+    uint32_t weight; // share of the weighted round robin
+    uint32_t credit; // segments left in the current round
+
+    // RFC 6298 on the samples of this path (microseconds)
+    long srtt, rttvar;
+    int sampled;
+
+    // window of this path (segments), halved on a loss at most once per RTT
+    uint32_t cwnd, ssthresh, grown, inflight;
+    uint64_t cut; // time of the last halving (microseconds)
+
+    uint64_t segments; // segments sent, retransmissions included
+    uint64_t bytes;    // payload bytes sent
+    uint64_t lost;     // segments sent again after a loss
+} CrudpPath_t;
+
+extern CrudpPath_t G_paths[PATH_MAX_PATHS];
+
+/**
+ * @brief Setup the paths, path 0 is the connection socket
+ *        e.g. "10.0.0.2,10.0.1.2:23300/192.168.7.1*2" adds a sub-path bound to
+ *        10.0.0.2 (port of the connection + 1) and one bound to 10.0.1.2:23300,
+ *        sending to 192.168.7.1 with twice the share in the round robin
+ *
+ * @param spec comma separated "local[:port][/peer][*weight]" list, NULL for one path
+ * @param scheduler "minrtt" (NULL too) or "wrr"
+ * @param local connection socket, already open
+ * @param remote peer of the connection
+ * @param window segments a path may have in flight at most
+ * @return int 0 on success, -1 on a bad spec or a socket that could not be opened
+ */
+int pathInit(const char *spec, const char *scheduler, UdpSocket_t *local, UdpSocket_t *remote, uint32_t window);
+
+/**
+ * @brief Number of paths, 1 without sub-paths
+ *
+ * @return int paths
+ */
+int pathCount();
+
+/**
+ * @brief Choose the path of the next new segment
+ *        a single path is not scheduled, it has the whole window
+ *
+ * @return int path, -1 if every path has a full window
+ */
+int pathSchedule();
+
+/**
+ * @brief Choose the path of a retransmission, the fastest one
+ *        that did not lose the segment if there is one
+ *
+ * @param lostOn path the segment was lost on
+ * @return int path
+ */
+int pathResend(int lostOn);
+
+/**
+ * @brief Account a segment sent on a path
+ *
+ * @param path path
+ * @param len payload bytes
+ */
+void pathSent(int path, uint32_t len);
+
+/**
+ * @brief Account a segment acknowledged, its path window grows
+ *
+ * @param path path it was last sent on
+ */
+void pathAcked(int path);
+
+/**
+ * @brief Account a segment lost on a path, its window is halved
+ *        the segment leaves the flight of the path until it is sent again
+ *
+ * @param path path it was last sent on
+ */
+void pathLost(int path);
+
+/**
+ * @brief Add an RTT sample to the path the ACK came back on
+ *
+ * @param path path
+ * @param rtt round trip time in microseconds
+ */
+void pathSample(int path, uint32_t rtt);
+
+/**
+ * @brief Retransmission timeout of the slowest path
+ *        the timer of the connection covers segments on every path
+ *
+ * @return uint64_t microseconds, 0 before the first sample
+ */
+uint64_t pathRTO();
+
+/**
+ * @brief Close the sockets of the sub-paths
+ *
+ */
+void pathClose();
+
+#endif
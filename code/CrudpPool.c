@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <errno.h>
+void perror(const char *s);
+
+#include "CrudpPool.h"
+#include "CrudpArena.h"
+
+// Every thread has its own free list, no locking on the packet path
+_Thread_local CrudpPacket_t *poolFreeList = NULL;
+_Thread_local uint64_t poolAllocated = 0;
+
+/**
+ * @brief Allocate a cache aligned slab and put its packets in the free list
+ *        a slab fills a whole huge page when the arenas are made of them
+ *
+ * @return int 0 on success, -1 if out of memory
+ */
+int poolGrow()
+{
+    uint32_t packets = (uint32_t)(arenaSlab(POOL_SLAB_PACKETS * sizeof(CrudpPacket_t)) / sizeof(CrudpPacket_t));
+    CrudpPacket_t *slab = (CrudpPacket_t *)arenaAlloc(packets * sizeof(CrudpPacket_t));
+
+    if (slab == NULL)
+        return -1;
+
+    // last in first out, the first packets taken are the first of the slab
+    for (uint32_t i = packets; i-- > 0;)
+    {
+        slab[i].next = poolFreeList;
+        poolFreeList = &slab[i];
+    }
+
+    poolAllocated += packets;
+
+    return 0;
+}
+
+CrudpPacket_t *packetAlloc()
+{
+    CrudpPacket_t *packet;
+
+    if (poolFreeList == NULL && poolGrow() < 0)
+        return NULL;
+
+    packet = poolFreeList;
+    poolFreeList = packet->next;
+
+    packet->next = NULL;
+    packet->refs = 1;
+    packet->n = 0;
+
+    return packet;
+}
+
+int poolReserve(uint64_t packets)
+{
+    while (poolAllocated < packets)
+        if (poolGrow() < 0)
+            return -1;
+
+    return 0;
+}
+
+CrudpPacket_t *packetRef(CrudpPacket_t *packet)
+{
+    packet->refs++;
+
+    return packet;
+}
+
+void packetPut(CrudpPacket_t *packet)
+{
+    if (packet == NULL || --packet->refs > 0)
+        return;
+
+    packet->next = poolFreeList;
+    poolFreeList = packet;
+}
+
+CrudpPacket_t *packetOf(const void *bytes)
+{
+    return (CrudpPacket_t *)((const uint8_t *)bytes - offsetof(CrudpPacket_t, bytes));
+}
+
+uint64_t poolPackets()
+{
+    return poolAllocated;
+}
@@ -0,0 +1,77 @@
+#ifndef __CrudpPool_h__
+#define __CrudpPool_h__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#define POOL_ALIGN ((uint32_t)64)                       // cache line
+#define POOL_PACKET_SIZE ((uint32_t)2048)               // packet with its bookkeeping
+#define POOL_PACKET_BYTES (POOL_PACKET_SIZE - POOL_ALIGN) // room for a datagram
+#define POOL_SLAB_PACKETS ((uint32_t)64)                // packets allocated at once
+
+/**
+ * @brief Packet buffer, shared by reference count
+ *        A packet may sit in the send ring, the delay queue of the
+ *        impairment emulator and the reassembly buffer at the same time,
+ *        it goes back to the pool when the last owner puts it.
+ */
+typedef struct CrudpPacket_s
+{
+    struct CrudpPacket_s *next; // free list
+    uint32_t refs;
+    uint32_t n; // bytes used
+
+    _Alignas(POOL_ALIGN) uint8_t bytes[POOL_PACKET_BYTES];
+} CrudpPacket_t;
+
+_Static_assert(sizeof(CrudpPacket_t) == POOL_PACKET_SIZE, "CrudpPacket_t does not match POOL_PACKET_SIZE");
+
+/**
+ * @brief Take a packet from the pool of the calling thread
+ *        a new slab is allocated only when every packet is in use
+ *
+ * @return CrudpPacket_t* packet with one reference, NULL if out of memory
+ */
+CrudpPacket_t *packetAlloc();
+
+/**
+ * @brief Grow the pool of the calling thread to 'packets' ahead of the transfer
+ *
+ * @param packets packets the pool should have allocated
+ * @return int 0 on success, -1 if out of memory
+ */
+int poolReserve(uint64_t packets);
+
+/**
+ * @brief Take one more reference
+ *
+ * @param packet packet to share
+ * @return CrudpPacket_t* the same packet
+ */
+CrudpPacket_t *packetRef(CrudpPacket_t *packet);
+
+/**
+ * @brief Drop a reference, the last one returns the packet to the pool
+ *        of the calling thread
+ *
+ * @param packet packet to put, NULL is ignored
+ */
+void packetPut(CrudpPacket_t *packet);
+
+/**
+ * @brief Find the packet from its bytes
+ *
+ * @param bytes the 'bytes' member of a packet
+ * @return CrudpPacket_t* packet
+ */
+CrudpPacket_t *packetOf(const void *bytes);
+
+/**
+ * @brief Number of packets the pool of the calling thread has allocated
+ *        it stops growing once the transfer reaches a steady state
+ *
+ * @return uint64_t packets
+ */
+uint64_t poolPackets();
+
+#endif
@@ -0,0 +1,522 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+
+#include <errno.h>
+void perror(const char *s);
+
+#include "CrudpReasm.h"
+#include "CrudpArena.h"
+
+#define REASM_WORD_BITS ((uint32_t)64)
+#define REASM_SPILLS ((uint32_t)16)
+#define REASM_WORDS(_capacity) (((_capacity) + REASM_WORD_BITS - 1) / REASM_WORD_BITS)
+
+int reasmInit(CrudpReasm_t *reasm, int fd, uint32_t capacity)
+{
+    memset(reasm, 0, sizeof(*reasm));
+
+    reasm->fd = fd;
+    reasm->seekable = lseek(fd, 0, SEEK_CUR) >= 0;
+    reasm->capacity = capacity ? capacity : 1;
+    reasm->end = REASM_END_UNKNOWN;
+
+    reasm->maxHelds = reasm->capacity / POOL_PACKET_SIZE ? reasm->capacity / POOL_PACKET_SIZE : 1;
+
+    reasm->held = (CrudpReasmSegment_t *)arenaAlloc(reasm->maxHelds * sizeof(CrudpReasmSegment_t));
+    reasm->bitmap = (uint64_t *)arenaAlloc(REASM_WORDS(reasm->capacity) * sizeof(uint64_t));
+
+    if (reasm->held == NULL || reasm->bitmap == NULL)
+    {
+        reasmFree(reasm);
+        return -1;
+    }
+
+    return 0;
+}
+
+void reasmFree(CrudpReasm_t *reasm)
+{
+    for (uint32_t i = 0; i < reasm->helds; i++)
+        packetPut(reasm->held[i].packet);
+
+    arenaFree(reasm->held, reasm->maxHelds * sizeof(CrudpReasmSegment_t));
+    arenaFree(reasm->bitmap, REASM_WORDS(reasm->capacity) * sizeof(uint64_t));
+    free(reasm->spill);
+
+    reasm->held = NULL;
+    reasm->helds = 0;
+    reasm->bitmap = NULL;
+    reasm->spill = NULL;
+    reasm->spills = reasm->maxSpills = 0;
+}
+
+/**
+ * @brief Set or clear n bits from index 'from', a word at a time
+ *
+ */
+void reasmBitsSet(uint64_t *bitmap, uint32_t from, uint32_t n, int set)
+{
+    while (n > 0)
+    {
+        uint32_t bit = from % REASM_WORD_BITS;
+        uint32_t count = REASM_WORD_BITS - bit < n ? REASM_WORD_BITS - bit : n;
+        uint64_t mask = (count == REASM_WORD_BITS ? ~(uint64_t)0 : (((uint64_t)1 << count) - 1)) << bit;
+
+        if (set)
+            bitmap[from / REASM_WORD_BITS] |= mask;
+        else
+            bitmap[from / REASM_WORD_BITS] &= ~mask;
+
+        from += count;
+        n -= count;
+    }
+}
+
+/**
+ * @brief Count the bits from index 'from' that are all set (or all clear)
+ *
+ * @return uint32_t length of the run, at most n
+ */
+uint32_t reasmBitsRun(const uint64_t *bitmap, uint32_t from, uint32_t n, int set)
+{
+    uint32_t run = 0;
+
+    while (run < n)
+    {
+        uint32_t bit = (from + run) % REASM_WORD_BITS;
+        uint64_t word = bitmap[(from + run) / REASM_WORD_BITS];
+        uint32_t ones;
+
+        if (!set)
+            word = ~word;
+        word >>= bit;
+
+        // the shift fills the top with zeros, so a run stops at the word end
+        ones = ~word == 0 ? REASM_WORD_BITS : (uint32_t)__builtin_ctzll(~word);
+        if (ones > REASM_WORD_BITS - bit)
+            ones = REASM_WORD_BITS - bit;
+
+        run += ones;
+        if (ones < REASM_WORD_BITS - bit)
+            break;
+    }
+
+    return run < n ? run : n;
+}
+
+/**
+ * @brief Set or clear the bits of stream bytes inside the window
+ *
+ */
+void reasmMark(CrudpReasm_t *reasm, uint64_t offset, uint32_t n, int set)
+{
+    uint32_t index = offset % reasm->capacity;
+    uint32_t first = reasm->capacity - index < n ? reasm->capacity - index : n;
+
+    reasmBitsSet(reasm->bitmap, index, first, set);
+    if (n > first)
+        reasmBitsSet(reasm->bitmap, 0, n - first, set);
+}
+
+/**
+ * @brief Count the bytes from a stream offset inside the window
+ *        that are all present (or all missing)
+ *
+ */
+uint32_t reasmRunOf(const CrudpReasm_t *reasm, uint64_t offset, uint32_t n, int set)
+{
+    uint32_t index = offset % reasm->capacity;
+    uint32_t first = reasm->capacity - index < n ? reasm->capacity - index : n;
+    uint32_t run = reasmBitsRun(reasm->bitmap, index, first, set);
+
+    if (run == first && n > first)
+        run += reasmBitsRun(reasm->bitmap, 0, n - first, set);
+
+    return run;
+}
+
+/**
+ * @brief Count the present bytes from a stream offset inside the window
+ *
+ */
+uint32_t reasmRun(const CrudpReasm_t *reasm, uint64_t offset, uint32_t n)
+{
+    return reasmRunOf(reasm, offset, n, 1);
+}
+
+/**
+ * @brief Keep a segment in its packet, sorted by offset
+ *
+ */
+void reasmHold(CrudpReasm_t *reasm, uint64_t offset, CrudpPacket_t *packet, const uint8_t *data, uint32_t len)
+{
+    uint32_t i = reasm->helds;
+
+    // segments mostly arrive in order, search from the end
+    while (i > 0 && reasm->held[i - 1].offset > offset)
+        i--;
+
+    memmove(reasm->held + i + 1, reasm->held + i, (reasm->helds - i) * sizeof(*reasm->held));
+    reasm->helds++;
+
+    reasm->held[i].offset = offset;
+    reasm->held[i].len = len;
+    reasm->held[i].data = data;
+    reasm->held[i].packet = packetRef(packet);
+}
+
+/**
+ * @brief Write bytes at their place in the output file
+ *        a non-blocking output that is full takes only the front
+ *
+ * @return int64_t bytes written, -1 on error
+ */
+int64_t reasmWrite(CrudpReasm_t *reasm, const uint8_t *data, uint32_t n, uint64_t offset)
+{
+    uint32_t total = n;
+
+    if (reasm->sink != NULL)
+        return reasm->sink(reasm->sinkContext, data, n, offset) < 0 ? -1 : n;
+
+    while (n > 0)
+    {
+        ssize_t w = reasm->seekable ? pwrite(reasm->fd, data, n, (off_t)offset)
+                                    : write(reasm->fd, data, n);
+
+        if (w < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                reasm->blocked = 1;
+                break;
+            }
+            perror("reasmWrite(): pwrite()");
+            return -1;
+        }
+
+        data += w;
+        offset += w;
+        n -= w;
+    }
+
+    return total - n;
+}
+
+/**
+ * @brief End of the spilled range covering an offset
+ *
+ * @return uint64_t offset itself if no range covers it
+ */
+uint64_t reasmSpillEnd(const CrudpReasm_t *reasm, uint64_t offset)
+{
+    for (uint32_t i = 0; i < reasm->spills && reasm->spill[i][0] <= offset; i++)
+    {
+        if (offset < reasm->spill[i][1])
+            return reasm->spill[i][1];
+    }
+
+    return offset;
+}
+
+/**
+ * @brief Remember a spilled range, merging it with its neighbours
+ *
+ * @return int 0 on success, -1 if out of memory
+ */
+int reasmSpillAdd(CrudpReasm_t *reasm, uint64_t start, uint64_t end)
+{
+    uint32_t i = 0, j;
+
+    while (i < reasm->spills && reasm->spill[i][1] < start)
+        i++;
+
+    // ranges i..j-1 overlap or touch the new one
+    for (j = i; j < reasm->spills && reasm->spill[j][0] <= end; j++)
+    {
+        if (reasm->spill[j][0] < start)
+            start = reasm->spill[j][0];
+        if (reasm->spill[j][1] > end)
+            end = reasm->spill[j][1];
+    }
+
+    if (i == j)
+    {
+        if (reasm->spills == reasm->maxSpills)
+        {
+            uint32_t max = reasm->maxSpills ? reasm->maxSpills * 2 : REASM_SPILLS;
+            uint64_t(*spill)[2] = realloc(reasm->spill, max * sizeof(*spill));
+
+            if (spill == NULL)
+            {
+                perror("reasmSpillAdd(): realloc()");
+                return -1;
+            }
+
+            reasm->spill = spill;
+            reasm->maxSpills = max;
+        }
+
+        memmove(reasm->spill + i + 1, reasm->spill + i, (reasm->spills - i) * sizeof(*reasm->spill));
+        reasm->spills++;
+    }
+    else
+    {
+        memmove(reasm->spill + i + 1, reasm->spill + j, (reasm->spills - j) * sizeof(*reasm->spill));
+        reasm->spills -= j - i - 1;
+    }
+
+    reasm->spill[i][0] = start;
+    reasm->spill[i][1] = end;
+
+    return 0;
+}
+
+/**
+ * @brief First missing byte from an offset, looking at the bitmap and the spilled ranges
+ *
+ */
+uint64_t reasmContiguous(const CrudpReasm_t *reasm, uint64_t offset)
+{
+    uint64_t windowEnd = reasm->delivered + reasm->capacity;
+
+    for (;;)
+    {
+        uint64_t next = offset;
+
+        if (next >= reasm->delivered && next < windowEnd)
+            next += reasmRun(reasm, next, windowEnd - next);
+        next = reasmSpillEnd(reasm, next);
+
+        if (next == offset)
+            return offset;
+        offset = next;
+    }
+}
+
+/**
+ * @brief Write the contiguous runs from 'delivered' and slide the window
+ *
+ * @return int 0 on success, -1 on a write error
+ */
+int reasmRelease(CrudpReasm_t *reasm)
+{
+    uint32_t i = 0, done = 0;
+
+    reasm->blocked = 0;
+
+    for (;;)
+    {
+        uint64_t offset = reasm->delivered;
+        uint64_t spilled;
+
+        if (done < reasm->helds && reasm->held[done].offset <= offset)
+        {
+            CrudpReasmSegment_t *segment = &reasm->held[done++];
+            uint64_t end = segment->offset + segment->len;
+
+            // written straight from the packet, the front may overlap what is written
+            if (end > offset)
+            {
+                int64_t w = reasmWrite(reasm, segment->data + (offset - segment->offset), end - offset, offset);
+
+                if (w < 0)
+                    return -1;
+
+                reasmMark(reasm, offset, (uint32_t)w, 0);
+                reasm->delivered = offset + w;
+
+                // the output is full, the rest waits in the packet
+                if (reasm->delivered < end)
+                {
+                    done--;
+                    break;
+                }
+            }
+
+            packetPut(segment->packet);
+            continue;
+        }
+
+        // already on the disk, drop the bits of the same bytes
+        if ((spilled = reasmSpillEnd(reasm, offset)) > offset)
+        {
+            uint64_t n = spilled - offset;
+
+            reasmMark(reasm, offset, n < reasm->capacity ? (uint32_t)n : reasm->capacity, 0);
+            reasm->delivered = spilled;
+            continue;
+        }
+
+        break;
+    }
+
+    memmove(reasm->held, reasm->held + done, (reasm->helds - done) * sizeof(*reasm->held));
+    reasm->helds -= done;
+
+    while (i < reasm->spills && reasm->spill[i][1] <= reasm->delivered)
+        i++;
+    memmove(reasm->spill, reasm->spill + i, (reasm->spills - i) * sizeof(*reasm->spill));
+    reasm->spills -= i;
+
+    return 0;
+}
+
+int reasmInsert(CrudpReasm_t *reasm, uint64_t offset, CrudpPacket_t *packet, const uint8_t *data, uint32_t len, int eod)
+{
+    uint64_t windowEnd = reasm->delivered + reasm->capacity;
+    int fresh = 0;
+
+    if (eod && reasm->end == REASM_END_UNKNOWN)
+        reasm->end = offset + len;
+
+    if (offset + len <= reasm->delivered)
+        return 0;
+
+    // the front was written already
+    if (offset < reasm->delivered)
+    {
+        uint32_t skip = reasm->delivered - offset;
+
+        offset += skip;
+        data += skip;
+        len -= skip;
+    }
+
+    // inside the window, keep the packet until the bytes before it arrive
+    if (offset < windowEnd)
+    {
+        uint32_t n = windowEnd - offset < len ? windowEnd - offset : len;
+
+        if (reasmRun(reasm, offset, n) < n && reasmSpillEnd(reasm, offset) < offset + n)
+        {
+            if (reasm->helds < reasm->maxHelds)
+            {
+                reasmHold(reasm, offset, packet, data, n);
+                reasmMark(reasm, offset, n, 1);
+                fresh = 1;
+            }
+            // out of budget, spill it with the rest
+            else
+                windowEnd = offset;
+        }
+    }
+
+    // beyond the window, write it to its place right away
+    if (offset + len > windowEnd && reasm->seekable)
+    {
+        uint64_t start = offset > windowEnd ? offset : windowEnd;
+        uint32_t n = offset + len - start;
+
+        if (reasmSpillEnd(reasm, start) < start + n)
+        {
+            if (reasmWrite(reasm, data + (start - offset), n, start) != n ||
+                reasmSpillAdd(reasm, start, start + n) < 0)
+                return -1;
+            fresh = 1;
+        }
+    }
+
+    if (reasmRelease(reasm) < 0)
+        return -1;
+
+    return fresh;
+}
+
+int reasmFlush(CrudpReasm_t *reasm)
+{
+    uint64_t delivered = reasm->delivered;
+
+    if (reasmRelease(reasm) < 0)
+        return -1;
+
+    return reasm->delivered > delivered;
+}
+
+int reasmDrain(CrudpReasm_t *reasm)
+{
+    int flags = fcntl(reasm->fd, F_GETFL);
+
+    if (!reasm->blocked)
+        return 0;
+
+    if (flags < 0 || fcntl(reasm->fd, F_SETFL, flags & ~O_NONBLOCK) < 0)
+    {
+        perror("reasmDrain(): fcntl()");
+        return -1;
+    }
+
+    return reasmRelease(reasm);
+}
+
+int reasmCompletes(const CrudpReasm_t *reasm, uint64_t offset, uint32_t len, int eod)
+{
+    uint64_t end = eod ? offset + len : reasm->end;
+    uint64_t present;
+
+    if (end == REASM_END_UNKNOWN)
+        return 0;
+
+    present = reasmContiguous(reasm, reasm->delivered);
+
+    // the segment fills the first hole, look past it
+    if (present >= offset && present < offset + len)
+        present = reasmContiguous(reasm, offset + len);
+
+    return present >= end;
+}
+
+uint32_t reasmWindow(const CrudpReasm_t *reasm, uint32_t segmentSize)
+{
+    uint64_t window = (uint64_t)(reasm->maxHelds - reasm->helds) * segmentSize;
+
+    // the held segments are in flight already, they count too
+    if (reasm->helds > 0)
+        window += reasm->held[reasm->helds - 1].offset + reasm->held[reasm->helds - 1].len - reasm->delivered;
+
+    return window < reasm->capacity ? (uint32_t)window : reasm->capacity;
+}
+
+uint32_t reasmHoles(const CrudpReasm_t *reasm, uint64_t upTo, uint64_t (*holes)[2], uint32_t max)
+{
+    uint64_t windowEnd = reasm->delivered + reasm->capacity;
+    uint64_t offset = reasm->delivered;
+    uint32_t n = 0;
+
+    while (n < max && (offset = reasmContiguous(reasm, offset)) < upTo)
+    {
+        uint64_t end = upTo;
+
+        // the hole ends at the next byte held in the window or spilled
+        if (offset < windowEnd)
+        {
+            uint64_t room = (end < windowEnd ? end : windowEnd) - offset;
+            uint32_t gap = reasmRunOf(reasm, offset, (uint32_t)room, 0);
+
+            if (gap < room)
+                end = offset + gap;
+        }
+
+        for (uint32_t i = 0; i < reasm->spills; i++)
+        {
+            if (reasm->spill[i][0] > offset)
+            {
+                if (reasm->spill[i][0] < end)
+                    end = reasm->spill[i][0];
+                break;
+            }
+        }
+
+        holes[n][0] = offset;
+        holes[n][1] = end;
+        n++;
+        offset = end;
+    }
+
+    return n;
+}
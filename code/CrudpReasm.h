@@ -0,0 +1,139 @@
+#ifndef __CrudpReasm_h__
+#define __CrudpReasm_h__
+
+#include <inttypes.h>
+
+#include "CrudpPool.h"
+
+#define REASM_END_UNKNOWN UINT64_MAX
+
+/**
+ * @brief Out of order segment, held by a reference to its packet
+ *
+ */
+typedef struct CrudpReasmSegment_s
+{
+    uint64_t offset;
+    uint32_t len;
+    const uint8_t *data;
+    CrudpPacket_t *packet;
+} CrudpReasmSegment_t;
+
+/**
+ * @brief Receiver reassembly buffer
+ *        A window of 'capacity' bytes covers the stream from 'delivered' on,
+ *        one bit per byte tells which bytes are present.
+ *        Out of order segments stay in their packets, at most 'capacity'
+ *        bytes of packets. Data beyond the window or the budget is written
+ *        to its place in the output file and remembered as a spilled range.
+ */
+typedef struct CrudpReasm_s
+{
+    int fd;       // output file
+    int seekable; // spilling needs positional writes
+
+    // writes the bytes instead of the file when set, e.g. to unpack a tree
+    int (*sink)(void *context, const uint8_t *data, uint32_t n, uint64_t offset);
+    void *sinkContext;
+
+    uint64_t *bitmap; // indexed by stream offset % capacity
+    uint32_t capacity;
+
+    // held segments, sorted by offset
+    CrudpReasmSegment_t *held;
+    uint32_t helds;
+    uint32_t maxHelds;
+
+    uint64_t delivered; // stream offset of the first byte not written in order
+    int blocked;        // a non-blocking output was full, 'delivered' waits for it
+    uint64_t end;       // stream length once the EOD segment arrived
+
+    // spilled ranges [start, end), sorted and disjoint
+    uint64_t (*spill)[2];
+    uint32_t spills;
+    uint32_t maxSpills;
+} CrudpReasm_t;
+
+/**
+ * @brief Setup a reassembly buffer
+ *
+ * @param reasm buffer to setup
+ * @param fd output file, written from its offset 0
+ * @param capacity memory budget in bytes
+ * @return int 0 on success, -1 if out of memory
+ */
+int reasmInit(CrudpReasm_t *reasm, int fd, uint32_t capacity);
+
+/**
+ * @brief Insert a segment and write every contiguous run in order
+ *        a segment kept out of order takes a reference to its packet
+ *
+ * @param reasm reassembly buffer
+ * @param offset stream offset of the first byte
+ * @param packet packet holding the payload
+ * @param data payload, inside the packet
+ * @param len payload length
+ * @param eod the segment ends the stream
+ * @return int 1 if it brought new bytes, 0 for a duplicate, -1 on a write error
+ */
+int reasmInsert(CrudpReasm_t *reasm, uint64_t offset, CrudpPacket_t *packet, const uint8_t *data, uint32_t len, int eod);
+
+/**
+ * @brief Write again what a full output held back
+ *
+ * @param reasm reassembly buffer
+ * @return int 1 if 'delivered' moved, 0 if not, -1 on a write error
+ */
+int reasmFlush(CrudpReasm_t *reasm);
+
+/**
+ * @brief Wait until the output took every byte held in order,
+ *        the output is made blocking for it
+ *
+ * @param reasm reassembly buffer
+ * @return int 0 on success, -1 on a write error
+ */
+int reasmDrain(CrudpReasm_t *reasm);
+
+/**
+ * @brief Would the segment complete the stream?
+ *        nothing is inserted
+ *
+ * @param reasm reassembly buffer
+ * @param offset stream offset of the first byte
+ * @param len payload length
+ * @param eod the segment ends the stream
+ * @return int 1 if every byte up to the end would be present
+ */
+int reasmCompletes(const CrudpReasm_t *reasm, uint64_t offset, uint32_t len, int eod);
+
+/**
+ * @brief Receive window to advertise
+ *        every segment out of order takes one packet of the budget,
+ *        the window covers what the free packets can hold
+ *
+ * @param reasm reassembly buffer
+ * @param segmentSize payload bytes of a segment
+ * @return uint32_t bytes the sender may have in flight from 'delivered' on
+ */
+uint32_t reasmWindow(const CrudpReasm_t *reasm, uint32_t segmentSize);
+
+/**
+ * @brief Missing ranges of the stream, from 'delivered' to an offset
+ *
+ * @param reasm reassembly buffer
+ * @param upTo stream offset past the last byte received
+ * @param holes [start, end) of every missing range, in order
+ * @param max room of holes
+ * @return uint32_t number of ranges
+ */
+uint32_t reasmHoles(const CrudpReasm_t *reasm, uint64_t upTo, uint64_t (*holes)[2], uint32_t max);
+
+/**
+ * @brief Put the held packets and release the bitmap, the file stays open
+ *
+ * @param reasm reassembly buffer
+ */
+void reasmFree(CrudpReasm_t *reasm);
+
+#endif
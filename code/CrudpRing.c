@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+void perror(const char *s);
+
+#include "CrudpRing.h"
+#include "CrudpArena.h"
+
+int ringInit(CrudpRing_t *ring, uint32_t size)
+{
+    uint32_t slots = 1;
+
+    while (slots < size)
+        slots <<= 1;
+
+    ring->head = ring->tail = 0;
+    ring->size = slots;
+    ring->release = NULL;
+
+    if ((ring->slots = (CrudpSegment_t *)arenaAlloc(slots * sizeof(CrudpSegment_t))) == NULL)
+    {
+        ring->size = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
+void ringFree(CrudpRing_t *ring)
+{
+    while (ringCount(ring) > 0)
+        packetPut(ring->slots[ring->head++ & (ring->size - 1)].packet);
+
+    arenaFree(ring->slots, ring->size * sizeof(CrudpSegment_t));
+    ring->slots = NULL;
+    ring->size = ring->head = ring->tail = 0;
+}
+
+uint32_t ringCount(const CrudpRing_t *ring)
+{
+    return ring->tail - ring->head;
+}
+
+CrudpSegment_t *ringPush(CrudpRing_t *ring)
+{
+    CrudpSegment_t *segment;
+
+    CrudpPacket_t *packet;
+
+    if (ringCount(ring) == ring->size || (packet = packetAlloc()) == NULL)
+        return NULL;
+
+    segment = &ring->slots[ring->tail++ & (ring->size - 1)];
+    segment->transmissions = 0;
+    segment->firstTs = 0;
+    segment->path = 0;
+    segment->delivered = 0;
+    segment->packet = packet;
+    segment->header = (CrudpHeader_t *)packet->bytes;
+    segment->payload = NULL;
+
+    return segment;
+}
+
+void ringUnpush(CrudpRing_t *ring)
+{
+    packetPut(ring->slots[--ring->tail & (ring->size - 1)].packet);
+}
+
+CrudpSegment_t *ringFront(CrudpRing_t *ring)
+{
+    if (ringCount(ring) == 0)
+        return NULL;
+
+    return &ring->slots[ring->head & (ring->size - 1)];
+}
+
+CrudpSegment_t *ringAt(CrudpRing_t *ring, uint32_t i)
+{
+    return &ring->slots[(ring->head + i) & (ring->size - 1)];
+}
+
+int ringUnshare(CrudpSegment_t *segment)
+{
+    CrudpPacket_t *packet;
+    int inside = segment->payload == segment->packet->bytes + HEADER_SIZE;
+
+    if (segment->packet->refs == 1)
+        return 0;
+
+    if ((packet = packetAlloc()) == NULL)
+        return -1;
+
+    // a payload read from a stream or built from a manifest or mux frames is in the packet,
+    // it moves with the header, one in the mapped file stays where it is
+    if (inside)
+    {
+        memcpy(packet->bytes, segment->packet->bytes, HEADER_SIZE + segment->len);
+        packet->n = HEADER_SIZE + segment->len;
+        segment->payload = packet->bytes + HEADER_SIZE;
+    }
+    else
+    {
+        memcpy(packet->bytes, segment->packet->bytes, HEADER_SIZE);
+        packet->n = HEADER_SIZE;
+    }
+
+    packetPut(segment->packet);
+    segment->packet = packet;
+    segment->header = (CrudpHeader_t *)packet->bytes;
+
+    return 0;
+}
+
+uint32_t ringRelease(CrudpRing_t *ring, uint64_t acked)
+{
+    uint32_t released = 0;
+    CrudpSegment_t *segment;
+
+    // an empty EOD segment is acknowledged by the FIN, not by an ACK
+    while ((segment = ringFront(ring)) != NULL && segment->len > 0 &&
+           segment->offset + segment->len <= acked)
+    {
+        if (ring->release != NULL)
+            ring->release(segment);
+
+        packetPut(segment->packet);
+        ring->head++;
+        released++;
+    }
+
+    return released;
+}
@@ -0,0 +1,118 @@
+#ifndef __CrudpRing_h__
+#define __CrudpRing_h__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "CrudpSocket.h"
+
+/**
+ * @brief Segment in flight, its header kept in wire format in a pooled packet
+ *        the payload stays in the mapped file, both go out in one sendmsg()
+ */
+typedef struct CrudpSegment_s
+{
+    uint64_t offset;        // stream offset of the payload
+    uint32_t len;           // payload length
+    uint32_t transmissions; // 1 for the first transmission
+    uint32_t firstTs;       // timestamp of the first transmission, kept once it is sent again
+    int path;               // path it was last sent on
+    int delivered;          // an echo named its last transmission, it waits for the cumulative ACK
+
+    CrudpPacket_t *packet;
+    CrudpHeader_t *header;  // start of the packet
+    const uint8_t *payload; // in the mapped file
+} CrudpSegment_t;
+
+
+/**
+ * @brief Ring of the segments in flight, oldest first
+ *
+ */
+typedef struct CrudpRing_s
+{
+    CrudpSegment_t *slots;
+    uint32_t size; // power of 2
+    uint32_t head; // oldest segment, free running
+    uint32_t tail; // next free slot, free running
+
+    // called for every segment an ACK releases when set, e.g. to open the window of its path
+    void (*release)(const CrudpSegment_t *segment);
+} CrudpRing_t;
+
+/**
+ * @brief Allocate the slots of a ring
+ *
+ * @param ring ring to setup
+ * @param size number of slots, rounded up to a power of 2
+ * @return int 0 on success, -1 if out of memory
+ */
+int ringInit(CrudpRing_t *ring, uint32_t size);
+
+/**
+ * @brief Release the slots
+ *
+ * @param ring ring to free
+ */
+void ringFree(CrudpRing_t *ring);
+
+/**
+ * @brief Number of segments in flight
+ *
+ * @param ring ring
+ * @return uint32_t segments
+ */
+uint32_t ringCount(const CrudpRing_t *ring);
+
+/**
+ * @brief Take the next free slot with a packet from the pool
+ *
+ * @param ring ring
+ * @return CrudpSegment_t* slot to fill, NULL if the ring is full
+ */
+CrudpSegment_t *ringPush(CrudpRing_t *ring);
+
+/**
+ * @brief Give back the slot taken by the last ringPush(), it was not sent
+ *
+ * @param ring ring
+ */
+void ringUnpush(CrudpRing_t *ring);
+
+/**
+ * @brief Oldest segment in flight
+ *
+ * @param ring ring
+ * @return CrudpSegment_t* segment, NULL if the ring is empty
+ */
+CrudpSegment_t *ringFront(CrudpRing_t *ring);
+
+/**
+ * @brief Segment in flight by age
+ *
+ * @param ring ring
+ * @param i 0 for the oldest, less than ringCount()
+ * @return CrudpSegment_t* segment
+ */
+CrudpSegment_t *ringAt(CrudpRing_t *ring, uint32_t i);
+
+/**
+ * @brief Give the segment a packet of its own before its header is rewritten
+ *        the emulator may still hold the packet of an earlier transmission,
+ *        a payload kept in the packet is copied along
+ *
+ * @param segment segment to send again
+ * @return int 0 on success, -1 if out of memory
+ */
+int ringUnshare(CrudpSegment_t *segment);
+
+/**
+ * @brief Drop every segment acknowledged by a cumulative ACK
+ *
+ * @param ring ring
+ * @param acked stream offset of the first byte not acknowledged
+ * @return uint32_t number of segments dropped
+ */
+uint32_t ringRelease(CrudpRing_t *ring, uint64_t acked);
+
+#endif
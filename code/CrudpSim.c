@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <errno.h>
+void perror(const char *s);
+
+#include "CrudpSim.h"
+#include "CrudpClock.h"
+#include "CrudpTimer.h"
+
+int simFd = -1;
+
+// something happened since the last report, one more turn of the main loop
+// runs the timers and the polls before the end point goes idle
+int simFresh = 1;
+
+int simInit(const char *spec)
+{
+    char *end;
+    long fd = strtol(spec, &end, 10);
+    uint64_t start;
+
+    if (end == spec || *end != ',' || fd < 0)
+        return -1;
+
+    start = strtoull(end + 1, &end, 10);
+    if (*end != '\0')
+        return -1;
+
+    simFd = (int)fd;
+    clockSet(start);
+
+    return 0;
+}
+
+int simActive()
+{
+    return simFd >= 0;
+}
+
+int simSend(const CrudpBuffer_t *buffer)
+{
+    CrudpSimMessage_t message;
+    struct iovec iov[3];
+    struct msghdr msg;
+
+    message.type = SIM_DATAGRAM;
+    message.len = buffer->n + buffer->payloadLen;
+    message.time = clockNow();
+
+    iov[0].iov_base = &message;
+    iov[0].iov_len = sizeof(message);
+    iov[1].iov_base = buffer->bytes;
+    iov[1].iov_len = buffer->n;
+    iov[2].iov_base = (void *)buffer->payload;
+    iov[2].iov_len = buffer->payloadLen;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = buffer->payloadLen ? 3 : 2;
+
+    if (sendmsg(simFd, &msg, 0) < 0)
+    {
+        perror("simSend(): sendmsg()");
+        return -1;
+    }
+
+    return (int)message.len;
+}
+
+int simRecv(const CrudpBuffer_t *buffer)
+{
+    CrudpSimMessage_t message;
+    struct iovec iov[2];
+    struct msghdr msg;
+    ssize_t r;
+
+    if (simFresh)
+    {
+        simFresh = 0;
+        errno = EWOULDBLOCK;
+        return -1;
+    }
+
+    // idle until the next timer, unless a datagram arrives first
+    message.type = SIM_IDLE;
+    message.len = 0;
+    message.time = timerNext() == UINT64_MAX ? UINT64_MAX : timerNext() * 1000;
+
+    if (send(simFd, &message, sizeof(message), 0) < 0)
+    {
+        perror("simRecv(): send()");
+        exit(1);
+    }
+
+    iov[0].iov_base = &message;
+    iov[0].iov_len = sizeof(message);
+    iov[1].iov_base = buffer->bytes;
+    iov[1].iov_len = buffer->n;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+
+    // the simulator is gone, so is the network
+    if ((r = recvmsg(simFd, &msg, 0)) <= 0)
+        exit(1);
+
+    clockSet(message.time);
+    simFresh = 1;
+
+    if (message.type != SIM_DATAGRAM)
+    {
+        errno = EWOULDBLOCK;
+        return -1;
+    }
+
+    // addresses mean nothing on a simulated path, the sender is left as it is
+    return (int)message.len;
+}
@@ -0,0 +1,61 @@
+#ifndef __CrudpSim_h__
+#define __CrudpSim_h__
+
+#include <inttypes.h>
+
+#include "CrudpSocket.h"
+
+#define SIM_DATAGRAM ((uint32_t)1) // both ways, a datagram sent or delivered
+#define SIM_IDLE ((uint32_t)2)     // end point to simulator, nothing to do until 'time'
+#define SIM_TICK ((uint32_t)3)     // simulator to end point, the clock moved to 'time'
+
+#define SIM_MESSAGE_MAX ((uint32_t)65536)
+
+/**
+ * @brief Message between an end point and the simulator, on a SOCK_SEQPACKET
+ *        socket pair, a datagram follows the message in the same record
+ *
+ */
+typedef struct CrudpSimMessage_s
+{
+    uint32_t type;
+    uint32_t len;  // datagram bytes after the message
+    uint64_t time; // virtual microseconds, the next timer for SIM_IDLE (UINT64_MAX if none)
+} CrudpSimMessage_t;
+
+/**
+ * @brief Hand the packet I/O and the clock over to a simulator
+ *        The end point runs in lock step: it processes what it is given at
+ *        the virtual time it is given, then reports its next timer and waits.
+ *        e.g. "5,1000000" for the socket pair on fd 5, starting at 1 s
+ *
+ * @param spec socket pair fd and start time in microseconds
+ * @return int 0 on success, -1 on a bad spec
+ */
+int simInit(const char *spec);
+
+/**
+ * @brief Is the simulator serving the packet I/O?
+ *
+ * @return int 1 if it is
+ */
+int simActive();
+
+/**
+ * @brief Pass a datagram to the simulated path
+ *
+ * @param buffer to send
+ * @return int size of the datagram, -1 on error
+ */
+int simSend(const CrudpBuffer_t *buffer);
+
+/**
+ * @brief Take the datagram delivered now, or wait for the simulator
+ *        once the end point has nothing left to do at this time
+ *
+ * @param buffer the datagram is copied into it
+ * @return int size of the datagram, -1 with errno EWOULDBLOCK if none
+ */
+int simRecv(const CrudpBuffer_t *buffer);
+
+#endif
@@ -0,0 +1,767 @@
+/*
+  Discrete event simulator for CRUDP.
+
+  Runs the real transmitter and receiver (Crudp with CRUDP_SIM) in lock
+  step on a virtual clock. Each end point processes what it is given at
+  the time it is given, then reports its next timer and waits. Every
+  datagram crosses a modelled path per direction: random loss, a
+  bottleneck of 'rate' kbit/s behind a FIFO of 'queue' packets, then a
+  one-way delay. Time jumps from one event to the next, so a transfer
+  costs the CPU time of its packets, whatever the path.
+
+  usage: CrudpSimulator [-o out.json] [-g sizes] [-b rates kbit] [-d delays ms]
+                        [-l losses %] [-q queues] [-m RTO min ms] [-n runs]
+                        [-s seed] [-t limit s] [-i interval ms]
+                        [-p base port] [-c Crudp binary]
+  lists are comma separated, e.g. -b 1000,10000 -l 0,1,5
+  every point of the grid runs 'runs' times, with seeds seed, seed+1, ...
+  -i adds the bytes acknowledged and the retransmissions of each run
+  every 'interval' ms of virtual time
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+
+#include <errno.h>
+void perror(const char *s);
+
+#include "CrudpSim.h"
+
+#define ERROR(_s) fprintf(stderr, "%s\n", _s)
+
+#define SIM_MAX_GRID ((int)16)
+#define SIM_PATH ((int)1024)
+#define SIM_START_US ((uint64_t)1000000) // virtual time of the first event, 0 is no timestamp
+#define SIM_OVERHEAD ((uint32_t)28)      // IPv4 and UDP headers on the wire
+#define SIM_QUEUE_MAX ((int)65536)       // packets of a path without a limit
+
+/**
+ * @brief One point of the grid
+ *
+ */
+typedef struct SimPoint_s
+{
+    long size;    // bytes
+    long rate;    // kbit/s, 0 is unlimited
+    double delay; // one-way, ms
+    double loss;  // percent
+    int queue;    // packets, 0 is unlimited
+    long rtoMin;  // ms, 0 keeps the default
+    int seed;
+} SimPoint_t;
+
+/**
+ * @brief One direction of the path
+ *
+ */
+typedef struct SimPath_s
+{
+    const SimPoint_t *point;
+    uint64_t rng;
+    uint64_t free;  // the link is busy until then
+    uint64_t *ends; // transmission end of every packet still queued, a ring
+    int head, count, max;
+    long lost, dropped;
+} SimPath_t;
+
+/**
+ * @brief Datagram on its way, ordered by arrival time
+ *
+ */
+typedef struct SimEvent_s
+{
+    uint64_t time;
+    uint64_t seq; // same arrival time, first sent first
+    int to;
+    uint32_t len;
+    uint8_t *bytes;
+} SimEvent_t;
+
+/**
+ * @brief Transmitter (0) or receiver (1)
+ *
+ */
+typedef struct SimEnd_s
+{
+    pid_t pid;
+    int fd;
+    int alive;
+    uint64_t next; // next timer
+} SimEnd_t;
+
+typedef struct SimResult_s
+{
+    const char *status;
+    double sim;  // virtual seconds until the receiver closed
+    double wall; // seconds the run took
+    long segments;
+    long retransmissions;
+    long lost;
+    long dropped;
+} SimResult_t;
+
+// Command line settings
+char *outName = "sim.json",
+     *crudpPath = "./Crudp";
+int basePort = 48000;
+int limit = 600;
+int seed = 1;
+int runs = 1;
+long interval = 0;
+
+double sizes[SIM_MAX_GRID] = {1048576},
+       rates[SIM_MAX_GRID] = {10000},
+       delays[SIM_MAX_GRID] = {10},
+       losses[SIM_MAX_GRID] = {0},
+       queues[SIM_MAX_GRID] = {100},
+       rtoMins[SIM_MAX_GRID] = {0};
+int nSizes = 1, nRates = 1, nDelays = 1, nLosses = 1, nQueues = 1, nRtoMins = 1;
+
+char workDir[64];
+
+// State of the run
+uint64_t now;
+SimEnd_t ends[2];
+SimPath_t paths[2]; // by sender
+SimEvent_t *heap;
+int heapCount = 0, heapMax = 0;
+uint64_t heapSeq = 0;
+
+// What the transmitter sent and the receiver acknowledged
+int dataStarted = 0, eodSeen = 0;
+uint32_t firstSeq, highestSeq, ackedSeq;
+long segments, retransmissions;
+
+// Samples of the run, virtual ms then bytes acknowledged then retransmissions
+long (*series)[3];
+int seriesCount = 0, seriesMax = 0;
+
+int parseList(char *list, double *values);
+void generateFile(const char *path, long size);
+void runPoint(const SimPoint_t *point, const char *file, SimResult_t *result);
+void writeResult(FILE *out, const SimPoint_t *point, const SimResult_t *result, int first);
+double wallNow();
+
+int main(int argc, char *argv[])
+{
+    char file[SIM_PATH];
+    int c, first = 1;
+    FILE *out;
+
+    while ((c = getopt(argc, argv, "o:g:b:d:l:q:m:n:s:t:i:p:c:")) != -1)
+    {
+        switch (c)
+        {
+        case 'o':
+            outName = optarg;
+            break;
+        case 'g':
+            nSizes = parseList(optarg, sizes);
+            break;
+        case 'b':
+            nRates = parseList(optarg, rates);
+            break;
+        case 'd':
+            nDelays = parseList(optarg, delays);
+            break;
+        case 'l':
+            nLosses = parseList(optarg, losses);
+            break;
+        case 'q':
+            nQueues = parseList(optarg, queues);
+            break;
+        case 'm':
+            nRtoMins = parseList(optarg, rtoMins);
+            break;
+        case 'n':
+            runs = atoi(optarg);
+            break;
+        case 's':
+            seed = atoi(optarg);
+            break;
+        case 't':
+            limit = atoi(optarg);
+            break;
+        case 'i':
+            interval = atol(optarg);
+            break;
+        case 'p':
+            basePort = atoi(optarg);
+            break;
+        case 'c':
+            crudpPath = optarg;
+            break;
+        default:
+            ERROR("usage: CrudpSimulator [-o out.json] [-g sizes] [-b rates] [-d delays] [-l losses] [-q queues] [-m RTO mins] [-n runs] [-s seed] [-t limit] [-i interval] [-p port] [-c Crudp]");
+            exit(1);
+        }
+    }
+
+    // a child that closed its end must not take the simulator with it
+    signal(SIGPIPE, SIG_IGN);
+
+    strcpy(workDir, "/tmp/crudp-sim-XXXXXX");
+    if (mkdtemp(workDir) == NULL)
+    {
+        perror("mkdtemp()");
+        exit(1);
+    }
+
+    if ((out = fopen(outName, "w")) == NULL)
+    {
+        perror("fopen()");
+        exit(1);
+    }
+
+    fprintf(out, "{\n  \"timestamp\": %ld,\n  \"limit_s\": %d,\n  \"runs\": [", (long)time(NULL), limit);
+
+    for (int g = 0; g < nSizes; g++)
+    {
+        snprintf(file, sizeof(file), "%s/%ld.txt", workDir, (long)sizes[g]);
+        generateFile(file, (long)sizes[g]);
+
+        for (int b = 0; b < nRates; b++)
+            for (int d = 0; d < nDelays; d++)
+                for (int l = 0; l < nLosses; l++)
+                    for (int q = 0; q < nQueues; q++)
+                        for (int m = 0; m < nRtoMins; m++)
+                            for (int n = 0; n < runs; n++)
+                            {
+                                SimPoint_t point = {(long)sizes[g], (long)rates[b], delays[d], losses[l],
+                                                    (int)queues[q], (long)rtoMins[m], seed + n};
+                                SimResult_t result;
+
+                                runPoint(&point, file, &result);
+
+                                fprintf(stderr, "%9ldB %7ldkbit %6.1fms %5.1f%% q%-5d seed %-4d %-8s %9.4fs sim %8.4fs wall %6ld rtx\n",
+                                        point.size, point.rate, point.delay, point.loss, point.queue, point.seed,
+                                        result.status, result.sim, result.wall, result.retransmissions);
+
+                                writeResult(out, &point, &result, first);
+                                first = 0;
+                            }
+
+        unlink(file);
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+    fclose(out);
+    rmdir(workDir);
+
+    return 0;
+}
+
+/**
+ * @brief Parse a comma separated list
+ *
+ * @param list text to parse
+ * @param values parsed values
+ * @return int number of values
+ */
+int parseList(char *list, double *values)
+{
+    int n = 0;
+
+    for (char *token = strtok(list, ","); token != NULL && n < SIM_MAX_GRID; token = strtok(NULL, ","))
+    {
+        values[n++] = atof(token);
+    }
+
+    return n;
+}
+
+/**
+ * @brief Generate a text file of 'size' bytes
+ *
+ */
+void generateFile(const char *path, long size)
+{
+    FILE *out = fopen(path, "w");
+
+    if (out == NULL)
+    {
+        perror("generateFile(): fopen()");
+        exit(1);
+    }
+
+    for (long i = 0; i < size; i++)
+    {
+        fputc(i % 64 == 63 ? '\n' : 'a' + (i * 7 + i / 64) % 26, out);
+    }
+    fclose(out);
+}
+
+double wallNow()
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (double)t.tv_sec + (double)t.tv_nsec / 1000000000;
+}
+
+/**
+ * @brief splitmix64, uniform in [0, 1)
+ *
+ */
+double pathRandom(SimPath_t *path)
+{
+    uint64_t z = (path->rng += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+
+    return (double)(z >> 11) / 9007199254740992.0;
+}
+
+/**
+ * @brief Add a datagram to the arrivals, a binary heap by time
+ *
+ */
+void eventPush(uint64_t time, int to, uint32_t len, const uint8_t *bytes)
+{
+    SimEvent_t event = {time, heapSeq++, to, len, (uint8_t *)malloc(len ? len : 1)};
+    int i = heapCount++;
+
+    if (event.bytes == NULL)
+    {
+        perror("eventPush(): malloc()");
+        exit(1);
+    }
+    memcpy(event.bytes, bytes, len);
+
+    if (heapCount > heapMax)
+    {
+        heapMax = heapMax ? heapMax * 2 : 1024;
+        if ((heap = (SimEvent_t *)realloc(heap, heapMax * sizeof(SimEvent_t))) == NULL)
+        {
+            perror("eventPush(): realloc()");
+            exit(1);
+        }
+    }
+
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+
+        if (heap[parent].time < event.time || (heap[parent].time == event.time && heap[parent].seq < event.seq))
+            break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = event;
+}
+
+/**
+ * @brief Take the earliest arrival
+ *
+ */
+SimEvent_t eventPop()
+{
+    SimEvent_t top = heap[0], last = heap[--heapCount];
+    int i = 0;
+
+    for (;;)
+    {
+        int child = 2 * i + 1;
+
+        if (child >= heapCount)
+            break;
+        if (child + 1 < heapCount &&
+            (heap[child + 1].time < heap[child].time ||
+             (heap[child + 1].time == heap[child].time && heap[child + 1].seq < heap[child].seq)))
+            child++;
+        if (last.time < heap[child].time || (last.time == heap[child].time && last.seq < heap[child].seq))
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (heapCount > 0)
+        heap[i] = last;
+
+    return top;
+}
+
+/**
+ * @brief Send a datagram along a path: loss, the bottleneck queue, the delay
+ *
+ */
+void pathSend(SimPath_t *path, int to, uint32_t len, const uint8_t *bytes)
+{
+    const SimPoint_t *point = path->point;
+    uint64_t start, end;
+
+    // packets whose transmission ended have left the queue
+    while (path->count > 0 && path->ends[path->head] <= now)
+    {
+        path->head = (path->head + 1) % path->max;
+        path->count--;
+    }
+
+    if (point->loss > 0 && pathRandom(path) * 100 < point->loss)
+    {
+        path->lost++;
+        return;
+    }
+
+    if (path->count >= path->max)
+    {
+        path->dropped++;
+        return;
+    }
+
+    start = path->free > now ? path->free : now;
+    end = start + (point->rate > 0 ? (uint64_t)(len + SIM_OVERHEAD) * 8000 / point->rate : 0);
+    path->free = end;
+    path->ends[(path->head + path->count++) % path->max] = end;
+
+    eventPush(end + (uint64_t)(point->delay * 1000), to, len, bytes);
+}
+
+/**
+ * @brief Follow the data of the transmitter and the acknowledgements of the receiver
+ *
+ */
+void account(int from, uint32_t len, const uint8_t *bytes)
+{
+    const CrudpHeader_t *header = (const CrudpHeader_t *)bytes;
+    uint32_t payload = len - HEADER_SIZE;
+
+    if (len < HEADER_SIZE || header->syn || header->fin)
+        return;
+
+    if (from == 0 && (payload > 0 || header->eod))
+    {
+        segments++;
+
+        if (!dataStarted)
+        {
+            dataStarted = 1;
+            firstSeq = highestSeq = ackedSeq = header->sn;
+        }
+
+        // behind what was sent already, or a second EOD
+        if ((int32_t)(header->sn - highestSeq) < 0 || (payload == 0 && eodSeen))
+            retransmissions++;
+        if ((int32_t)(header->sn + payload - highestSeq) > 0)
+            highestSeq = header->sn + payload;
+        eodSeen |= payload == 0;
+    }
+
+    if (from == 1 && dataStarted && header->ack && (int32_t)(header->an - ackedSeq) > 0)
+        ackedSeq = header->an;
+}
+
+/**
+ * @brief Take what an end point sends until it is idle or gone
+ *
+ */
+void drain(int i)
+{
+    static uint8_t record[sizeof(CrudpSimMessage_t) + SIM_MESSAGE_MAX];
+    CrudpSimMessage_t *message = (CrudpSimMessage_t *)record;
+
+    while (ends[i].alive)
+    {
+        ssize_t r = recv(ends[i].fd, record, sizeof(record), 0);
+
+        if (r < (ssize_t)sizeof(CrudpSimMessage_t))
+        {
+            if (r < 0 && errno == EINTR)
+                continue;
+
+            // it exited, the transfer is over for this end point
+            ends[i].alive = 0;
+            close(ends[i].fd);
+            waitpid(ends[i].pid, NULL, 0);
+            break;
+        }
+
+        if (message->type == SIM_IDLE)
+        {
+            ends[i].next = message->time;
+            break;
+        }
+
+        if (message->type == SIM_DATAGRAM && message->len <= r - sizeof(CrudpSimMessage_t))
+        {
+            account(i, message->len, record + sizeof(CrudpSimMessage_t));
+            pathSend(&paths[i], 1 - i, message->len, record + sizeof(CrudpSimMessage_t));
+        }
+    }
+}
+
+/**
+ * @brief Wake an end point at 'now', with a datagram or for its timer
+ *
+ */
+void wake(int i, const SimEvent_t *event)
+{
+    CrudpSimMessage_t message = {event ? SIM_DATAGRAM : SIM_TICK, event ? event->len : 0, now};
+    struct iovec iov[2] = {{&message, sizeof(message)}, {event ? event->bytes : NULL, event ? event->len : 0}};
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = event ? 2 : 1;
+
+    ends[i].next = UINT64_MAX;
+    if (sendmsg(ends[i].fd, &msg, MSG_NOSIGNAL) < 0)
+        perror("wake(): sendmsg()");
+
+    drain(i);
+}
+
+/**
+ * @brief Fork an end point on one side of a socket pair
+ *
+ */
+void spawn(int i, const SimPoint_t *point, const char *file, const char *output)
+{
+    int pair[2];
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, pair) < 0)
+    {
+        perror("spawn(): socketpair()");
+        exit(1);
+    }
+
+    if ((ends[i].pid = fork()) == 0)
+    {
+        char value[64];
+        int null = open("/dev/null", O_WRONLY);
+
+        close(pair[0]);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+
+        snprintf(value, sizeof(value), "%d,%" PRIu64, pair[1], now);
+        setenv("CRUDP_SIM", value, 1);
+        snprintf(value, sizeof(value), "%d", basePort + i);
+        setenv("CRUDP_PORT", value, 1);
+        snprintf(value, sizeof(value), "%d", basePort + 1 - i);
+        setenv("CRUDP_PEER_PORT", value, 1);
+        setenv("CRUDP_OUTPUT", output, 1);
+        if (point->rtoMin > 0)
+        {
+            snprintf(value, sizeof(value), "%ld", point->rtoMin);
+            setenv("CRUDP_RTO_MIN", value, 1);
+        }
+
+        // the path is modelled here, the datagrams have to stay readable
+        unsetenv("CRUDP_IMPAIR");
+        unsetenv("CRUDP_PSK");
+        unsetenv("CRUDP_XDP");
+        unsetenv("CRUDP_ZEROCOPY");
+        unsetenv("CRUDP_STATS_FILE");
+        unsetenv("CRUDP_STATS_SOCK");
+
+        execl(crudpPath, crudpPath, "127.0.0.1", i == 0 ? "-t" : "-r", file, (char *)0);
+        _exit(127);
+    }
+
+    close(pair[1]);
+    ends[i].fd = pair[0];
+    ends[i].alive = ends[i].pid > 0;
+    ends[i].next = UINT64_MAX;
+
+    drain(i);
+}
+
+/**
+ * @brief Compare the received file with the source file
+ *
+ * @return int 1 if both are the same
+ */
+int sameFile(const char *a, const char *b)
+{
+    FILE *fa = fopen(a, "rb"), *fb = fopen(b, "rb");
+    int same = fa != NULL && fb != NULL;
+
+    while (same)
+    {
+        int ca = fgetc(fa), cb = fgetc(fb);
+
+        if (ca != cb)
+            same = 0;
+        if (ca == EOF || cb == EOF)
+            break;
+    }
+
+    if (fa)
+        fclose(fa);
+    if (fb)
+        fclose(fb);
+
+    return same;
+}
+
+/**
+ * @brief Record the samples due before 'until'
+ *
+ */
+void sample(uint64_t *next, uint64_t until)
+{
+    for (; interval > 0 && *next <= until; *next += (uint64_t)interval * 1000)
+    {
+        if (seriesCount == seriesMax)
+        {
+            seriesMax = seriesMax ? seriesMax * 2 : 256;
+            if ((series = realloc(series, seriesMax * sizeof(*series))) == NULL)
+            {
+                perror("sample(): realloc()");
+                exit(1);
+            }
+        }
+
+        series[seriesCount][0] = (long)((*next - SIM_START_US) / 1000);
+        series[seriesCount][1] = dataStarted ? (long)(ackedSeq - firstSeq) : 0;
+        series[seriesCount][2] = retransmissions;
+        seriesCount++;
+    }
+}
+
+void runPoint(const SimPoint_t *point, const char *file, SimResult_t *result)
+{
+    char output[SIM_PATH];
+    uint64_t nextSample = SIM_START_US;
+    double start = wallNow();
+
+    memset(result, 0, sizeof(*result));
+    snprintf(output, sizeof(output), "%s/sim.out", workDir);
+    unlink(output);
+
+    now = SIM_START_US;
+    dataStarted = eodSeen = 0;
+    segments = retransmissions = 0;
+    seriesCount = 0;
+
+    for (int i = 0; i < 2; i++)
+    {
+        free(paths[i].ends);
+        memset(&paths[i], 0, sizeof(paths[i]));
+        paths[i].point = point;
+        paths[i].rng = (uint64_t)point->seed * 2 + i;
+        paths[i].max = point->queue > 0 ? point->queue : SIM_QUEUE_MAX;
+        if ((paths[i].ends = (uint64_t *)malloc(paths[i].max * sizeof(uint64_t))) == NULL)
+        {
+            perror("runPoint(): malloc()");
+            exit(1);
+        }
+    }
+
+    // The transmitter listens, so it has to be up before the receiver sends SYN
+    spawn(0, point, file, output);
+    spawn(1, point, NULL, output);
+
+    result->status = "ok";
+
+    while (ends[1].alive)
+    {
+        uint64_t next = heapCount > 0 ? heap[0].time : UINT64_MAX;
+        int timer = -1;
+
+        for (int i = 0; i < 2; i++)
+        {
+            if (ends[i].alive && ends[i].next < next)
+            {
+                next = ends[i].next;
+                timer = i;
+            }
+        }
+
+        if (next == UINT64_MAX)
+        {
+            result->status = "stalled";
+            break;
+        }
+        if (next - SIM_START_US > (uint64_t)limit * 1000000)
+        {
+            result->status = "timeout";
+            break;
+        }
+
+        sample(&nextSample, next);
+        now = next > now ? next : now;
+
+        if (timer >= 0)
+        {
+            wake(timer, NULL);
+        }
+        else
+        {
+            SimEvent_t event = eventPop();
+
+            if (ends[event.to].alive)
+                wake(event.to, &event);
+            free(event.bytes);
+        }
+    }
+
+    result->sim = (double)(now - SIM_START_US) / 1000000;
+
+    // the receiver is done, the transmitter may wait for an ACK that got lost
+    for (int i = 0; i < 2; i++)
+    {
+        if (ends[i].alive)
+        {
+            kill(ends[i].pid, SIGKILL);
+            close(ends[i].fd);
+            waitpid(ends[i].pid, NULL, 0);
+            ends[i].alive = 0;
+        }
+    }
+
+    while (heapCount > 0)
+    {
+        SimEvent_t event = eventPop();
+        free(event.bytes);
+    }
+
+    if (strcmp(result->status, "ok") == 0 && !sameFile(file, output))
+        result->status = "corrupt";
+
+    result->wall = wallNow() - start;
+    result->segments = segments;
+    result->retransmissions = retransmissions;
+    result->lost = paths[0].lost + paths[1].lost;
+    result->dropped = paths[0].dropped + paths[1].dropped;
+
+    unlink(output);
+}
+
+void writeResult(FILE *out, const SimPoint_t *point, const SimResult_t *result, int first)
+{
+    int ok = strcmp(result->status, "ok") == 0;
+
+    fprintf(out, "%s\n    {\"bytes\": %ld, \"rate_kbit\": %ld, \"delay_ms\": %g, \"loss_pct\": %g, "
+                 "\"queue\": %d, \"rto_min_ms\": %ld, \"seed\": %d, "
+                 "\"status\": \"%s\", \"sim_s\": %.6f, \"wall_s\": %.6f, \"goodput_Bps\": %.1f, "
+                 "\"segments_sent\": %ld, \"retransmissions\": %ld, \"lost\": %ld, \"dropped\": %ld",
+            first ? "" : ",", point->size, point->rate, point->delay, point->loss,
+            point->queue, point->rtoMin, point->seed,
+            result->status, result->sim, result->wall,
+            ok && result->sim > 0 ? point->size / result->sim : 0,
+            result->segments, result->retransmissions, result->lost, result->dropped);
+
+    if (interval > 0)
+    {
+        fprintf(out, ", \"series\": [");
+        for (int i = 0; i < seriesCount; i++)
+            fprintf(out, "%s[%ld, %ld, %ld]", i ? ", " : "", series[i][0], series[i][1], series[i][2]);
+        fprintf(out, "]");
+    }
+
+    fprintf(out, "}");
+}
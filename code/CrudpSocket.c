@@ -5,6 +5,8 @@
 #include <inttypes.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/random.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <unistd.h>
@@ -15,14 +17,17 @@
 void perror(const char *s);
 
 #include "CrudpSocket.h"
-
-#define HEADER_SIZE ((uint32_t)12)
-#define MAX_WINDOW_SIZE ((uint32_t)1388)
-#define MIN_WINDOW_SIZE ((uint32_t)10)
-
-// Random seed for Transmitter Sequence number
+#include "CrudpStats.h"
+#include "CrudpImpair.h"
+#include "CrudpZerocopy.h"
+#include "CrudpXdp.h"
+#include "CrudpAead.h"
+#include "CrudpClock.h"
+#include "CrudpSim.h"
+
+// Seed for Transmitter Sequence number, where the kernel has no random bytes
 #define R_T ((unsigned int)160005106)
-// Random seed for Receiver Sequence number
+// Seed for Receiver Sequence number, where the kernel has no random bytes
 #define R_R ((unsigned int)23204)
 
 // Global variables
@@ -31,6 +36,143 @@ uint32_t seqNumber = 0;
 uint32_t ackNumber = 0;
 uint32_t startSeq = 0;
 
+// Timestamp to echo, ts of the latest segment received
+uint32_t tsRecent = 0;
+
+// Receive window to advertise, free space of the reassembly buffer
+uint32_t recvWindow = 0;
+
+// The stream carries a directory tree, announced in the SYN,ACK
+int treeMode = 0;
+
+// The stream carries several files as independent streams, announced in the SYN,ACK
+int muxMode = 0;
+
+// The receiver reports losses instead of acknowledging every segment, announced in the SYN,ACK
+int bulkMode = 0;
+
+_Static_assert(sizeof(CrudpHeader_t) == HEADER_SIZE, "CrudpHeader_t does not match HEADER_SIZE");
+
+/**
+ * @brief Fill the timestamp fields of a header
+ *
+ * @param header header to send
+ */
+void stampHeader(CrudpHeader_t *header)
+{
+    static uint32_t last = 0;
+    uint32_t ts = timestampNow();
+
+    // every transmission has a timestamp of its own, its echo names it
+    if (last != 0 && (int32_t)(ts - last) <= 0)
+        ts = last + 1 ? last + 1 : 1;
+
+    header->ts = last = ts;
+    header->tsecr = tsRecent;
+}
+
+CrudpHeader_t *headerAlloc()
+{
+    CrudpPacket_t *packet = packetAlloc();
+
+    if (packet == NULL)
+        exit(1);
+
+    memset(packet->bytes, 0, HEADER_SIZE);
+    packet->n = HEADER_SIZE;
+
+    return (CrudpHeader_t *)packet->bytes;
+}
+
+/**
+ * @brief Stamp and send a header built by headerAlloc() and the payload
+ *        built after it in its packet, then put the packet
+ *
+ * @param local Transmitter socket
+ * @param remote Receiver socket
+ * @param header header to send
+ * @param len payload bytes after the header
+ * @return int total size of data sent
+ */
+int sendPacket(const UdpSocket_t *local, const UdpSocket_t *remote, CrudpHeader_t *header, uint32_t len)
+{
+    CrudpBuffer_t toSend;
+
+    stampHeader(header);
+
+    toSend.n = HEADER_SIZE + len;
+    toSend.bytes = (uint8_t *)header;
+    toSend.packet = packetOf(header);
+    toSend.payload = NULL;
+    toSend.payloadLen = 0;
+
+    int r = sendCrudp(local, remote, &toSend);
+
+    packetPut(toSend.packet);
+
+    return r;
+}
+
+/**
+ * @brief Stamp and send a header built by headerAlloc(), then put its packet
+ *
+ * @param local Transmitter socket
+ * @param remote Receiver socket
+ * @param header header to send
+ * @return int total size of data sent
+ */
+int sendHeader(const UdpSocket_t *local, const UdpSocket_t *remote, CrudpHeader_t *header)
+{
+    return sendPacket(local, remote, header, 0);
+}
+
+/**
+ * @brief Send a SYN or SYN,ACK, with the random nonce of this end as payload in the AEAD mode
+ *
+ * @param local Transmitter socket
+ * @param remote Receiver socket
+ * @param header header to send
+ * @return int total size of data sent, -1 if no nonce could be drawn
+ */
+int sendSyn(const UdpSocket_t *local, const UdpSocket_t *remote, CrudpHeader_t *header)
+{
+    if (!aeadEnabled())
+        return sendPacket(local, remote, header, 0);
+
+    if (aeadHello((uint8_t *)header + HEADER_SIZE) < 0)
+    {
+        packetPut(packetOf(header));
+        return -1;
+    }
+
+    return sendPacket(local, remote, header, AEAD_NONCE_SIZE);
+}
+
+/**
+ * @brief Initial sequence number, random bytes of the kernel or rand() seeded by the time
+ *
+ * @param seed added to the time
+ * @return uint32_t sequence number
+ */
+uint32_t randomSeq(unsigned int seed)
+{
+    uint32_t isn;
+
+    if (getrandom(&isn, sizeof(isn), 0) == sizeof(isn))
+        return isn;
+
+    srand(time(NULL) + seed);
+    return (uint32_t)rand();
+}
+
+uint32_t timestampNow()
+{
+    uint32_t ts = (uint32_t)clockNow();
+
+    /* 0 means no timestamp to echo */
+    return ts ? ts : 1;
+}
+
 UdpSocket_t *
 setupUdpSocket_t(const char *hostname, const uint16_t port)
 {
@@ -124,18 +266,17 @@ int openUdp(UdpSocket_t *udp)
 int synSend(const UdpSocket_t *local, const UdpSocket_t *remote)
 {
     /* Make a new header for sending SYN */
-    CrudpHeader_t *header = (CrudpHeader_t *)calloc(1, HEADER_SIZE);
+    CrudpHeader_t *header = headerAlloc();
 
     /* Sequence Number has to be a random number  */
-    srand(time(NULL) + R_T);
-    startSeq = (int)(rand() % (int)pow(2, 8 * 32));
+    startSeq = randomSeq(R_T);
     seqNumber = startSeq;
     header->sn = seqNumber;
 
     header->an = 0;
 
-    /* Default window size is 1 */
-    header->wn = 0;
+    /* The AEAD capabilities ride in the window field of a SYN */
+    header->wn = aeadCaps();
 
     /* SYN Flag */
     header->syn = 1;
@@ -144,23 +285,7 @@ int synSend(const UdpSocket_t *local, const UdpSocket_t *remote)
     header->eod = 0;
     header->fin = 0;
 
-    /* Make a new buffer which will contain header in the start of array */
-    unsigned char newBuffer[HEADER_SIZE];
-
-    /* Copy the header as byte array */
-    for (unsigned int i = 0; i < HEADER_SIZE; i++)
-    {
-        newBuffer[i] = *((char *)header + i);
-    }
-
-    CrudpBuffer_t toSend;
-
-    toSend.n = HEADER_SIZE;
-    toSend.bytes = newBuffer;
-
-    int r = sendCrudp(local, remote, &toSend);
-
-    free(header);
+    int r = sendSyn(local, remote, header);
 
     return r;
 };
@@ -168,11 +293,10 @@ int synSend(const UdpSocket_t *local, const UdpSocket_t *remote)
 int synRecv(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHeader_t *recvHeader)
 {
     /* Make a new header for sending SYN ACK*/
-    CrudpHeader_t *header = (CrudpHeader_t *)calloc(1, HEADER_SIZE);
+    CrudpHeader_t *header = headerAlloc();
 
     /* Sequence Number has to be a random number  */
-    srand(time(NULL) + R_R);
-    startSeq = (int)(rand() % (int)pow(2, 8 * 32));
+    startSeq = randomSeq(R_R);
     seqNumber = startSeq;
     header->sn = seqNumber;
 
@@ -180,8 +304,8 @@ int synRecv(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHead
     ackNumber = recvHeader->sn;
     header->an = ++ackNumber;
 
-    /* Default window size is 1 */
-    header->wn = 0;
+    /* The AEAD capabilities ride in the window field of a SYN */
+    header->wn = aeadCaps();
 
     /* SYN Flag */
     header->syn = 1;
@@ -190,32 +314,80 @@ int synRecv(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHead
     header->ack = 1;
     header->eod = 0;
     header->fin = 0;
+    header->tree = treeMode;
+    header->mux = muxMode;
+    header->bulk = bulkMode;
 
-    /* Make a new buffer which will contain header in the start of array */
-    unsigned char newBuffer[HEADER_SIZE];
+    int r = sendSyn(local, remote, header);
 
-    /* Copy the header as byte array */
-    for (unsigned int i = 0; i < HEADER_SIZE; i++)
-    {
-        newBuffer[i] = *((char *)header + i);
-    }
+    seqNumber++;
 
-    CrudpBuffer_t toSend;
+    return r;
+};
 
-    toSend.n = HEADER_SIZE;
-    toSend.bytes = newBuffer;
+int synRecvCookie(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHeader_t *recvHeader, uint32_t cookie)
+{
+    /* Nothing is kept, the cookie is the sequence number */
+    CrudpHeader_t *header = headerAlloc();
 
-    int r = sendCrudp(local, remote, &toSend);
+    header->sn = cookie;
+    header->an = recvHeader->sn + 1;
+    header->wn = aeadCaps();
 
-    seqNumber++;
-    free(header);
+    /* SYN, ACK Flag */
+    header->syn = 1;
+    header->ack = 1;
+    header->eod = 0;
+    header->fin = 0;
+    header->tree = treeMode;
+    header->mux = muxMode;
+    header->bulk = bulkMode;
 
-    return r;
+    return sendSyn(local, remote, header);
+};
+
+int cookieEstablish(const CrudpHeader_t *recvHeader)
+{
+    /* The state synRecv() would have left */
+    startSeq = recvHeader->an - 1;
+    seqNumber = recvHeader->an;
+    ackNumber = recvHeader->sn;
+
+    return 0;
 };
 
+int seqAfter(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) > 0;
+}
+
+uint64_t seqUnwrap(uint64_t reference, uint32_t seq)
+{
+    int32_t diff = (int32_t)(seq - (uint32_t)reference);
+
+    // before the start of the stream, a stale or forged value tells nothing new
+    if (diff < 0 && (uint64_t)-(int64_t)diff > reference)
+        return reference;
+
+    return reference + diff;
+}
+
+void setDataOffset(CrudpHeader_t *header, uint64_t offset)
+{
+    /* The data starts right after the SYN,ACK */
+    header->sn = startSeq + 1 + (uint32_t)offset;
+    header->rwnd = (uint32_t)(offset >> 32);
+}
+
+uint64_t dataOffset(const CrudpHeader_t *header, uint32_t base)
+{
+    return (uint64_t)header->rwnd << 32 | (uint32_t)(header->sn - base);
+}
+
 void ackChecker(const CrudpHeader_t *recvHeader)
 {
-    if (recvHeader->an != seqNumber)
+    // acknowledges bytes never sent
+    if (seqAfter(recvHeader->an, seqNumber))
     {
         printf("\033[1;31m");
 
@@ -232,7 +404,7 @@ void ackChecker(const CrudpHeader_t *recvHeader)
 int estWait(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHeader_t *recvHeader)
 {
     /* Make a new header for sending SYN ACK*/
-    CrudpHeader_t *header = (CrudpHeader_t *)calloc(1, HEADER_SIZE);
+    CrudpHeader_t *header = headerAlloc();
 
     ++seqNumber;
 
@@ -248,6 +420,7 @@ int estWait(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHead
 
     /* Default window size is 1000 */
     header->wn = windowSize;
+    header->rwnd = recvWindow;
     header->syn = 0;
 
     /* ACK Flag */
@@ -255,36 +428,20 @@ int estWait(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHead
     header->eod = recvHeader->eod;
     header->fin = 0;
 
-    /* Make a new buffer which will contain header in the start of array */
-    unsigned char newBuffer[HEADER_SIZE];
-
-    /* Copy the header as byte array */
-    for (unsigned int i = 0; i < HEADER_SIZE; i++)
-    {
-        newBuffer[i] = *((char *)header + i);
-    }
-
-    CrudpBuffer_t toSend;
-
-    toSend.n = HEADER_SIZE;
-    toSend.bytes = newBuffer;
-
-    int r = sendCrudp(local, remote, &toSend);
+    /* The first sealed ACK carries both nonces, for a listener with SYN cookies */
+    header->hello = recvHeader->syn && aeadEnabled();
 
-    free(header);
+    int r = sendHeader(local, remote, header);
 
     return r;
 };
 
-int sendData(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHeader_t *recvHeader, const unsigned char *data, int eod)
+int sendData(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHeader_t *recvHeader, CrudpHeader_t *header, uint64_t offset, const uint8_t *data, uint32_t size, int eod)
 {
-    /* Make a new header for sending SYN ACK*/
-    CrudpHeader_t *header = (CrudpHeader_t *)calloc(1, HEADER_SIZE);
-
     /* Sequence number from the transmitter has to be increment */
     ackChecker(recvHeader);
 
-    header->sn = recvHeader->an;
+    setDataOffset(header, offset);
 
     // ackNumber = recvHeader->sn;
     header->an = recvHeader->sn;
@@ -297,46 +454,38 @@ int sendData(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHea
     header->eod = eod;
     header->fin = 0;
 
-    /* Make a new buffer which will contain header in the start of array */
-    unsigned int totalSize = HEADER_SIZE + header->wn;
-    unsigned char newBuffer[totalSize];
+    seqNumber = header->sn + size;
 
-    /* Copy the header as byte array */
-    for (unsigned int i = 0; i < HEADER_SIZE; i++)
-    {
-        newBuffer[i] = *((char *)header + i);
-    }
+    return resendData(local, remote, header, data, size);
+};
 
-    for (unsigned int i = HEADER_SIZE, j = 0; i < totalSize; i++, j++)
-    {
-        newBuffer[i] = *((char *)data + j);
-    }
+int resendData(const UdpSocket_t *local, const UdpSocket_t *remote, CrudpHeader_t *header, const uint8_t *data, uint32_t size)
+{
+    /* Only the timestamps change, the data is never copied */
+    stampHeader(header);
 
     CrudpBuffer_t toSend;
 
-    toSend.n = totalSize;
-    toSend.bytes = newBuffer;
-
-    int r = sendCrudp(local, remote, &toSend);
-
-    seqNumber += recvHeader->wn;
-
-    free(header);
+    toSend.n = HEADER_SIZE;
+    toSend.bytes = (uint8_t *)header;
+    toSend.packet = packetOf(header);
+    toSend.payload = data;
+    toSend.payloadLen = size;
 
-    return r;
+    return sendCrudp(local, remote, &toSend);
 };
 
 int recvData(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHeader_t *recvHeader, int rto_incr)
 {
     /* Make a new header for sending SYN ACK*/
-    CrudpHeader_t *header = (CrudpHeader_t *)calloc(1, HEADER_SIZE);
+    CrudpHeader_t *header = headerAlloc();
 
     /* Sequence number from the transmitter has to be increment */
     ackChecker(recvHeader);
 
     header->sn = recvHeader->an;
 
-    ackNumber = recvHeader->sn + recvHeader->wn;
+    /* ackNumber is the first byte the reassembly buffer still misses */
     header->an = ackNumber;
 
     /* Default window size is 1 */
@@ -344,17 +493,18 @@ int recvData(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHea
     if (rto_incr)
     {
         header->wn -= 100;
-        if (header->wn < 10 || header->wn > 1388)
-            header->wn = 10;
+        if (header->wn < MIN_WINDOW_SIZE || header->wn > MAX_WINDOW_SIZE)
+            header->wn = MIN_WINDOW_SIZE;
     }
     else
     {
         header->wn = header->wn << 1;
-        if (header->wn >= 1388)
+        if (header->wn >= MAX_WINDOW_SIZE)
         {
-            header->wn = 1388;
+            header->wn = MAX_WINDOW_SIZE;
         }
     }
+    header->rwnd = recvWindow;
     header->syn = 0;
 
     /* ACK Flag */
@@ -362,23 +512,63 @@ int recvData(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHea
     header->eod = recvHeader->eod;
     header->fin = 0;
 
-    /* Make a new buffer which will contain header in the start of array */
-    unsigned char newBuffer[HEADER_SIZE];
+    int r = sendHeader(local, remote, header);
 
-    /* Copy the header as byte array */
-    for (unsigned int i = 0; i < HEADER_SIZE; i++)
-    {
-        newBuffer[i] = *((char *)header + i);
-    }
+    return r;
+};
 
-    CrudpBuffer_t toSend;
+int sendReport(const UdpSocket_t *local, const UdpSocket_t *remote, CrudpHeader_t *header, uint32_t len, uint32_t rwnd)
+{
+    header->sn = seqNumber;
+    header->an = ackNumber;
+    header->wn = MAX_WINDOW_SIZE;
+    header->rwnd = rwnd;
+    header->ack = 1;
+    header->bulk = 1;
 
-    toSend.n = HEADER_SIZE;
-    toSend.bytes = newBuffer;
+    /* The echo is the latest data, the transmitter measures the RTT with it */
+    return sendPacket(local, remote, header, len);
+};
 
-    int r = sendCrudp(local, remote, &toSend);
+int sendAnnounce(const UdpSocket_t *local, const UdpSocket_t *group, uint32_t session, const void *announce, uint32_t len)
+{
+    CrudpHeader_t *header = headerAlloc();
+
+    /* Nobody answers it, the session is all a member needs */
+    header->an = session;
+    header->wn = MAX_WINDOW_SIZE;
+    header->syn = 1;
 
-    free(header);
+    memcpy((uint8_t *)header + HEADER_SIZE, announce, len);
+
+    return sendPacket(local, group, header, len);
+};
+
+int sendGroupFin(const UdpSocket_t *local, const UdpSocket_t *group, uint32_t session)
+{
+    CrudpHeader_t *header = headerAlloc();
+
+    header->an = session;
+    header->fin = 1;
+
+    return sendHeader(local, group, header);
+};
+
+int sendWindow(const UdpSocket_t *local, const UdpSocket_t *remote, uint16_t wn)
+{
+    CrudpHeader_t *header = headerAlloc();
+    uint32_t echo = tsRecent;
+    int r;
+
+    header->sn = seqNumber;
+    header->an = ackNumber;
+    header->wn = wn;
+    header->rwnd = recvWindow;
+    header->ack = 1;
+
+    tsRecent = 0;
+    r = sendHeader(local, remote, header);
+    tsRecent = echo;
 
     return r;
 };
@@ -386,15 +576,17 @@ int recvData(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHea
 int sendFin(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHeader_t *recvHeader)
 {
     /* Make a new header for sending SYN ACK*/
-    CrudpHeader_t *header = (CrudpHeader_t *)calloc(1, HEADER_SIZE);
+    CrudpHeader_t *header = headerAlloc();
 
     /* Sequence number from the transmitter has to be increment */
     ackChecker(recvHeader);
 
     header->sn = recvHeader->an;
 
-    ackNumber = recvHeader->sn + recvHeader->wn;
-    header->an = ++ackNumber;
+    /* The receiver acknowledges the stream it took, the transmitter the FIN of it */
+    if (recvHeader->fin)
+        ackNumber = recvHeader->sn + 1;
+    header->an = ackNumber;
 
     /* Default window size is 1 */
     header->wn = 0;
@@ -405,34 +597,91 @@ int sendFin(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHead
     header->eod = recvHeader->eod;
     header->fin = 1;
 
-    /* Make a new buffer which will contain header in the start of array */
-    unsigned char newBuffer[HEADER_SIZE];
+    int r = sendHeader(local, remote, header);
 
-    /* Copy the header as byte array */
-    for (unsigned int i = 0; i < HEADER_SIZE; i++)
+    return r;
+};
+
+int sendCrudp(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpBuffer_t *buffer)
+{
+    CrudpBuffer_t sealed;
+    int r;
+
+    /* everything but a SYN is sealed, into a packet of its own */
+    if (aeadActive() && !((const CrudpHeader_t *)buffer->bytes)->syn)
     {
-        newBuffer[i] = *((char *)header + i);
+        if ((sealed.packet = packetAlloc()) == NULL)
+            return -1;
+
+        sealed.n = aeadSeal(buffer, sealed.packet);
+        sealed.bytes = sealed.packet->bytes;
+        sealed.payload = NULL;
+        sealed.payloadLen = 0;
+        buffer = &sealed;
     }
 
-    CrudpBuffer_t toSend;
+    /* the emulator sends the packet later, or never */
+    r = impairActive() ? impairSend(local, remote, buffer)
+                       : sendRawCrudp(local, remote, buffer);
 
-    toSend.n = HEADER_SIZE;
-    toSend.bytes = newBuffer;
+    if (buffer == &sealed)
+        packetPut(sealed.packet);
 
-    int r = sendCrudp(local, remote, &toSend);
-    free(header);
+    if (r >= 0)
+    {
+        G_stats.bytesSent += r;
+        G_stats.segmentsSent++;
+    }
 
     return r;
 };
 
-int sendCrudp(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpBuffer_t *buffer)
+int sendRawCrudp(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpBuffer_t *buffer)
 {
-    int r = sendto(local->sd, (void *)buffer->bytes, buffer->n, 0,
-                   (struct sockaddr *)&remote->addr, sizeof(remote->addr));
+    struct iovec iov[2];
+    struct msghdr msg;
+
+    if (simActive())
+        return simSend(buffer);
+
+    if (xdpActive(local->sd))
+    {
+        int r = xdpSend(remote, buffer);
+
+        if (r < 0)
+            perror("sendCrudp(): xdpSend()");
+
+        return r;
+    }
+
+    iov[0].iov_base = buffer->bytes;
+    iov[0].iov_len = buffer->n;
+    iov[1].iov_base = (void *)buffer->payload;
+    iov[1].iov_len = buffer->payloadLen;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = (void *)&remote->addr;
+    msg.msg_namelen = sizeof(remote->addr);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = buffer->payloadLen ? 2 : 1;
+
+    int zerocopy = zerocopyWanted(local->sd, buffer->packet, buffer->n + buffer->payloadLen);
+    int r = sendmsg(local->sd, &msg, zerocopy ? MSG_ZEROCOPY : 0);
+
+    // out of pinned memory, send it the usual way
+    if (r < 0 && zerocopy && errno == ENOBUFS)
+    {
+        zerocopy = 0;
+        r = sendmsg(local->sd, &msg, 0);
+    }
+
+    // the kernel may still read the packet and the payload
+    if (r >= 0 && zerocopy)
+        zerocopyTrack(buffer->packet);
 
     if (r < 0)
     {
-        printf("%d ", buffer->n);
+        printf("%d ", buffer->n + buffer->payloadLen);
         perror("sendCrudp(): sendto()");
     }
 
@@ -443,8 +692,29 @@ int recvCrudp(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpBu
 {
     int r;
     socklen_t l = sizeof(struct sockaddr);
-    r = recvfrom(local->sd, (void *)buffer->bytes, buffer->n, 0,
-                 (struct sockaddr *)&remote->addr, &l);
+
+    if (simActive())
+        r = simRecv(buffer);
+    else if (xdpActive(local->sd))
+        r = xdpRecv((UdpSocket_t *)remote, buffer);
+    else
+        r = recvfrom(local->sd, (void *)buffer->bytes, buffer->n, 0,
+                     (struct sockaddr *)&remote->addr, &l);
+
+    if (r >= 0)
+    {
+        G_stats.bytesRecv += r;
+        G_stats.segmentsRecv++;
+    }
+
+    /* a forged or corrupted datagram is as good as a truncated one */
+    if (r >= (int)HEADER_SIZE && aeadActive() && !((const CrudpHeader_t *)buffer->bytes)->syn &&
+        (r = aeadOpen(buffer->bytes, (uint32_t)r)) < 0)
+    {
+        G_stats.aeadRejected++;
+        r = 0;
+    }
+
     return r;
 };
 
@@ -4,6 +4,12 @@
 #include <inttypes.h>
 #include <netinet/in.h>
 
+#include "CrudpPool.h"
+
+#define HEADER_SIZE ((uint32_t)24)
+#define MAX_WINDOW_SIZE ((uint32_t)1388)
+#define MIN_WINDOW_SIZE ((uint32_t)10)
+
 typedef struct UdpSocket_s
 {
     int sd;
@@ -18,19 +24,36 @@ typedef struct CrudpHeader_s
 {
     uint32_t sn : 32; //sequence number
     uint32_t an : 32; //acknowledgement number
-    uint16_t wn : 16; //window size
+    uint16_t wn : 16; //segment size, payload bytes of the next segment
 
     //1 bit flag
     unsigned int syn : 1; //SYN
     unsigned int ack : 1; //ACK
     unsigned int eod : 1; //EOD (Flag up when there is no data to send)
     unsigned int fin : 1; //FIN
+    unsigned int gcm : 1; //payload sealed with AES-256-GCM instead of ChaCha20-Poly1305
+    unsigned int tree : 1; //SYN,ACK: the stream is a manifest followed by the files of a directory
+    unsigned int mp : 1;   //sent on a sub-path, acknowledge it on the way it came
+    unsigned int mux : 1;  //SYN,ACK: the stream carries framed independent streams
+    unsigned int bulk : 1; //SYN,ACK: bulk mode, the receiver reports losses instead of acknowledging every segment
+                           //ACK: a report of the receiver is the payload
+    unsigned int hello : 1; //ACK of a SYN,ACK: the random nonces of both ends follow the sealed datagram in the clear
+
+    uint32_t ts : 32;    //timestamp of the sender (microseconds)
+    uint32_t tsecr : 32; //timestamp echo reply, ts of the segment acknowledged
+    uint32_t rwnd : 32;  //receive window, bytes the receiver takes from 'an' on
+                         //data: upper 32 bits of the stream offset, 'sn' has the lower ones
 } CrudpHeader_t;
 
 typedef struct CrudpBuffer_s
 {
     uint32_t n;
     uint8_t *bytes;
+    CrudpPacket_t *packet; // packet holding the bytes, shared instead of copied
+
+    // sent after 'bytes' without copying, e.g. the payload in the mapped file
+    const uint8_t *payload;
+    uint32_t payloadLen;
 } CrudpBuffer_t;
 
 typedef struct UdpBuffer_s
@@ -70,6 +93,27 @@ int synSend(const UdpSocket_t *local, const UdpSocket_t *remote);
  */
 int synRecv(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHeader_t *recvHeader);
 
+/**
+ * @brief Answer a SYN with a SYN cookie (Send SYN ACK)
+ *        no state is kept, the listener stays in LISTEN
+ * 
+ * @param local Transmitter socket
+ * @param remote Where the SYN came from
+ * @param recvHeader Received SYN
+ * @param cookie Initial sequence number made by cookieMake()
+ * @return int total size of data sent
+ */
+int synRecvCookie(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHeader_t *recvHeader, uint32_t cookie);
+
+/**
+ * @brief Set the sequence numbers from the ACK of a valid SYN cookie
+ *        as if synRecv() had answered the SYN
+ * 
+ * @param recvHeader Received ACK
+ * @return int 0
+ */
+int cookieEstablish(const CrudpHeader_t *recvHeader);
+
 /**
  * @brief Wait for Established (Send ACK)
  * 
@@ -82,25 +126,81 @@ int estWait(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHead
 
 /**
  * @brief Check acknowledgement
+ *        an ACK behind seqNumber is fine, more data is in flight
  * 
  * @param recvHeader Received header
  */
 void ackChecker(const CrudpHeader_t *recvHeader);
 
+/**
+ * @brief Is a sequence number after another one? (RFC 1982)
+ *        right for numbers less than 2^31 apart, across the wrap at 2^32
+ *
+ * @param a sequence number
+ * @param b sequence number
+ * @return int 1 if 'a' comes after 'b'
+ */
+int seqAfter(uint32_t a, uint32_t b);
+
+/**
+ * @brief The 64 bit value nearest to a reference with the lower 32 bits of a sequence number
+ *        e.g. the stream offset of an ACK, from the one acknowledged before
+ *
+ * @param reference 64 bit value less than 2^31 away
+ * @param seq lower 32 bits
+ * @return uint64_t the value, the reference itself where it would be below 0
+ */
+uint64_t seqUnwrap(uint64_t reference, uint32_t seq);
+
+/**
+ * @brief Put the stream offset of a data segment in its header,
+ *        its sequence number and its epoch (the upper 32 bits in 'rwnd')
+ *
+ * @param header data segment
+ * @param offset stream offset of the first byte of the payload
+ */
+void setDataOffset(CrudpHeader_t *header, uint64_t offset);
+
+/**
+ * @brief Stream offset of a received data segment
+ *
+ * @param header data segment
+ * @param base sequence number of the first data byte
+ * @return uint64_t stream offset of the first byte of the payload
+ */
+uint64_t dataOffset(const CrudpHeader_t *header, uint32_t base);
+
 /**
  * @brief Send data from loacl to remote
  *        use when the connection established.
  * @param local Transmitter socket
  * @param remote Receiver socket
  * @param recvHeader Received header
- * @param data Data to send
+ * @param header Header to fill, at the start of a pooled packet
+ * @param offset Stream offset of the first byte of data
+ * @param data Data to send, it must stay valid until the segment is acknowledged
+ * @param size Size of the data, less than the window at the end of the file
  * @param eod End of data flag
  * @return int total size of data sent
  */
-int sendData(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHeader_t *recvHeader, const unsigned char *data, int eod);
+int sendData(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHeader_t *recvHeader, CrudpHeader_t *header, uint64_t offset, const uint8_t *data, uint32_t size, int eod);
+
+/**
+ * @brief Send a segment built by sendData() again
+ *        only the timestamps are rewritten
+ * @param local Transmitter socket
+ * @param remote Receiver socket
+ * @param header Header sent before
+ * @param data Data sent before
+ * @param size Size of the data
+ * @return int total size of data sent
+ */
+int resendData(const UdpSocket_t *local, const UdpSocket_t *remote, CrudpHeader_t *header, const uint8_t *data, uint32_t size);
 
 /**
- * @brief Receive data from remote socket
+ * @brief Acknowledge received data
+ *        the caller sets ackNumber to the first byte still missing
+ *        and recvWindow to the bytes it can take from there
  * 
  * @param local Transmitter socket
  * @param remote Receiver socket
@@ -112,6 +212,60 @@ int sendData(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHea
  */
 int recvData(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHeader_t *recvHeader, int rto_incr);
 
+/**
+ * @brief Advertise a window that opened without new data, e.g. once a full
+ *        output took what waited for it
+ *        the echo is left out, it would be as old as the wait
+ *
+ * @param local Transmitter socket
+ * @param remote Receiver socket
+ * @param wn segment size to ask for
+ * @return int total size of data sent
+ */
+int sendWindow(const UdpSocket_t *local, const UdpSocket_t *remote, uint16_t wn);
+
+/**
+ * @brief Send a report of the bulk mode, built in the packet after the header
+ *        it acknowledges in order data as an ACK does
+ *
+ * @param local Receiver socket
+ * @param remote Transmitter socket
+ * @param header header from headerAlloc(), the report after it
+ * @param len report bytes
+ * @param rwnd bytes the receiver takes from 'an' on
+ * @return int total size of data sent
+ */
+int sendReport(const UdpSocket_t *local, const UdpSocket_t *remote, CrudpHeader_t *header, uint32_t len, uint32_t rwnd);
+
+/**
+ * @brief Announce the file of a multicast session to the group (Send SYN)
+ *
+ * @param local Transmitter socket
+ * @param group Group address
+ * @param session Session id, in 'an'
+ * @param announce Payload, copied after the header
+ * @param len Payload bytes
+ * @return int total size of data sent
+ */
+int sendAnnounce(const UdpSocket_t *local, const UdpSocket_t *group, uint32_t session, const void *announce, uint32_t len);
+
+/**
+ * @brief End a multicast session (Send FIN), nobody acknowledges it
+ *
+ * @param local Transmitter socket
+ * @param group Group address
+ * @param session Session id, in 'an'
+ * @return int total size of data sent
+ */
+int sendGroupFin(const UdpSocket_t *local, const UdpSocket_t *group, uint32_t session);
+
+/**
+ * @brief Take a zeroed header from the packet pool
+ *
+ * @return CrudpHeader_t* header at the start of a packet
+ */
+CrudpHeader_t *headerAlloc();
+
 /**
  * @brief Send FIN packet
  * 
@@ -132,6 +286,18 @@ int sendFin(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpHead
  */
 int sendCrudp(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpBuffer_t *buffer);
 
+/**
+ * @brief Send UDP Packet, bypassing the impairment emulator
+ *        the bytes and the payload go out as one datagram by sendmsg()
+ *        MSG_ZEROCOPY is used if enabled, the packet is held until the kernel is done
+ * 
+ * @param local Transmitter socket
+ * @param remote Receiver socket
+ * @param buffer to send
+ * @return int total size of data sent 
+ */
+int sendRawCrudp(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpBuffer_t *buffer);
+
 /**
  * @brief Receive UDP Packet
  * 
@@ -142,6 +308,13 @@ int sendCrudp(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpBu
  */
 int recvCrudp(const UdpSocket_t *local, const UdpSocket_t *remote, const CrudpBuffer_t *buffer);
 
+/**
+ * @brief Get the timestamp for the ts field
+ *
+ * @return uint32_t monotonic microseconds, never 0
+ */
+uint32_t timestampNow();
+
 // Close Udp Socket
 void closeUdp(UdpSocket_t *udp);
 
@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <errno.h>
+void perror(const char *s);
+
+#include "CrudpStats.h"
+#include "CrudpPool.h"
+#include "CrudpClock.h"
+#include "CrudpPath.h"
+
+#define STATS_TEXT_SIZE ((int)8192)
+#define STATS_INTERVAL_MS ((long)1000)
+
+CrudpStats_t G_stats;
+
+const char *statsRole = "unknown";
+const char *statsPeer = "unknown";
+
+char *statsFile = NULL;
+char *statsSock = NULL;
+int statsSd = -1;
+
+long statsInterval = STATS_INTERVAL_MS;
+double statsLastWrite = 0;
+
+double statsNow()
+{
+    return (double)clockNow() / 1000000;
+}
+
+void statsInit(const char *role, const char *peer)
+{
+    char *interval;
+    struct sockaddr_un addr;
+
+    statsRole = role;
+    statsPeer = peer ? peer : "unknown";
+    G_stats.start = statsNow();
+
+    statsFile = getenv("CRUDP_STATS_FILE");
+    statsSock = getenv("CRUDP_STATS_SOCK");
+
+    if ((interval = getenv("CRUDP_STATS_INTERVAL")) != NULL)
+    {
+        statsInterval = atol(interval);
+    }
+
+    if (statsSock == NULL)
+    {
+        return;
+    }
+
+    if (strlen(statsSock) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "statsInit(): socket path is too long\n");
+        statsSock = NULL;
+        return;
+    }
+
+    if ((statsSd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+        perror("statsInit(): socket()");
+        statsSock = NULL;
+        return;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, statsSock);
+    unlink(statsSock);
+
+    if (bind(statsSd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(statsSd, 8) < 0 ||
+        fcntl(statsSd, F_SETFL, O_NONBLOCK) < 0)
+    {
+        perror("statsInit(): bind()/listen()");
+        close(statsSd);
+        statsSd = -1;
+        statsSock = NULL;
+    }
+}
+
+int statsFormat(char *text, int size)
+{
+    int n = 0;
+    double elapsed = statsNow() - G_stats.start;
+    double goodput = elapsed > 0 ? G_stats.payloadDelivered / elapsed : 0;
+
+#define STATS_METRIC(_name, _type, _help, _fmt, _value)                                  \
+    if (n < size)                                                                        \
+        n += snprintf(text + n, size - n,                                                \
+                      "# HELP crudp_" _name " " _help "\n"                               \
+                      "# TYPE crudp_" _name " " _type "\n"                               \
+                      "crudp_" _name "{role=\"%s\",peer=\"%s\"} " _fmt "\n",             \
+                      statsRole, statsPeer, _value);
+
+    STATS_METRIC("bytes_sent_total", "counter", "Bytes sent, header included.", "%" PRIu64, G_stats.bytesSent)
+    STATS_METRIC("bytes_received_total", "counter", "Bytes received, header included.", "%" PRIu64, G_stats.bytesRecv)
+    STATS_METRIC("segments_sent_total", "counter", "Segments sent.", "%" PRIu64, G_stats.segmentsSent)
+    STATS_METRIC("segments_received_total", "counter", "Segments received.", "%" PRIu64, G_stats.segmentsRecv)
+    STATS_METRIC("retransmissions_total", "counter", "Segments sent again.", "%" PRIu64, G_stats.retransmissions)
+    STATS_METRIC("rack_losses_total", "counter", "Segments found lost by RACK before the timeout.", "%" PRIu64, G_stats.lossesDetected)
+    STATS_METRIC("tail_loss_probes_total", "counter", "Tail loss probes sent.", "%" PRIu64, G_stats.tailProbes)
+    STATS_METRIC("nack_ranges_total", "counter", "Missing ranges the receiver reports asked for in bulk or multicast mode.", "%" PRIu64, G_stats.nackRanges)
+    STATS_METRIC("nacks_suppressed_total", "counter", "NACKs to a multicast group not sent, another member asked first.", "%" PRIu64, G_stats.nacksSuppressed)
+    STATS_METRIC("spurious_retransmissions_total", "counter", "Retransmissions found needless by the timestamp echo.", "%" PRIu64, G_stats.spurious)
+    STATS_METRIC("duplicates_total", "counter", "Segments abandoned due to duplication.", "%" PRIu64, G_stats.duplicates)
+    STATS_METRIC("payload_delivered_bytes_total", "counter", "Payload acknowledged or written to the file.", "%" PRIu64, G_stats.payloadDelivered)
+    STATS_METRIC("zerocopy_sent_total", "counter", "Datagrams sent with MSG_ZEROCOPY.", "%" PRIu64, G_stats.zerocopySent)
+    STATS_METRIC("zerocopy_copied_total", "counter", "Zerocopy datagrams the kernel copied after all.", "%" PRIu64, G_stats.zerocopyCopied)
+    STATS_METRIC("syn_cookies_sent_total", "counter", "SYN,ACKs sent with a SYN cookie.", "%" PRIu64, G_stats.cookiesSent)
+    STATS_METRIC("syn_cookies_rejected_total", "counter", "Datagrams dropped by the listener for want of a valid cookie.", "%" PRIu64, G_stats.cookiesRejected)
+    STATS_METRIC("aead_rejected_total", "counter", "Sealed datagrams dropped because the tag did not match.", "%" PRIu64, G_stats.aeadRejected)
+    STATS_METRIC("srtt_seconds", "gauge", "Smoothed round trip time.", "%.9f", G_stats.srtt / 1e9)
+    STATS_METRIC("rttvar_seconds", "gauge", "Round trip time variation.", "%.9f", G_stats.rttvar / 1e9)
+    STATS_METRIC("rto_seconds", "gauge", "Retransmission timeout.", "%.9f", G_stats.rto / 1e9)
+    STATS_METRIC("cwnd_bytes", "gauge", "Bytes allowed in flight.", "%" PRIu32, G_stats.cwnd)
+    STATS_METRIC("rwnd_bytes", "gauge", "Receive window advertised by the receiver.", "%" PRIu32, G_stats.rwnd)
+    STATS_METRIC("pace_rate_bytes_per_second", "gauge", "Rate of the bulk mode pacer.", "%" PRIu64, G_stats.paceRate)
+    STATS_METRIC("pool_packets", "gauge", "Packet buffers allocated by the pool.", "%" PRIu64, poolPackets())
+    STATS_METRIC("elapsed_seconds", "gauge", "Wall time since the transfer started.", "%.6f", elapsed)
+    STATS_METRIC("goodput_bytes_per_second", "gauge", "Payload delivered per second of wall time.", "%.1f", goodput)
+
+#undef STATS_METRIC
+
+    // every sub-path of a multipath transmitter, path 0 is the connection socket
+#define STATS_PATH_METRIC(_name, _type, _help, _fmt, _field)                                      \
+    if (n < size)                                                                                  \
+        n += snprintf(text + n, size - n, "# HELP crudp_path_" _name " " _help "\n"              \
+                                          "# TYPE crudp_path_" _name " " _type "\n");             \
+    for (int i = 0; i < pathCount() && n < size; i++)                                              \
+        n += snprintf(text + n, size - n, "crudp_path_" _name "{role=\"%s\",peer=\"%s\",path=\"%d\"} " _fmt "\n", \
+                      statsRole, statsPeer, i, _field);
+
+    if (pathCount() > 1)
+    {
+        STATS_PATH_METRIC("segments_sent_total", "counter", "Segments sent on the path.", "%" PRIu64, G_paths[i].segments)
+        STATS_PATH_METRIC("payload_sent_bytes_total", "counter", "Payload sent on the path.", "%" PRIu64, G_paths[i].bytes)
+        STATS_PATH_METRIC("lost_total", "counter", "Segments lost on the path and sent again.", "%" PRIu64, G_paths[i].lost)
+        STATS_PATH_METRIC("srtt_seconds", "gauge", "Smoothed round trip time of the path.", "%.9f", G_paths[i].srtt / 1e6)
+        STATS_PATH_METRIC("cwnd_segments", "gauge", "Segments the path may have in flight.", "%" PRIu32, G_paths[i].cwnd)
+    }
+
+#undef STATS_PATH_METRIC
+
+    return n < size ? n : size - 1;
+}
+
+/**
+ * @brief Rewrite the stats file through a temporary file
+ *        so readers never see a partial snapshot
+ */
+void statsWriteFile()
+{
+    char text[STATS_TEXT_SIZE];
+    char tmp[1024];
+    FILE *file;
+
+    int n = statsFormat(text, sizeof(text));
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", statsFile);
+    if ((file = fopen(tmp, "w")) == NULL)
+    {
+        perror("statsWriteFile(): fopen()");
+        return;
+    }
+
+    fwrite(text, 1, n, file);
+    fclose(file);
+
+    if (rename(tmp, statsFile) < 0)
+    {
+        perror("statsWriteFile(): rename()");
+    }
+}
+
+/**
+ * @brief Answer every pending connection on the stats socket
+ *        An HTTP header is prepended so the socket can be scraped
+ */
+void statsServe()
+{
+    static const char response[] = "HTTP/1.0 200 OK\r\n"
+                                   "Content-Type: text/plain; version=0.0.4\r\n\r\n";
+    char text[STATS_TEXT_SIZE];
+    int sd;
+
+    while ((sd = accept(statsSd, NULL, NULL)) >= 0)
+    {
+        int n = statsFormat(text, sizeof(text));
+
+        if (write(sd, response, sizeof(response) - 1) < 0 || write(sd, text, n) < 0)
+        {
+            perror("statsServe(): write()");
+        }
+        close(sd);
+    }
+
+    if (errno != EWOULDBLOCK && errno != EAGAIN)
+    {
+        perror("statsServe(): accept()");
+    }
+}
+
+void statsPoll()
+{
+    if (statsSd >= 0)
+    {
+        statsServe();
+    }
+
+    if (statsFile != NULL)
+    {
+        double now = statsNow();
+
+        if ((now - statsLastWrite) * 1000 >= statsInterval)
+        {
+            statsLastWrite = now;
+            statsWriteFile();
+        }
+    }
+}
+
+void statsClose()
+{
+    if (statsFile != NULL)
+    {
+        statsWriteFile();
+    }
+
+    if (statsSd >= 0)
+    {
+        close(statsSd);
+        unlink(statsSock);
+        statsSd = -1;
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef __CrudpStats_h__
+#define __CrudpStats_h__
+
+#include <inttypes.h>
+
+/**
+ * @brief Per-connection counters and gauges
+ *
+ */
+typedef struct CrudpStats_s
+{
+    // counters
+    uint64_t bytesSent;        // bytes sent, header included
+    uint64_t bytesRecv;        // bytes received, header included
+    uint64_t segmentsSent;     // segments sent
+    uint64_t segmentsRecv;     // segments received
+    uint64_t retransmissions;  // segments sent again
+    uint64_t lossesDetected;   // of those, found lost by RACK before the timeout
+    uint64_t tailProbes;       // tail loss probes sent
+    uint64_t nackRanges;       // missing ranges the reports of the bulk or multicast mode asked for
+    uint64_t nacksSuppressed;  // NACKs of a group member not sent, another member asked first
+    uint64_t duplicates;       // segments abandoned due to duplication
+    uint64_t spurious;         // retransmissions the original transmission made needless
+    uint64_t payloadDelivered; // payload acknowledged (transmitter) or written (receiver)
+    uint64_t zerocopySent;     // datagrams sent with MSG_ZEROCOPY
+    uint64_t zerocopyCopied;   // of those, copied by the kernel after all
+    uint64_t cookiesSent;      // SYN,ACKs sent with a SYN cookie
+    uint64_t cookiesRejected;  // datagrams the listener dropped, no valid cookie
+    uint64_t aeadRejected;     // sealed datagrams dropped, the tag did not match
+
+    // gauges (nanoseconds)
+    long srtt;   // smoothed RTT
+    long rttvar; // RTT variation
+    long rto;    // retransmission timeout
+
+    uint32_t cwnd; // bytes in flight allowed by the current window
+    uint32_t rwnd; // receive window advertised by the receiver
+
+    uint64_t paceRate; // bytes per second of the bulk mode pacer
+
+    double start; // wall clock start of the transfer (seconds)
+} CrudpStats_t;
+
+extern CrudpStats_t G_stats;
+
+/**
+ * @brief Get monotonic wall time
+ *
+ * @return double seconds
+ */
+double statsNow();
+
+/**
+ * @brief Setup the stats exporters
+ *        CRUDP_STATS_FILE - file rewritten every CRUDP_STATS_INTERVAL ms
+ *        CRUDP_STATS_SOCK - Unix socket answering every connection with a snapshot
+ *
+ * @param role "transmitter" or "receiver"
+ * @param peer remote host name
+ */
+void statsInit(const char *role, const char *peer);
+
+/**
+ * @brief Serve pending stats requests and refresh the stats file if due
+ *        call it from the main loop
+ */
+void statsPoll();
+
+/**
+ * @brief Write the final snapshot and remove the stats socket
+ *
+ */
+void statsClose();
+
+/**
+ * @brief Format a snapshot in Prometheus text format
+ *
+ * @param text buffer to write
+ * @param size size of the buffer
+ * @return int number of bytes written
+ */
+int statsFormat(char *text, int size);
+
+#endif
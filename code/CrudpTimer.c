@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <time.h>
+
+#include <errno.h>
+void perror(const char *s);
+
+#include "CrudpTimer.h"
+#include "CrudpClock.h"
+
+#define TIMER_MASK ((uint64_t)(TIMER_LEVEL_SLOTS - 1))
+
+// every slot is the sentinel of a circular list
+CrudpTimer_t wheel[TIMER_LEVELS][TIMER_LEVEL_SLOTS];
+
+// last tick that was processed
+uint64_t wheelTick = 0;
+int wheelReady = 0;
+uint32_t wheelCount = 0;
+
+uint64_t timerNow()
+{
+    return clockNow() / 1000;
+}
+
+/**
+ * @brief Empty every slot and start at the current time
+ *
+ */
+void timerInit()
+{
+    for (uint32_t level = 0; level < TIMER_LEVELS; level++)
+        for (uint32_t slot = 0; slot < TIMER_LEVEL_SLOTS; slot++)
+            wheel[level][slot].next = wheel[level][slot].prev = &wheel[level][slot];
+
+    wheelTick = timerNow();
+    wheelReady = 1;
+}
+
+void timerSetup(CrudpTimer_t *timer, void (*expire)(CrudpTimer_t *), void *data)
+{
+    if (!wheelReady)
+        timerInit();
+
+    timer->next = timer->prev = NULL;
+    timer->expires = 0;
+    timer->expire = expire;
+    timer->data = data;
+}
+
+int timerArmed(const CrudpTimer_t *timer)
+{
+    return timer->next != NULL;
+}
+
+uint32_t timerCount()
+{
+    return wheelCount;
+}
+
+uint64_t timerNext()
+{
+    uint64_t next = UINT64_MAX;
+
+    if (wheelCount == 0)
+        return next;
+
+    // a few timers in 256 slots, a full scan is cheap and needs no ordering
+    for (uint32_t level = 0; level < TIMER_LEVELS; level++)
+        for (uint32_t slot = 0; slot < TIMER_LEVEL_SLOTS; slot++)
+            for (CrudpTimer_t *timer = wheel[level][slot].next; timer != &wheel[level][slot]; timer = timer->next)
+                if (timer->expires < next)
+                    next = timer->expires;
+
+    // a deadline in the past runs at the next tick
+    return next > wheelTick ? next : wheelTick + 1;
+}
+
+/**
+ * @brief Put the timer in the slot of its deadline
+ *        Level n holds deadlines less than 64^(n+1) ticks away
+ *
+ * @param timer timer to insert
+ * @param earliest first tick whose slot may still be processed
+ */
+void timerInsert(CrudpTimer_t *timer, uint64_t earliest)
+{
+    uint64_t expires = timer->expires > earliest ? timer->expires : earliest;
+    uint64_t delta = expires - wheelTick;
+    uint32_t level = 0;
+    CrudpTimer_t *head;
+
+    while (level < TIMER_LEVELS - 1 && delta >= ((uint64_t)1 << ((level + 1) * TIMER_LEVEL_BITS)))
+        level++;
+
+    // too far away, park it in the furthest slot and insert it again later
+    if (delta >= ((uint64_t)1 << (TIMER_LEVELS * TIMER_LEVEL_BITS)))
+        expires = wheelTick + ((uint64_t)1 << (TIMER_LEVELS * TIMER_LEVEL_BITS)) - 1;
+
+    head = &wheel[level][(expires >> (level * TIMER_LEVEL_BITS)) & TIMER_MASK];
+
+    timer->next = head;
+    timer->prev = head->prev;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+void timerArm(CrudpTimer_t *timer, uint64_t expires)
+{
+    if (!wheelReady)
+        timerInit();
+
+    timerCancel(timer);
+
+    timer->expires = expires;
+    timerInsert(timer, wheelTick + 1);
+    wheelCount++;
+}
+
+void timerCancel(CrudpTimer_t *timer)
+{
+    if (!timerArmed(timer))
+        return;
+
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = timer->prev = NULL;
+    wheelCount--;
+}
+
+/**
+ * @brief Move the timers of a slot to lower levels
+ *
+ */
+void timerCascade(uint32_t level, uint32_t slot)
+{
+    CrudpTimer_t *head = &wheel[level][slot];
+    CrudpTimer_t *timer = head->next;
+
+    head->next = head->prev = head;
+
+    while (timer != head)
+    {
+        CrudpTimer_t *next = timer->next;
+
+        // the slot of this tick is processed right after the cascade
+        timerInsert(timer, wheelTick);
+        timer = next;
+    }
+}
+
+int timerAdvance(uint64_t now)
+{
+    int expired = 0;
+
+    if (!wheelReady)
+        timerInit();
+
+    // nothing armed, no need to walk the ticks
+    if (wheelCount == 0)
+    {
+        if (now > wheelTick)
+            wheelTick = now;
+        return 0;
+    }
+
+    while (wheelTick < now)
+    {
+        CrudpTimer_t list, *head;
+        uint32_t slot;
+
+        wheelTick++;
+        slot = wheelTick & TIMER_MASK;
+
+        for (uint32_t level = 1; slot == 0 && level < TIMER_LEVELS; level++)
+        {
+            uint32_t upper = (wheelTick >> (level * TIMER_LEVEL_BITS)) & TIMER_MASK;
+
+            timerCascade(level, upper);
+            if (upper != 0)
+                break;
+        }
+
+        head = &wheel[0][slot];
+        if (head->next == head)
+            continue;
+
+        // detach the slot, callbacks may arm timers into it again
+        list.next = head->next;
+        list.prev = head->prev;
+        list.next->prev = list.prev->next = &list;
+        head->next = head->prev = head;
+
+        while (list.next != &list)
+        {
+            CrudpTimer_t *timer = list.next;
+
+            timer->prev->next = timer->next;
+            timer->next->prev = timer->prev;
+            timer->next = timer->prev = NULL;
+            wheelCount--;
+
+            // parked, not due yet
+            if (timer->expires > wheelTick)
+            {
+                timerInsert(timer, wheelTick + 1);
+                wheelCount++;
+                continue;
+            }
+
+            expired++;
+            timer->expire(timer);
+        }
+    }
+
+    return expired;
+}
@@ -0,0 +1,94 @@
+#ifndef __CrudpTimer_h__
+#define __CrudpTimer_h__
+
+#include <inttypes.h>
+
+// 4 levels of 64 slots with 1 ms ticks cover about 4.6 hours,
+// later deadlines wait in the last level until they are in range.
+#define TIMER_LEVEL_BITS ((uint32_t)6)
+#define TIMER_LEVEL_SLOTS ((uint32_t)(1 << TIMER_LEVEL_BITS))
+#define TIMER_LEVELS ((uint32_t)4)
+
+/**
+ * @brief Timer, embedded in whatever owns the deadline
+ *        (a segment, a connection)
+ */
+typedef struct CrudpTimer_s
+{
+    struct CrudpTimer_s *next;
+    struct CrudpTimer_s *prev;
+
+    uint64_t expires; // deadline in ms of timerNow()
+
+    /**
+     * @brief Called from timerAdvance() when the deadline has passed
+     *        the timer is already disarmed, so it may be armed again
+     */
+    void (*expire)(struct CrudpTimer_s *timer);
+    void *data;
+} CrudpTimer_t;
+
+/**
+ * @brief Get monotonic time, virtual in a simulation
+ *
+ * @return uint64_t milliseconds
+ */
+uint64_t timerNow();
+
+/**
+ * @brief Setup a timer before arming it
+ *
+ * @param timer timer to setup
+ * @param expire callback
+ * @param data owner of the timer
+ */
+void timerSetup(CrudpTimer_t *timer, void (*expire)(CrudpTimer_t *), void *data);
+
+/**
+ * @brief Arm (or re-arm) a timer, O(1)
+ *
+ * @param timer timer to arm
+ * @param expires deadline in ms of timerNow()
+ */
+void timerArm(CrudpTimer_t *timer, uint64_t expires);
+
+/**
+ * @brief Disarm a timer, O(1)
+ *
+ * @param timer timer to disarm, it may be disarmed already
+ */
+void timerCancel(CrudpTimer_t *timer);
+
+/**
+ * @brief Is the timer armed?
+ *
+ * @param timer timer to check
+ * @return int 1 if armed
+ */
+int timerArmed(const CrudpTimer_t *timer);
+
+/**
+ * @brief Run every timer whose deadline has passed
+ *        call it from the main loop
+ *
+ * @param now current time in ms of timerNow()
+ * @return int number of expired timers
+ */
+int timerAdvance(uint64_t now);
+
+/**
+ * @brief Number of armed timers
+ *
+ * @return uint32_t armed timers
+ */
+uint32_t timerCount();
+
+/**
+ * @brief Earliest deadline of the armed timers
+ *        a simulation skips the time until then
+ *
+ * @return uint64_t deadline in ms of timerNow(), UINT64_MAX if none is armed
+ */
+uint64_t timerNext();
+
+#endif
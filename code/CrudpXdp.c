@@ -0,0 +1,576 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <linux/if_xdp.h>
+#include <linux/if_link.h>
+#include <linux/bpf.h>
+
+#include <errno.h>
+void perror(const char *s);
+
+#include "CrudpXdp.h"
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+#define XDP_ETH_HLEN ((uint32_t)14)
+#define XDP_IP_HLEN ((uint32_t)20)
+#define XDP_UDP_HLEN ((uint32_t)8)
+#define XDP_HLEN (XDP_ETH_HLEN + XDP_IP_HLEN + XDP_UDP_HLEN)
+
+#define XDP_ARP_TRIES ((int)100)
+#define XDP_LOG_SIZE ((uint32_t)4096)
+
+/**
+ * @brief One of the four rings shared with the kernel
+ *        producer and consumer are free running, 'mask' indexes the entries
+ */
+typedef struct XdpRing_s
+{
+    uint32_t *producer;
+    uint32_t *consumer;
+    void *entries;
+    uint32_t mask;
+    void *map;
+    size_t mapSize;
+} XdpRing_t;
+
+int xdpSd = -1;    // AF_XDP socket
+int xdpUdpSd = -1; // UDP socket it stands in for
+int xdpMapFd = -1;
+int xdpProgFd = -1;
+int xdpLinkFd = -1;
+
+uint8_t *xdpUmem = NULL;
+XdpRing_t xdpFill, xdpComp, xdpRx, xdpTx;
+
+// free send frames, the receive frames live in the fill and receive rings
+uint64_t xdpFree[XDP_FRAMES / 2];
+uint32_t xdpFrees = 0;
+
+uint8_t xdpLocalMac[6];
+uint8_t xdpPeerMac[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff}; // broadcast until known
+int xdpPeerKnown = 0;
+struct in_addr xdpLocalIp;
+struct in_addr xdpPeerIp;
+uint16_t xdpPort = 0; // network order
+uint16_t xdpIpId = 0;
+
+long xdpBpf(int cmd, union bpf_attr *attr)
+{
+    return syscall(SYS_bpf, cmd, attr, sizeof(*attr));
+}
+
+/**
+ * @brief Map a ring with the offsets the kernel gave
+ *
+ * @return int 0 on success, -1 on error
+ */
+int xdpMapRing(XdpRing_t *ring, const struct xdp_ring_offset *off, size_t entry, off_t pgoff)
+{
+    ring->mapSize = off->desc + XDP_RING_SIZE * entry;
+    ring->map = mmap(NULL, ring->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, xdpSd, pgoff);
+
+    if (ring->map == MAP_FAILED)
+    {
+        perror("xdpMapRing(): mmap()");
+        ring->map = NULL;
+        return -1;
+    }
+
+    ring->producer = (uint32_t *)((uint8_t *)ring->map + off->producer);
+    ring->consumer = (uint32_t *)((uint8_t *)ring->map + off->consumer);
+    ring->entries = (uint8_t *)ring->map + off->desc;
+    ring->mask = XDP_RING_SIZE - 1;
+
+    return 0;
+}
+
+void xdpUnmapRing(XdpRing_t *ring)
+{
+    if (ring->map != NULL)
+        munmap(ring->map, ring->mapSize);
+    memset(ring, 0, sizeof(*ring));
+}
+
+/**
+ * @brief Give receive frames to the kernel
+ *
+ */
+void xdpFillFrames(const uint64_t *addrs, uint32_t n)
+{
+    uint32_t prod = *xdpFill.producer;
+
+    for (uint32_t i = 0; i < n; i++)
+        ((uint64_t *)xdpFill.entries)[(prod + i) & xdpFill.mask] = addrs[i];
+
+    __atomic_store_n(xdpFill.producer, prod + n, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Take back the send frames the kernel is done with
+ *
+ */
+void xdpReclaim()
+{
+    uint32_t cons = *xdpComp.consumer;
+    uint32_t prod = __atomic_load_n(xdpComp.producer, __ATOMIC_ACQUIRE);
+
+    while (cons != prod)
+        xdpFree[xdpFrees++] = ((uint64_t *)xdpComp.entries)[cons++ & xdpComp.mask];
+
+    __atomic_store_n(xdpComp.consumer, cons, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Hand the datagrams for our port to the socket of the queue
+ *        the program is built by hand, there is no libbpf to compile one
+ *
+ * @return int 0 on success, -1 on error
+ */
+int xdpLoadProgram(int ifindex)
+{
+#define XDP_INSN(_code, _dst, _src, _off, _imm) \
+    ((struct bpf_insn){.code = (_code), .dst_reg = (_dst), .src_reg = (_src), .off = (_off), .imm = (_imm)})
+
+    // offsets: Ethernet type 12, IP header length 14, IP protocol 23, UDP destination port 36
+    struct bpf_insn program[] = {
+        XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_X, 6, 1, 0, 0),            // r6 = ctx
+        XDP_INSN(BPF_LDX | BPF_MEM | BPF_W, 2, 6, 0, 0),              // r2 = data
+        XDP_INSN(BPF_LDX | BPF_MEM | BPF_W, 3, 6, 4, 0),              // r3 = data_end
+        XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_X, 4, 2, 0, 0),            // r4 = data
+        XDP_INSN(BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, XDP_HLEN),     // r4 += headers
+        XDP_INSN(BPF_JMP | BPF_JGT | BPF_X, 4, 3, 15, 0),             // too short: pass
+        XDP_INSN(BPF_LDX | BPF_MEM | BPF_H, 5, 2, 12, 0),             // r5 = Ethernet type
+        XDP_INSN(BPF_JMP | BPF_JNE | BPF_K, 5, 0, 13, htons(0x0800)), // not IPv4: pass
+        XDP_INSN(BPF_LDX | BPF_MEM | BPF_B, 5, 2, 23, 0),             // r5 = IP protocol
+        XDP_INSN(BPF_JMP | BPF_JNE | BPF_K, 5, 0, 11, IPPROTO_UDP),   // not UDP: pass
+        XDP_INSN(BPF_LDX | BPF_MEM | BPF_B, 5, 2, 14, 0),             // r5 = version, IHL
+        XDP_INSN(BPF_ALU64 | BPF_AND | BPF_K, 5, 0, 0, 0x0f),         // r5 = IHL
+        XDP_INSN(BPF_JMP | BPF_JNE | BPF_K, 5, 0, 8, 5),              // IP options: pass
+        XDP_INSN(BPF_LDX | BPF_MEM | BPF_H, 5, 2, 36, 0),             // r5 = UDP destination port
+        XDP_INSN(BPF_JMP | BPF_JNE | BPF_K, 5, 0, 6, xdpPort),        // not our port: pass
+        XDP_INSN(BPF_LDX | BPF_MEM | BPF_W, 2, 6, 16, 0),             // r2 = rx_queue_index
+        XDP_INSN(BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, xdpMapFd),
+        XDP_INSN(0, 0, 0, 0, 0),                                      // r1 = XSKMAP
+        XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS),     // no socket: pass
+        XDP_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map), //
+        XDP_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),                     //
+        XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, XDP_PASS),     // pass: r0 = XDP_PASS
+        XDP_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+    };
+
+#undef XDP_INSN
+
+    static char log[XDP_LOG_SIZE];
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns = (uint64_t)(uintptr_t)program;
+    attr.insn_cnt = sizeof(program) / sizeof(program[0]);
+    attr.license = (uint64_t)(uintptr_t) "GPL";
+    attr.log_buf = (uint64_t)(uintptr_t)log;
+    attr.log_size = sizeof(log);
+    attr.log_level = 1;
+
+    if ((xdpProgFd = xdpBpf(BPF_PROG_LOAD, &attr)) < 0)
+    {
+        perror("xdpLoadProgram(): bpf(BPF_PROG_LOAD)");
+        fprintf(stderr, "%s\n", log);
+        return -1;
+    }
+
+    // generic mode works on every driver, the link goes away with the process
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = xdpProgFd;
+    attr.link_create.target_ifindex = ifindex;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+
+    if ((xdpLinkFd = xdpBpf(BPF_LINK_CREATE, &attr)) < 0)
+    {
+        perror("xdpLoadProgram(): bpf(BPF_LINK_CREATE)");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Look the peer up in the ARP table
+ *
+ * @return int 1 if found
+ */
+int xdpArpLookup(const char *ifname)
+{
+    char line[256], ip[64], mac[64], dev[IFNAMSIZ + 1];
+    unsigned int flags, m[6];
+    int found = 0;
+    FILE *arp = fopen("/proc/net/arp", "r");
+
+    if (arp == NULL)
+        return 0;
+
+    while (!found && fgets(line, sizeof(line), arp) != NULL)
+    {
+        if (sscanf(line, "%63s %*s %x %63s %*s %16s", ip, &flags, mac, dev) != 4 ||
+            (flags & 0x2) == 0 || strcmp(dev, ifname) != 0 || inet_addr(ip) != xdpPeerIp.s_addr)
+            continue;
+
+        if (sscanf(mac, "%x:%x:%x:%x:%x:%x", &m[0], &m[1], &m[2], &m[3], &m[4], &m[5]) == 6)
+        {
+            for (int i = 0; i < 6; i++)
+                xdpPeerMac[i] = (uint8_t)m[i];
+            found = 1;
+        }
+    }
+
+    fclose(arp);
+
+    return found;
+}
+
+/**
+ * @brief Find the MAC address of the peer
+ *        an empty datagram through the kernel makes it resolve the address,
+ *        the peer drops it as too short for a header
+ *
+ */
+void xdpResolvePeer(const char *ifname, const UdpSocket_t *local, const UdpSocket_t *remote)
+{
+    for (int i = 0; i < XDP_ARP_TRIES && !(xdpPeerKnown = xdpArpLookup(ifname)); i++)
+    {
+        if (i % 10 == 0)
+            (void)sendto(local->sd, "", 0, MSG_DONTWAIT, (const struct sockaddr *)&remote->addr, sizeof(remote->addr));
+        usleep(10000);
+    }
+}
+
+int xdpInit(const char *spec, const UdpSocket_t *local, const UdpSocket_t *remote)
+{
+    char ifname[IFNAMSIZ];
+    const char *colon = strchr(spec, ':');
+    uint32_t queue = colon ? (uint32_t)atoi(colon + 1) : 0;
+    size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
+    int ifindex;
+
+    struct ifreq ifr;
+    struct xdp_umem_reg umem;
+    struct xdp_mmap_offsets off;
+    struct sockaddr_xdp sxdp;
+    socklen_t optlen = sizeof(off);
+    uint32_t ringSize = XDP_RING_SIZE;
+    uint64_t fill[XDP_FRAMES / 2];
+    union bpf_attr attr;
+
+    memset(ifname, 0, sizeof(ifname));
+    if (len < IFNAMSIZ)
+        memcpy(ifname, spec, len);
+
+    if (len == 0 || len >= IFNAMSIZ || (ifindex = if_nametoindex(ifname)) == 0)
+    {
+        fprintf(stderr, "xdpInit(): unknown interface '%s'\n", spec);
+        return -1;
+    }
+
+    // addresses for the headers built in user space
+    memset(&ifr, 0, sizeof(ifr));
+    strcpy(ifr.ifr_name, ifname);
+    if (ioctl(local->sd, SIOCGIFHWADDR, &ifr) < 0)
+    {
+        perror("xdpInit(): ioctl(SIOCGIFHWADDR)");
+        return -1;
+    }
+    memcpy(xdpLocalMac, ifr.ifr_hwaddr.sa_data, 6);
+
+    ifr.ifr_addr.sa_family = AF_INET;
+    if (ioctl(local->sd, SIOCGIFADDR, &ifr) < 0)
+    {
+        perror("xdpInit(): ioctl(SIOCGIFADDR)");
+        return -1;
+    }
+    xdpLocalIp = ((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr;
+    xdpPeerIp = remote->addr.sin_addr;
+    xdpPort = local->addr.sin_port;
+
+    xdpResolvePeer(ifname, local, remote);
+
+    if ((xdpSd = socket(AF_XDP, SOCK_RAW, 0)) < 0)
+    {
+        perror("xdpInit(): socket(AF_XDP)");
+        return -1;
+    }
+
+    xdpUmem = mmap(NULL, (size_t)XDP_FRAMES * XDP_FRAME_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (xdpUmem == MAP_FAILED)
+    {
+        perror("xdpInit(): mmap(UMEM)");
+        xdpUmem = NULL;
+        xdpClose();
+        return -1;
+    }
+
+    memset(&umem, 0, sizeof(umem));
+    umem.addr = (uint64_t)(uintptr_t)xdpUmem;
+    umem.len = (uint64_t)XDP_FRAMES * XDP_FRAME_SIZE;
+    umem.chunk_size = XDP_FRAME_SIZE;
+
+    if (setsockopt(xdpSd, SOL_XDP, XDP_UMEM_REG, &umem, sizeof(umem)) < 0 ||
+        setsockopt(xdpSd, SOL_XDP, XDP_UMEM_FILL_RING, &ringSize, sizeof(ringSize)) < 0 ||
+        setsockopt(xdpSd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ringSize, sizeof(ringSize)) < 0 ||
+        setsockopt(xdpSd, SOL_XDP, XDP_RX_RING, &ringSize, sizeof(ringSize)) < 0 ||
+        setsockopt(xdpSd, SOL_XDP, XDP_TX_RING, &ringSize, sizeof(ringSize)) < 0 ||
+        getsockopt(xdpSd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0)
+    {
+        perror("xdpInit(): setsockopt(SOL_XDP)");
+        xdpClose();
+        return -1;
+    }
+
+    if (xdpMapRing(&xdpFill, &off.fr, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING) < 0 ||
+        xdpMapRing(&xdpComp, &off.cr, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING) < 0 ||
+        xdpMapRing(&xdpRx, &off.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING) < 0 ||
+        xdpMapRing(&xdpTx, &off.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING) < 0)
+    {
+        xdpClose();
+        return -1;
+    }
+
+    // the first half receives, the second half sends
+    for (uint32_t i = 0; i < XDP_FRAMES / 2; i++)
+    {
+        fill[i] = (uint64_t)i * XDP_FRAME_SIZE;
+        xdpFree[i] = (uint64_t)(XDP_FRAMES / 2 + i) * XDP_FRAME_SIZE;
+    }
+    xdpFrees = XDP_FRAMES / 2;
+    xdpFillFrames(fill, XDP_FRAMES / 2);
+
+    // copy mode works on every driver, veth included
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = ifindex;
+    sxdp.sxdp_queue_id = queue;
+    sxdp.sxdp_flags = XDP_COPY;
+
+    if (bind(xdpSd, (struct sockaddr *)&sxdp, sizeof(sxdp)) < 0)
+    {
+        perror("xdpInit(): bind(AF_XDP)");
+        xdpClose();
+        return -1;
+    }
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(uint32_t);
+    attr.max_entries = queue + 1;
+
+    if ((xdpMapFd = xdpBpf(BPF_MAP_CREATE, &attr)) < 0)
+    {
+        perror("xdpInit(): bpf(BPF_MAP_CREATE)");
+        xdpClose();
+        return -1;
+    }
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = xdpMapFd;
+    attr.key = (uint64_t)(uintptr_t)&queue;
+    attr.value = (uint64_t)(uintptr_t)&xdpSd;
+
+    if (xdpBpf(BPF_MAP_UPDATE_ELEM, &attr) < 0)
+    {
+        perror("xdpInit(): bpf(BPF_MAP_UPDATE_ELEM)");
+        xdpClose();
+        return -1;
+    }
+
+    if (xdpLoadProgram(ifindex) < 0)
+    {
+        xdpClose();
+        return -1;
+    }
+
+    xdpUdpSd = local->sd;
+
+    return 0;
+}
+
+int xdpActive(int sd)
+{
+    return xdpSd >= 0 && sd == xdpUdpSd;
+}
+
+/**
+ * @brief IPv4 header checksum
+ *
+ */
+uint16_t xdpChecksum(const uint8_t *bytes, uint32_t n)
+{
+    uint32_t sum = 0;
+
+    for (uint32_t i = 0; i < n; i += 2)
+        sum += (uint32_t)bytes[i] << 8 | bytes[i + 1];
+
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+
+    return htons((uint16_t)~sum);
+}
+
+int xdpSend(const UdpSocket_t *remote, const CrudpBuffer_t *buffer)
+{
+    uint32_t size = buffer->n + buffer->payloadLen;
+    uint32_t prod = *xdpTx.producer;
+    uint8_t *frame, *ip, *udp;
+    struct xdp_desc *desc;
+
+    if (XDP_HLEN + size > XDP_FRAME_SIZE)
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    if (xdpFrees == 0)
+        xdpReclaim();
+
+    // every frame is in flight or the ring is full
+    if (xdpFrees == 0 || prod - __atomic_load_n(xdpTx.consumer, __ATOMIC_ACQUIRE) == XDP_RING_SIZE)
+    {
+        (void)sendto(xdpSd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+        errno = EAGAIN;
+        return -1;
+    }
+
+    desc = &((struct xdp_desc *)xdpTx.entries)[prod & xdpTx.mask];
+    desc->addr = xdpFree[--xdpFrees];
+    desc->len = XDP_HLEN + size;
+    desc->options = 0;
+
+    frame = xdpUmem + desc->addr;
+    ip = frame + XDP_ETH_HLEN;
+    udp = ip + XDP_IP_HLEN;
+
+    memcpy(frame, xdpPeerMac, 6);
+    memcpy(frame + 6, xdpLocalMac, 6);
+    frame[12] = 0x08;
+    frame[13] = 0x00;
+
+    ip[0] = 0x45;
+    ip[1] = 0;
+    *(uint16_t *)(ip + 2) = htons((uint16_t)(XDP_IP_HLEN + XDP_UDP_HLEN + size));
+    *(uint16_t *)(ip + 4) = htons(xdpIpId++);
+    *(uint16_t *)(ip + 6) = htons(0x4000); // don't fragment
+    ip[8] = 64;
+    ip[9] = IPPROTO_UDP;
+    *(uint16_t *)(ip + 10) = 0;
+    memcpy(ip + 12, &xdpLocalIp, 4);
+    memcpy(ip + 16, &remote->addr.sin_addr, 4);
+    *(uint16_t *)(ip + 10) = xdpChecksum(ip, XDP_IP_HLEN);
+
+    // a zero UDP checksum is valid over IPv4
+    *(uint16_t *)(udp + 0) = xdpPort;
+    *(uint16_t *)(udp + 2) = remote->addr.sin_port;
+    *(uint16_t *)(udp + 4) = htons((uint16_t)(XDP_UDP_HLEN + size));
+    *(uint16_t *)(udp + 6) = 0;
+
+    // the one copy, from the packet and the mapped file into the frame
+    memcpy(udp + XDP_UDP_HLEN, buffer->bytes, buffer->n);
+    if (buffer->payloadLen)
+        memcpy(udp + XDP_UDP_HLEN + buffer->n, buffer->payload, buffer->payloadLen);
+
+    __atomic_store_n(xdpTx.producer, prod + 1, __ATOMIC_RELEASE);
+
+    // copy mode sends on the kick
+    if (sendto(xdpSd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 &&
+        errno != EAGAIN && errno != EBUSY && errno != ENOBUFS)
+    {
+        perror("xdpSend(): sendto()");
+        return -1;
+    }
+
+    xdpReclaim();
+
+    return size;
+}
+
+int xdpRecv(UdpSocket_t *remote, const CrudpBuffer_t *buffer)
+{
+    uint32_t cons = *xdpRx.consumer;
+    int r = -1;
+
+    while (r < 0 && cons != __atomic_load_n(xdpRx.producer, __ATOMIC_ACQUIRE))
+    {
+        const struct xdp_desc *desc = &((struct xdp_desc *)xdpRx.entries)[cons++ & xdpRx.mask];
+        const uint8_t *frame = xdpUmem + desc->addr;
+        const uint8_t *ip = frame + XDP_ETH_HLEN;
+        const uint8_t *udp = ip + XDP_IP_HLEN;
+        uint32_t udpLen = ntohs(*(const uint16_t *)(udp + 4));
+
+        // the program checked the headers, the length is still the sender's word
+        if (udpLen >= XDP_UDP_HLEN && XDP_HLEN + udpLen - XDP_UDP_HLEN <= desc->len)
+        {
+            r = udpLen - XDP_UDP_HLEN < buffer->n ? udpLen - XDP_UDP_HLEN : buffer->n;
+            memcpy(buffer->bytes, udp + XDP_UDP_HLEN, r);
+
+            remote->addr.sin_family = AF_INET;
+            memcpy(&remote->addr.sin_addr, ip + 12, 4);
+            remote->addr.sin_port = *(const uint16_t *)udp;
+
+            // the peer answers from where it sent
+            if (remote->addr.sin_addr.s_addr == xdpPeerIp.s_addr)
+            {
+                memcpy(xdpPeerMac, frame + 6, 6);
+                xdpPeerKnown = 1;
+            }
+        }
+
+        // the frame goes back to the kernel right away
+        uint64_t addr = desc->addr;
+        xdpFillFrames(&addr, 1);
+    }
+
+    __atomic_store_n(xdpRx.consumer, cons, __ATOMIC_RELEASE);
+
+    if (r < 0)
+        errno = EWOULDBLOCK;
+
+    return r;
+}
+
+void xdpClose()
+{
+    if (xdpLinkFd >= 0)
+        close(xdpLinkFd);
+    if (xdpProgFd >= 0)
+        close(xdpProgFd);
+    if (xdpMapFd >= 0)
+        close(xdpMapFd);
+
+    xdpUnmapRing(&xdpFill);
+    xdpUnmapRing(&xdpComp);
+    xdpUnmapRing(&xdpRx);
+    xdpUnmapRing(&xdpTx);
+
+    if (xdpSd >= 0)
+        close(xdpSd);
+    if (xdpUmem != NULL)
+        munmap(xdpUmem, (size_t)XDP_FRAMES * XDP_FRAME_SIZE);
+
+    xdpLinkFd = xdpProgFd = xdpMapFd = xdpSd = xdpUdpSd = -1;
+    xdpUmem = NULL;
+    xdpFrees = 0;
+}
@@ -0,0 +1,58 @@
+#ifndef __CrudpXdp_h__
+#define __CrudpXdp_h__
+
+#include <inttypes.h>
+
+#include "CrudpSocket.h"
+
+#define XDP_FRAME_SIZE ((uint32_t)2048)
+#define XDP_FRAMES ((uint32_t)4096) // half for receive, half for send
+#define XDP_RING_SIZE ((uint32_t)2048)
+
+/**
+ * @brief Open the AF_XDP backend on one queue of an interface
+ *        A small XDP program (generic/SKB mode, so veth works) hands the
+ *        UDP datagrams for 'port' to the AF_XDP socket, everything else
+ *        (ARP, other ports) goes on to the kernel stack.
+ *        e.g. "veth0" or "eth1:3" for queue 3
+ *
+ * @param spec interface name and optional queue
+ * @param local local end-point, its port is served by the backend
+ * @param remote remote end-point, its MAC address is looked up in the ARP table
+ * @return int 0 on success, -1 on error
+ */
+int xdpInit(const char *spec, const UdpSocket_t *local, const UdpSocket_t *remote);
+
+/**
+ * @brief Is the AF_XDP backend serving this socket?
+ *
+ * @param sd UDP socket of the local end-point
+ * @return int 1 if it is
+ */
+int xdpActive(int sd);
+
+/**
+ * @brief Build Ethernet, IPv4 and UDP headers in a UMEM frame and send it
+ *
+ * @param remote Receiver socket
+ * @param buffer to send
+ * @return int size of the UDP payload sent, -1 with errno EAGAIN if no frame is free
+ */
+int xdpSend(const UdpSocket_t *remote, const CrudpBuffer_t *buffer);
+
+/**
+ * @brief Take the next datagram for our port from the receive ring
+ *
+ * @param remote filled with the address of the sender
+ * @param buffer the UDP payload is copied into it
+ * @return int size of the UDP payload, -1 with errno EWOULDBLOCK if none
+ */
+int xdpRecv(UdpSocket_t *remote, const CrudpBuffer_t *buffer);
+
+/**
+ * @brief Detach the XDP program and release the rings
+ *
+ */
+void xdpClose();
+
+#endif
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+
+#include <errno.h>
+void perror(const char *s);
+
+#include "CrudpZerocopy.h"
+#include "CrudpStats.h"
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
+#define ZEROCOPY_DRAIN_MS ((int)1000)
+
+int zerocopySd = -1;
+uint32_t zerocopyThreshold = 0;
+
+// the kernel numbers zerocopy sends from 0, completions come as ranges
+CrudpPacket_t *zerocopyHeld[ZEROCOPY_PENDING];
+uint32_t zerocopyNext = 0; // id of the next send
+uint32_t zerocopyDone = 0; // every send before this id is completed
+
+int zerocopyInit(int sd, uint32_t threshold)
+{
+    int one = 1;
+
+    if (setsockopt(sd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0)
+    {
+        perror("zerocopyInit(): setsockopt(SO_ZEROCOPY)");
+        return -1;
+    }
+
+    zerocopySd = sd;
+    zerocopyThreshold = threshold;
+    zerocopyNext = zerocopyDone = 0;
+
+    return 0;
+}
+
+int zerocopyWanted(int sd, const CrudpPacket_t *packet, uint32_t n)
+{
+    return sd == zerocopySd && packet != NULL && n >= zerocopyThreshold &&
+           zerocopyNext - zerocopyDone < ZEROCOPY_PENDING;
+}
+
+void zerocopyTrack(CrudpPacket_t *packet)
+{
+    zerocopyHeld[zerocopyNext++ % ZEROCOPY_PENDING] = packetRef(packet);
+    G_stats.zerocopySent++;
+}
+
+/**
+ * @brief Put the packets of the sends [lo, hi]
+ *
+ */
+void zerocopyRelease(uint32_t lo, uint32_t hi)
+{
+    for (uint32_t id = lo; id != hi + 1; id++)
+    {
+        CrudpPacket_t **held = &zerocopyHeld[id % ZEROCOPY_PENDING];
+
+        packetPut(*held);
+        *held = NULL;
+    }
+
+    // completions may come out of order, move on over the released ones
+    while (zerocopyDone != zerocopyNext && zerocopyHeld[zerocopyDone % ZEROCOPY_PENDING] == NULL)
+        zerocopyDone++;
+}
+
+int zerocopyPoll()
+{
+    int completed = 0;
+
+    if (zerocopySd < 0 || zerocopyDone == zerocopyNext)
+        return 0;
+
+    for (;;)
+    {
+        char control[128];
+        struct msghdr msg;
+        struct cmsghdr *cmsg;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(zerocopySd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                perror("zerocopyPoll(): recvmsg()");
+            break;
+        }
+
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            struct sock_extended_err *err = (struct sock_extended_err *)CMSG_DATA(cmsg);
+
+            if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                continue;
+
+            // the kernel had to copy after all, e.g. on loopback
+            if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                G_stats.zerocopyCopied += err->ee_data - err->ee_info + 1;
+
+            zerocopyRelease(err->ee_info, err->ee_data);
+            completed += err->ee_data - err->ee_info + 1;
+        }
+    }
+
+    return completed;
+}
+
+void zerocopyDrain()
+{
+    struct pollfd fd;
+
+    if (zerocopySd < 0)
+        return;
+
+    fd.fd = zerocopySd;
+    fd.events = 0; // POLLERR is always reported
+
+    while (zerocopyDone != zerocopyNext)
+    {
+        if (poll(&fd, 1, ZEROCOPY_DRAIN_MS) <= 0)
+        {
+            fprintf(stderr, "zerocopyDrain(): %u sends not completed\n", zerocopyNext - zerocopyDone);
+            break;
+        }
+        zerocopyPoll();
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef __CrudpZerocopy_h__
+#define __CrudpZerocopy_h__
+
+#include <inttypes.h>
+
+#include "CrudpPool.h"
+
+#define ZEROCOPY_PENDING ((uint32_t)1024) // sends waiting for their completion
+
+/**
+ * @brief Enable MSG_ZEROCOPY on a socket
+ *        The kernel keeps the pages of a zerocopy send until it reports
+ *        the completion on the error queue, so every send holds a
+ *        reference to its packet until then.
+ *
+ * @param sd socket
+ * @param threshold datagrams of at least this many bytes are sent with MSG_ZEROCOPY
+ * @return int 0 if enabled, -1 if the kernel does not support it
+ */
+int zerocopyInit(int sd, uint32_t threshold);
+
+/**
+ * @brief Should a datagram be sent with MSG_ZEROCOPY?
+ *
+ * @param sd socket
+ * @param packet packet holding the datagram, NULL if its lifetime is unknown
+ * @param n datagram size
+ * @return int 1 to use MSG_ZEROCOPY
+ */
+int zerocopyWanted(int sd, const CrudpPacket_t *packet, uint32_t n);
+
+/**
+ * @brief Hold the packet of a zerocopy send until its completion
+ *        call it after every successful sendmsg() with MSG_ZEROCOPY
+ *
+ * @param packet packet sent
+ */
+void zerocopyTrack(CrudpPacket_t *packet);
+
+/**
+ * @brief Read the completions from the error queue and put their packets
+ *        call it from the main loop
+ *
+ * @return int number of completed sends
+ */
+int zerocopyPoll();
+
+/**
+ * @brief Wait until the kernel released every page sent
+ *        call it before the file or the pool goes away
+ */
+void zerocopyDrain();
+
+#endif